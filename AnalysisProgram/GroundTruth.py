@@ -10,6 +10,7 @@ Last Update Time:
 import os
 import matplotlib.pyplot as plt
 from TimeWindows import *
+from pqnative import TimeWindowIndex
 import random
 import csv
 import time
@@ -440,13 +441,17 @@ class GroundTruth_stale:
         return dict(list(ret.items())[0: K])
 
 
-def Comparison(path, alpha, k, T, TW0_TB, TW0_z, sample_threshold=[1000, 2000, 5000, 10000, 15000, 20000], packet_sample_number=20):
+def Comparison(path, alpha, k, T, TW0_TB, TW0_z, sample_threshold=[1000, 2000, 5000, 10000, 15000, 20000], packet_sample_number=20, native=False):
     """
     Compare TW with related works: Count-Min Sketch, HashPipe, FlowRadar
     :param path: the path to the parent folder of RAW and INT data
+    :param native: query TW through the native index (pqnative.py), same results
     outputs comparison result to a csv file
     """
-    tw = TimeWindowController(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
+    if native:
+        tw = TimeWindowIndex(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
+    else:
+        tw = TimeWindowController(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
     gt = GroundTruth(path)
     print('-----------------------------------------------------------------------------------')
     print('---------------    Compare Time Windows with Related Works   ----------------------')
@@ -570,11 +575,14 @@ def DataPlaneQuery(path, alpha, k, T, TW0_TB, TW0_z):
             resultWriter.writerow([PQ_p, PQ_r])
     csv_file.close()
 
-def timer(path, alpha, k, T, TW0_TB, TW0_z, packet_sample_number=20):
+def timer(path, alpha, k, T, TW0_TB, TW0_z, packet_sample_number=20, native=False):
     '''
     Count the execution time of query
     '''
-    tw = TimeWindowController(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
+    if native:
+        tw = TimeWindowIndex(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
+    else:
+        tw = TimeWindowController(path=path, alpha=alpha, k=k, T=T, TW0_TB=TW0_TB, TW0_z=TW0_z)
     gt = GroundTruth(path)
     stairs = [1000, 2000, 5000, 10000, 15000, 20000]
     pkts = gt.packet_experiencing_high_delay2(stairs)
@@ -48,8 +48,9 @@ class QueueMonitor:
         """
         read and load register values
         Raw data are loaded in the ascending order of time, i.e., from the old one to the lastest
-        :return: [{'ts': A_B_C, 'qm': [{'FID': hex_string, 'seq': integer, 'wrap': integer}]}]
+        :return: [{'ts': A_B_C, 'qm': [{'FID': hex_string, 'seq': integer, 'wrap': integer}], 'interval': integer}]
         A_B is the file written time, C indicates whether seq num overflow, qm is the stack
+        interval is the reading interval (us) chosen after the snapshot, None if it is not logged
         The elements of qm correspond to slots in the stack
         wrap is the overflow times of the seq number
         """
@@ -69,16 +70,22 @@ class QueueMonitor:
         ts = sorted(ts, key=lambda x: (x[0], x[1]))
         ts = [[str(t[0]), str(t[1]), str(t[2])] for t in ts]
         files = [os.path.join(root, '_'.join(t) + '.bin') for t in ts]
+        intervals = self.load_intervals(path)
         ret = [] #
         wrap = 0
         for (i, f) in enumerate(files):
             print("Loading QM file: {0}".format(f))
             if ts[i][2] == '1':
                 wrap += 1
+            # periodical snapshots only hold the live prefix of the stack (3 registers x 4 bytes per slot)
+            # slots beyond the prefix are empty
+            slot_num = min(os.path.getsize(f) // 12, self.max_qdepth)
             with open(f, 'rb') as fptr:
                 current_qm = [] #[{'FID': hex_string, 'seq': integer, 'wrap': integer}]
-                for j in range(self.max_qdepth):
+                for j in range(slot_num):
                     current_qm.append({})
+                for j in range(slot_num, self.max_qdepth):
+                    current_qm.append({'FID': '0000000000000000', 'seq': 0, 'wrap': wrap})
                 order = 0
                 num = 0
                 chunk = fptr.read(4)
@@ -91,17 +98,38 @@ class QueueMonitor:
                         current_qm[num]['seq'] = seq
                         current_qm[num]['wrap'] = wrap
                     num += 1
-                    if num == self.max_qdepth:
+                    if num == slot_num:
                         num = 0
                         order += 1
+                        if order == 3:
+                            break
                     chunk = fptr.read(4)
-            ret.append({'qm': current_qm, 'ts': ts[i]})
+            ret.append({'qm': current_qm, 'ts': ts[i], 'interval': intervals.get((ts[i][0], ts[i][1]))})
+        return ret
+
+    def load_intervals(self, path):
+        """
+        load the adaptive reading intervals logged by the control plane
+        qm_meta.csv is in the parent folder of the QM data folder, line format: ts_sec ts_usec interval_us entries stack_top
+        :return: {(ts_sec, ts_usec): interval_us}, empty if the intervals are fixed
+        """
+        ret = {}
+        meta = os.path.join(os.path.dirname(os.path.normpath(path)), 'qm_meta.csv')
+        if not os.path.exists(meta):
+            return ret
+        with open(meta, 'r') as fptr:
+            fptr.readline()     # skip the header
+            for line in fptr:
+                fields = line.split()
+                if len(fields) < 3:
+                    continue
+                ret[(fields[0], fields[1])] = int(fields[2])
         return ret
 
     def filter_QM(self):
         """
         filter stale register values from QM data
-        :return: [{'ts': A_B_C, 'qdepth': integer, 'QM_result': [{'index': integer, 'FID': hex_string}]}]
+        :return: [{'ts': A_B_C, 'qdepth': integer, 'QM_result': [{'index': integer, 'FID': hex_string}], 'interval': integer}]
         """
         ret = []
         if not self.QM_registers:
@@ -117,9 +145,9 @@ class QueueMonitor:
                 first_ret.append({'index': i, 'FID': slot['FID'], 'seq': slot['seq'] + (slot['wrap'] << 32)})
                 current_seq = slot['seq'] + (slot['wrap'] << 32)
         if not first_ret:
-            ret.append({'ts': self.QM_registers[0]['ts'], 'qdepth': 0, 'QM_result': []})
+            ret.append({'ts': self.QM_registers[0]['ts'], 'qdepth': 0, 'QM_result': [], 'interval': self.QM_registers[0]['interval']})
         else:
-            ret.append({'ts': self.QM_registers[0]['ts'], 'qdepth': first_ret[-1]['index'], 'QM_result': first_ret})
+            ret.append({'ts': self.QM_registers[0]['ts'], 'qdepth': first_ret[-1]['index'], 'QM_result': first_ret, 'interval': self.QM_registers[0]['interval']})
         # get the current QM from the previous QM
         for i in range(1, len(self.QM_registers)):
             current_QM = self.QM_registers[i]['qm']
@@ -134,7 +162,7 @@ class QueueMonitor:
                     all_empty = False
                     break
             if all_empty:
-                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': 0, 'QM_result': []})
+                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': 0, 'QM_result': [], 'interval': self.QM_registers[i]['interval']})
                 continue
             # check whether there is an later packet in the previous stack
             for item in prev_ret:
@@ -156,9 +184,9 @@ class QueueMonitor:
                     current_seq = current_QM[z]['seq'] + (current_QM[z]['wrap'] << 32)
                     current_ret.append({'index': z, 'FID': current_QM[z]['FID'], 'seq': current_seq})
             if not current_ret:
-                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': 0, 'QM_result': []})
+                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': 0, 'QM_result': [], 'interval': self.QM_registers[i]['interval']})
             else:
-                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': current_ret[-1]['index'], 'QM_result': current_ret})
+                ret.append({'ts': self.QM_registers[i]['ts'], 'qdepth': current_ret[-1]['index'], 'QM_result': current_ret, 'interval': self.QM_registers[i]['interval']})
         return ret
 
 
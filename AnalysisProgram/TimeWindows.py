@@ -75,6 +75,8 @@ class TimeWindowController:
         read signal packets from raw data
         :return: [{'type': int, 'enqueue_ts': int, 'dequeue_ts': int}]
         """
+        # signals of the current control plane carry their timestamps unwrapped with the switch clock
+        # (PrintQueue_Tofino/src/ctrl/clock.h) after the 12 bytes: no cell has to be searched for the wraps
         # Raw binary files are named in the format A_B.bin,
         # where A is the time value of the seconds, B is the time value of the microseconds when the file is written
         # first sort the files according to the written time
@@ -83,15 +85,27 @@ class TimeWindowController:
             for (i, f) in enumerate(fs):
                 print("Loading SIGNAL file: {0}".format(f))
                 tw_idx = 0
+                named = False
                 file_name = f.split('.')[0].split('_')
                 for (i, tws) in enumerate(self.TW_registers):
                     if tws['ts'] == file_name:
                         tw_idx = i
+                        named = True
                         break
                 CLOSE_THRESHOLD = 5
                 with open(os.path.join(root, f), 'rb') as fptr:
-                    chunk = fptr.read(12)
-                    if chunk:
+                    chunk = fptr.read(12 + SIGNAL_CLOCK.size)
+                    if len(chunk) == 12 + SIGNAL_CLOCK.size and self.TW_registers:
+                        type = int.from_bytes(chunk[0:4], 'little')
+                        host_ns, enqueue_ts, dequeue_ts = SIGNAL_CLOCK.unpack_from(chunk, 12)[0:3]
+                        if named:
+                            # whole overflows onto the latest cell of the set read with the signal
+                            shift = ((self.TW_registers[tw_idx]['lts'] - dequeue_ts + 2**31) >> 32) * (2**32)
+                            enqueue_ts += shift
+                            dequeue_ts += shift
+                        ret.append({'type': type, 'enqueue_ts': enqueue_ts, 'dequeue_ts': dequeue_ts})
+                    elif len(chunk) >= 12:
+                        chunk = chunk[0:12]
                         # storage format: [type | enqueue_ts | dequeue_ts ][type | enqueue_ts | dequeue_ts ]
                         type = int.from_bytes(chunk[0:4], 'little')
                         enqueue_ts = int.from_bytes(chunk[4:8], 'little')
@@ -186,18 +200,30 @@ class TimeWindowController:
         root = None
         for (root, dirs, fs) in os.walk(path):
             for f in fs:
-                ts.append(f.split('.')[0].split('_'))
+                ts.append(f.split('.')[0].split('_') + [f.split('.')[-1]])
         if not ts:
             print("Error! Path does not exist!")
             return
-        ts = [[int(t[0]), int(t[1])] for t in ts]
+        ts = [[int(t[0]), int(t[1]), t[2]] for t in ts]
         ts = sorted(ts, key=lambda x: (x[0], x[1]))
+        exts = [t[2] for t in ts]
         ts = [[str(t[0]), str(t[1])] for t in ts]
-        file_names = ['_'.join(t) + '.bin' for t in ts]
-        files = [os.path.join(root, '_'.join(t) + '.bin') for t in ts]
+        file_names = ['_'.join(t) + '.' + e for (t, e) in zip(ts, exts)]
+        files = [os.path.join(root, name) for name in file_names]
         # read register value
         ret = []
         for (i, f) in enumerate(files):
+            if os.path.getsize(f) == 0:
+                # empty file: the port is idle in the period and the control plane skips the reading
+                print("Skipping idle TW file: {0}".format(f))
+                continue
+            if exts[i] == 'cells':
+                # already filtered by the control plane (--tw-format=cells)
+                print("Loading TW cells file: {0}".format(f))
+                tw = load_tw_cells(f)
+                tw['ts'] = ts[i]
+                ret.append(tw)
+                continue
             print("Loading TW file: {0}".format(f))
             with open(f, 'rb') as fptr:
                 current_tw = []
@@ -244,7 +270,7 @@ class TimeWindowController:
         file_name = 'TW_{0}_{1}_{2}.json'.format(self.alpha, self.k, self.T)
         file_path = os.path.join(save_file_path, file_name)
         for i in range(len(self.TW_registers)):
-            del self.TW_registers[i]['tw']
+            self.TW_registers[i].pop('tw', None)
         self.config['TW_registers'] = self.TW_registers
         with open(file_path, 'w') as f:
             json.dump(self.config, f, indent=4)
@@ -271,6 +297,9 @@ class TimeWindowController:
         wrapping = 0
         pre_largest_tts = 0
         for (tw_idx, tw) in enumerate(self.TW_registers):
+            if 'tw' not in tw:
+                # set filtered by the control plane, see load_tw_cells
+                continue
             # Wrapping is to tackle situation where dequeue timestamp overflows.
             # In the unit of nanoseconds, 32 bits overflows approximately every 4 seconds
             # if a tts suddenly becomes large/small (near 2^32 or 0), there must be an overflow
@@ -480,6 +509,46 @@ class TimeWindowController:
         plt.close()
 
 num_pipes = 2
+TW_CELLS_MAGIC = 0x43545150  # "PQTC"
+TW_CELLS_HEADER = struct.Struct('<IHHBBBBIqqqiB3x16I')
+TW_CELLS_CELL = struct.Struct('<III')
+# after [type | enqueue_ts | dequeue_ts] of a signal file (clock.h): host_ns, enqueue_ns, dequeue_ns, and the
+# fit of the switch clock: host_ns, switch_ns, rate, samples
+SIGNAL_CLOCK = struct.Struct('<qqqqqdI4x')
+
+
+def load_tw_cells(file_path):
+    """
+    load a set of TWs filtered by the control plane (PrintQueue_Tofino/src/ctrl/tw_cells.h)
+    :return: {'TW_result': [cell_representation], 'largest_cell': cell representation,
+              'smallest_cell': cell representation, 'sts': integer, 'lts': integer}, as filter_TW
+    cell_representation = {'tts': integer, 'FID': hex_string, 'wrap': integer, 'twid': integer}
+    """
+    with open(file_path, 'rb') as fptr:
+        data = fptr.read()
+    fields = TW_CELLS_HEADER.unpack_from(data, 0)
+    magic, version, header_size, k, T, alpha, tb0, cell_num, base, sts, lts, wrap, smallest_twid = fields[0:13]
+    window_cells = fields[13:13 + T]
+    if magic != TW_CELLS_MAGIC:
+        raise ValueError('{0} is not a TW cells file'.format(file_path))
+
+    def cell(ts, twid):
+        # ts = (tts << TB) + 2^(TB - 1) + wrap * 2^32
+        tb = tb0 + twid * alpha
+        return {'tts': (ts & 0xffffffff) >> tb, 'twid': twid, 'wrap': ts >> 32}
+
+    TW_result = []
+    offset = header_size
+    for (twid, num) in enumerate(window_cells):
+        for (ts_offset, src, dst) in TW_CELLS_CELL.iter_unpack(data[offset: offset + num * TW_CELLS_CELL.size]):
+            temp = cell(base + ts_offset, twid)
+            temp['FID'] = '{0:08x}{1:08x}'.format(src, dst)
+            TW_result.append(temp)
+        offset += num * TW_CELLS_CELL.size
+    return {'TW_result': TW_result, 'largest_cell': cell(lts, 0), 'smallest_cell': cell(sts, smallest_twid),
+            'sts': sts, 'lts': lts}
+
+
 class TimeWindowController_stale:
     def __init__(self, path, alpha = 1, k = 12, T = 5, TW0_TB = 6, TW0_z = 64/110, save_file_path = None):
         self.alpha = alpha
@@ -0,0 +1,145 @@
+/*************************************************************************
+	> File Name: baseline.cpp
+  > Description: Related works of Comparison (GroundTruth.py) on the sets
+  >              of windows answering a culprit query
+*************************************************************************/
+
+#include <algorithm>
+
+#include "baseline.h"
+
+namespace pq {
+
+const BaselineDef baseline_defs[BASELINE_NUM] = {
+    {BASELINE_CM, 3, 1024, "CM 1024x3"},
+    {BASELINE_CM, 5, 4096, "CM 4096x5"},
+    {BASELINE_HP, 3, 1024, "HP 1024x3"},
+    {BASELINE_HP, 5, 4096, "HP 4096x5"},
+    {BASELINE_FR, 3, 1024 * 3, "FR 1024x3"},
+    {BASELINE_FR, 3, 4096 * 5, "FR 4096x5"},
+};
+
+void BaselineWorker::init(const GtData &g, const std::vector<uint16_t> &hashes, uint32_t cache_sets){
+  this->g = &g;
+  this->hashes = &hashes;
+  cache.assign(cache_sets > 0 ? cache_sets : 1, BaselineSet());
+  scratch.assign(g.flows.size(), 0);
+}
+
+//----------------------------------------------------------------------
+// One pass over the packets of the set feeds the HashPipes and counts the
+// flows; Count-Min and FlowRadar take the counts, in their order.
+//----------------------------------------------------------------------
+const BaselineSet &BaselineWorker::get(uint32_t set, int64_t sts, int64_t lts){
+  BaselineSet *e = &cache[0];
+  for (BaselineSet &c : cache){
+    if (c.set == set){
+      c.used = ++clock;
+      hits++;
+      return c;
+    }
+    if (c.used < e->used){
+      e = &c;
+    }
+  }
+  built++;
+  e->set = set;
+  e->used = ++clock;
+  const uint16_t *h = hashes->data();
+  size_t lo = std::lower_bound(g->dts.begin(), g->dts.end(), sts) - g->dts.begin();
+  size_t hi = std::upper_bound(g->dts.begin(), g->dts.end(), lts) - g->dts.begin();
+  for (int b = 0; b < BASELINE_NUM; b++){
+    if (baseline_defs[b].kind == BASELINE_HP){
+      hp[b].init(baseline_defs[b].rows, baseline_defs[b].cols);
+    }
+  }
+  e->gt.clear();
+  for (size_t i = lo; i < hi; i++){
+    uint32_t f = g->flow[i];
+    if (scratch[f]++ == 0){
+      e->gt.push_back(std::make_pair(f, 0));
+    }
+    for (int b = 0; b < BASELINE_NUM; b++){
+      if (baseline_defs[b].kind == BASELINE_HP){
+        hp[b].add(f, h);
+      }
+    }
+  }
+  for (auto &x : e->gt){
+    x.second = scratch[x.first];
+    scratch[x.first] = 0;
+  }
+  sketch_sort(e->gt);
+  for (int b = 0; b < BASELINE_NUM; b++){
+    const BaselineDef &d = baseline_defs[b];
+    switch (d.kind){
+      case BASELINE_CM:
+        e->cm[b].init(d.rows, d.cols);
+        for (auto &x : e->gt){
+          e->cm[b].add(h + (size_t)x.first * SKETCH_HASH_NUM, x.second);
+        }
+        break;
+      case BASELINE_HP:
+        hp[b].result(e->r[b], scratch);
+        break;
+      case BASELINE_FR:
+        fr.init(d.cols);
+        for (auto &x : e->gt){
+          fr.add(g->flows[x.first], h + (size_t)x.first * SKETCH_HASH_NUM, x.second);
+        }
+        fr.decode(g->flow_ids, *hashes, extra, e->r[b]);
+        break;
+    }
+  }
+  return *e;
+}
+
+// result[key] = result.get(key, 0) + int(val * proportion)
+void BaselineWorker::add(int b, const SketchResult &r, double proportion){
+  std::vector<uint32_t> &p = pos[b];
+  for (auto &x : r){
+    if (p.size() <= x.first){
+      p.resize(x.first + 1, 0);
+    }
+    if (p[x.first] == 0){
+      acc[b].push_back(std::make_pair(x.first, 0));
+      p[x.first] = acc[b].size();
+    }
+    acc[b][p[x.first] - 1].second += (int64_t)(x.second * proportion);
+  }
+}
+
+void BaselineWorker::compare(const TwIndex &idx, const TwQuery &q, const GtResult &gt, double *precision, double *recall){
+  const uint16_t *h = hashes->data();
+  for (int b = 0; b < BASELINE_NUM; b++){
+    acc[b].clear();
+  }
+  for (size_t i = 0; i < q.sets.size(); i++){
+    const TwSet &s = idx.sets[q.sets[i]];
+    double proportion = s.lts == s.sts ? 1 : (double)(q.end[i] - q.start[i]) / (s.lts - s.sts);
+    const BaselineSet &e = get(q.sets[i], s.sts, s.lts);
+    for (int b = 0; b < BASELINE_NUM; b++){
+      if (baseline_defs[b].kind != BASELINE_CM){
+        add(b, e.r[b], proportion);
+        continue;
+      }
+      // Count_Min queried with the flows of the ground truth
+      ret.clear();
+      for (auto &x : gt){
+        ret.push_back(std::make_pair(x.first, e.cm[b].query(h + (size_t)x.first * SKETCH_HASH_NUM)));
+      }
+      sketch_sort(ret);
+      add(b, ret, proportion);
+    }
+  }
+  for (int b = 0; b < BASELINE_NUM; b++){
+    tw.clear();
+    for (auto &x : acc[b]){
+      pos[b][x.first] = 0;
+      tw.push_back(std::make_pair(x.first < g->flows.size() ? x.first : UINT32_MAX, x.second));
+    }
+    gt_precision_recall(gt, tw, scratch, precision[b], recall[b]);
+  }
+}
+
+}
@@ -0,0 +1,76 @@
+/*************************************************************************
+	> File Name: baseline.h
+  > Description: Related works of Comparison (GroundTruth.py) on the sets
+  >              of windows answering a culprit query
+*************************************************************************/
+
+#ifndef _PQ_BASELINE_H_
+#define _PQ_BASELINE_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "sketch.h"
+#include "gt_data.h"
+#include "tw_index.h"
+
+namespace pq {
+
+enum BaselineKind {
+  BASELINE_CM,
+  BASELINE_HP,
+  BASELINE_FR,
+};
+
+struct BaselineDef {
+  BaselineKind kind;
+  uint32_t rows, cols;                  // CM rows x cols, HP stages x cells, FR hashes and cells
+  const char *name;
+};
+
+// in the columns of qdepth_level_*_result.csv
+#define BASELINE_NUM 6
+extern const BaselineDef baseline_defs[BASELINE_NUM];
+
+// sketches of the packets dequeued in a set of windows, [sts, lts]
+struct BaselineSet {
+  uint32_t set = UINT32_MAX;
+  uint64_t used = 0;
+  GtResult gt;                          // GroundTruth.retrieve(sts, lts)
+  CountMin cm[BASELINE_NUM];            // per CM baseline
+  SketchResult r[BASELINE_NUM];         // per HP / FR baseline
+};
+
+//----------------------------------------------------------------------
+// The sketches are filled from the ground truth of a whole set and cut
+// to the query by the share of the set it covers, as Comparison. They
+// only depend on the set: the last sets built are kept (cache of them)
+// for the following queries. One worker per thread; hashes is the table
+// of sketch_hash_batch over g.flows.
+//----------------------------------------------------------------------
+struct BaselineWorker {
+  const GtData *g = nullptr;
+  const std::vector<uint16_t> *hashes = nullptr;
+  std::vector<BaselineSet> cache;
+  uint64_t clock = 0, built = 0, hits = 0;
+  HashPipe hp[BASELINE_NUM];
+  FlowRadar fr;
+  std::unordered_map<uint64_t, uint32_t> extra;       // flows of FR collisions
+  std::vector<int64_t> scratch;
+  std::vector<uint32_t> pos[BASELINE_NUM];
+  SketchResult ret, acc[BASELINE_NUM];
+  GtResult tw;
+
+  void init(const GtData &g, const std::vector<uint16_t> &hashes, uint32_t cache_sets = 16);
+  // precision / recall of the baselines for a victim packet, gt its
+  // ground truth and q the time windows answer of its interval
+  void compare(const TwIndex &idx, const TwQuery &q, const GtResult &gt, double *precision, double *recall);
+
+ private:
+  const BaselineSet &get(uint32_t set, int64_t sts, int64_t lts);
+  void add(int b, const SketchResult &r, double proportion);
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*************************************************************************
+	> File Name: eval.cpp
+  > Description: Accuracy of culprit queries of victim packets against
+  >              the ground truth (Comparison, DataPlaneQuery)
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <tuple>
+
+#include "eval.h"
+#include "clock.h"
+#include "parallel.h"
+
+namespace pq {
+
+void Evaluator::init(const TwIndex &idx, const GtData &g, uint32_t threads, uint32_t cache_sets){
+  this->idx = &idx;
+  this->g = &g;
+  this->threads = thread_num(threads);
+  gi.build(g);
+  tw2gt.resize(idx.flow_num);
+  for (uint32_t f = 0; f < idx.flow_num; f++){
+    auto it = g.flow_ids.find(idx.flows[f]);
+    tw2gt[f] = it == g.flow_ids.end() ? UINT32_MAX : it->second;
+  }
+  hashes.resize(g.flows.size() * SKETCH_HASH_NUM);
+  sketch_hash_batch(g.flows.data(), g.flows.size(), hashes.data());
+  workers.assign(this->threads, EvalWorker());
+  for (EvalWorker &w : workers){
+    w.scratch.assign(g.flows.size(), 0);
+    w.base.init(g, hashes, cache_sets);
+  }
+}
+
+void Evaluator::run(const EvalVictim *v, size_t n, EvalRow *rows, bool baselines){
+  const size_t run_len = 16;
+  parallel_for((n + run_len - 1) / run_len, threads, [&](size_t r, uint32_t t){
+    EvalWorker &w = workers[t];
+    for (size_t i = r * run_len; i < n && i < (r + 1) * run_len; i++){
+      EvalRow &row = rows[i];
+      row.answered = false;
+      if (tw_retrieve(*idx, v[i].ets, v[i].dts, w.q) <= 0){
+        continue;
+      }
+      gt_index_retrieve(gi, v[i].ets, v[i].dts, w.gt, w.scratch);
+      w.tw.clear();
+      for (uint32_t f : w.q.order){
+        w.tw.push_back(std::make_pair(tw2gt[f], w.q.est[f]));
+      }
+      gt_precision_recall(w.gt, w.tw, w.scratch, row.precision[0], row.recall[0]);
+      if (row.precision[0] == 0 && row.recall[0] == 0){
+        continue;
+      }
+      row.answered = true;
+      if (baselines){
+        w.base.compare(*idx, w.q, w.gt, row.precision + 1, row.recall + 1);
+      }
+    }
+  });
+}
+
+void Evaluator::sketch_stats(uint64_t &built, uint64_t &hits) const {
+  built = hits = 0;
+  for (const EvalWorker &w : workers){
+    built += w.base.built;
+    hits += w.base.hits;
+  }
+}
+
+// cell of set s close to the dequeue ts, the first in the order of
+// filter_TW: its number of overflows (-1 for the cycle before the first)
+static bool signal_wrap(const TwIndex &idx, uint32_t s, uint32_t dequeue_ts, int64_t &wrap){
+  const int64_t close_threshold = 5;
+  const TwSet &set = idx.sets[s];
+  uint32_t best = UINT32_MAX;
+  for (uint32_t c = set.off; c < set.off + set.num; c++){
+    int tb = idx.p.tb0 + idx.p.alpha * idx.cell_twid[c];
+    // back from the middle of the cell to tts and wrap (tw_cell_ts)
+    int64_t t = idx.cell_ts[c] - (1LL << (tb - 1));
+    int64_t tts = (t & 0xFFFFFFFFLL) >> tb, d = ((int64_t)dequeue_ts >> tb) - tts;
+    if (d < close_threshold && d > -close_threshold && idx.cell_seq[c] < best){
+      best = idx.cell_seq[c];
+      wrap = t >> 32;                   // floor
+    }
+  }
+  return best != UINT32_MAX;
+}
+
+int eval_load_signals(const TwIndex &idx, const char *dir, std::vector<EvalVictim> &v){
+  std::vector<std::tuple<uint32_t, uint32_t, std::string>> files;
+  DIR *dp = opendir(dir);
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", dir);
+    return -1;
+  }
+  struct dirent *e;
+  while ((e = readdir(dp)) != NULL){
+    unsigned long sec, usec;
+    char end[8];
+    if (sscanf(e->d_name, "%lu_%lu%7s", &sec, &usec, end) == 3 && strcmp(end, ".bin") == 0){
+      files.push_back(std::make_tuple(sec, usec, std::string(dir) + "/" + e->d_name));
+    }
+  }
+  closedir(dp);
+  std::sort(files.begin(), files.end());
+
+  v.clear();
+  for (auto &f : files){
+    if (idx.set_num == 0){
+      break;
+    }
+    FILE *fp = fopen(std::get<2>(f).c_str(), "rb");
+    if (fp == NULL){
+      printf("Error opening %s!\n", std::get<2>(f).c_str());
+      return -1;
+    }
+    uint8_t b[12 + sizeof(pq_clock_signal_t)];
+    size_t n = fread(b, 1, sizeof(b), fp);
+    fclose(fp);
+    if (n < 12){
+      continue;
+    }
+    uint32_t enqueue_ts = b[4] | b[5] << 8 | b[6] << 16 | (uint32_t)b[7] << 24;
+    uint32_t dequeue_ts = b[8] | b[9] << 8 | b[10] << 16 | (uint32_t)b[11] << 24;
+    // the set read with the signal, the first one if none
+    uint32_t s = 0;
+    bool named = false;
+    for (uint32_t i = 0; i < idx.set_num; i++){
+      if (idx.sets[i].sec == std::get<0>(f) && idx.sets[i].usec == std::get<1>(f)){
+        s = i;
+        named = true;
+        break;
+      }
+    }
+    EvalVictim x;
+    x.qlen = 0;
+    if (n == sizeof(b)){
+      pq_clock_signal_t c;
+      memcpy(&c, b + 12, sizeof(c));
+      x.dts = c.dequeue_ns;
+      x.ets = c.enqueue_ns;
+      if (named){
+        int64_t shift = ((idx.sets[s].lts - c.dequeue_ns + (1LL << 31)) >> 32) * (1LL << 32);
+        x.dts += shift;
+        x.ets += shift;
+      }
+      v.push_back(x);
+      continue;
+    }
+    int64_t wrap;
+    if (!signal_wrap(idx, s, dequeue_ts, wrap) && (s == 0 || !signal_wrap(idx, s - 1, dequeue_ts, wrap))){
+      continue;
+    }
+    x.dts = dequeue_ts + wrap * (1LL << 32);
+    x.ets = enqueue_ts + (enqueue_ts < dequeue_ts ? wrap : wrap - 1) * (1LL << 32);
+    v.push_back(x);
+  }
+  return 0;
+}
+
+}
@@ -0,0 +1,74 @@
+/*************************************************************************
+	> File Name: eval.h
+  > Description: Accuracy of culprit queries of victim packets against
+  >              the ground truth (Comparison, DataPlaneQuery)
+*************************************************************************/
+
+#ifndef _PQ_EVAL_H_
+#define _PQ_EVAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "tw_index.h"
+#include "gt_index.h"
+#include "baseline.h"
+
+namespace pq {
+
+// a packet whose culprits are queried over [ets, dts]
+struct EvalVictim {
+  int64_t ets, dts;
+  uint32_t qlen;
+};
+
+// time windows, then the baselines
+#define EVAL_METHODS (BASELINE_NUM + 1)
+
+struct EvalRow {
+  bool answered = false;                // answered and not 0 / 0 for TW
+  double precision[EVAL_METHODS], recall[EVAL_METHODS];
+};
+
+struct EvalWorker {
+  TwQuery q;
+  GtResult gt, tw;
+  std::vector<int64_t> scratch;
+  BaselineWorker base;
+};
+
+//----------------------------------------------------------------------
+// Snapshots and ground truth are loaded once; victims are shared out to
+// the threads in runs of consecutive ones, so that a thread meets the
+// same sets of windows again and keeps their sketches.
+//----------------------------------------------------------------------
+struct Evaluator {
+  const TwIndex *idx = nullptr;
+  const GtData *g = nullptr;
+  GtIndex gi;
+  std::vector<uint16_t> hashes;
+  std::vector<uint32_t> tw2gt;          // dense id of the TW -> of the ground truth
+  uint32_t threads = 1;
+  std::vector<EvalWorker> workers;
+
+  void init(const TwIndex &idx, const GtData &g, uint32_t threads, uint32_t cache_sets = 16);
+  // rows[i] of v[i], the baselines of the answered ones if asked
+  void run(const EvalVictim *v, size_t n, EvalRow *rows, bool baselines);
+  // sets sketched and reused by the baselines
+  void sketch_stats(uint64_t &built, uint64_t &hits) const;
+};
+
+//----------------------------------------------------------------------
+// poll_signals of TimeWindowController: the first record of every file
+// of dir (<sec>_<usec>.bin, type, enqueue ts, dequeue ts, 32-bit little
+// endian). Timestamps unwrapped by the control plane (clock.h) are taken
+// as they are, moved by whole overflows onto the latest cell of the set
+// of the same name; older files take the overflows from a cell close to
+// the dequeue ts in that set, else in the set before. Files in time order.
+//----------------------------------------------------------------------
+int eval_load_signals(const TwIndex &idx, const char *dir, std::vector<EvalVictim> &v);
+
+}
+
+#endif
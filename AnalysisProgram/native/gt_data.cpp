@@ -0,0 +1,198 @@
+/*************************************************************************
+	> File Name: gt_data.cpp
+  > Description: Ground truth (INT data of the receiver) of a port and
+  >              culprit queries over it (GroundTruth.py)
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "gt_data.h"
+#include "mapped_file.h"
+
+namespace pq {
+
+static inline uint32_t be32(const uint8_t *b){
+  return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+//----------------------------------------------------------------------
+// The receiver names the files by the TSC when they are written, they
+// are read in that order. As GroundTruth, the first packet of a file only
+// sets the previous timestamps.
+//----------------------------------------------------------------------
+int gt_load(const char *path, GtData &g){
+  const int first_K = 10, last_K = 10;
+  const int64_t wrap = 1LL << 32;
+  std::string dir = std::string(path) + "/gt_data";
+  std::vector<std::pair<uint64_t, std::string>> files;
+  DIR *dp = opendir(dir.c_str());
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", dir.c_str());
+    return -1;
+  }
+  struct dirent *e;
+  while ((e = readdir(dp)) != NULL){
+    char *end;
+    uint64_t tsc = strtoull(e->d_name, &end, 10);
+    if (end != e->d_name && strcmp(end, ".bin") == 0){
+      files.push_back(std::make_pair(tsc, dir + "/" + e->d_name));
+    }
+  }
+  closedir(dp);
+  std::sort(files.begin(), files.end());
+
+  g = GtData();
+  int64_t base_enqueue = 0, base_dequeue = 0, p_dqts = 0, p_eqts = 0;
+  int first = 0;
+  for (auto &f : files){
+    MappedFile m;
+    if (m.map(f.second.c_str()) < 0){
+      return -1;
+    }
+    size_t n = m.size / 20;
+    if (n == 0){
+      continue;
+    }
+    p_dqts = be32(m.data) + base_dequeue;
+    p_eqts = be32(m.data + 4) + base_enqueue;
+    if (p_eqts > p_dqts){
+      base_dequeue += wrap;
+      p_dqts += wrap;
+    }
+    for (size_t i = 1; i < n; i++){
+      const uint8_t *c = m.data + 20 * i;
+      int64_t dqts = be32(c) + base_dequeue, eqts = be32(c + 4) + base_enqueue;
+      if (first < first_K){
+        first++;
+        p_dqts = dqts;
+        p_eqts = eqts;
+        continue;
+      }
+      if (eqts > dqts){
+        base_dequeue += wrap;
+        dqts += wrap;
+      }
+      if (dqts < p_dqts){
+        if (p_dqts - dqts > 4000000000LL){
+          // dequeue timestamp overflow
+          base_dequeue += wrap;
+          dqts += wrap;
+        }else{
+          continue;
+        }
+      }
+      if (eqts < p_eqts){
+        if (p_eqts - eqts > 4000000000LL){
+          base_enqueue += wrap;
+          eqts += wrap;
+        }else{
+          continue;
+        }
+      }
+      uint64_t fid = (uint64_t)be32(c + 12) << 32 | be32(c + 16);
+      auto it = g.flow_ids.emplace(fid, g.flows.size()).first;
+      if (it->second == g.flows.size()){
+        g.flows.push_back(fid);
+      }
+      g.dts.push_back(dqts);
+      g.ets.push_back(eqts);
+      g.qlen.push_back(be32(c + 8));
+      g.flow.push_back(it->second);
+      p_dqts = dqts;
+      p_eqts = eqts;
+    }
+  }
+  if (g.dts.size() <= (size_t)last_K){
+    printf("Error: no packet in %s!\n", dir.c_str());
+    return -1;
+  }
+  size_t n = g.dts.size() - last_K;
+  g.dts.resize(n);
+  g.ets.resize(n);
+  g.qlen.resize(n);
+  g.flow.resize(n);
+  return 0;
+}
+
+void gt_count(const GtData &g, size_t lo, size_t hi, GtResult &r, std::vector<int64_t> &scratch){
+  r.clear();
+  if (scratch.size() < g.flows.size()){
+    scratch.assign(g.flows.size(), 0);
+  }
+  for (size_t i = lo; i < hi; i++){
+    if (scratch[g.flow[i]]++ == 0){
+      r.push_back(std::make_pair(g.flow[i], 0));
+    }
+  }
+  for (auto &x : r){
+    x.second = scratch[x.first];
+    scratch[x.first] = 0;
+  }
+  std::stable_sort(r.begin(), r.end(), [](const std::pair<uint32_t, int64_t> &x, const std::pair<uint32_t, int64_t> &y){
+    return x.second > y.second;
+  });
+}
+
+void gt_retrieve(const GtData &g, int64_t ts, int64_t te, GtResult &r, std::vector<int64_t> &scratch){
+  size_t lo = std::lower_bound(g.dts.begin(), g.dts.end(), ts) - g.dts.begin();
+  size_t hi = std::upper_bound(g.dts.begin(), g.dts.end(), te) - g.dts.begin();
+  gt_count(g, lo, std::max(lo, hi), r, scratch);
+}
+
+void gt_sample(const GtData &g, const std::vector<uint32_t> &thr, uint32_t n, uint64_t seed,
+               std::vector<std::vector<uint32_t>> &level){
+  std::mt19937_64 rng(seed);
+  level.assign(thr.size(), std::vector<uint32_t>());
+  for (size_t i = 0; i < g.qlen.size(); i++){
+    for (size_t j = thr.size(); j-- > 0;){
+      if (g.qlen[i] > thr[j]){
+        if (j + 1 == thr.size() || g.qlen[i] <= thr[j + 1]){
+          level[j].push_back(i);
+        }
+        break;
+      }
+    }
+  }
+  for (auto &l : level){
+    // the first n of a shuffle
+    for (uint32_t i = 0; i < n && i < l.size(); i++){
+      std::swap(l[i], l[i + rng() % (l.size() - i)]);
+    }
+    if (l.size() > n){
+      l.resize(n);
+    }
+  }
+}
+
+void gt_precision_recall(const GtResult &gt, const GtResult &tw, std::vector<int64_t> &scratch, double &precision, double &recall){
+  int64_t precision_total = 0, precision_hit = 0, recall_total = 0;
+  size_t gt_num = gt.empty() ? 0 : gt.size() - 1, tw_num = tw.empty() ? 0 : tw.size() - 1;
+  // counts of the ground truth, +1 to tell a flow of 0 packets from none
+  for (size_t i = 0; i < gt_num; i++){
+    scratch[gt[i].first] = gt[i].second + 1;
+    recall_total += gt[i].second;
+  }
+  for (size_t i = 0; i < tw_num; i++){
+    precision_total += tw[i].second;
+    if (tw[i].first != UINT32_MAX && scratch[tw[i].first] > 0){
+      precision_hit += std::min(tw[i].second, scratch[tw[i].first] - 1);
+    }
+  }
+  for (size_t i = 0; i < gt_num; i++){
+    scratch[gt[i].first] = 0;
+  }
+  if (recall_total == 0 || precision_total == 0){
+    precision = recall = 0;
+    return;
+  }
+  precision = (double)precision_hit / precision_total;
+  recall = (double)precision_hit / recall_total;
+}
+
+}
@@ -0,0 +1,58 @@
+/*************************************************************************
+	> File Name: gt_data.h
+  > Description: Ground truth (INT data of the receiver) of a port and
+  >              culprit queries over it (GroundTruth.py)
+*************************************************************************/
+
+#ifndef _PQ_GT_DATA_H_
+#define _PQ_GT_DATA_H_
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// Packets of gt_data/<rdtsc>.bin, 20 bytes each, big endian:
+// dequeue ts, enqueue ts, enqueue qdepth, src_ip, dst_ip. Loaded as
+// GroundTruth: overflows of the 32-bit timestamps added, out of order
+// packets dropped, the first and last 10 packets left out. Dequeue
+// timestamps are non-decreasing.
+//----------------------------------------------------------------------
+struct GtData {
+  std::vector<int64_t> ets, dts;
+  std::vector<uint32_t> qlen;
+  std::vector<uint32_t> flow;           // dense id
+  std::vector<uint64_t> flows;          // dense id -> src_ip << 32 | dst_ip
+  std::unordered_map<uint64_t, uint32_t> flow_ids;
+};
+
+// path: the parent folder of gt_data
+int gt_load(const char *path, GtData &g);
+
+// flows of a query result in order, with their packet numbers
+typedef std::vector<std::pair<uint32_t, int64_t>> GtResult;
+
+// retrieve of GroundTruth: packets dequeued in [ts, te] per flow (dense
+// id), number descending, equal ones in the order of their first packet
+void gt_retrieve(const GtData &g, int64_t ts, int64_t te, GtResult &r, std::vector<int64_t> &scratch);
+// the same over the packets [lo, hi)
+void gt_count(const GtData &g, size_t lo, size_t hi, GtResult &r, std::vector<int64_t> &scratch);
+
+// packets of packet_experiencing_high_delay2, sampled as Comparison:
+// level j holds the queue depths in (thr[j], thr[j + 1]], the last one
+// those above the largest threshold; n packets (indexes of g) taken per
+// level without replacement, all of them when fewer
+void gt_sample(const GtData &g, const std::vector<uint32_t> &thr, uint32_t n, uint64_t seed,
+               std::vector<std::vector<uint32_t>> &level);
+
+// precision_and_recall_packet_number of TimeWindows.py, the last flow of
+// both results left out. Flows of tw are dense ids of g, UINT32_MAX for
+// flows not in g. scratch: g.flows.size() zeros, left so.
+void gt_precision_recall(const GtResult &gt, const GtResult &tw, std::vector<int64_t> &scratch, double &precision, double &recall);
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*************************************************************************
+	> File Name: gt_index.cpp
+  > Description: Range counts per flow over the ground truth of a port
+*************************************************************************/
+
+#include <algorithm>
+
+#include "gt_index.h"
+#include "parallel.h"
+
+namespace pq {
+
+void GtIndex::build(const GtData &g){
+  this->g = &g;
+  size_t n = g.dts.size();
+  ts.clear();
+  for (size_t i = 0; i < n; i += stride){
+    ts.push_back(g.dts[i]);
+  }
+  // counting sort of the packets by flow, offsets stay ascending
+  flow_off.assign(g.flows.size() + 1, 0);
+  for (uint32_t f : g.flow){
+    flow_off[f + 1]++;
+  }
+  for (size_t f = 0; f < g.flows.size(); f++){
+    flow_off[f + 1] += flow_off[f];
+  }
+  flow_pos.resize(n);
+  std::vector<uint32_t> next(flow_off.begin(), flow_off.end() - 1);
+  for (size_t i = 0; i < n; i++){
+    flow_pos[next[g.flow[i]]++] = i;
+  }
+}
+
+// first packet dequeued at or after t (after t when upper)
+static size_t locate(const GtIndex &x, int64_t t, bool upper){
+  const std::vector<int64_t> &dts = x.g->dts;
+  size_t j = upper ? std::upper_bound(x.ts.begin(), x.ts.end(), t) - x.ts.begin()
+                   : std::lower_bound(x.ts.begin(), x.ts.end(), t) - x.ts.begin();
+  // within the stride before sample j
+  size_t lo = j == 0 ? 0 : (j - 1) * x.stride + 1;
+  size_t hi = std::min(dts.size(), j * x.stride);
+  if (lo >= hi){
+    return hi;
+  }
+  return upper ? std::upper_bound(dts.begin() + lo, dts.begin() + hi, t) - dts.begin()
+               : std::lower_bound(dts.begin() + lo, dts.begin() + hi, t) - dts.begin();
+}
+
+void GtIndex::range(int64_t ts, int64_t te, size_t &lo, size_t &hi) const {
+  lo = locate(*this, ts, false);
+  hi = std::max(lo, locate(*this, te, true));
+}
+
+uint32_t GtIndex::count(uint32_t f, size_t lo, size_t hi) const {
+  const uint32_t *b = flow_pos.data() + flow_off[f], *e = flow_pos.data() + flow_off[f + 1];
+  return std::lower_bound(b, e, (uint32_t)hi) - std::lower_bound(b, e, (uint32_t)lo);
+}
+
+void gt_index_retrieve(const GtIndex &x, int64_t ts, int64_t te, GtResult &r, std::vector<int64_t> &scratch){
+  const GtData &g = *x.g;
+  size_t lo, hi;
+  x.range(ts, te, lo, hi);
+  // a rank costs about as much as counting 32 packets
+  if (hi - lo <= 32 * g.flows.size()){
+    gt_count(g, lo, hi, r, scratch);
+    return;
+  }
+  // ranks of every flow; equal numbers in the order of the first packet
+  r.clear();
+  std::vector<uint32_t> first;
+  for (uint32_t f = 0; f < g.flows.size(); f++){
+    const uint32_t *b = x.flow_pos.data() + x.flow_off[f], *e = x.flow_pos.data() + x.flow_off[f + 1];
+    if (b == e || e[-1] < lo || *b >= hi){
+      continue;
+    }
+    const uint32_t *s = std::lower_bound(b, e, (uint32_t)lo), *t = std::lower_bound(s, e, (uint32_t)hi);
+    if (t > s){
+      r.push_back(std::make_pair(f, t - s));
+      first.push_back(*s);
+    }
+  }
+  std::vector<uint32_t> order(r.size());
+  for (uint32_t i = 0; i < order.size(); i++){
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+    return r[a].second != r[b].second ? r[a].second > r[b].second : first[a] < first[b];
+  });
+  GtResult s(r.size());
+  for (uint32_t i = 0; i < order.size(); i++){
+    s[i] = r[order[i]];
+  }
+  r.swap(s);
+}
+
+void gt_index_retrieve_batch(const GtIndex &x, const std::vector<std::pair<int64_t, int64_t>> &q,
+                             std::vector<GtResult> &r, uint32_t threads){
+  r.resize(q.size());
+  threads = std::min<size_t>(thread_num(threads), std::max<size_t>(q.size(), 1));
+  std::vector<std::vector<int64_t>> scratch(threads);
+  // chunks of queries, so that one thread keeps its scratch warm
+  size_t chunk = (q.size() + threads * 8 - 1) / (threads * 8);
+  parallel_for(chunk ? (q.size() + chunk - 1) / chunk : 0, threads, [&](size_t c, uint32_t t){
+    for (size_t i = c * chunk; i < q.size() && i < (c + 1) * chunk; i++){
+      gt_index_retrieve(x, q[i].first, q[i].second, r[i], scratch[t]);
+    }
+  });
+}
+
+void gt_index_count_batch(const GtIndex &x, const std::vector<std::pair<int64_t, int64_t>> &q,
+                          const std::vector<uint32_t> &f, std::vector<uint32_t> &n, uint32_t threads){
+  n.resize(q.size() * f.size());
+  parallel_for(q.size(), threads, [&](size_t i, uint32_t){
+    size_t lo, hi;
+    x.range(q[i].first, q[i].second, lo, hi);
+    for (size_t j = 0; j < f.size(); j++){
+      n[i * f.size() + j] = x.count(f[j], lo, hi);
+    }
+  });
+}
+
+}
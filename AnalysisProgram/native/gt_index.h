@@ -0,0 +1,54 @@
+/*************************************************************************
+	> File Name: gt_index.h
+  > Description: Range counts per flow over the ground truth of a port
+*************************************************************************/
+
+#ifndef _PQ_GT_INDEX_H_
+#define _PQ_GT_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+
+#include "gt_data.h"
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// Built once over the packets of GtData (dequeue order):
+// - time table: the dequeue ts of every stride-th packet, an interval is
+//   located by a binary search in it and one within stride packets;
+// - per flow prefix counts: the offsets of the packets of each flow,
+//   sorted, so that the packets of a flow in [lo, hi) are the difference
+//   of two ranks.
+//----------------------------------------------------------------------
+struct GtIndex {
+  const GtData *g = nullptr;
+  uint32_t stride = 64;
+  std::vector<int64_t> ts;                      // g->dts[i * stride]
+  std::vector<uint32_t> flow_off;               // flows + 1
+  std::vector<uint32_t> flow_pos;               // packets, by flow
+
+  void build(const GtData &g);
+  // packets [lo, hi) dequeued in [ts, te]
+  void range(int64_t ts, int64_t te, size_t &lo, size_t &hi) const;
+  // packets of flow f in [lo, hi)
+  uint32_t count(uint32_t f, size_t lo, size_t hi) const;
+};
+
+// gt_retrieve through the index: the packets of the interval are counted
+// when fewer than the flows, otherwise the ranks of every flow; the same
+// result either way
+void gt_index_retrieve(const GtIndex &x, int64_t ts, int64_t te, GtResult &r, std::vector<int64_t> &scratch);
+
+// intervals q[i] into r[i], on threads threads (0: one per core)
+void gt_index_retrieve_batch(const GtIndex &x, const std::vector<std::pair<int64_t, int64_t>> &q,
+                             std::vector<GtResult> &r, uint32_t threads);
+
+// packets of the flows f[j] dequeued in q[i], into n[i * f.size() + j]
+void gt_index_count_batch(const GtIndex &x, const std::vector<std::pair<int64_t, int64_t>> &q,
+                          const std::vector<uint32_t> &f, std::vector<uint32_t> &n, uint32_t threads);
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*************************************************************************
+	> File Name: mapped_file.h
+  > Description: Read-only mapping of a whole file
+*************************************************************************/
+
+#ifndef _PQ_MAPPED_FILE_H_
+#define _PQ_MAPPED_FILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace pq {
+
+// empty files are not mapped (data = nullptr, size = 0)
+struct MappedFile {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  int map(const char *file){
+    int fd = open(file, O_RDONLY);
+    if (fd < 0){
+      printf("Error opening %s!\n", file);
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0){
+      printf("Error reading %s!\n", file);
+      close(fd);
+      return -1;
+    }
+    size = st.st_size;
+    if (size > 0){
+      void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m == MAP_FAILED){
+        printf("Error mapping %s!\n", file);
+        close(fd);
+        size = 0;
+        return -1;
+      }
+      data = (const uint8_t *)m;
+    }
+    close(fd);
+    return 0;
+  }
+
+  void unmap(){
+    if (data != nullptr){
+      munmap((void *)data, size);
+    }
+    data = nullptr;
+    size = 0;
+  }
+
+  ~MappedFile(){
+    unmap();
+  }
+};
+
+}
+
+#endif
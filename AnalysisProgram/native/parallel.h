@@ -0,0 +1,57 @@
+/*************************************************************************
+	> File Name: parallel.h
+  > Description: Work sharing of independent jobs across threads
+*************************************************************************/
+
+#ifndef _PQ_PARALLEL_H_
+#define _PQ_PARALLEL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace pq {
+
+// threads = 0: one per core
+static inline uint32_t thread_num(uint32_t threads){
+  if (threads == 0){
+    threads = std::thread::hardware_concurrency();
+  }
+  return threads == 0 ? 1 : threads;
+}
+
+//----------------------------------------------------------------------
+// Run f(i, thread) for i in [0, n) on up to threads threads, jobs taken
+// one at a time so that uneven jobs balance. thread is in [0, threads).
+//----------------------------------------------------------------------
+template <class F>
+void parallel_for(size_t n, uint32_t threads, F f){
+  threads = thread_num(threads);
+  if (threads > n){
+    threads = n;
+  }
+  if (threads <= 1){
+    for (size_t i = 0; i < n; i++){
+      f(i, 0);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (uint32_t t = 0; t < threads; t++){
+    pool.emplace_back([&, t](){
+      size_t i;
+      while ((i = next.fetch_add(1)) < n){
+        f(i, t);
+      }
+    });
+  }
+  for (std::thread &th : pool){
+    th.join();
+  }
+}
+
+}
+
+#endif
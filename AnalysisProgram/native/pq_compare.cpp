@@ -0,0 +1,303 @@
+/*************************************************************************
+	> File Name: pq_compare.cpp
+  > Description: Comparison of GroundTruth.py: time windows against
+  >              Count-Min, HashPipe and FlowRadar on sampled victim
+  >              packets per queue depth level, and DataPlaneQuery.py
+  >              on the signals of the data plane
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eval.h"
+
+static double now_ms(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// comma separated list of numbers
+static int parse_list(const char *s, std::vector<uint32_t> &v){
+  v.clear();
+  while (*s){
+    char *end;
+    unsigned long x = strtoul(s, &end, 10);
+    if (end == s || (*end != ',' && *end != '\0')){
+      return -1;
+    }
+    v.push_back(x);
+    s = *end == ',' ? end + 1 : end;
+  }
+  return v.empty() ? -1 : 0;
+}
+
+// a float as written by the csv module (repr): the shortest digits that
+// read back the same, after a tab unless first
+static void print_float(FILE *f, double x, bool first = false){
+  char s[32];
+  for (int p = 1; p <= 17; p++){
+    snprintf(s, sizeof(s), "%.*g", p, x);
+    if (strtod(s, NULL) == x){
+      break;
+    }
+  }
+  fprintf(f, strpbrk(s, ".e") ? "%s%s" : "%s%s.0", first ? "" : "\t", s);
+}
+
+static void pq_compare_usage(void){
+  printf("Usage: pq_compare [OPTIONS]\n");
+  printf("\n");
+  printf("Writes PATH/qdepth_level_<j>_result.csv for the packets sampled at queue depth level j\n");
+  printf("and PATH/data_plane_query_accuracy.csv for the signals of the data plane, if any\n");
+  printf(" --path=path Parent folder of gt_data and tw_data (default .)\n");
+  printf(" --tw=path Parent folder of tw_data, or a store written by pq_ingest (default PATH)\n");
+  printf(" --k=n Cell number exponent (default 12)\n");
+  printf(" --T=n Number of time windows (default 4)\n");
+  printf(" --alpha=n Compression factor (default 1)\n");
+  printf(" --tb0=n Trimmed bits of the first window, TW0_TB (default 10)\n");
+  printf(" --z=p Cell probability of the first window, TW0_z (default 0.8192)\n");
+  printf(" --thresholds=list Queue depth levels of the sampled packets (default 1000,2000,5000,10000,15000,20000)\n");
+  printf(" --samples=n Packets sampled per level (default 20)\n");
+  printf(" --seed=n Seed of the sampling (default 1)\n");
+  printf(" --cache=n Sets of windows whose sketches are kept (default 16)\n");
+  printf(" --signals=path Signals of the data plane, written to PATH/data_plane_query_accuracy.csv (default PATH/signal_data)\n");
+  printf(" --threads=n Threads loading the snapshots and evaluating the packets (default: one per core)\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = ".", *tw_path = NULL, *signal_path = NULL;
+  pq::TwParams p;
+  p.k = 12;
+  p.T = 4;
+  p.alpha = 1;
+  p.tb0 = 10;
+  p.z = 1024.0 / 1250;
+  std::vector<uint32_t> thr = {1000, 2000, 5000, 10000, 15000, 20000};
+  uint32_t samples = 20, cache = 16, threads = 0;
+  uint64_t seed = 1;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_PATH,
+    OPT_TW,
+    OPT_K,
+    OPT_T,
+    OPT_ALPHA,
+    OPT_TB0,
+    OPT_Z,
+    OPT_THRESHOLDS,
+    OPT_SAMPLES,
+    OPT_SEED,
+    OPT_CACHE,
+    OPT_SIGNALS,
+    OPT_THREADS,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"path", required_argument, 0, OPT_PATH},
+      {"tw", required_argument, 0, OPT_TW},
+      {"k", required_argument, 0, OPT_K},
+      {"T", required_argument, 0, OPT_T},
+      {"alpha", required_argument, 0, OPT_ALPHA},
+      {"tb0", required_argument, 0, OPT_TB0},
+      {"z", required_argument, 0, OPT_Z},
+      {"thresholds", required_argument, 0, OPT_THRESHOLDS},
+      {"samples", required_argument, 0, OPT_SAMPLES},
+      {"seed", required_argument, 0, OPT_SEED},
+      {"cache", required_argument, 0, OPT_CACHE},
+      {"signals", required_argument, 0, OPT_SIGNALS},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_PATH:
+        path = optarg;
+        break;
+      case OPT_TW:
+        tw_path = optarg;
+        break;
+      case OPT_K:
+        p.k = atoi(optarg);
+        break;
+      case OPT_T:
+        p.T = atoi(optarg);
+        break;
+      case OPT_ALPHA:
+        p.alpha = atoi(optarg);
+        break;
+      case OPT_TB0:
+        p.tb0 = atoi(optarg);
+        break;
+      case OPT_Z:
+        p.z = atof(optarg);
+        break;
+      case OPT_THRESHOLDS:
+        if (parse_list(optarg, thr) < 0){
+          printf("Error: bad list %s!\n", optarg);
+          return 1;
+        }
+        break;
+      case OPT_SAMPLES:
+        samples = atoi(optarg);
+        break;
+      case OPT_SEED:
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case OPT_CACHE:
+        cache = atoi(optarg);
+        break;
+      case OPT_SIGNALS:
+        signal_path = optarg;
+        break;
+      case OPT_THREADS:
+        threads = atoi(optarg);
+        break;
+      case 'h':
+      case '?':
+        pq_compare_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+  if (tw_path == NULL){
+    tw_path = path;
+  }
+
+  double s = now_ms();
+  pq::TwIndex idx;
+  pq::GtData g;
+  // the ground truth is loaded while the snapshots are
+  int gt_ret = 0;
+  std::thread gt_loader([&](){
+    gt_ret = pq::gt_load(path, g);
+  });
+  int tw_ret = idx.open(tw_path, p, threads);
+  gt_loader.join();
+  if (tw_ret < 0 || gt_ret < 0){
+    return 1;
+  }
+  pq::Evaluator ev;
+  ev.init(idx, g, threads, cache);
+  std::vector<std::vector<uint32_t>> level;
+  pq::gt_sample(g, thr, samples, seed, level);
+  printf("Loaded %u sets, %zu packets, %zu flows in %.1f ms\n", idx.set_num, g.dts.size(), g.flows.size(), now_ms() - s);
+  printf("Evaluating on %u threads\n", ev.threads);
+
+  printf("%5s %7s %8s", "level", "samples", "answered");
+  printf(" %17s", "TW");
+  for (int b = 0; b < BASELINE_NUM; b++){
+    printf(" %17s", pq::baseline_defs[b].name);
+  }
+  printf("\n");
+  s = now_ms();
+  std::vector<pq::EvalVictim> v;
+  std::vector<pq::EvalRow> rows;
+  for (size_t j = 0; j < level.size(); j++){
+    // evaluated by dequeue time, so that packets sharing sets go to the
+    // same thread; written in the order sampled
+    const std::vector<uint32_t> &l = level[j];
+    std::vector<uint32_t> order(l.size());
+    for (uint32_t i = 0; i < order.size(); i++){
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y){
+      return g.dts[l[x]] < g.dts[l[y]];
+    });
+    v.clear();
+    for (uint32_t i : order){
+      v.push_back(pq::EvalVictim{g.ets[l[i]], g.dts[l[i]], g.qlen[l[i]]});
+    }
+    rows.resize(v.size());
+    ev.run(v.data(), v.size(), rows.data(), true);
+    std::vector<uint32_t> rank(l.size());
+    for (uint32_t i = 0; i < order.size(); i++){
+      rank[order[i]] = i;
+    }
+    std::string name = std::string(path) + "/qdepth_level_" + std::to_string(j) + "_result.csv";
+    FILE *f = fopen(name.c_str(), "w");
+    if (f == NULL){
+      printf("Error opening %s!\n", name.c_str());
+      return 1;
+    }
+    // csv excel-tab: idx, ets, dts, qlen, then precision, recall of each
+    uint32_t n = 0;
+    std::vector<double> mean(2 * EVAL_METHODS, 0);
+    for (uint32_t i = 0; i < l.size(); i++){
+      const pq::EvalVictim &x = v[rank[i]];
+      const pq::EvalRow &r = rows[rank[i]];
+      if (!r.answered){
+        continue;
+      }
+      fprintf(f, "%u\t%ld\t%ld\t%u", n, x.ets, x.dts, x.qlen);
+      for (int k = 0; k < EVAL_METHODS; k++){
+        print_float(f, r.precision[k]);
+        print_float(f, r.recall[k]);
+        mean[2 * k] += r.precision[k];
+        mean[2 * k + 1] += r.recall[k];
+      }
+      fprintf(f, "\r\n");
+      n++;
+    }
+    fclose(f);
+    printf("%5zu %7zu %8u", j, l.size(), n);
+    for (int k = 0; k < EVAL_METHODS; k++){
+      printf("     %.4f/%.4f", n ? mean[2 * k] / n : 0, n ? mean[2 * k + 1] / n : 0);
+    }
+    printf("\n");
+  }
+  uint64_t built, hits;
+  ev.sketch_stats(built, hits);
+  printf("Compared in %.1f ms: %lu sets sketched, %lu reused\n", now_ms() - s, built, hits);
+  printf("Results written to %s/qdepth_level_*_result.csv\n", path);
+
+  // DataPlaneQuery: the packets of the signals of the data plane
+  std::string sig = signal_path ? signal_path : std::string(path) + "/signal_data";
+  DIR *dp = opendir(sig.c_str());
+  if (dp == NULL){
+    printf("No %s, data plane queries skipped\n", sig.c_str());
+    return 0;
+  }
+  closedir(dp);
+  if (pq::eval_load_signals(idx, sig.c_str(), v) < 0){
+    return 1;
+  }
+  std::string name = std::string(path) + "/data_plane_query_accuracy.csv";
+  FILE *f = fopen(name.c_str(), "w");
+  if (f == NULL){
+    printf("Error opening %s!\n", name.c_str());
+    return 1;
+  }
+  rows.resize(v.size());
+  ev.run(v.data(), v.size(), rows.data(), false);
+  uint32_t n = 0;
+  double mp = 0, mr = 0;
+  for (const pq::EvalRow &r : rows){
+    if (!r.answered){
+      continue;
+    }
+    print_float(f, r.precision[0], true);
+    print_float(f, r.recall[0]);
+    fprintf(f, "\r\n");
+    mp += r.precision[0];
+    mr += r.recall[0];
+    n++;
+  }
+  fclose(f);
+  printf("Data plane queries: %zu signals, %u answered, precision %.4f, recall %.4f\n", v.size(), n, n ? mp / n : 0, n ? mr / n : 0);
+  printf("Results written to %s\n", name.c_str());
+  return 0;
+}
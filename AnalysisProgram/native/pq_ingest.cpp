@@ -0,0 +1,115 @@
+/*************************************************************************
+	> File Name: pq_ingest.cpp
+  > Description: Bulk ingest of the time windows snapshots of ports into
+  >              one indexed store per port
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <string>
+
+#include "tw_ingest.h"
+#include "parallel.h"
+
+static double now_ms(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void pq_ingest_usage(void){
+  printf("Usage: pq_ingest [OPTIONS] PORT_DIR...\n");
+  printf("\n");
+  printf("Stores the snapshots of PORT_DIR/tw_data (.cells or .bin) in PORT_DIR/tw_store.pqtw\n");
+  printf(" --k=n Cell number exponent (default 10)\n");
+  printf(" --T=n Number of time windows (default 3)\n");
+  printf(" --alpha=n Compression factor (default 1)\n");
+  printf(" --tb0=n Trimmed bits of the first window, TW0_TB (default 7)\n");
+  printf(" --threads=n Decoding threads (default: one per core)\n");
+  printf(" --out=dir Write <dir>/<n>.pqtw for the n-th PORT_DIR instead\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  pq::TwParams p;
+  uint32_t threads = 0;
+  const char *out = NULL;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_K,
+    OPT_T,
+    OPT_ALPHA,
+    OPT_TB0,
+    OPT_THREADS,
+    OPT_OUT,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"k", required_argument, 0, OPT_K},
+      {"T", required_argument, 0, OPT_T},
+      {"alpha", required_argument, 0, OPT_ALPHA},
+      {"tb0", required_argument, 0, OPT_TB0},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {"out", required_argument, 0, OPT_OUT},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_K:
+        p.k = atoi(optarg);
+        break;
+      case OPT_T:
+        p.T = atoi(optarg);
+        break;
+      case OPT_ALPHA:
+        p.alpha = atoi(optarg);
+        break;
+      case OPT_TB0:
+        p.tb0 = atoi(optarg);
+        break;
+      case OPT_THREADS:
+        threads = atoi(optarg);
+        break;
+      case OPT_OUT:
+        out = optarg;
+        break;
+      case 'h':
+      case '?':
+        pq_ingest_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+  if (optind == argc){
+    pq_ingest_usage();
+    return 1;
+  }
+  if (pq::tw_params_check(p) < 0){
+    return 1;
+  }
+
+  printf("Ingesting %d ports on %u threads\n", argc - optind, pq::thread_num(threads));
+  for (int i = optind; i < argc; i++){
+    pq::TwData d;
+    std::string dir = std::string(argv[i]) + "/tw_data";
+    std::string store = out ? std::string(out) + "/" + std::to_string(i - optind) + ".pqtw" : std::string(argv[i]) + "/tw_store.pqtw";
+    double s = now_ms();
+    if (pq::tw_ingest(dir.c_str(), p, threads, d) < 0){
+      return 1;
+    }
+    double m = now_ms();
+    if (pq::tw_store_write(store.c_str(), p, d) < 0){
+      return 1;
+    }
+    printf("%s: %zu sets, %zu cells, %zu flows, decoded in %.1f ms, stored in %.1f ms to %s\n",
+           argv[i], d.sets.size(), d.cell_ts.size(), d.flows.size(), m - s, now_ms() - m, store.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,196 @@
+/*************************************************************************
+	> File Name: pq_qm.cpp
+  > Description: Queue stacks of the queue monitor snapshots of a port and
+  >              the flows in the queue during intervals
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "qm_index.h"
+
+static double now_us(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+// the stacks as filter_QM: ts, qdepth, entries, interval, and the
+// entries themselves when asked
+static void list(const pq::QmIndex &x, bool entries){
+  std::vector<uint32_t> e;
+  for (uint32_t s = 0; s < x.snaps.size(); s++){
+    const pq::QmSnapshot &snap = x.snaps[s];
+    printf("%u_%u qdepth %u, %u entries, interval %ld\n", snap.sec, snap.usec, snap.qdepth, snap.depth, snap.interval);
+    if (!entries){
+      continue;
+    }
+    x.stack(s, e);
+    for (uint32_t i : e){
+      const pq::QmEntry &en = x.entries[i];
+      printf("  %u %016lx %ld\n", en.index, x.flows[en.flow], en.seq);
+    }
+  }
+}
+
+static void print_query(const pq::QmIndex &x, const pq::QmQuery &q, int64_t t1, int64_t t2, int64_t n, uint32_t K, double us){
+  if (n < 0){
+    printf("For query %ld to %ld, no snapshot of the queue is found!\n", t1, t2);
+    return;
+  }
+  const pq::QmSnapshot &a = x.snaps[q.first], &b = x.snaps[q.last];
+  printf("query %ld to %ld: snapshots %u_%u to %u_%u, %ld flows, %.1f us\n", t1, t2, a.sec, a.usec, b.sec, b.usec, n, us);
+  for (uint32_t i = 0; i < q.order.size() && (K == 0 || i < K); i++){
+    uint32_t f = q.order[i];
+    printf("  %016lx %u\n", x.flows[f], q.count[f]);
+  }
+}
+
+//----------------------------------------------------------------------
+// n queries of width us starting at random snapshots, latency percentiles
+//----------------------------------------------------------------------
+static void bench(const pq::QmIndex &x, pq::QmQuery &q, uint32_t n, int64_t width){
+  std::mt19937_64 rng(1);
+  std::vector<double> lat;
+  if (x.snaps.empty()){
+    printf("No snapshot to query!\n");
+    return;
+  }
+  for (uint32_t i = 0; i < n; i++){
+    const pq::QmSnapshot &s = x.snaps[rng() % x.snaps.size()];
+    int64_t t = (int64_t)s.sec * 1000000 + s.usec;
+    double st = now_us();
+    pq::qm_occupancy(x, t, t + width, q);
+    lat.push_back(now_us() - st);
+  }
+  std::sort(lat.begin(), lat.end());
+  double sum = 0;
+  for (double l : lat){
+    sum += l;
+  }
+  printf("%u queries of %ld us: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         n, width, sum / n, lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+static void pq_qm_usage(void){
+  printf("Usage: pq_qm [OPTIONS] [t1 t2]...\n");
+  printf("\n");
+  printf(" --path=path Folder of the queue monitor snapshots, qm_meta.csv in its parent (default ./qm_data)\n");
+  printf(" --max-qdepth=n Slots of the stack (default 25000)\n");
+  printf(" --threads=n Threads loading the snapshots (default: one per core)\n");
+  printf(" --top=K Flows printed per query, 0 for all (default 10)\n");
+  printf(" --list Print the queue depth of every snapshot instead\n");
+  printf(" --stacks Print the stack of every snapshot instead\n");
+  printf(" --bench=n Time n random queries instead\n");
+  printf(" --width=us Interval of the random queries (default 1000)\n");
+  printf(" -h,--help Display this help message and exit\n");
+  printf("Queries are wall clock times in microseconds, as the names of the snapshots.\n");
+  printf("Without a query on the command line, queries are read from stdin as \"t1 t2\" lines.\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = "./qm_data";
+  uint32_t max_qdepth = 25000, K = 10, bench_n = 0, threads = 0;
+  int64_t width = 1000;
+  bool show_list = false, show_stacks = false;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_PATH,
+    OPT_MAX_QDEPTH,
+    OPT_THREADS,
+    OPT_TOP,
+    OPT_LIST,
+    OPT_STACKS,
+    OPT_BENCH,
+    OPT_WIDTH,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"path", required_argument, 0, OPT_PATH},
+      {"max-qdepth", required_argument, 0, OPT_MAX_QDEPTH},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {"top", required_argument, 0, OPT_TOP},
+      {"list", no_argument, 0, OPT_LIST},
+      {"stacks", no_argument, 0, OPT_STACKS},
+      {"bench", required_argument, 0, OPT_BENCH},
+      {"width", required_argument, 0, OPT_WIDTH},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_PATH:
+        path = optarg;
+        break;
+      case OPT_MAX_QDEPTH:
+        max_qdepth = atoi(optarg);
+        break;
+      case OPT_THREADS:
+        threads = atoi(optarg);
+        break;
+      case OPT_TOP:
+        K = atoi(optarg);
+        break;
+      case OPT_LIST:
+        show_list = true;
+        break;
+      case OPT_STACKS:
+        show_stacks = true;
+        break;
+      case OPT_BENCH:
+        bench_n = atoi(optarg);
+        break;
+      case OPT_WIDTH:
+        width = atoll(optarg);
+        break;
+      case 'h':
+      case '?':
+        pq_qm_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+
+  pq::QmIndex x;
+  double s = now_us();
+  if (x.open(path, max_qdepth, threads) < 0){
+    return 1;
+  }
+  printf("Loaded %zu snapshots, %zu entries, %zu flows in %.1f ms\n", x.snaps.size(), x.entries.size(), x.flows.size(), (now_us() - s) / 1e3);
+
+  pq::QmQuery q;
+  if (show_list || show_stacks){
+    list(x, show_stacks);
+    return 0;
+  }
+  if (bench_n > 0){
+    bench(x, q, bench_n, width);
+    return 0;
+  }
+  long long t1, t2;
+  if (optind < argc){
+    for (int i = optind; i + 1 < argc; i += 2){
+      t1 = atoll(argv[i]);
+      t2 = atoll(argv[i + 1]);
+      s = now_us();
+      int64_t n = pq::qm_occupancy(x, t1, t2, q);
+      print_query(x, q, t1, t2, n, K, now_us() - s);
+    }
+    return 0;
+  }
+  while (scanf("%lld %lld", &t1, &t2) == 2){
+    s = now_us();
+    int64_t n = pq::qm_occupancy(x, t1, t2, q);
+    print_query(x, q, t1, t2, n, K, now_us() - s);
+  }
+  return 0;
+}
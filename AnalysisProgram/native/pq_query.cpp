@@ -0,0 +1,201 @@
+/*************************************************************************
+	> File Name: pq_query.cpp
+  > Description: Top-K culprit flows of intervals from the time windows
+  >              snapshots of a port
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "tw_index.h"
+
+static double now_us(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void print_query(const pq::TwIndex &idx, const pq::TwQuery &q, int64_t ts, int64_t te, int64_t n, uint32_t K, double us){
+  if (n < 0){
+    printf("For query %ld to %ld, no right set of time windows is found!\n", ts, te);
+    return;
+  }
+  printf("query %ld to %ld: %zu sets, window %d, %ld flows, %.1f us\n", ts, te, q.sets.size(), q.window_id, n, us);
+  for (size_t i = 0; i < q.sets.size(); i++){
+    const pq::TwSet &s = idx.sets[q.sets[i]];
+    printf("  set %u_%u [%ld, %ld]: %ld to %ld\n", s.sec, s.usec, s.sts, s.lts, q.start[i], q.end[i]);
+  }
+  for (uint32_t i = 0; i < q.order.size() && (K == 0 || i < K); i++){
+    uint32_t f = q.order[i];
+    printf("  %016lx %ld\n", idx.flows[f], q.est[f]);
+  }
+}
+
+//----------------------------------------------------------------------
+// n queries of width ns starting at random cells, latency percentiles
+//----------------------------------------------------------------------
+static void bench(const pq::TwIndex &idx, pq::TwQuery &q, uint32_t n, int64_t width){
+  std::mt19937_64 rng(1);
+  std::vector<double> lat;
+  uint64_t found = 0;
+  if (idx.cell_num == 0){
+    printf("No cell to query!\n");
+    return;
+  }
+  for (uint32_t i = 0; i < n; i++){
+    int64_t ts = idx.cell_ts[rng() % idx.cell_num];
+    double s = now_us();
+    found += pq::tw_retrieve(idx, ts, ts + width, q) >= 0;
+    lat.push_back(now_us() - s);
+  }
+  std::sort(lat.begin(), lat.end());
+  double sum = 0;
+  for (double l : lat){
+    sum += l;
+  }
+  printf("%u queries of %ld ns (%lu answered): mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         n, width, found, sum / n, lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+static void pq_query_usage(void){
+  printf("Usage: pq_query [OPTIONS] [ts te]...\n");
+  printf("\n");
+  printf(" --path=path Parent folder of tw_data, or a store written by pq_ingest (default .)\n");
+  printf(" --k=n Cell number exponent (default 10)\n");
+  printf(" --T=n Number of time windows (default 3)\n");
+  printf(" --alpha=n Compression factor (default 1)\n");
+  printf(" --tb0=n Trimmed bits of the first window, TW0_TB (default 7)\n");
+  printf(" --z=p Cell probability of the first window, TW0_z (default 1)\n");
+  printf(" --threads=n Threads loading the snapshots (default: one per core)\n");
+  printf(" --top=K Flows printed per query, 0 for all (default 10)\n");
+  printf(" --bench=n Time n random queries instead\n");
+  printf(" --width=ns Interval of the random queries (default 100000)\n");
+  printf(" --no-summary Count every cell instead of the summaries of the store\n");
+  printf(" -h,--help Display this help message and exit\n");
+  printf("Without a query on the command line, queries are read from stdin as \"ts te\" lines.\n");
+}
+
+int main(int argc, char *argv[]) {
+  pq::TwParams p;
+  const char *path = ".";
+  uint32_t K = 10, bench_n = 0, threads = 0;
+  int64_t width = 100000;
+  bool summary = true;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_PATH,
+    OPT_K,
+    OPT_T,
+    OPT_ALPHA,
+    OPT_TB0,
+    OPT_Z,
+    OPT_THREADS,
+    OPT_TOP,
+    OPT_BENCH,
+    OPT_WIDTH,
+    OPT_NO_SUMMARY,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"path", required_argument, 0, OPT_PATH},
+      {"k", required_argument, 0, OPT_K},
+      {"T", required_argument, 0, OPT_T},
+      {"alpha", required_argument, 0, OPT_ALPHA},
+      {"tb0", required_argument, 0, OPT_TB0},
+      {"z", required_argument, 0, OPT_Z},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {"top", required_argument, 0, OPT_TOP},
+      {"bench", required_argument, 0, OPT_BENCH},
+      {"width", required_argument, 0, OPT_WIDTH},
+      {"no-summary", no_argument, 0, OPT_NO_SUMMARY},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_PATH:
+        path = optarg;
+        break;
+      case OPT_K:
+        p.k = atoi(optarg);
+        break;
+      case OPT_T:
+        p.T = atoi(optarg);
+        break;
+      case OPT_ALPHA:
+        p.alpha = atoi(optarg);
+        break;
+      case OPT_TB0:
+        p.tb0 = atoi(optarg);
+        break;
+      case OPT_Z:
+        p.z = atof(optarg);
+        break;
+      case OPT_THREADS:
+        threads = atoi(optarg);
+        break;
+      case OPT_TOP:
+        K = atoi(optarg);
+        break;
+      case OPT_BENCH:
+        bench_n = atoi(optarg);
+        break;
+      case OPT_WIDTH:
+        width = atoll(optarg);
+        break;
+      case OPT_NO_SUMMARY:
+        summary = false;
+        break;
+      case 'h':
+      case '?':
+        pq_query_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+
+  pq::TwIndex idx;
+  double s = now_us();
+  if (idx.open(path, p, threads) < 0){
+    return 1;
+  }
+  printf("Loaded %u sets, %lu cells, %u flows in %.1f ms\n", idx.set_num, idx.cell_num, idx.flow_num, (now_us() - s) / 1e3);
+  printf("Cofficients:");
+  for (double c : idx.coef){
+    printf(" %g", c);
+  }
+  printf("\n");
+
+  pq::TwQuery q;
+  q.use_summary = summary;
+  if (bench_n > 0){
+    bench(idx, q, bench_n, width);
+    return 0;
+  }
+  long long ts, te;
+  if (optind < argc){
+    for (int i = optind; i + 1 < argc; i += 2){
+      ts = atoll(argv[i]);
+      te = atoll(argv[i + 1]);
+      s = now_us();
+      int64_t n = pq::tw_retrieve(idx, ts, te, q);
+      print_query(idx, q, ts, te, n, K, now_us() - s);
+    }
+    return 0;
+  }
+  while (scanf("%lld %lld", &ts, &te) == 2){
+    s = now_us();
+    int64_t n = pq::tw_retrieve(idx, ts, te, q);
+    print_query(idx, q, ts, te, n, K, now_us() - s);
+  }
+  return 0;
+}
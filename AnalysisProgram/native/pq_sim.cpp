@@ -0,0 +1,309 @@
+/*************************************************************************
+	> File Name: pq_sim.cpp
+  > Description: Parameter sweep of the time windows replayed on recorded
+  >              ground truth: culprit query precision / recall and read
+  >              bandwidth per configuration
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "tw_sim.h"
+#include "tw_index.h"
+#include "gt_index.h"
+#include "parallel.h"
+
+static double now_ms(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// comma separated list of numbers
+template <typename V>
+static int parse_list(const char *s, std::vector<V> &v){
+  v.clear();
+  while (*s){
+    char *end;
+    double x = strtod(s, &end);
+    if (end == s || (*end != ',' && *end != '\0')){
+      return -1;
+    }
+    v.push_back((V)x);
+    s = *end == ',' ? end + 1 : end;
+  }
+  return v.empty() ? -1 : 0;
+}
+
+struct SimResult {
+  int ret = 0;
+  pq::TwSimStats st;
+  uint64_t sets = 0, cells = 0;
+  std::vector<double> z, precision, recall;     // per z
+  std::vector<uint32_t> answered;
+};
+
+// queries as Comparison of GroundTruth.py: [enqueue ts, dequeue ts] of
+// the sampled packets
+static void sample_queries(const pq::GtData &g, const std::vector<uint32_t> &thr, uint32_t n, uint64_t seed,
+                           std::vector<std::pair<int64_t, int64_t>> &q){
+  std::vector<std::vector<uint32_t>> level;
+  pq::gt_sample(g, thr, n, seed, level);
+  for (auto &l : level){
+    for (uint32_t i : l){
+      q.push_back(std::make_pair(g.ets[i], g.dts[i]));
+    }
+  }
+}
+
+static void pq_sim_usage(void){
+  printf("Usage: pq_sim [OPTIONS]\n");
+  printf("\n");
+  printf("Replays PATH/gt_data through the time windows of every combination of the lists\n");
+  printf(" --path=path Parent folder of gt_data (default .)\n");
+  printf(" --k=list Cell number exponents (default 12)\n");
+  printf(" --T=list Numbers of time windows (default 4)\n");
+  printf(" --alpha=list Compression factors (default 1)\n");
+  printf(" --tb0=list Trimmed bits of the first window, TW0_TB (default 10)\n");
+  printf(" --z=list Cell probabilities of the first window, 0 for the simulated one (default 0)\n");
+  printf(" --read-period=us Reading interval of the registers (default: the set period less 100 us, as the control plane)\n");
+  printf(" --thresholds=list Queue depth levels of the sampled packets (default 1000,2000,5000,10000,15000,20000)\n");
+  printf(" --samples=n Queries per level (default 20)\n");
+  printf(" --seed=n Seed of the sampling (default 1)\n");
+  printf(" --threads=n Configurations simulated at once (default: one per core)\n");
+  printf(" --out=file Result table (default PATH/tw_sweep.csv)\n");
+  printf(" --dump=dir Write the snapshots of the n-th configuration to <dir>/<n>/tw_data\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = ".", *dump = NULL;
+  std::string out;
+  std::vector<int> ks = {12}, Ts = {4}, alphas = {1}, tb0s = {10};
+  std::vector<double> zs = {0};
+  std::vector<uint32_t> thr = {1000, 2000, 5000, 10000, 15000, 20000};
+  uint32_t samples = 20, threads = 0;
+  uint64_t seed = 1;
+  int64_t read_period = 0;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_PATH,
+    OPT_K,
+    OPT_T,
+    OPT_ALPHA,
+    OPT_TB0,
+    OPT_Z,
+    OPT_READ_PERIOD,
+    OPT_THRESHOLDS,
+    OPT_SAMPLES,
+    OPT_SEED,
+    OPT_THREADS,
+    OPT_OUT,
+    OPT_DUMP,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"path", required_argument, 0, OPT_PATH},
+      {"k", required_argument, 0, OPT_K},
+      {"T", required_argument, 0, OPT_T},
+      {"alpha", required_argument, 0, OPT_ALPHA},
+      {"tb0", required_argument, 0, OPT_TB0},
+      {"z", required_argument, 0, OPT_Z},
+      {"read-period", required_argument, 0, OPT_READ_PERIOD},
+      {"thresholds", required_argument, 0, OPT_THRESHOLDS},
+      {"samples", required_argument, 0, OPT_SAMPLES},
+      {"seed", required_argument, 0, OPT_SEED},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {"out", required_argument, 0, OPT_OUT},
+      {"dump", required_argument, 0, OPT_DUMP},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    int ret = 0;
+    switch (c) {
+      case OPT_PATH:
+        path = optarg;
+        break;
+      case OPT_K:
+        ret = parse_list(optarg, ks);
+        break;
+      case OPT_T:
+        ret = parse_list(optarg, Ts);
+        break;
+      case OPT_ALPHA:
+        ret = parse_list(optarg, alphas);
+        break;
+      case OPT_TB0:
+        ret = parse_list(optarg, tb0s);
+        break;
+      case OPT_Z:
+        ret = parse_list(optarg, zs);
+        break;
+      case OPT_READ_PERIOD:
+        read_period = atoll(optarg) * 1000;
+        break;
+      case OPT_THRESHOLDS:
+        ret = parse_list(optarg, thr);
+        break;
+      case OPT_SAMPLES:
+        samples = atoi(optarg);
+        break;
+      case OPT_SEED:
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case OPT_THREADS:
+        threads = atoi(optarg);
+        break;
+      case OPT_OUT:
+        out = optarg;
+        break;
+      case OPT_DUMP:
+        dump = optarg;
+        break;
+      case 'h':
+      case '?':
+        pq_sim_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+    if (ret < 0){
+      printf("Error: bad list %s!\n", optarg);
+      return 1;
+    }
+  }
+  if (out.empty()){
+    out = std::string(path) + "/tw_sweep.csv";
+  }
+
+  std::vector<pq::TwSimConfig> configs;
+  for (int k : ks){
+    for (int T : Ts){
+      for (int alpha : alphas){
+        for (int tb0 : tb0s){
+          pq::TwSimConfig c;
+          c.p.k = k;
+          c.p.T = T;
+          c.p.alpha = alpha;
+          c.p.tb0 = tb0;
+          c.read_period = read_period;
+          if (pq::tw_params_check(c.p) < 0){
+            continue;
+          }
+          configs.push_back(c);
+        }
+      }
+    }
+  }
+  std::vector<std::string> dumps(configs.size());
+  if (dump && mkdir(dump, 0755) != 0 && errno != EEXIST){
+    printf("Error creating %s!\n", dump);
+    return 1;
+  }
+  for (size_t i = 0; dump && i < configs.size(); i++){
+    dumps[i] = std::string(dump) + "/" + std::to_string(i);
+    configs[i].dump = dumps[i].c_str();
+  }
+
+  pq::GtData g;
+  double s = now_ms();
+  if (pq::gt_load(path, g) < 0){
+    return 1;
+  }
+  std::vector<std::pair<int64_t, int64_t>> queries;
+  sample_queries(g, thr, samples, seed, queries);
+  pq::GtIndex gi;
+  gi.build(g);
+  std::vector<pq::GtResult> gt;
+  pq::gt_index_retrieve_batch(gi, queries, gt, threads);
+  printf("Loaded %zu packets, %zu flows, %zu queries in %.1f ms\n", g.dts.size(), g.flows.size(), queries.size(), now_ms() - s);
+  printf("Simulating %zu configurations on %u threads\n", configs.size(), pq::thread_num(threads));
+
+  s = now_ms();
+  std::vector<SimResult> res(configs.size());
+  pq::parallel_for(configs.size(), threads, [&](size_t i, uint32_t){
+    SimResult &r = res[i];
+    pq::TwData d;
+    pq::TwIndex idx;
+    pq::TwQuery q;
+    pq::GtResult tw;
+    std::vector<int64_t> sc(g.flows.size(), 0);
+    if (pq::tw_simulate(g, configs[i], d, r.st) < 0 || idx.open(std::move(d), configs[i].p) < 0){
+      r.ret = -1;
+      return;
+    }
+    r.sets = idx.set_num;
+    r.cells = idx.cell_num;
+    std::vector<uint32_t> tw2gt(idx.flow_num);
+    for (uint32_t f = 0; f < idx.flow_num; f++){
+      auto it = g.flow_ids.find(idx.flows[f]);
+      tw2gt[f] = it == g.flow_ids.end() ? UINT32_MAX : it->second;
+    }
+    for (double z : zs){
+      idx.p.z = z > 0 ? z : r.st.z;
+      idx.coef = pq::tw_coefficient(idx.p.z, idx.p.alpha, idx.p.T);
+      double sp = 0, sr = 0;
+      uint32_t n = 0;
+      for (size_t j = 0; j < queries.size(); j++){
+        if (pq::tw_retrieve(idx, queries[j].first, queries[j].second, q) <= 0){
+          continue;
+        }
+        tw.clear();
+        for (uint32_t f : q.order){
+          tw.push_back(std::make_pair(tw2gt[f], q.est[f]));
+        }
+        double p, rc;
+        pq::gt_precision_recall(gt[j], tw, sc, p, rc);
+        if (p == 0 && rc == 0){
+          continue;
+        }
+        sp += p;
+        sr += rc;
+        n++;
+      }
+      r.z.push_back(idx.p.z);
+      r.precision.push_back(n ? sp / n : 0);
+      r.recall.push_back(n ? sr / n : 0);
+      r.answered.push_back(n);
+    }
+  });
+  printf("Simulated in %.1f ms\n", now_ms() - s);
+
+  FILE *f = fopen(out.c_str(), "w");
+  if (f == NULL){
+    printf("Error opening %s!\n", out.c_str());
+    return 1;
+  }
+  fprintf(f, "k\tT\talpha\ttb0\tz\tread_period_us\tsets\tcells\tqueries\tanswered\tprecision\trecall\tread_MBps\n");
+  printf("%3s %3s %5s %4s %7s %10s %6s %9s %8s %9s %7s %9s\n",
+         "k", "T", "alpha", "tb0", "z", "period_us", "sets", "cells", "answered", "precision", "recall", "read_MBps");
+  for (size_t i = 0; i < configs.size(); i++){
+    const pq::TwParams &p = configs[i].p;
+    const SimResult &r = res[i];
+    if (r.ret < 0){
+      printf("Error: configuration k=%d, T=%d, alpha=%d, TW0_TB=%d failed!\n", p.k, p.T, p.alpha, p.tb0);
+      continue;
+    }
+    // bytes read per second while the port is busy
+    double mbps = (double)r.st.read_bytes * 1e3 / r.st.read_period;
+    for (size_t j = 0; j < r.z.size(); j++){
+      fprintf(f, "%d\t%d\t%d\t%d\t%.4f\t%ld\t%lu\t%lu\t%zu\t%u\t%.4f\t%.4f\t%.3f\n", p.k, p.T, p.alpha, p.tb0, r.z[j],
+              r.st.read_period / 1000, r.sets, r.cells, queries.size(), r.answered[j], r.precision[j], r.recall[j], mbps);
+      printf("%3d %3d %5d %4d %7.4f %10ld %6lu %9lu %8u %9.4f %7.4f %9.3f\n", p.k, p.T, p.alpha, p.tb0, r.z[j],
+             r.st.read_period / 1000, r.sets, r.cells, r.answered[j], r.precision[j], r.recall[j], mbps);
+    }
+  }
+  fclose(f);
+  printf("Results written to %s\n", out.c_str());
+  return 0;
+}
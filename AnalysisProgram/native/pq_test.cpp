@@ -0,0 +1,192 @@
+/*************************************************************************
+	> File Name: pq_test.cpp
+  > Description: Checks of the native engines: time windows replayed on
+  >              packets across an overflow of the 32-bit dequeue
+  >              timestamp, stored as raw sets and as filtered sets
+  >              (tw_cells.h), and ingested back
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "tw_sim.h"
+#include "tw_cells.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)){ \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw){
+  return remove(path);
+}
+
+//----------------------------------------------------------------------
+// Packets of flows round-robin every gap ns, from before to after the
+// first overflow of the 32-bit dequeue timestamp
+//----------------------------------------------------------------------
+static void tw_packets(pq::GtData &g, uint32_t flows, int64_t gap, int64_t before, int64_t after){
+  for (uint32_t f = 0; f < flows; f++){
+    uint64_t fid = (uint64_t)(0x0a000001 + f) << 32 | 0x0a010001;
+    g.flow_ids[fid] = g.flows.size();
+    g.flows.push_back(fid);
+  }
+  uint32_t n = 0;
+  for (int64_t t = (1LL << 32) - before; t < (1LL << 32) + after; t += gap, n++){
+    g.dts.push_back(t);
+    g.ets.push_back(t);
+    g.qlen.push_back(0);
+    g.flow.push_back(n % flows);
+  }
+}
+
+//----------------------------------------------------------------------
+// Every set of d as a filtered snapshot <dir>/tw_data/<sec>_<usec>.cells,
+// cells in the order of filter_TW
+//----------------------------------------------------------------------
+static int write_cells(const char *dir, const pq::TwParams &p, const pq::TwData &d){
+  std::string folder = std::string(dir) + "/tw_data";
+  if (mkdir(dir, 0755) != 0 || mkdir(folder.c_str(), 0755) != 0){
+    printf("Error creating %s!\n", folder.c_str());
+    return -1;
+  }
+  for (const pq::TwSet &s : d.sets){
+    pq_tw_cells_header_t h;
+    std::vector<pq_tw_cell_t> cells(s.num);
+    memset(&h, 0, sizeof(h));
+    h.magic = PQ_TW_CELLS_MAGIC;
+    h.version = PQ_TW_CELLS_VERSION;
+    h.header_size = sizeof(h);
+    h.k = p.k;
+    h.T = p.T;
+    h.alpha = p.alpha;
+    h.tb0 = p.tb0;
+    h.cell_num = s.num;
+    h.sts = s.sts;
+    h.lts = s.lts;
+    h.wrap = s.lts >> 32;
+    h.base = INT64_MAX;
+    for (uint32_t c = s.off; c < s.off + s.num; c++){
+      h.base = std::min(h.base, d.cell_ts[c]);
+    }
+    for (uint32_t c = s.off; c < s.off + s.num; c++){
+      pq_tw_cell_t &x = cells[d.cell_seq[c] - s.off];
+      uint64_t fid = d.flows[d.cell_flow[c]];
+      x.ts_offset = d.cell_ts[c] - h.base;
+      x.src_ip = fid >> 32;
+      x.dst_ip = fid;
+      h.window_cells[d.cell_twid[c]]++;
+    }
+    char name[512];
+    snprintf(name, sizeof(name), "%s/%u_%u.cells", folder.c_str(), s.sec, s.usec);
+    FILE *f = fopen(name, "wb");
+    if (f == NULL){
+      printf("Error opening %s!\n", name);
+      return -1;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(cells.data(), sizeof(pq_tw_cell_t), cells.size(), f);
+    fclose(f);
+  }
+  return 0;
+}
+
+// a cell of window twid at ts holds a packet of its flow dequeued within its span
+static bool tw_cell_matches(const pq::GtData &g, const pq::TwParams &p, int64_t ts, uint32_t twid, uint64_t fid){
+  int64_t half = 1LL << (p.tb0 + twid * p.alpha - 1);
+  auto lo = std::lower_bound(g.dts.begin(), g.dts.end(), ts - half);
+  auto hi = std::lower_bound(g.dts.begin(), g.dts.end(), ts + half);
+  for (auto i = lo; i != hi; i++){
+    if (g.flows[g.flow[i - g.dts.begin()]] == fid){
+      return true;
+    }
+  }
+  return false;
+}
+
+static void tw_compare(const char *what, const pq::TwData &x, const pq::TwData &y){
+  CHECK(x.sets.size() == y.sets.size(), "%s: %zu sets, %zu expected", what, y.sets.size(), x.sets.size());
+  CHECK(x.cell_ts.size() == y.cell_ts.size(), "%s: %zu cells, %zu expected", what, y.cell_ts.size(), x.cell_ts.size());
+  if (x.sets.size() != y.sets.size() || x.cell_ts.size() != y.cell_ts.size()){
+    return;
+  }
+  uint32_t bad_sets = 0, bad_cells = 0;
+  for (size_t i = 0; i < x.sets.size(); i++){
+    const pq::TwSet &a = x.sets[i], &b = y.sets[i];
+    bad_sets += a.sts != b.sts || a.lts != b.lts || a.off != b.off || a.num != b.num || a.sec != b.sec || a.usec != b.usec;
+  }
+  for (size_t c = 0; c < x.cell_ts.size(); c++){
+    bad_cells += x.cell_ts[c] != y.cell_ts[c] || x.flows[x.cell_flow[c]] != y.flows[y.cell_flow[c]]
+                 || x.cell_seq[c] != y.cell_seq[c] || x.cell_twid[c] != y.cell_twid[c];
+  }
+  CHECK(bad_sets == 0, "%s: %u sets differ", what, bad_sets);
+  CHECK(bad_cells == 0, "%s: %u cells differ", what, bad_cells);
+}
+
+//----------------------------------------------------------------------
+// Time windows across an overflow of the dequeue timestamp: the sets of
+// the simulator, their raw snapshots and their filtered snapshots give
+// the same cells, every cell holds a packet of its flow dequeued within
+// its span, and cells after the overflow have it added
+//----------------------------------------------------------------------
+static void test_tw_wrap(const char *tmp){
+  pq::GtData g;
+  pq::TwSimConfig c;
+  pq::TwSimStats st;
+  pq::TwData sim, bin, cells;
+  std::string raw_dir = std::string(tmp) + "/raw", cells_dir = std::string(tmp) + "/cells";
+  c.p.k = 10;
+  c.p.T = 3;
+  c.p.alpha = 1;
+  c.p.tb0 = 7;
+  c.dump = raw_dir.c_str();
+  tw_packets(g, 16, 100, 50000000, 50000000);
+  CHECK(pq::tw_simulate(g, c, sim, st) == 0, "tw_simulate");
+  CHECK(st.reads > 100, "%lu snapshots", st.reads);
+  CHECK(pq::tw_ingest((raw_dir + "/tw_data").c_str(), c.p, 0, bin) == 0, "tw_ingest of the raw sets");
+  tw_compare("raw sets", sim, bin);
+  CHECK(write_cells(cells_dir.c_str(), c.p, bin) == 0, "write_cells");
+  CHECK(pq::tw_ingest((cells_dir + "/tw_data").c_str(), c.p, 0, cells) == 0, "tw_ingest of the filtered sets");
+  tw_compare("filtered sets", bin, cells);
+
+  uint64_t before = 0, after = 0, unmatched = 0;
+  for (size_t i = 0; i < cells.cell_ts.size(); i++){
+    int64_t ts = cells.cell_ts[i];
+    if (ts < (1LL << 32)){
+      before++;
+    }else{
+      after++;
+    }
+    unmatched += !tw_cell_matches(g, c.p, ts, cells.cell_twid[i], cells.flows[cells.cell_flow[i]]);
+  }
+  CHECK(before > 0 && after > 0, "%lu cells before the overflow, %lu after", before, after);
+  CHECK(unmatched == 0, "%lu of %zu cells hold no packet of their flow", unmatched, cells.cell_ts.size());
+  for (size_t i = 1; i < cells.sets.size(); i++){
+    CHECK(cells.sets[i].lts > cells.sets[i - 1].lts, "set %zu: latest cell %ld not after %ld", i, cells.sets[i].lts, cells.sets[i - 1].lts);
+  }
+  printf("tw wrap: %zu sets, %zu cells (%lu after the overflow)\n", cells.sets.size(), cells.cell_ts.size(), after);
+}
+
+int main(int argc, char *argv[]) {
+  char tmp[] = "/tmp/pq_test.XXXXXX";
+  if (mkdtemp(tmp) == NULL){
+    printf("Error creating %s!\n", tmp);
+    return 1;
+  }
+  test_tw_wrap(tmp);
+  nftw(tmp, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  printf("%s: %d failures\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*************************************************************************
+	> File Name: pqnative.cpp
+  > Description: C interface of libpqnative over the C++ engines
+*************************************************************************/
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+
+#include "pqnative.h"
+#include "tw_index.h"
+#include "qm_index.h"
+
+struct pq_tw {
+  pq::TwIndex idx;
+};
+
+struct pq_tw_query {
+  const pq_tw *tw;
+  pq::TwQuery q;
+};
+
+static pq::TwParams tw_params(int k, int T, int alpha, int tb0, double z){
+  pq::TwParams p;
+  p.k = k;
+  p.T = T;
+  p.alpha = alpha;
+  p.tb0 = tb0;
+  p.z = z;
+  return p;
+}
+
+pq_tw_t *pq_tw_open(const char *path, int k, int T, int alpha, int tb0, double z, uint32_t threads){
+  pq_tw_t *tw = new pq_tw_t;
+  if (tw->idx.open(path, tw_params(k, T, alpha, tb0, z), threads) < 0){
+    delete tw;
+    return NULL;
+  }
+  return tw;
+}
+
+int pq_tw_ingest(const char *path, const char *store, int k, int T, int alpha, int tb0, uint32_t threads){
+  pq::TwData d;
+  pq::TwParams p = tw_params(k, T, alpha, tb0, 1);
+  std::string dir = std::string(path) + "/tw_data";
+  if (pq::tw_ingest(dir.c_str(), p, threads, d) < 0){
+    return -1;
+  }
+  return pq::tw_store_write(store, p, d);
+}
+
+void pq_tw_close(pq_tw_t *tw){
+  delete tw;
+}
+
+uint32_t pq_tw_set_num(const pq_tw_t *tw){
+  return tw->idx.set_num;
+}
+
+uint32_t pq_tw_flow_num(const pq_tw_t *tw){
+  return tw->idx.flow_num;
+}
+
+int pq_tw_set_info(const pq_tw_t *tw, uint32_t i, int64_t *sts, int64_t *lts, uint32_t *sec, uint32_t *usec, uint32_t *cells){
+  if (i >= tw->idx.set_num){
+    return -1;
+  }
+  const pq::TwSet &s = tw->idx.sets[i];
+  *sts = s.sts;
+  *lts = s.lts;
+  *sec = s.sec;
+  *usec = s.usec;
+  *cells = s.num;
+  return 0;
+}
+
+void pq_tw_coefficient(const pq_tw_t *tw, double *coef){
+  std::copy(tw->idx.coef.begin(), tw->idx.coef.end(), coef);
+}
+
+pq_tw_query_t *pq_tw_query_new(const pq_tw_t *tw){
+  pq_tw_query_t *q = new pq_tw_query_t;
+  q->tw = tw;
+  return q;
+}
+
+void pq_tw_query_free(pq_tw_query_t *q){
+  delete q;
+}
+
+int64_t pq_tw_retrieve(pq_tw_query_t *q, int64_t ts, int64_t te){
+  return pq::tw_retrieve(q->tw->idx, ts, te, q->q);
+}
+
+uint32_t pq_tw_result(const pq_tw_query_t *q, uint32_t K, uint64_t *fid, int64_t *est){
+  uint32_t n = q->q.order.size();
+  if (K != 0 && K < n){
+    n = K;
+  }
+  for (uint32_t i = 0; i < n; i++){
+    uint32_t f = q->q.order[i];
+    fid[i] = q->tw->idx.flows[f];
+    est[i] = q->q.est[f];
+  }
+  return n;
+}
+
+uint32_t pq_tw_result_sets(const pq_tw_query_t *q, uint32_t cap, uint32_t *set, int64_t *start, int64_t *end, int *window_id){
+  uint32_t n = std::min<size_t>(cap, q->q.sets.size());
+  std::copy(q->q.sets.begin(), q->q.sets.begin() + n, set);
+  std::copy(q->q.start.begin(), q->q.start.begin() + n, start);
+  std::copy(q->q.end.begin(), q->q.end.begin() + n, end);
+  *window_id = q->q.window_id;
+  return q->q.sets.size();
+}
+
+struct pq_qm {
+  pq::QmIndex idx;
+};
+
+struct pq_qm_query {
+  const pq_qm *qm;
+  pq::QmQuery q;
+};
+
+pq_qm_t *pq_qm_open(const char *dir, uint32_t max_qdepth, uint32_t threads){
+  pq_qm_t *qm = new pq_qm_t;
+  if (qm->idx.open(dir, max_qdepth, threads) < 0){
+    delete qm;
+    return NULL;
+  }
+  return qm;
+}
+
+void pq_qm_close(pq_qm_t *qm){
+  delete qm;
+}
+
+uint32_t pq_qm_snapshot_num(const pq_qm_t *qm){
+  return qm->idx.snaps.size();
+}
+
+uint32_t pq_qm_flow_num(const pq_qm_t *qm){
+  return qm->idx.flows.size();
+}
+
+int pq_qm_snapshot_info(const pq_qm_t *qm, uint32_t i, uint32_t *sec, uint32_t *usec, uint32_t *wrap,
+                        int64_t *interval, uint32_t *qdepth, uint32_t *depth){
+  if (i >= qm->idx.snaps.size()){
+    return -1;
+  }
+  const pq::QmSnapshot &s = qm->idx.snaps[i];
+  *sec = s.sec;
+  *usec = s.usec;
+  *wrap = s.wrap;
+  *interval = s.interval;
+  *qdepth = s.qdepth;
+  *depth = s.depth;
+  return 0;
+}
+
+uint32_t pq_qm_stack(const pq_qm_t *qm, uint32_t i, uint32_t cap, uint32_t *index, uint64_t *fid, int64_t *seq){
+  const pq::QmIndex &x = qm->idx;
+  if (i >= x.snaps.size()){
+    return 0;
+  }
+  uint32_t p = x.snaps[i].depth;
+  for (uint32_t e = x.snaps[i].top; e != QM_NONE; e = x.entries[e].below){
+    if (--p < cap){
+      index[p] = x.entries[e].index;
+      fid[p] = x.flows[x.entries[e].flow];
+      seq[p] = x.entries[e].seq;
+    }
+  }
+  return x.snaps[i].depth;
+}
+
+pq_qm_query_t *pq_qm_query_new(const pq_qm_t *qm){
+  pq_qm_query_t *q = new pq_qm_query_t;
+  q->qm = qm;
+  return q;
+}
+
+void pq_qm_query_free(pq_qm_query_t *q){
+  delete q;
+}
+
+int64_t pq_qm_occupancy(pq_qm_query_t *q, int64_t t1, int64_t t2){
+  return pq::qm_occupancy(q->qm->idx, t1, t2, q->q);
+}
+
+uint32_t pq_qm_result(const pq_qm_query_t *q, uint32_t K, uint64_t *fid, uint32_t *count){
+  uint32_t n = q->q.order.size();
+  if (K != 0 && K < n){
+    n = K;
+  }
+  for (uint32_t i = 0; i < n; i++){
+    uint32_t f = q->q.order[i];
+    fid[i] = q->qm->idx.flows[f];
+    count[i] = q->q.count[f];
+  }
+  return n;
+}
@@ -0,0 +1,79 @@
+/*************************************************************************
+	> File Name: pqnative.h
+  > Description: C interface of libpqnative, loaded by pqnative.py
+*************************************************************************/
+
+#ifndef _PQ_NATIVE_H_
+#define _PQ_NATIVE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------
+// Time windows: snapshots of a port (<path>/tw_data) and culprit queries
+//----------------------------------------------------------------------
+typedef struct pq_tw pq_tw_t;
+typedef struct pq_tw_query pq_tw_query_t;
+
+// path: the parent folder of tw_data, or a store written by pq_tw_ingest;
+// the snapshots are loaded on threads threads (0: one per core).
+// NULL on error
+pq_tw_t *pq_tw_open(const char *path, int k, int T, int alpha, int tb0, double z, uint32_t threads);
+// store of the snapshots of <path>/tw_data (tw_store.h)
+int pq_tw_ingest(const char *path, const char *store, int k, int T, int alpha, int tb0, uint32_t threads);
+void pq_tw_close(pq_tw_t *tw);
+uint32_t pq_tw_set_num(const pq_tw_t *tw);
+uint32_t pq_tw_flow_num(const pq_tw_t *tw);
+int pq_tw_set_info(const pq_tw_t *tw, uint32_t i, int64_t *sts, int64_t *lts, uint32_t *sec, uint32_t *usec, uint32_t *cells);
+void pq_tw_coefficient(const pq_tw_t *tw, double *coef);
+
+// a query holds its result and scratch space, one per thread
+pq_tw_query_t *pq_tw_query_new(const pq_tw_t *tw);
+void pq_tw_query_free(pq_tw_query_t *q);
+// estimated packet number of the flows in [ts, te], returns the number
+// of flows, -1 when no set covers ts
+int64_t pq_tw_retrieve(pq_tw_query_t *q, int64_t ts, int64_t te);
+// the first K flows of the result (K = 0: all), estimate descending;
+// flow ID = src_ip << 32 | dst_ip. Returns the number of flows copied.
+uint32_t pq_tw_result(const pq_tw_query_t *q, uint32_t K, uint64_t *fid, int64_t *est);
+// sets the query falls in and the query cut per set, at most cap of them
+// copied; window_id: the window holding most flows. Returns the number
+// of sets.
+uint32_t pq_tw_result_sets(const pq_tw_query_t *q, uint32_t cap, uint32_t *set, int64_t *start, int64_t *end, int *window_id);
+
+//----------------------------------------------------------------------
+// Queue monitor: stacks of the snapshots of a port and the flows in the
+// queue during intervals (wall clock, us)
+//----------------------------------------------------------------------
+typedef struct pq_qm pq_qm_t;
+typedef struct pq_qm_query pq_qm_query_t;
+
+// dir: the folder of the snapshots, as QueueMonitor. NULL on error
+pq_qm_t *pq_qm_open(const char *dir, uint32_t max_qdepth, uint32_t threads);
+void pq_qm_close(pq_qm_t *qm);
+uint32_t pq_qm_snapshot_num(const pq_qm_t *qm);
+uint32_t pq_qm_flow_num(const pq_qm_t *qm);
+// interval: -1 if not logged in qm_meta.csv
+int pq_qm_snapshot_info(const pq_qm_t *qm, uint32_t i, uint32_t *sec, uint32_t *usec, uint32_t *wrap,
+                        int64_t *interval, uint32_t *qdepth, uint32_t *depth);
+// stack of snapshot i, bottom to top, at most cap entries copied; seq
+// with the overflows. Returns the depth of the stack.
+uint32_t pq_qm_stack(const pq_qm_t *qm, uint32_t i, uint32_t cap, uint32_t *index, uint64_t *fid, int64_t *seq);
+
+pq_qm_query_t *pq_qm_query_new(const pq_qm_t *qm);
+void pq_qm_query_free(pq_qm_query_t *q);
+// flows in the queue during [t1, t2], returns the number of flows, -1
+// when no snapshot is written by t2
+int64_t pq_qm_occupancy(pq_qm_query_t *q, int64_t t1, int64_t t2);
+// the first K flows of the result (K = 0: all), entries descending.
+// Returns the number of flows copied.
+uint32_t pq_qm_result(const pq_qm_query_t *q, uint32_t K, uint64_t *fid, uint32_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
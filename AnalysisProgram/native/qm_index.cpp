@@ -0,0 +1,249 @@
+/*************************************************************************
+	> File Name: qm_index.cpp
+  > Description: Queue stacks reconstructed from the queue monitor
+  >              snapshots of a port and occupancy queries over them
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "qm_index.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+namespace pq {
+
+struct QmFile {
+  uint32_t sec, usec;
+  bool wrap;
+  std::string name;
+};
+
+// the slots of a snapshot that hold a packet, by index
+struct QmDecoded {
+  int ret = 0;
+  std::vector<uint32_t> index;
+  std::vector<uint64_t> fid;
+  std::vector<uint32_t> seq;
+};
+
+//----------------------------------------------------------------------
+// Snapshots hold the live prefix of the stack, [src x n][dst x n][seq x n]
+// with n = file size / 12 (at most max_qdepth, as poll_registers), the
+// slots beyond are empty. Empty slots (flow ID 0) are dropped here:
+// registers are reset after every read, most of them are.
+//----------------------------------------------------------------------
+static void decode(const QmFile &f, uint32_t max_qdepth, QmDecoded &s){
+  MappedFile m;
+  if (m.map(f.name.c_str()) < 0){
+    s.ret = -1;
+    return;
+  }
+  uint32_t n = std::min<size_t>(m.size / 12, max_qdepth);
+  const uint32_t *src = (const uint32_t *)m.data, *dst = src + n, *seq = src + 2 * n;
+  s.index.resize(n);
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < n; i++){
+    s.index[num] = i;
+    num += (src[i] | dst[i]) != 0;
+  }
+  s.index.resize(num);
+  s.fid.resize(num);
+  s.seq.resize(num);
+  for (uint32_t j = 0; j < num; j++){
+    uint32_t i = s.index[j];
+    s.fid[j] = (uint64_t)src[i] << 32 | dst[i];
+    s.seq[j] = seq[i];
+  }
+}
+
+//----------------------------------------------------------------------
+// load_intervals: qm_meta.csv in the parent folder of dir, lines
+// "ts_sec ts_usec interval_us entries stack_top" after a header
+//----------------------------------------------------------------------
+static void load_intervals(const char *dir, std::map<std::pair<uint32_t, uint32_t>, int64_t> &m){
+  std::string d(dir);
+  while (d.size() > 1 && d.back() == '/'){
+    d.pop_back();
+  }
+  size_t pos = d.rfind('/');
+  std::string meta = pos == std::string::npos ? "qm_meta.csv" : d.substr(0, pos == 0 ? 1 : pos) + "/qm_meta.csv";
+  FILE *f = fopen(meta.c_str(), "r");
+  if (f == NULL){
+    return;
+  }
+  char line[256];
+  if (fgets(line, sizeof(line), f) != NULL){
+    while (fgets(line, sizeof(line), f) != NULL){
+      unsigned int sec, usec;
+      long interval;
+      if (sscanf(line, "%u %u %ld", &sec, &usec, &interval) == 3){
+        m[std::make_pair(sec, usec)] = interval;
+      }
+    }
+  }
+  fclose(f);
+}
+
+//----------------------------------------------------------------------
+// filter_QM, a snapshot after the other. With cur the seq of the last
+// slot taken (never reset), a slot is valid when it holds a flow and its
+// seq + wrap << 32 is larger than cur:
+//   * the stack is kept below the first valid slot at or under its top,
+//     or whole if there is none
+//   * from there, the valid slots are pushed, cur growing
+//   * a snapshot without any flow empties the stack
+//----------------------------------------------------------------------
+int QmIndex::open(const char *dir, uint32_t max_qdepth, uint32_t threads){
+  std::vector<QmFile> files;
+  this->max_qdepth = max_qdepth;
+  snaps.clear();
+  entries.clear();
+  flows.clear();
+  DIR *dp = opendir(dir);
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", dir);
+    return -1;
+  }
+  struct dirent *e;
+  while ((e = readdir(dp)) != NULL){
+    QmFile f;
+    unsigned int c;
+    char ext[16];
+    if (sscanf(e->d_name, "%u_%u_%u.%15s", &f.sec, &f.usec, &c, ext) != 4 || strcmp(ext, "bin") != 0){
+      continue;
+    }
+    f.wrap = c == 1;
+    f.name = std::string(dir) + "/" + e->d_name;
+    files.push_back(f);
+  }
+  closedir(dp);
+  std::sort(files.begin(), files.end(), [](const QmFile &x, const QmFile &y){
+    return x.sec != y.sec ? x.sec < y.sec : x.usec < y.usec;
+  });
+  std::map<std::pair<uint32_t, uint32_t>, int64_t> intervals;
+  load_intervals(dir, intervals);
+
+  std::vector<QmDecoded> dec(files.size());
+  parallel_for(files.size(), threads, [&](size_t i, uint32_t){
+    decode(files[i], max_qdepth, dec[i]);
+  });
+
+  std::unordered_map<uint64_t, uint32_t> flow_ids;
+  int64_t cur = -1;
+  uint32_t wrap = 0, top = QM_NONE, depth = 0;
+  for (size_t i = 0; i < files.size(); i++){
+    QmDecoded &s = dec[i];
+    if (s.ret < 0){
+      return -1;
+    }
+    wrap += files[i].wrap;
+    QmSnapshot snap;
+    snap.sec = files[i].sec;
+    snap.usec = files[i].usec;
+    snap.wrap = wrap;
+    auto it = intervals.find(std::make_pair(snap.sec, snap.usec));
+    snap.interval = it == intervals.end() ? -1 : it->second;
+    snap.first = entries.size();
+    if (s.index.empty()){
+      top = QM_NONE;
+      depth = 0;
+    }else{
+      int64_t w = (int64_t)wrap << 32;
+      int64_t last = top == QM_NONE ? -1 : entries[top].index;
+      size_t j = 0;
+      int64_t start = last + 1;
+      for (; j < s.index.size() && s.index[j] <= last; j++){
+        if (s.seq[j] + w > cur){
+          start = s.index[j];
+          break;
+        }
+      }
+      while (top != QM_NONE && entries[top].index >= start){
+        top = entries[top].below;
+        depth--;
+      }
+      for (; j < s.index.size(); j++){
+        if (s.seq[j] + w <= cur){
+          continue;
+        }
+        cur = s.seq[j] + w;
+        auto f = flow_ids.emplace(s.fid[j], flows.size());
+        if (f.second){
+          flows.push_back(s.fid[j]);
+        }
+        entries.push_back(QmEntry{s.index[j], f.first->second, top, cur});
+        top = entries.size() - 1;
+        depth++;
+      }
+    }
+    snap.top = top;
+    snap.depth = depth;
+    snap.qdepth = top == QM_NONE ? 0 : entries[top].index;
+    snaps.push_back(snap);
+    s = QmDecoded();
+  }
+  return 0;
+}
+
+int64_t QmIndex::find(int64_t t) const {
+  auto it = std::upper_bound(snaps.begin(), snaps.end(), t, [](int64_t t, const QmSnapshot &s){
+    return t < (int64_t)s.sec * 1000000 + s.usec;
+  });
+  return (it - snaps.begin()) - 1;
+}
+
+void QmIndex::stack(uint32_t s, std::vector<uint32_t> &e) const {
+  e.clear();
+  for (uint32_t x = snaps[s].top; x != QM_NONE; x = entries[x].below){
+    e.push_back(x);
+  }
+  std::reverse(e.begin(), e.end());
+}
+
+int64_t qm_occupancy(const QmIndex &x, int64_t t1, int64_t t2, QmQuery &q){
+  for (uint32_t f : q.order){
+    q.count[f] = 0;
+  }
+  q.order.clear();
+  q.last = x.find(t2);
+  if (q.last < 0){
+    q.first = -1;
+    return -1;
+  }
+  q.first = std::min(x.find(t1), q.last);
+  if (q.count.size() < x.flows.size()){
+    q.count.assign(x.flows.size(), 0);
+  }
+  auto add = [&](uint32_t e){
+    uint32_t f = x.entries[e].flow;
+    if (q.count[f]++ == 0){
+      q.order.push_back(f);
+    }
+  };
+  // the stack in force at t1, then the pushes until t2
+  size_t from = 0, to = q.last + 1 < (int64_t)x.snaps.size() ? x.snaps[q.last + 1].first : x.entries.size();
+  if (q.first >= 0){
+    x.stack(q.first, q.e);
+    for (uint32_t e : q.e){
+      add(e);
+    }
+    from = q.first + 1 < (int64_t)x.snaps.size() ? x.snaps[q.first + 1].first : x.entries.size();
+  }else{
+    q.first = 0;
+  }
+  for (size_t e = from; e < to; e++){
+    add(e);
+  }
+  std::stable_sort(q.order.begin(), q.order.end(), [&](uint32_t a, uint32_t b){
+    return q.count[a] > q.count[b];
+  });
+  return q.order.size();
+}
+
+}
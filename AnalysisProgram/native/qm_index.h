@@ -0,0 +1,77 @@
+/*************************************************************************
+	> File Name: qm_index.h
+  > Description: Queue stacks reconstructed from the queue monitor
+  >              snapshots of a port (filter_QM of QueueMonitor.py) and
+  >              occupancy queries over them
+*************************************************************************/
+
+#ifndef _PQ_QM_INDEX_H_
+#define _PQ_QM_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace pq {
+
+#define QM_NONE UINT32_MAX
+
+// a snapshot <sec>_<usec>_<overflow>.bin and the stack after it
+struct QmSnapshot {
+  uint32_t sec, usec;
+  uint32_t wrap;                // overflows of the seq number so far
+  int64_t interval;             // reading interval after it (qm_meta.csv), -1 if not logged
+  uint32_t top;                 // entry on top of the stack, QM_NONE if empty
+  uint32_t depth;               // entries in the stack
+  uint32_t qdepth;              // slot of the top entry, 0 if empty
+  uint32_t first;               // entries pushed by the snapshot: [first, first of the next)
+};
+
+// a valid slot, pushed once and shared by the stacks that keep it
+struct QmEntry {
+  uint32_t index;               // slot
+  uint32_t flow;                // dense id
+  uint32_t below;               // entry under it, QM_NONE at the bottom
+  int64_t seq;                  // seq + wrap << 32
+};
+
+//----------------------------------------------------------------------
+// The stacks of all snapshots as one persistent stack: a snapshot keeps
+// the entries of the previous stack below its first newer slot and
+// pushes its own valid slots, so only the slots it holds are visited
+// and the stack of any snapshot is its top entry followed downwards.
+//----------------------------------------------------------------------
+class QmIndex {
+public:
+  uint32_t max_qdepth = 25000;
+  std::vector<QmSnapshot> snaps;
+  std::vector<QmEntry> entries;
+  std::vector<uint64_t> flows;          // dense id -> src_ip << 32 | dst_ip
+
+  // dir: the folder of the snapshots, as QueueMonitor; qm_meta.csv is
+  // read from its parent. Decoded on threads threads (0: one per core)
+  int open(const char *dir, uint32_t max_qdepth = 25000, uint32_t threads = 0);
+  // last snapshot written at or before t (us), -1 if none
+  int64_t find(int64_t t) const;
+  // entries of the stack of snapshot s, bottom to top
+  void stack(uint32_t s, std::vector<uint32_t> &e) const;
+};
+
+//----------------------------------------------------------------------
+// Result and scratch space of a query, one per querying thread
+//----------------------------------------------------------------------
+struct QmQuery {
+  int64_t first = -1, last = -1;                // snapshots of the query
+  std::vector<uint32_t> order;                  // flows, entries descending
+  std::vector<uint32_t> count;                  // entries per dense id
+  std::vector<uint32_t> e;
+};
+
+// flows in the queue during [t1, t2] (us): the entries of the stack in
+// force at t1 and those pushed until t2, counted per flow, equal numbers
+// in the order of the stack. Returns the number of flows, -1 when no
+// snapshot is written by t2.
+int64_t qm_occupancy(const QmIndex &x, int64_t t1, int64_t t2, QmQuery &q);
+
+}
+
+#endif
@@ -0,0 +1,285 @@
+/*************************************************************************
+	> File Name: sketch.cpp
+  > Description: Count-Min, HashPipe and FlowRadar of the comparison
+  >              (TimeWindows.py), with the same hash functions
+*************************************************************************/
+
+#include <functional>
+
+#include "sketch.h"
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// crcmod.mkCrcFun(poly, rev, initCrc, xorOut): the register starts at
+// initCrc ^ xorOut and the result is xored with xorOut. Both directions
+// are one table lookup per byte,
+//   reflected: crc = table[(b ^ crc) & 0xff] ^ (crc >> 8)
+//   normal:    crc = table[(b ^ crc >> 8) & 0xff] ^ (crc << 8)
+// written as the same shifts so that the eight run side by side.
+//----------------------------------------------------------------------
+struct CrcDef {
+  uint32_t poly;
+  bool rev;
+  uint16_t init, xor_out;
+};
+
+static const CrcDef crc_defs[SKETCH_HASH_NUM] = {
+    {0x18005, true, 0x0000, 0x0000},            // crc16
+    {0x18005, true, 0x0000, 0xFFFF},            // crc16_usb
+    {0x11021, false, 0x0000, 0xFFFF},           // crc16_genibus
+    {0x18005, false, 0x0000, 0x0000},           // crc16_buypass
+    {0x10589, false, 0x0001, 0x0001},           // crc16_dect
+    {0x13d65, true, 0xFFFF, 0xFFFF},            // crc16_dnp
+    {0x18005, true, 0xFFFF, 0xFFFF},            // crc16_maxim
+    {0x18005, false, 0x800d, 0x0000},           // crc16_dds_110
+};
+
+struct CrcTables {
+  uint16_t table[SKETCH_HASH_NUM][256];
+  uint16_t start[SKETCH_HASH_NUM], xor_out[SKETCH_HASH_NUM];
+  uint8_t in_shift[SKETCH_HASH_NUM], right[SKETCH_HASH_NUM], left[SKETCH_HASH_NUM];
+
+  CrcTables(){
+    for (int i = 0; i < SKETCH_HASH_NUM; i++){
+      const CrcDef &d = crc_defs[i];
+      uint16_t poly = d.poly & 0xFFFF;
+      if (d.rev){
+        uint16_t r = 0;
+        for (int b = 0; b < 16; b++){
+          r |= ((poly >> b) & 1) << (15 - b);
+        }
+        poly = r;
+      }
+      for (uint32_t v = 0; v < 256; v++){
+        uint16_t c = d.rev ? v : v << 8;
+        for (int b = 0; b < 8; b++){
+          if (d.rev){
+            c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+          }else{
+            c = (c & 0x8000) ? (c << 1) ^ poly : c << 1;
+          }
+        }
+        table[i][v] = c;
+      }
+      start[i] = d.init ^ d.xor_out;
+      xor_out[i] = d.xor_out;
+      in_shift[i] = d.rev ? 0 : 8;
+      right[i] = d.rev ? 8 : 0;
+      left[i] = d.rev ? 0 : 8;
+    }
+  }
+};
+
+static const CrcTables &crc_tables(void){
+  static const CrcTables t;
+  return t;
+}
+
+void sketch_hash(uint64_t fid, uint16_t *h){
+  sketch_hash_batch(&fid, 1, h);
+}
+
+void sketch_hash_batch(const uint64_t *fid, size_t n, uint16_t *h){
+  const CrcTables &t = crc_tables();
+  for (size_t f = 0; f < n; f++){
+    uint16_t c[SKETCH_HASH_NUM];
+    for (int i = 0; i < SKETCH_HASH_NUM; i++){
+      c[i] = t.start[i];
+    }
+    // bytearray.fromhex of the flow ID: big endian
+    for (int b = 7; b >= 0; b--){
+      uint8_t x = fid[f] >> (8 * b);
+      for (int i = 0; i < SKETCH_HASH_NUM; i++){
+        c[i] = t.table[i][(x ^ (c[i] >> t.in_shift[i])) & 0xFF] ^ (uint16_t)((c[i] >> t.right[i]) << t.left[i]);
+      }
+    }
+    for (int i = 0; i < SKETCH_HASH_NUM; i++){
+      h[f * SKETCH_HASH_NUM + i] = c[i] ^ t.xor_out[i];
+    }
+  }
+}
+
+void sketch_sort(SketchResult &r){
+  std::stable_sort(r.begin(), r.end(), [](const std::pair<uint32_t, int64_t> &x, const std::pair<uint32_t, int64_t> &y){
+    return x.second > y.second;
+  });
+}
+
+void CountMin::init(uint32_t rows, uint32_t cols){
+  this->rows = rows;
+  this->cols = cols;
+  c.assign((size_t)rows * cols, 0);
+}
+
+void HashPipe::init(uint32_t stages, uint32_t cells){
+  this->stages = stages;
+  this->cells = cells;
+  flow.assign((size_t)stages * cells, UINT32_MAX);
+  n.assign((size_t)stages * cells, 0);
+}
+
+void HashPipe::add(uint32_t f, const uint16_t *hashes){
+  uint32_t idx = hashes[f * SKETCH_HASH_NUM] % cells;
+  if (flow[idx] == UINT32_MAX || flow[idx] == f){
+    flow[idx] = f;
+    n[idx]++;
+    return;
+  }
+  // the new flow always takes the cell of the first stage
+  uint32_t swap_f = flow[idx];
+  int64_t swap_n = n[idx];
+  flow[idx] = f;
+  n[idx] = 1;
+  for (uint32_t i = 1; i < stages; i++){
+    idx = i * cells + hashes[swap_f * SKETCH_HASH_NUM + i] % cells;
+    if (flow[idx] == UINT32_MAX || flow[idx] == swap_f){
+      flow[idx] = swap_f;
+      n[idx] += swap_n;
+      break;
+    }
+    if (n[idx] < swap_n){
+      std::swap(flow[idx], swap_f);
+      std::swap(n[idx], swap_n);
+    }
+  }
+}
+
+void HashPipe::result(SketchResult &r, std::vector<int64_t> &scratch) const {
+  r.clear();
+  for (size_t i = 0; i < flow.size(); i++){
+    uint32_t f = flow[i];
+    if (f == UINT32_MAX){
+      continue;
+    }
+    if (scratch.size() <= f){
+      scratch.resize(f + 1, 0);
+    }
+    // position + 1 of the flow in r
+    if (scratch[f] == 0){
+      r.push_back(std::make_pair(f, 0));
+      scratch[f] = r.size();
+    }
+    r[scratch[f] - 1].second += n[i];
+  }
+  for (auto &x : r){
+    scratch[x.first] = 0;
+  }
+  sketch_sort(r);
+}
+
+void FlowRadar::init(uint32_t cells){
+  this->cells = cells;
+  bit.assign(cells, 0);
+  fn.assign(cells, 0);
+  pn.assign(cells, 0);
+  fid_xor.assign(cells, 0);
+}
+
+void FlowRadar::add(uint64_t fid, const uint16_t *h, int64_t n){
+  uint32_t p[hash_num];
+  int sum = 0;
+  for (int j = 0; j < hash_num; j++){
+    p[j] = h[j] % cells;
+  }
+  for (int j = 0; j < hash_num; j++){
+    sum += bit[p[j]];
+    bit[p[j]] = 1;
+  }
+  if (sum == hash_num){
+    // taken as an old flow
+    for (int j = 0; j < hash_num; j++){
+      pn[p[j]] += n;
+    }
+    return;
+  }
+  for (int j = 0; j < hash_num; j++){
+    fn[p[j]]++;
+    pn[p[j]] += n;
+    fid_xor[p[j]] ^= fid;
+  }
+}
+
+//----------------------------------------------------------------------
+// Flow_Radar sweeps all cells until no one holds a single flow. The same
+// peeling order is kept with a work queue: a cell left with one flow
+// after the sweep has passed it waits for the next sweep (next), one
+// ahead of the sweep is taken in this one (heap, by index). A cell is
+// taken at most once per sweep; one whose flow does not hash back to it
+// (where Flow_Radar never stops) is left.
+//----------------------------------------------------------------------
+void FlowRadar::decode(const std::unordered_map<uint64_t, uint32_t> &ids, const std::vector<uint16_t> &hashes,
+                       std::unordered_map<uint64_t, uint32_t> &extra, SketchResult &r){
+  r.clear();
+  next.clear();
+  sweep.assign(cells, 0);
+  for (uint32_t i = 0; i < cells; i++){
+    if (fn[i] == 1){
+      next.push_back(i);
+    }
+  }
+  uint32_t s = 0;
+  while (!next.empty()){
+    s++;
+    heap.swap(next);
+    next.clear();
+    for (uint32_t i : heap){
+      sweep[i] = s;
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+    while (!heap.empty()){
+      std::pop_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+      uint32_t i = heap.back();
+      heap.pop_back();
+      if (fn[i] != 1){
+        continue;
+      }
+      uint64_t fid = fid_xor[i];
+      uint32_t f;
+      const uint16_t *h;
+      uint16_t tmp[SKETCH_HASH_NUM];
+      auto it = ids.find(fid);
+      if (it != ids.end()){
+        f = it->second;
+        h = hashes.data() + (size_t)f * SKETCH_HASH_NUM;
+      }else{
+        f = extra.emplace(fid, ids.size() + extra.size()).first->second;
+        sketch_hash(fid, tmp);
+        h = tmp;
+      }
+      if (pos.size() <= f){
+        pos.resize(f + 1, 0);
+      }
+      // a flow decoded again keeps its place with the new number
+      if (pos[f] == 0){
+        r.push_back(std::make_pair(f, 0));
+        pos[f] = r.size();
+      }
+      r[pos[f] - 1].second = pn[i];
+      for (int j = 0; j < hash_num; j++){
+        uint32_t idx = h[j] % cells;
+        fn[idx]--;
+        pn[idx] -= pn[i];
+        fid_xor[idx] ^= fid;
+        if (fn[idx] == 1){
+          if (idx > i && sweep[idx] != s){
+            sweep[idx] = s;
+            heap.push_back(idx);
+            std::push_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+          }else if (idx <= i){
+            next.push_back(idx);
+          }
+        }
+      }
+    }
+    // a cell may wait twice for the next sweep
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+  }
+  for (auto &x : r){
+    pos[x.first] = 0;
+  }
+  sketch_sort(r);
+}
+
+}
@@ -0,0 +1,99 @@
+/*************************************************************************
+	> File Name: sketch.h
+  > Description: Count-Min, HashPipe and FlowRadar of the comparison
+  >              (TimeWindows.py), with the same hash functions
+*************************************************************************/
+
+#ifndef _PQ_SKETCH_H_
+#define _PQ_SKETCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// HashFunction of TimeWindows.py: eight CRC-16 (crcmod) of the flow ID,
+// the 8 bytes of src_ip, dst_ip. Values of a flow are kept side by side,
+// h[i] of flow f at f * SKETCH_HASH_NUM + i.
+//----------------------------------------------------------------------
+#define SKETCH_HASH_NUM 8
+
+void sketch_hash(uint64_t fid, uint16_t *h);
+// n flows at once, the eight CRCs of a flow side by side
+void sketch_hash_batch(const uint64_t *fid, size_t n, uint16_t *h);
+
+// flows of a sketch result, in order, with their packet numbers
+typedef std::vector<std::pair<uint32_t, int64_t>> SketchResult;
+
+// number descending, equal ones kept in order, as sorted() of Python
+void sketch_sort(SketchResult &r);
+
+//----------------------------------------------------------------------
+// Count_Min: rows x cols counters (cols a power of 2), row i indexed by
+// h[i] & (cols - 1). Flows are added with their packet numbers.
+//----------------------------------------------------------------------
+struct CountMin {
+  uint32_t rows = 0, cols = 0;
+  std::vector<uint32_t> c;
+
+  void init(uint32_t rows, uint32_t cols);
+  void add(const uint16_t *h, int64_t n){
+    for (uint32_t i = 0; i < rows; i++){
+      c[i * cols + (h[i] & (cols - 1))] += n;
+    }
+  }
+  int64_t query(const uint16_t *h) const {
+    uint32_t m = c[h[0] & (cols - 1)];
+    for (uint32_t i = 1; i < rows; i++){
+      m = std::min(m, c[i * cols + (h[i] & (cols - 1))]);
+    }
+    return m;
+  }
+};
+
+//----------------------------------------------------------------------
+// hash_pipe: stages x cells, stage i indexed by h[i] % cells. Packets
+// are added one by one in dequeue order; flows are dense ids, hashes the
+// table of all flows.
+//----------------------------------------------------------------------
+struct HashPipe {
+  uint32_t stages = 0, cells = 0;
+  std::vector<uint32_t> flow;                   // UINT32_MAX: empty
+  std::vector<int64_t> n;
+
+  void init(uint32_t stages, uint32_t cells);
+  void add(uint32_t f, const uint16_t *hashes);
+  // flows of the cells, stage by stage, summed
+  void result(SketchResult &r, std::vector<int64_t> &scratch) const;
+};
+
+//----------------------------------------------------------------------
+// Flow_Radar: cells counting cells with 3 hashes, h[i] % cells, behind
+// a Bloom filter of the same cells. Flows are added once each, with their
+// packet numbers.
+//----------------------------------------------------------------------
+struct FlowRadar {
+  static const int hash_num = 3;
+  uint32_t cells = 0;
+  std::vector<uint8_t> bit;
+  std::vector<int64_t> fn, pn;
+  std::vector<uint64_t> fid_xor;
+  std::vector<uint32_t> pos, heap, next, sweep;
+
+  void init(uint32_t cells);
+  void add(uint64_t fid, const uint16_t *h, int64_t n);
+  // peels the cells of one flow. Decoded flows are the dense ids of ids,
+  // hashes their table; other flow IDs (collisions) are given ids from
+  // ids.size() on, kept in extra.
+  void decode(const std::unordered_map<uint64_t, uint32_t> &ids, const std::vector<uint16_t> &hashes,
+              std::unordered_map<uint64_t, uint32_t> &extra, SketchResult &r);
+};
+
+}
+
+#endif
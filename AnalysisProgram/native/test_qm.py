@@ -0,0 +1,91 @@
+'''
+File Description:
+    Checks the queue stacks of the native index (QueueMonitorIndex, pqnative.py) against QueueMonitor.filter_QM on
+    a fixed sequence of generated queue monitor snapshots: live prefixes with stale slots above the stack top, full
+    snapshots, empty ones and an overflow of the seq number. Run by make test, after libpqnative.
+'''
+import os
+import random
+import shutil
+import struct
+import sys
+import tempfile
+
+sys.path.insert(1, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+from QueueMonitor import QueueMonitor
+from pqnative import QueueMonitorIndex
+
+MAX_QDEPTH = 256
+MARGIN = 8
+
+
+def write_snapshots(path, seed=7, num=60):
+    """
+    stack of the data plane: an enqueued packet takes the slot on top with the next seq number, a dequeued one
+    frees it but leaves its values; every snapshot reads the slots below the top + MARGIN, or all of them
+    :return: number of snapshots written
+    """
+    rnd = random.Random(seed)
+    src = [0] * MAX_QDEPTH
+    dst = [0] * MAX_QDEPTH
+    seq = [0] * MAX_QDEPTH
+    top = 0
+    next_seq = (1 << 32) - 300
+    for i in range(num):
+        overflow = 0
+        if i % 17 == 5:
+            # idle period: the queue drains
+            top = 0
+        else:
+            for _ in range(rnd.randrange(0, 40)):
+                if rnd.random() < 0.55 and top < MAX_QDEPTH:
+                    src[top] = 0x0a000001 + rnd.randrange(8)
+                    dst[top] = 0x0a010001
+                    seq[top] = next_seq & 0xffffffff
+                    next_seq += 1
+                    if next_seq & 0xffffffff == 0:
+                        overflow = 1
+                    top += 1
+                elif top > 0:
+                    top -= 1
+        count = MAX_QDEPTH if i % 7 == 3 else min(top + MARGIN, MAX_QDEPTH)
+        if i % 13 == 8:
+            count = 0
+        name = os.path.join(path, '{0}_{1}_{2}.bin'.format(100 + i // 10, (i % 10) * 100000, overflow))
+        with open(name, 'wb') as f:
+            for column in (src, dst, seq):
+                f.write(struct.pack('<{0}I'.format(count), *column[:count]))
+    return num
+
+
+def main():
+    tmp = tempfile.mkdtemp(prefix='pq_test_qm.')
+    failures = 0
+    try:
+        path = os.path.join(tmp, 'qm_data')
+        os.mkdir(path)
+        num = write_snapshots(path)
+        expected = QueueMonitor(path, max_qdepth=MAX_QDEPTH).QM_result
+        index = QueueMonitorIndex(path, max_qdepth=MAX_QDEPTH, threads=2)
+        if len(expected) != num or len(index.QM_snapshots) != num:
+            print('FAIL: {0} stacks of filter_QM, {1} of the native index, {2} snapshots'.format(
+                len(expected), len(index.QM_snapshots), num))
+            failures += 1
+        for i in range(min(len(expected), len(index.QM_snapshots))):
+            stack = index.stack(i)
+            want = [(e['index'], e['FID'], e['seq']) for e in expected[i]['QM_result']]
+            got = [(e['index'], e['FID'], e['seq']) for e in stack['QM_result']]
+            if stack['ts'] != expected[i]['ts'] or stack['qdepth'] != expected[i]['qdepth'] or got != want:
+                print('FAIL: snapshot {0} {1}: qdepth {2}, {3} entries, filter_QM {4}, qdepth {5}, {6} entries'.format(
+                    i, stack['ts'], stack['qdepth'], len(got), expected[i]['ts'], expected[i]['qdepth'], len(want)))
+                failures += 1
+        depth = max(len(s['QM_result']) for s in expected)
+        print('qm stacks: {0} snapshots, deepest stack {1} entries'.format(num, depth))
+    finally:
+        shutil.rmtree(tmp)
+    print('{0}: {1} failures'.format('FAIL' if failures else 'PASS', failures))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,293 @@
+/*************************************************************************
+	> File Name: tw_index.cpp
+  > Description: Interval index over the time windows sets of a port and
+  >              culprit queries
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+
+#include "tw_index.h"
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// calculate_coefficient of TimeWindows.py: share of the packets of a
+// cycle that window i keeps
+//----------------------------------------------------------------------
+std::vector<double> tw_coefficient(double z, int alpha, int T){
+  std::vector<double> c(1, 1.0);
+  double co = 1;
+  for (int i = 0; i < T - 1; i++){
+    double p = 1 - z * z;
+    double map = (double)(1 << alpha);
+    co *= z * (1 - pow(p, map)) / (1 - p) / map;
+    c.push_back(co);
+    z = 1 - pow(p, map);
+  }
+  return c;
+}
+
+//----------------------------------------------------------------------
+// Store written by pq_ingest, the columns are used in place
+//----------------------------------------------------------------------
+int TwIndex::open_store(const char *file){
+  if (store.map(file) < 0){
+    return -1;
+  }
+  pq_tw_store_header_t h;
+  if (store.size < sizeof(h)){
+    printf("Error: %s is not a TW store!\n", file);
+    return -1;
+  }
+  memcpy(&h, store.data, sizeof(h));
+  if (h.magic != PQ_TW_STORE_MAGIC || h.version != PQ_TW_STORE_VERSION || h.header_size != sizeof(h) || h.size != store.size){
+    printf("Error: %s is not a TW store of this version!\n", file);
+    return -1;
+  }
+  if (h.k != p.k || h.T != p.T || h.alpha != p.alpha || h.tb0 != p.tb0){
+    printf("Error: %s is captured with k=%d, T=%d, alpha=%d, TW0_TB=%d!\n", file, h.k, h.T, h.alpha, h.tb0);
+    return -1;
+  }
+  // expected length of the sections, 0: a multiple of the element
+  const uint64_t len[PQ_TW_SEC_NUM] = {
+    (uint64_t)h.set_num * sizeof(TwSet), (uint64_t)h.flow_num * sizeof(uint64_t),
+    h.cell_num * sizeof(int64_t), h.cell_num * sizeof(uint32_t), h.cell_num * sizeof(uint32_t), h.cell_num,
+    (uint64_t)h.set_num * sizeof(int32_t), ((uint64_t)h.set_num + 1) * sizeof(uint64_t),
+    (uint64_t)h.canon_num * sizeof(uint32_t), (uint64_t)h.set_num * sizeof(int32_t), 0, 0, 0};
+  const uint64_t elem[PQ_TW_SEC_NUM] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, sizeof(TwEntry), sizeof(TwBlock), sizeof(TwBlock)};
+  for (int i = 0; i < PQ_TW_SEC_NUM; i++){
+    if (h.off[i] % PQ_TW_STORE_ALIGN != 0 || h.off[i] > h.size || h.len[i] > h.size - h.off[i]
+        || (len[i] != 0 ? h.len[i] != len[i] : h.len[i] % elem[i] != 0)){
+      printf("Error: section %d of %s is corrupted!\n", i, file);
+      return -1;
+    }
+  }
+  sets = (const TwSet *)(store.data + h.off[PQ_TW_SEC_SETS]);
+  set_num = h.set_num;
+  flows = (const uint64_t *)(store.data + h.off[PQ_TW_SEC_FLOWS]);
+  flow_num = h.flow_num;
+  cell_ts = (const int64_t *)(store.data + h.off[PQ_TW_SEC_TS]);
+  cell_flow = (const uint32_t *)(store.data + h.off[PQ_TW_SEC_FLOW]);
+  cell_seq = (const uint32_t *)(store.data + h.off[PQ_TW_SEC_SEQ]);
+  cell_twid = store.data + h.off[PQ_TW_SEC_TWID];
+  cell_num = h.cell_num;
+  next = (const int32_t *)(store.data + h.off[PQ_TW_SEC_NEXT]);
+  sum_off = (const uint64_t *)(store.data + h.off[PQ_TW_SEC_SUM_OFF]);
+  canon = (const uint32_t *)(store.data + h.off[PQ_TW_SEC_CANON]);
+  canon_num = h.canon_num;
+  canon_pos = (const int32_t *)(store.data + h.off[PQ_TW_SEC_CANON_POS]);
+  entries = (const TwEntry *)(store.data + h.off[PQ_TW_SEC_ENTRIES]);
+  entry_num = h.len[PQ_TW_SEC_ENTRIES] / sizeof(TwEntry);
+  if (sum_off[set_num] > entry_num){
+    printf("Error: summaries of %s are corrupted!\n", file);
+    return -1;
+  }
+  for (int l = 0; l < PQ_TW_STORE_LEVELS; l++){
+    blocks[l] = (const TwBlock *)(store.data + h.off[PQ_TW_SEC_SECONDS + l]);
+    block_num[l] = h.len[PQ_TW_SEC_SECONDS + l] / sizeof(TwBlock);
+    for (uint32_t i = 0; i < block_num[l]; i++){
+      const TwBlock &b = blocks[l][i];
+      if (b.first == 0 || b.first > b.last || b.last >= canon_num || b.off > entry_num || b.num > entry_num - b.off){
+        printf("Error: rollups of %s are corrupted!\n", file);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int TwIndex::open(const char *path, const TwParams &params, uint32_t threads){
+  struct stat st;
+  p = params;
+  if (tw_params_check(p) < 0){
+    return -1;
+  }
+  coef = tw_coefficient(p.z, p.alpha, p.T);
+  if (stat(path, &st) == 0 && S_ISREG(st.st_mode)){
+    if (open_store(path) < 0){
+      return -1;
+    }
+  }else{
+    TwData d;
+    std::string dir = std::string(path) + "/tw_data";
+    if (tw_ingest(dir.c_str(), p, threads, d) < 0){
+      return -1;
+    }
+    return open(std::move(d), p);
+  }
+  tree.build(sets, set_num);
+  return 0;
+}
+
+int TwIndex::open(TwData &&d, const TwParams &params){
+  p = params;
+  if (tw_params_check(p) < 0){
+    return -1;
+  }
+  coef = tw_coefficient(p.z, p.alpha, p.T);
+  data = std::move(d);
+  sets = data.sets.data();
+  set_num = data.sets.size();
+  flows = data.flows.data();
+  flow_num = data.flows.size();
+  cell_ts = data.cell_ts.data();
+  cell_flow = data.cell_flow.data();
+  cell_seq = data.cell_seq.data();
+  cell_twid = data.cell_twid.data();
+  cell_num = data.cell_ts.size();
+  next = data.next.data();
+  sum_off = data.sum_off.data();
+  canon = data.canon.data();
+  canon_num = data.canon.size();
+  canon_pos = data.canon_pos.data();
+  entries = data.entries.data();
+  entry_num = data.entries.size();
+  for (int l = 0; l < PQ_TW_STORE_LEVELS; l++){
+    blocks[l] = data.blocks[l].data();
+    block_num[l] = data.blocks[l].size();
+  }
+  tree.build(sets, set_num);
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// retrieve of TimeWindowController:
+//   * the query starts in the first set holding ts. A query beyond the
+//     latest cell of the set is cut there and goes on from the next set
+//     holding max(lts, sts of the next set)
+//   * cells of a window are counted per flow, the estimate of a flow is
+//     the sum over the windows of int(N / coefficient). Summaries keep
+//     counts, not estimates, so that they add up exactly and z is
+//     chosen at query time.
+//   * flows are ordered as the dict of retrieve: stable sort on the
+//     estimate after each window, new flows appended in the order of
+//     their first cell
+//----------------------------------------------------------------------
+int64_t tw_retrieve(const TwIndex &idx, int64_t ts, int64_t te, TwQuery &q){
+  const int T = idx.p.T;
+  const size_t F = idx.flow_num;
+  q.sets.clear();
+  q.start.clear();
+  q.end.clear();
+  q.order.clear();
+  q.window_id = -1;
+  int64_t j = idx.find_set(0, ts);
+  if (j < 0){
+    return -1;
+  }
+  if (q.count.size() < T * F){
+    q.count.assign(T * F, 0);
+    q.first.assign(T * F, 0);
+  }
+  if (q.est.size() < F){
+    q.est.assign(F, 0);
+    q.in_result.assign(F, 0);
+  }
+  q.touched.resize(T);
+  auto add = [&q, F](uint32_t w, uint32_t f, uint32_t count, uint32_t seq){
+    size_t x = w * F + f;
+    if (q.count[x] == 0){
+      q.touched[w].push_back(f);
+      q.first[x] = seq;
+    }else if (seq < q.first[x]){
+      q.first[x] = seq;
+    }
+    q.count[x] += count;
+  };
+  auto add_entries = [&](uint64_t off, uint64_t num){
+    for (const TwEntry *e = idx.entries + off, *end = e + num; e < end; e++){
+      add(e->twid, e->flow, e->count, e->first);
+    }
+  };
+  // the set of the first cut is counted from its cells, a set ending
+  // before te from the summary of the set before it: all of its cells
+  // from the start of its cut on
+  int64_t prev = -1;
+  while (j >= 0){
+    const TwSet &s = idx.sets[j];
+    q.sets.push_back(j);
+    q.start.push_back(ts);
+    q.end.push_back(std::min(te, s.lts));
+    if (prev >= 0 && te > s.lts && q.use_summary){
+      add_entries(idx.sum_off[prev], idx.sum_off[prev + 1] - idx.sum_off[prev]);
+    }else{
+      const int64_t *b = idx.cell_ts + s.off, *e = b + s.num;
+      uint32_t lo = std::lower_bound(b, e, ts) - idx.cell_ts;
+      uint32_t hi = std::upper_bound(b, e, q.end.back()) - idx.cell_ts;
+      for (uint32_t c = lo; c < hi; c++){
+        add(idx.cell_twid[c], idx.cell_flow[c], 1, idx.cell_seq[c]);
+      }
+    }
+    if (te <= s.lts || (uint32_t)j + 1 == idx.set_num){
+      break;
+    }
+    // a rollup of the sets after j along canon, all ending before te
+    int32_t pos = idx.canon_pos[j];
+    for (int l = PQ_TW_STORE_LEVELS - 1; l >= 0 && q.use_summary && pos >= 0; l--){
+      const TwBlock *bb = idx.blocks[l], *be = bb + idx.block_num[l];
+      const TwBlock *r = std::lower_bound(bb, be, (uint32_t)pos + 1, [](const TwBlock &x, uint32_t v){
+        return x.first < v;
+      });
+      if (r == be || r->first != (uint32_t)pos + 1 || idx.sets[idx.canon[r->last]].lts >= te){
+        continue;
+      }
+      for (uint32_t c = r->first; c <= r->last; c++){
+        const TwSet &t = idx.sets[idx.canon[c - 1]];
+        q.sets.push_back(idx.canon[c]);
+        q.start.push_back(std::max(t.lts, idx.sets[idx.canon[c - 1] + 1].sts));
+        q.end.push_back(idx.sets[idx.canon[c]].lts);
+      }
+      add_entries(r->off, r->num);
+      j = idx.canon[r->last];
+      pos = r->last;
+      l = PQ_TW_STORE_LEVELS;       // minutes again from the end of it
+      if ((uint32_t)j + 1 == idx.set_num){
+        break;
+      }
+    }
+    if ((uint32_t)j + 1 == idx.set_num){
+      break;
+    }
+    prev = j;
+    ts = std::max(idx.sets[j].lts, idx.sets[j + 1].sts);
+    j = idx.next[j];
+  }
+  size_t max_window = 0;
+  for (int w = 0; w < T; w++){
+    if (q.window_id < 0 || q.touched[w].size() > max_window){
+      max_window = q.touched[w].size();
+      q.window_id = w;
+    }
+  }
+  for (int w = 0; w < T; w++){
+    std::vector<uint32_t> &t = q.touched[w];
+    const uint32_t *first = q.first.data() + w * F;
+    std::sort(t.begin(), t.end(), [first](uint32_t x, uint32_t y){
+      return first[x] < first[y];
+    });
+    for (uint32_t f : t){
+      if (!q.in_result[f]){
+        q.in_result[f] = 1;
+        q.est[f] = 0;
+        q.order.push_back(f);
+      }
+      q.est[f] += (int64_t)(q.count[w * F + f] / idx.coef[w]);
+      q.count[w * F + f] = 0;
+    }
+    t.clear();
+    std::stable_sort(q.order.begin(), q.order.end(), [&q](uint32_t x, uint32_t y){
+      return q.est[x] > q.est[y];
+    });
+  }
+  for (uint32_t f : q.order){
+    q.in_result[f] = 0;
+  }
+  return q.order.size();
+}
+
+}
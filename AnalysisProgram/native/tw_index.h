@@ -0,0 +1,94 @@
+/*************************************************************************
+	> File Name: tw_index.h
+  > Description: Indexed time windows snapshots of a port and culprit
+  >              queries over them (retrieve of TimeWindows.py)
+*************************************************************************/
+
+#ifndef _PQ_TW_INDEX_H_
+#define _PQ_TW_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "tw_ingest.h"
+#include "mapped_file.h"
+
+namespace pq {
+
+//----------------------------------------------------------------------
+// Valid cells of every set of a port, in the order of the snapshots,
+// ingested from the snapshots or mapped from a store (tw_store.h).
+// Flow IDs are mapped to dense ids. In a set, cells are sorted by their
+// reconstructed timestamp, seq keeping their order in the set (the order
+// of filter_TW), which the order of equal estimates depends on.
+//----------------------------------------------------------------------
+class TwIndex {
+public:
+  TwParams p;
+  std::vector<double> coef;             // calculate_coefficient
+  const TwSet *sets = nullptr;
+  uint32_t set_num = 0;
+  const int64_t *cell_ts = nullptr;
+  const uint32_t *cell_flow = nullptr;
+  const uint32_t *cell_seq = nullptr;
+  const uint8_t *cell_twid = nullptr;
+  uint64_t cell_num = 0;
+  const uint64_t *flows = nullptr;      // dense id -> src_ip << 32 | dst_ip
+  uint32_t flow_num = 0;
+  // summaries (tw_summary.h)
+  const int32_t *next = nullptr;
+  const uint64_t *sum_off = nullptr;
+  const uint32_t *canon = nullptr;
+  uint32_t canon_num = 0;
+  const int32_t *canon_pos = nullptr;
+  const TwEntry *entries = nullptr;
+  uint64_t entry_num = 0;
+  const TwBlock *blocks[PQ_TW_STORE_LEVELS] = {};
+  uint32_t block_num[PQ_TW_STORE_LEVELS] = {};
+
+  TwIndex() = default;
+  TwIndex(const TwIndex &) = delete;
+  TwIndex &operator=(const TwIndex &) = delete;
+  // path: the parent folder of tw_data as for TimeWindowController, or
+  // a store written by pq_ingest
+  int open(const char *path, const TwParams &params, uint32_t threads = 0);
+  // cells already in memory, e.g. of a simulation
+  int open(TwData &&d, const TwParams &params);
+  // first set j >= from with sts <= ts <= lts, -1 if none
+  int64_t find_set(uint32_t from, int64_t ts) const { return tree.find(from, ts); }
+
+private:
+  TwData data;                          // ingested cells
+  MappedFile store;                     // mapped store
+  TwSetTree tree;
+
+  int open_store(const char *file);
+};
+
+std::vector<double> tw_coefficient(double z, int alpha, int T);
+
+//----------------------------------------------------------------------
+// Result and scratch space of a query, one per querying thread
+//----------------------------------------------------------------------
+struct TwQuery {
+  std::vector<uint32_t> sets;                   // sets the query falls in
+  std::vector<int64_t> start, end;              // the query cut per set
+  int window_id = -1;                           // window with most flows
+  std::vector<uint32_t> order;                  // flows, estimate descending
+  std::vector<int64_t> est;                     // estimate per dense id
+  bool use_summary = true;                      // same result without
+
+  std::vector<uint32_t> count;                  // T x flows
+  std::vector<uint32_t> first;                  // T x flows, seq of the first cell
+  std::vector<std::vector<uint32_t>> touched;   // per window
+  std::vector<uint8_t> in_result;
+};
+
+// estimated packet number per flow in [ts, te], returns the number of
+// flows, -1 when no set covers ts. The sets fully covered are counted
+// from their summaries unless q.use_summary is false.
+int64_t tw_retrieve(const TwIndex &idx, int64_t ts, int64_t te, TwQuery &q);
+
+}
+
+#endif
@@ -0,0 +1,374 @@
+/*************************************************************************
+	> File Name: tw_ingest.cpp
+  > Description: Parallel decoding and filtering of the time windows
+  >              snapshots of a port, and the indexed store of them
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include "tw_ingest.h"
+#include "tw_cells.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+namespace pq {
+
+// parameters of the shared valid cell filter (tw_cells.h)
+static inline pq_tw_params_t tw_filter_params(const TwParams &p){
+  return pq_tw_params_t{(uint32_t)p.k, (uint32_t)p.T, (uint32_t)p.alpha, (uint32_t)p.tb0};
+}
+
+int tw_params_check(const TwParams &p){
+  if (p.T < 1 || p.T > PQ_TW_MAX_WINDOWS || p.k < 1 || p.k > 20 || p.tb0 < 1 || p.alpha < 0
+      || p.tb0 + (p.T - 1) * p.alpha > 31){
+    printf("Error: unsupported time windows parameters k=%d, T=%d, alpha=%d, TW0_TB=%d!\n", p.k, p.T, p.alpha, p.tb0);
+    return -1;
+  }
+  return 0;
+}
+
+struct TwFile {
+  uint32_t sec, usec;
+  bool cells;
+  std::string name;
+};
+
+static void add_cell(TwDecoded &s, int64_t ts, uint64_t fid, uint32_t twid){
+  s.ts.push_back(ts);
+  s.fid.push_back(fid);
+  s.seq.push_back(s.seq.size());
+  s.twid.push_back(twid);
+}
+
+//----------------------------------------------------------------------
+// Set filtered by the control plane (tw_cells.h): timestamps are already
+// unwrapped, cells are stored window after window
+//----------------------------------------------------------------------
+static int decode_cells(const TwParams &p, const MappedFile &m, const char *file, TwDecoded &s){
+  pq_tw_cells_header_t h;
+  // version 1 headers end before the clock fields, which are not used here
+  if (m.size < PQ_TW_CELLS_HEADER_V1_SIZE){
+    printf("Error: %s is not a TW cells file!\n", file);
+    return -1;
+  }
+  memcpy(&h, m.data, std::min(m.size, sizeof(h)));
+  if (h.magic != PQ_TW_CELLS_MAGIC || h.header_size < PQ_TW_CELLS_HEADER_V1_SIZE || h.T > PQ_TW_MAX_WINDOWS
+      || m.size < h.header_size + (size_t)h.cell_num * sizeof(pq_tw_cell_t)){
+    printf("Error: %s is not a TW cells file!\n", file);
+    return -1;
+  }
+  if (h.k != p.k || h.T != p.T || h.alpha != p.alpha || h.tb0 != p.tb0){
+    printf("Error: %s is captured with k=%d, T=%d, alpha=%d, TW0_TB=%d!\n", file, h.k, h.T, h.alpha, h.tb0);
+    return -1;
+  }
+  const pq_tw_cell_t *c = (const pq_tw_cell_t *)(m.data + h.header_size);
+  uint32_t n = 0;
+  for (uint32_t w = 0; w < h.T; w++){
+    for (uint32_t i = 0; i < h.window_cells[w] && n < h.cell_num; i++, n++){
+      add_cell(s, h.base + c[n].ts_offset, (uint64_t)c[n].src_ip << 32 | c[n].dst_ip, w);
+    }
+  }
+  s.sts = h.sts;
+  s.lts = h.lts;
+  s.valid = n > 0;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Raw set, [2^k tts][2^k src][2^k dst] per window, filtered by the valid
+// cell filter of the control plane (pq_tw_valid_cells, tw_cells.h) with no
+// overflow for the latest cell: cells of the previous cycle beyond an
+// overflow get -1
+//----------------------------------------------------------------------
+struct RawCtx {
+  const pq_tw_params_t *f;
+  TwDecoded *s;
+  int64_t smallest = 0, smallest_wrap = 0;
+  uint32_t smallest_twid = 0;
+};
+
+static void raw_cell(void *ctx, uint32_t twid, int64_t tts, int64_t wrap, uint32_t src, uint32_t dst, bool first){
+  RawCtx *c = (RawCtx *)ctx;
+  add_cell(*c->s, pq_tw_cell_ts(c->f, tts, twid, wrap), (uint64_t)src << 32 | dst, twid);
+  if (first){
+    c->s->valid = true;
+    c->smallest = tts;
+    c->smallest_twid = twid;
+    c->smallest_wrap = wrap;
+  }
+}
+
+static void decode_raw(const TwParams &p, const uint32_t *reg, TwDecoded &s){
+  pq_tw_params_t f = tw_filter_params(p);
+  RawCtx c;
+  int64_t largest;
+  uint32_t largest_idx;
+
+  if (!pq_tw_largest(&f, reg, &largest, &largest_idx)){
+    return;
+  }
+  s.raw = true;
+  s.largest = largest;
+  s.lts = pq_tw_cell_ts(&f, largest, 0, 0);
+  c.f = &f;
+  c.s = &s;
+  pq_tw_valid_cells(&f, reg, largest, largest_idx, 0, raw_cell, &c);
+  s.sts = pq_tw_cell_ts(&f, c.smallest, c.smallest_twid, c.smallest_wrap);
+}
+
+//----------------------------------------------------------------------
+// Sort the cells of a set by ts (equal ones in the order of the set) and
+// list its flows
+//----------------------------------------------------------------------
+static void sort_set(TwDecoded &s){
+  uint32_t n = s.ts.size();
+  std::vector<uint32_t> perm(n);
+  for (uint32_t i = 0; i < n; i++){
+    perm[i] = i;
+  }
+  std::sort(perm.begin(), perm.end(), [&s](uint32_t x, uint32_t y){
+    return s.ts[x] != s.ts[y] ? s.ts[x] < s.ts[y] : x < y;
+  });
+  std::vector<int64_t> ts(n);
+  std::vector<uint64_t> fid(n);
+  std::vector<uint32_t> seq(n);
+  std::vector<uint8_t> twid(n);
+  for (uint32_t i = 0; i < n; i++){
+    ts[i] = s.ts[perm[i]];
+    fid[i] = s.fid[perm[i]];
+    seq[i] = perm[i];
+    twid[i] = s.twid[perm[i]];
+  }
+  s.ts.swap(ts);
+  s.fid.swap(fid);
+  s.seq.swap(seq);
+  s.twid.swap(twid);
+  s.uniq = s.fid;
+  std::sort(s.uniq.begin(), s.uniq.end());
+  s.uniq.erase(std::unique(s.uniq.begin(), s.uniq.end()), s.uniq.end());
+}
+
+void tw_decode_raw(const TwParams &p, const uint32_t *reg, TwDecoded &s){
+  decode_raw(p, reg, s);
+  if (s.valid){
+    sort_set(s);
+  }
+}
+
+//----------------------------------------------------------------------
+// Decode a snapshot, independent of the other snapshots
+//----------------------------------------------------------------------
+static void decode(const TwParams &p, const TwFile &f, TwDecoded &s){
+  MappedFile m;
+  s.sec = f.sec;
+  s.usec = f.usec;
+  if (m.map(f.name.c_str()) < 0){
+    s.ret = -1;
+    return;
+  }
+  if (m.size == 0){
+    // idle period
+    return;
+  }
+  if (f.cells){
+    s.ret = decode_cells(p, m, f.name.c_str(), s);
+  }else if (m.size != (size_t)3 * p.T * ((size_t)1 << p.k) * sizeof(uint32_t)){
+    printf("Warning: %s is not a set of %d x 2^%d cells, skipped\n", f.name.c_str(), p.T, p.k);
+    return;
+  }else{
+    decode_raw(p, (const uint32_t *)m.data, s);
+  }
+  if (s.ret < 0 || !s.valid){
+    return;
+  }
+  sort_set(s);
+}
+
+//----------------------------------------------------------------------
+// Snapshots are named <sec>_<usec>.cells or <sec>_<usec>.bin, taken in
+// the order they are written:
+//   1. decode, filter and sort every snapshot, in parallel
+//   2. stitch, in order: overflows of the raw sets, counted against the
+//      latest cell of the port so far (nearest unwrap, as tw_cells.c),
+//      offsets of the sets, dense ids of the flows
+//   3. fill the columns, in parallel
+//----------------------------------------------------------------------
+int tw_ingest(const char *dir, const TwParams &p, uint32_t threads, TwData &d){
+  std::vector<TwFile> files;
+  if (tw_params_check(p) < 0){
+    return -1;
+  }
+  DIR *dp = opendir(dir);
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", dir);
+    return -1;
+  }
+  struct dirent *e;
+  while ((e = readdir(dp)) != NULL){
+    TwFile f;
+    char ext[16];
+    if (sscanf(e->d_name, "%u_%u.%15s", &f.sec, &f.usec, ext) != 3){
+      continue;
+    }
+    if (strcmp(ext, "cells") != 0 && strcmp(ext, "bin") != 0){
+      continue;
+    }
+    f.cells = ext[0] == 'c';
+    f.name = std::string(dir) + "/" + e->d_name;
+    files.push_back(f);
+  }
+  closedir(dp);
+  std::sort(files.begin(), files.end(), [](const TwFile &x, const TwFile &y){
+    return x.sec != y.sec ? x.sec < y.sec : x.usec < y.usec;
+  });
+
+  std::vector<TwDecoded> dec(files.size());
+  parallel_for(files.size(), threads, [&](size_t i, uint32_t){
+    decode(p, files[i], dec[i]);
+  });
+  return tw_stitch(p, dec, threads, d);
+}
+
+int tw_stitch(const TwParams &p, std::vector<TwDecoded> &dec, uint32_t threads, TwData &d){
+  pq_tw_params_t f = tw_filter_params(p);
+  int64_t tts_bit = 32 - p.tb0, latest = 0;
+  bool latest_valid = false;
+  uint64_t cell_num = 0;
+  std::unordered_map<uint64_t, uint32_t> flow_ids;
+  d = TwData();
+  for (size_t i = 0; i < dec.size(); i++){
+    TwDecoded &s = dec[i];
+    if (s.ret < 0){
+      return -1;
+    }
+    if (s.raw){
+      // a raw set without valid cell still moves the latest cell
+      int64_t wrapping = 0;
+      if (latest_valid){
+        wrapping = pq_tw_nearest_wrap(&f, latest, s.largest);
+      }
+      if (!latest_valid || (wrapping << tts_bit) + s.largest > latest){
+        latest = (wrapping << tts_bit) + s.largest;
+        latest_valid = true;
+      }
+      s.shift = wrapping << 32;
+    }
+    if (!s.valid){
+      continue;
+    }
+    if (cell_num + s.ts.size() > UINT32_MAX){
+      printf("Error: more than 2^32 cells in a port!\n");
+      return -1;
+    }
+    s.off = cell_num;
+    cell_num += s.ts.size();
+    TwSet set = {s.sts + s.shift, s.lts + s.shift, s.off, (uint32_t)s.ts.size(), s.sec, s.usec};
+    d.sets.push_back(set);
+    for (uint64_t fid : s.uniq){
+      if (flow_ids.emplace(fid, d.flows.size()).second){
+        d.flows.push_back(fid);
+      }
+    }
+  }
+
+  d.cell_ts.resize(cell_num);
+  d.cell_flow.resize(cell_num);
+  d.cell_seq.resize(cell_num);
+  d.cell_twid.resize(cell_num);
+  parallel_for(dec.size(), threads, [&](size_t i, uint32_t){
+    TwDecoded &s = dec[i];
+    if (!s.valid){
+      return;
+    }
+    for (size_t c = 0; c < s.ts.size(); c++){
+      d.cell_ts[s.off + c] = s.ts[c] + s.shift;
+      d.cell_flow[s.off + c] = flow_ids.find(s.fid[c])->second;
+      d.cell_seq[s.off + c] = s.off + s.seq[c];
+      d.cell_twid[s.off + c] = s.twid[c];
+    }
+    s = TwDecoded();
+  });
+  tw_summarize(d, threads);
+  return 0;
+}
+
+static int write_section(FILE *f, uint64_t &pos, pq_tw_store_header_t &h, int sec, const void *data, size_t len){
+  static const uint8_t zero[PQ_TW_STORE_ALIGN] = {0};
+  size_t pad = (PQ_TW_STORE_ALIGN - pos % PQ_TW_STORE_ALIGN) % PQ_TW_STORE_ALIGN;
+  if (fwrite(zero, 1, pad, f) != pad || (len > 0 && fwrite(data, 1, len, f) != len)){
+    return -1;
+  }
+  h.off[sec] = pos + pad;
+  h.len[sec] = len;
+  pos = h.off[sec] + len;
+  return 0;
+}
+
+template <typename V>
+static int write_section(FILE *f, uint64_t &pos, pq_tw_store_header_t &h, int sec, const V &v){
+  return write_section(f, pos, h, sec, v.data(), v.size() * sizeof(v[0]));
+}
+
+//----------------------------------------------------------------------
+// Store of the cells of a port and their summaries (tw_store.h), written
+// to file.tmp then renamed so that a reader never maps a partial store
+//----------------------------------------------------------------------
+int tw_store_write(const char *file, const TwParams &p, const TwData &d){
+  pq_tw_store_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.magic = PQ_TW_STORE_MAGIC;
+  h.version = PQ_TW_STORE_VERSION;
+  h.header_size = sizeof(h);
+  h.k = p.k;
+  h.T = p.T;
+  h.alpha = p.alpha;
+  h.tb0 = p.tb0;
+  h.set_num = d.sets.size();
+  h.flow_num = d.flows.size();
+  h.canon_num = d.canon.size();
+  h.cell_num = d.cell_ts.size();
+  std::string tmp = std::string(file) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == NULL){
+    printf("Error opening %s!\n", tmp.c_str());
+    return -1;
+  }
+  uint64_t pos = sizeof(h);
+  int ret = fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+  ret |= write_section(f, pos, h, PQ_TW_SEC_SETS, d.sets);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_FLOWS, d.flows);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_TS, d.cell_ts);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_FLOW, d.cell_flow);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_SEQ, d.cell_seq);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_TWID, d.cell_twid);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_NEXT, d.next);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_SUM_OFF, d.sum_off);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_CANON, d.canon);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_CANON_POS, d.canon_pos);
+  ret |= write_section(f, pos, h, PQ_TW_SEC_ENTRIES, d.entries);
+  for (int l = 0; l < PQ_TW_STORE_LEVELS; l++){
+    ret |= write_section(f, pos, h, PQ_TW_SEC_SECONDS + l, d.blocks[l]);
+  }
+  h.size = pos;
+  // header with the sections
+  ret |= fseek(f, 0, SEEK_SET);
+  ret |= fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+  ret |= fclose(f);
+  if (ret != 0){
+    printf("Error writing %s!\n", tmp.c_str());
+    remove(tmp.c_str());
+    return -1;
+  }
+  if (rename(tmp.c_str(), file) != 0){
+    printf("Error renaming %s!\n", tmp.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+}
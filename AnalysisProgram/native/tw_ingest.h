@@ -0,0 +1,78 @@
+/*************************************************************************
+	> File Name: tw_ingest.h
+  > Description: Parallel decoding and filtering of the time windows
+  >              snapshots of a port, and the indexed store of them
+*************************************************************************/
+
+#ifndef _PQ_TW_INGEST_H_
+#define _PQ_TW_INGEST_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "tw_store.h"
+#include "tw_summary.h"
+
+namespace pq {
+
+// parameters of the data plane, as TimeWindowController
+struct TwParams {
+  int k = 10;
+  int T = 3;
+  int alpha = 1;
+  int tb0 = 7;          // TW0_TB
+  double z = 1;         // TW0_z
+};
+
+// sections of the store (tw_store.h)
+struct TwData {
+  std::vector<TwSet> sets;
+  std::vector<int64_t> cell_ts;
+  std::vector<uint32_t> cell_flow;
+  std::vector<uint32_t> cell_seq;
+  std::vector<uint8_t> cell_twid;
+  std::vector<uint64_t> flows;
+  // summaries
+  std::vector<int32_t> next;
+  std::vector<uint64_t> sum_off;
+  std::vector<uint32_t> canon;
+  std::vector<int32_t> canon_pos;
+  std::vector<TwEntry> entries;
+  std::vector<TwBlock> blocks[PQ_TW_STORE_LEVELS];
+};
+
+//----------------------------------------------------------------------
+// A decoded snapshot. The timestamps of a raw set lack the overflows of
+// its latest cell, added by the stitching pass.
+//----------------------------------------------------------------------
+struct TwDecoded {
+  int ret = 0;
+  bool valid = false;
+  bool raw = false;
+  uint32_t sec = 0, usec = 0;           // snapshot <sec>_<usec>
+  int64_t largest = 0;                  // raw: tts of the latest cell of TW0
+  int64_t sts = 0, lts = 0;
+  std::vector<int64_t> ts;              // sorted
+  std::vector<uint64_t> fid;
+  std::vector<uint32_t> seq;            // position in the order of filter_TW
+  std::vector<uint8_t> twid;
+  std::vector<uint64_t> uniq;           // flow IDs of the set, sorted
+  int64_t shift = 0;                    // stitching: overflows << 32
+  uint32_t off = 0;
+};
+
+int tw_params_check(const TwParams &p);
+// cells of the snapshots of dir (<port dir>/tw_data) and their
+// summaries, on threads threads (0: one per core)
+int tw_ingest(const char *dir, const TwParams &p, uint32_t threads, TwData &d);
+// raw set as read from the registers, [2^k tts][2^k src][2^k dst] per
+// window, filtered and sorted as a .bin snapshot
+void tw_decode_raw(const TwParams &p, const uint32_t *reg, TwDecoded &s);
+// sets decoded in the order of the snapshots into d, then summarized.
+// dec is consumed.
+int tw_stitch(const TwParams &p, std::vector<TwDecoded> &dec, uint32_t threads, TwData &d);
+int tw_store_write(const char *file, const TwParams &p, const TwData &d);
+
+}
+
+#endif
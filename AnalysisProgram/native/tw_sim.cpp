@@ -0,0 +1,144 @@
+/*************************************************************************
+	> File Name: tw_sim.cpp
+  > Description: Time windows of the data plane replayed on the ground
+  >              truth of a port, for sizing k, T, alpha and TW0_TB
+*************************************************************************/
+
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "tw_sim.h"
+
+namespace pq {
+
+int64_t tw_set_period(const TwParams &p){
+  int64_t cycles = p.alpha == 0 ? p.T : ((1LL << (p.alpha * p.T)) - 1) / ((1LL << p.alpha) - 1);
+  return cycles << (p.k + p.tb0);
+}
+
+// a cell of the registers, the three words side by side
+struct TwSimCell {
+  uint32_t tts, src, dst;
+};
+
+static int dump_snapshot(const char *dir, int64_t ts, const std::vector<uint32_t> &raw){
+  char name[512];
+  snprintf(name, sizeof(name), "%s/tw_data/%ld_%ld.bin", dir, ts / 1000000000, ts % 1000000000 / 1000);
+  FILE *f = fopen(name, "wb");
+  if (f == NULL){
+    printf("Error opening %s!\n", name);
+    return -1;
+  }
+  size_t n = fwrite(raw.data(), sizeof(uint32_t), raw.size(), f);
+  if (fclose(f) != 0 || n != raw.size()){
+    printf("Error writing %s!\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// time_windows_data_query.p4 on the packets in dequeue order: a packet
+// is stored in TW0 at the cell of its 32-bit dequeue tts, the evicted
+// cell moves on to the next window, with tts >> alpha, when it belongs to
+// the previous cycle of the same cell.
+// As poller.c, the registers of a port are two halves: every read period
+// the data plane is flipped to the other half, which is not cleared, and
+// the half it leaves is read. An idle port is neither flipped nor read.
+// The data plane query halves (highest bit) are not simulated.
+//----------------------------------------------------------------------
+int tw_simulate(const GtData &g, const TwSimConfig &c, TwData &d, TwSimStats &st){
+  const TwParams &p = c.p;
+  if (tw_params_check(p) < 0){
+    return -1;
+  }
+  const uint32_t K = 1U << p.k, mask = K - 1, cells = p.T * K;
+  st = TwSimStats();
+  st.read_period = c.read_period;
+  if (st.read_period <= 0){
+    // poller.c: the set period less 100 us, to read a little ahead
+    int64_t us = tw_set_period(p) / 1000 - 100;
+    st.read_period = us > 0 ? us * 1000 : tw_set_period(p);
+  }
+  st.read_bytes = (uint64_t)cells * 3 * sizeof(uint32_t);
+  if (c.dump){
+    std::string dir = std::string(c.dump) + "/tw_data";
+    if ((mkdir(c.dump, 0755) != 0 && errno != EEXIST) || (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)){
+      printf("Error creating %s!\n", dir.c_str());
+      return -1;
+    }
+  }
+
+  std::vector<TwSimCell> reg(2 * cells, TwSimCell{0, 0, 0});
+  std::vector<uint32_t> raw(3 * cells);
+  std::vector<TwDecoded> dec;
+  uint32_t half = 0;
+  uint64_t busy = 0, kept = 0;
+  int64_t read_ts = g.dts.empty() ? 0 : g.dts[0] + st.read_period;
+  // read the half being written, then flip
+  auto read = [&]() -> int {
+    const TwSimCell *r = reg.data() + half * cells;
+    for (int w = 0; w < p.T; w++){
+      uint32_t *tts_r = raw.data() + 3 * w * K, *src_r = tts_r + K, *dst_r = tts_r + 2 * K;
+      for (uint32_t j = 0; j < K; j++){
+        tts_r[j] = r[w * K + j].tts;
+        src_r[j] = r[w * K + j].src;
+        dst_r[j] = r[w * K + j].dst;
+      }
+    }
+    half ^= 1;
+    busy = 0;
+    st.reads++;
+    if (c.dump && dump_snapshot(c.dump, read_ts, raw) < 0){
+      return -1;
+    }
+    dec.emplace_back();
+    TwDecoded &s = dec.back();
+    s.sec = read_ts / 1000000000;
+    s.usec = read_ts % 1000000000 / 1000;
+    tw_decode_raw(p, raw.data(), s);
+    for (uint8_t w : s.twid){
+      kept += w == 0;
+    }
+    if (!s.valid && !s.raw){
+      dec.pop_back();
+    }
+    return 0;
+  };
+
+  for (size_t i = 0; i < g.dts.size(); i++){
+    if (g.dts[i] >= read_ts){
+      if (busy > 0 && read() < 0){
+        return -1;
+      }
+      // periods without packet are skipped
+      read_ts += ((g.dts[i] - read_ts) / st.read_period + 1) * st.read_period;
+    }
+    uint64_t fid = g.flows[g.flow[i]];
+    uint32_t tts = (uint32_t)g.dts[i] >> p.tb0, src = fid >> 32, dst = (uint32_t)fid;
+    TwSimCell *r = reg.data() + half * cells;
+    for (int w = 0; w < p.T; w++){
+      TwSimCell &x = r[w * K + (tts & mask)];
+      TwSimCell old = x;
+      x.tts = tts;
+      x.src = src;
+      x.dst = dst;
+      if (old.tts == 0 || old.tts != tts - K){
+        break;
+      }
+      tts = old.tts >> p.alpha;
+      src = old.src;
+      dst = old.dst;
+    }
+    busy++;
+  }
+  if (busy > 0 && read() < 0){
+    return -1;
+  }
+  st.z = st.reads > 0 ? (double)kept / st.reads / K : 0;
+  return tw_stitch(p, dec, 1, d);
+}
+
+}
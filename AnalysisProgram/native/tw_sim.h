@@ -0,0 +1,39 @@
+/*************************************************************************
+	> File Name: tw_sim.h
+  > Description: Time windows of the data plane replayed on the ground
+  >              truth of a port, for sizing k, T, alpha and TW0_TB
+*************************************************************************/
+
+#ifndef _PQ_TW_SIM_H_
+#define _PQ_TW_SIM_H_
+
+#include <stdint.h>
+
+#include "tw_ingest.h"
+#include "gt_data.h"
+
+namespace pq {
+
+struct TwSimConfig {
+  TwParams p;
+  int64_t read_period = 0;              // ns, 0: as the control plane
+  const char *dump = nullptr;           // write the snapshots to <dump>/tw_data
+};
+
+struct TwSimStats {
+  int64_t read_period = 0;              // ns
+  uint64_t reads = 0;                   // snapshots of a busy port
+  uint64_t read_bytes = 0;              // per snapshot
+  double z = 0;                         // TW0 cells kept per snapshot / 2^k
+};
+
+// span of a set of windows, 2^(k + TW0_TB) (2^(alpha T) - 1) / (2^alpha - 1)
+int64_t tw_set_period(const TwParams &p);
+
+// time windows of the packets of g, read and filtered as by the control
+// plane (poller.c, tw_cells.c) into d
+int tw_simulate(const GtData &g, const TwSimConfig &c, TwData &d, TwSimStats &st);
+
+}
+
+#endif
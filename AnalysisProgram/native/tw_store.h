@@ -0,0 +1,101 @@
+/*************************************************************************
+	> File Name: tw_store.h
+  > Description: Layout of the indexed store of the time windows snapshots
+  >              of a port, written by pq_ingest
+*************************************************************************/
+
+#ifndef _PQ_TW_STORE_H_
+#define _PQ_TW_STORE_H_
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// A store (<port dir>/tw_store.pqtw by default) holds the valid cells of
+// every set of a port, overflows resolved, and summaries of them, as
+// sections to be mapped as is: the header gives the offset and length in
+// bytes of every section, each starting on a 64-byte boundary.
+//   * sets: pq_tw_store_set_t in the order of the snapshots
+//   * flows: flow IDs (src_ip << 32 | dst_ip, uint64) by dense id
+//   * ts, flow, seq, twid: the cells; the cells of a set are
+//     [off, off + num), sorted by ts (int64, ns). flow is the dense id
+//     (uint32), seq the position of the cell in the order of filter_TW
+//     over the whole port (uint32), twid the window (uint8).
+// Summaries (tw_summary.h):
+//   * next: per set (int32), the set retrieve goes on with when a query
+//     goes past the latest cell of the set, -1 if none
+//   * sum_off: set_num + 1 offsets (uint64) in entries. The summary of
+//     set j counts the cells next[j] contributes to such a query.
+//   * canon, canon_pos: the sets along next (uint32), the position of a
+//     set along them (int32, -1 never)
+//   * entries: pq_tw_store_entry_t, summaries of sets then rollups
+//   * seconds, minutes: pq_tw_store_block_t, rollups of the summaries of
+//     the sets along canon whose latest cell is in the same second /
+//     minute
+// All fields are little endian.
+//----------------------------------------------------------------------
+#define PQ_TW_STORE_MAGIC 0x53545150    // "PQTS"
+#define PQ_TW_STORE_VERSION 2
+#define PQ_TW_STORE_ALIGN 64
+#define PQ_TW_STORE_LEVELS 2            // seconds, minutes
+
+enum pq_tw_store_section {
+  PQ_TW_SEC_SETS,
+  PQ_TW_SEC_FLOWS,
+  PQ_TW_SEC_TS,
+  PQ_TW_SEC_FLOW,
+  PQ_TW_SEC_SEQ,
+  PQ_TW_SEC_TWID,
+  PQ_TW_SEC_NEXT,
+  PQ_TW_SEC_SUM_OFF,
+  PQ_TW_SEC_CANON,
+  PQ_TW_SEC_CANON_POS,
+  PQ_TW_SEC_ENTRIES,
+  PQ_TW_SEC_SECONDS,
+  PQ_TW_SEC_MINUTES,
+  PQ_TW_SEC_NUM
+};
+
+typedef struct pq_tw_store_set {
+  int64_t sts;                    // ts of the oldest cell
+  int64_t lts;                    // ts of the latest cell
+  uint32_t off;                   // first cell of the set
+  uint32_t num;                   // number of cells
+  uint32_t sec;                   // snapshot <sec>_<usec>
+  uint32_t usec;
+} pq_tw_store_set_t;
+
+// cells of a flow in a window
+typedef struct pq_tw_store_entry {
+  uint32_t flow;                  // dense id
+  uint32_t count;
+  uint32_t first;                 // smallest seq of the cells
+  uint8_t twid;
+  uint8_t pad[3];
+} pq_tw_store_entry_t;
+
+// summaries of the sets canon[first - 1] .. canon[last - 1] merged
+typedef struct pq_tw_store_block {
+  uint32_t first;                 // positions along canon
+  uint32_t last;
+  uint64_t off;                   // entries [off, off + num)
+  uint64_t num;
+} pq_tw_store_block_t;
+
+typedef struct pq_tw_store_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;           // sizeof(pq_tw_store_header_t)
+  uint8_t k;
+  uint8_t T;
+  uint8_t alpha;
+  uint8_t tb0;
+  uint32_t set_num;
+  uint32_t flow_num;
+  uint32_t canon_num;
+  uint64_t cell_num;
+  uint64_t off[PQ_TW_SEC_NUM];
+  uint64_t len[PQ_TW_SEC_NUM];
+  uint64_t size;                  // size of the file
+} pq_tw_store_header_t;
+
+#endif
@@ -0,0 +1,182 @@
+/*************************************************************************
+	> File Name: tw_summary.cpp
+  > Description: Interval tree over the time windows sets of a port, and
+  >              per set flow summaries with per second / minute rollups
+*************************************************************************/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "tw_ingest.h"
+#include "tw_summary.h"
+#include "parallel.h"
+
+namespace pq {
+
+void TwSetTree::build(const TwSet *sets, uint32_t n){
+  num = n;
+  leaves = 1;
+  while (leaves < n){
+    leaves <<= 1;
+  }
+  seg_sts.assign(2 * leaves, INT64_MAX);
+  seg_lts.assign(2 * leaves, INT64_MIN);
+  for (uint32_t i = 0; i < n; i++){
+    seg_sts[leaves + i] = sets[i].sts;
+    seg_lts[leaves + i] = sets[i].lts;
+  }
+  for (uint32_t i = leaves - 1; i > 0; i--){
+    seg_sts[i] = std::min(seg_sts[2 * i], seg_sts[2 * i + 1]);
+    seg_lts[i] = std::max(seg_lts[2 * i], seg_lts[2 * i + 1]);
+  }
+}
+
+int64_t TwSetTree::find(uint32_t node, uint32_t l, uint32_t r, uint32_t from, int64_t ts) const {
+  if (r < from || seg_sts[node] > ts || seg_lts[node] < ts){
+    return -1;
+  }
+  if (l == r){
+    return l;
+  }
+  uint32_t mid = (l + r) / 2;
+  int64_t j = find(2 * node, l, mid, from, ts);
+  return j >= 0 ? j : find(2 * node + 1, mid + 1, r, from, ts);
+}
+
+int64_t TwSetTree::find(uint32_t from, int64_t ts) const {
+  if (num == 0){
+    return -1;
+  }
+  return find(1, 0, leaves - 1, from, ts);
+}
+
+static inline uint64_t entry_key(const TwEntry &e){
+  return (uint64_t)e.twid << 32 | e.flow;
+}
+
+// entries with the same window and flow added up, sorted by window, flow
+static void combine(std::vector<TwEntry> &v){
+  std::sort(v.begin(), v.end(), [](const TwEntry &x, const TwEntry &y){
+    return entry_key(x) < entry_key(y);
+  });
+  size_t n = 0;
+  for (size_t i = 0; i < v.size(); i++){
+    if (n > 0 && entry_key(v[n - 1]) == entry_key(v[i])){
+      v[n - 1].count += v[i].count;
+      v[n - 1].first = std::min(v[n - 1].first, v[i].first);
+    }else{
+      v[n++] = v[i];
+    }
+  }
+  v.resize(n);
+}
+
+static inline int64_t floor_div(int64_t a, int64_t b){
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+//----------------------------------------------------------------------
+// A query of retrieve (tw_index.cpp) going past the latest cell of set j
+// goes on with set next[j] from max(lts of j, sts of j + 1) to the latest
+// cell of next[j], or to its end if that is before. Only the sets where a
+// query starts or ends need their cells, the sets in between contribute
+// the same cells to every query: the summary of j counts them per window
+// and flow.
+// Following next from the first set, then from every set not reached,
+// gives canon. Consecutive sets along canon are merged into rollups per
+// second and per minute of their latest cell, so that a long query
+// adds up a few rollups instead of every set.
+//----------------------------------------------------------------------
+void tw_summarize(TwData &d, uint32_t threads){
+  uint32_t n = d.sets.size();
+  TwSetTree tree;
+  tree.build(d.sets.data(), n);
+  d.next.assign(n, -1);
+  std::vector<std::vector<TwEntry>> part(n);
+  parallel_for(n, threads, [&](size_t j, uint32_t){
+    if (j + 1 == n){
+      return;
+    }
+    int64_t ts = std::max(d.sets[j].lts, d.sets[j + 1].sts);
+    int64_t k = tree.find(j + 1, ts);
+    d.next[j] = k;
+    if (k < 0){
+      return;
+    }
+    const TwSet &s = d.sets[k];
+    const int64_t *b = d.cell_ts.data() + s.off, *e = b + s.num;
+    uint64_t lo = std::lower_bound(b, e, ts) - d.cell_ts.data();
+    uint64_t hi = std::upper_bound(b, e, s.lts) - d.cell_ts.data();
+    std::vector<TwEntry> &v = part[j];
+    v.resize(hi - lo);
+    for (uint64_t c = lo; c < hi; c++){
+      TwEntry &x = v[c - lo];
+      x.flow = d.cell_flow[c];
+      x.count = 1;
+      x.first = d.cell_seq[c];
+      x.twid = d.cell_twid[c];
+      x.pad[0] = x.pad[1] = x.pad[2] = 0;
+    }
+    combine(v);
+  });
+  d.sum_off.assign(n + 1, 0);
+  for (uint32_t j = 0; j < n; j++){
+    d.sum_off[j + 1] = d.sum_off[j] + part[j].size();
+  }
+  d.entries.resize(d.sum_off[n]);
+  parallel_for(n, threads, [&](size_t j, uint32_t){
+    std::copy(part[j].begin(), part[j].end(), d.entries.begin() + d.sum_off[j]);
+    std::vector<TwEntry>().swap(part[j]);
+  });
+
+  d.canon.clear();
+  d.canon_pos.assign(n, -1);
+  for (uint32_t j = 0; j < n; j++){
+    int64_t c = j;
+    while (c >= 0 && d.canon_pos[c] < 0){
+      d.canon_pos[c] = d.canon.size();
+      d.canon.push_back(c);
+      c = d.next[c];
+    }
+  }
+
+  for (int l = 0; l < PQ_TW_STORE_LEVELS; l++){
+    std::vector<TwBlock> &blocks = d.blocks[l];
+    blocks.clear();
+    // runs of positions q reached from q - 1 with the latest cell in the
+    // same second / minute, more than one per rollup
+    uint32_t first = 0;
+    int64_t unit = 0;
+    for (uint32_t q = 1; q <= d.canon.size(); q++){
+      bool linked = q < d.canon.size() && d.next[d.canon[q - 1]] == (int32_t)d.canon[q];
+      int64_t u = linked ? floor_div(d.sets[d.canon[q]].lts, tw_level_ns[l]) : 0;
+      if (first > 0 && (!linked || u != unit)){
+        if (q - 1 > first){
+          TwBlock b = {first, q - 1, 0, 0};
+          blocks.push_back(b);
+        }
+        first = 0;
+      }
+      if (linked && first == 0){
+        first = q;
+        unit = u;
+      }
+    }
+    std::vector<std::vector<TwEntry>> merged(blocks.size());
+    parallel_for(blocks.size(), threads, [&](size_t i, uint32_t){
+      std::vector<TwEntry> &v = merged[i];
+      for (uint32_t q = blocks[i].first; q <= blocks[i].last; q++){
+        uint32_t c = d.canon[q - 1];
+        v.insert(v.end(), d.entries.begin() + d.sum_off[c], d.entries.begin() + d.sum_off[c + 1]);
+      }
+      combine(v);
+    });
+    for (size_t i = 0; i < blocks.size(); i++){
+      blocks[i].off = d.entries.size();
+      blocks[i].num = merged[i].size();
+      d.entries.insert(d.entries.end(), merged[i].begin(), merged[i].end());
+    }
+  }
+}
+
+}
@@ -0,0 +1,49 @@
+/*************************************************************************
+	> File Name: tw_summary.h
+  > Description: Interval tree over the time windows sets of a port, and
+  >              per set flow summaries with per second / minute rollups
+*************************************************************************/
+
+#ifndef _PQ_TW_SUMMARY_H_
+#define _PQ_TW_SUMMARY_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "tw_store.h"
+
+namespace pq {
+
+typedef pq_tw_store_set_t TwSet;
+typedef pq_tw_store_entry_t TwEntry;
+typedef pq_tw_store_block_t TwBlock;
+
+// length of the rollups of a level, ns
+static const int64_t tw_level_ns[PQ_TW_STORE_LEVELS] = {1000000000LL, 60000000000LL};
+
+//----------------------------------------------------------------------
+// Segment tree over the sets: smallest sts and largest lts of a node,
+// leaves padded to a power of 2 with empty intervals
+//----------------------------------------------------------------------
+class TwSetTree {
+public:
+  void build(const TwSet *sets, uint32_t n);
+  // first set j >= from with sts <= ts <= lts, -1 if none
+  int64_t find(uint32_t from, int64_t ts) const;
+
+private:
+  std::vector<int64_t> seg_sts, seg_lts;
+  uint32_t leaves = 0, num = 0;
+
+  int64_t find(uint32_t node, uint32_t l, uint32_t r, uint32_t from, int64_t ts) const;
+};
+
+struct TwData;
+
+// next, sum_off, canon, canon_pos, entries and blocks of d from its sets
+// and cells, on threads threads
+void tw_summarize(TwData &d, uint32_t threads);
+
+}
+
+#endif
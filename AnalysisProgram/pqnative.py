@@ -0,0 +1,217 @@
+'''
+File Description:
+    1) Python binding of libpqnative (native/), the native engines of the Analysis Program.
+    2) TimeWindowIndex: indexed culprit queries over the time windows snapshots of a port.
+    3) ingest: indexed store of the time windows snapshots of a port.
+    4) QueueMonitorIndex: queue stacks of the queue monitor snapshots of a port, and the flows in the queue.
+'''
+import ctypes
+import os
+
+_lib = None
+
+
+def load_library():
+    """
+    load libpqnative.so, from $PQNATIVE_LIB or native/ (run make in native/ first)
+    """
+    global _lib
+    if _lib is not None:
+        return _lib
+    path = os.environ.get('PQNATIVE_LIB',
+                          os.path.join(os.path.dirname(os.path.abspath(__file__)), 'native', 'libpqnative.so'))
+    lib = ctypes.CDLL(path)
+    i64, u32, u64, p = ctypes.c_int64, ctypes.c_uint32, ctypes.c_uint64, ctypes.c_void_p
+    P = ctypes.POINTER
+    lib.pq_tw_open.restype = p
+    lib.pq_tw_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                               ctypes.c_double, u32]
+    lib.pq_tw_ingest.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                 ctypes.c_int, u32]
+    lib.pq_tw_close.argtypes = [p]
+    lib.pq_tw_set_num.restype = u32
+    lib.pq_tw_set_num.argtypes = [p]
+    lib.pq_tw_flow_num.restype = u32
+    lib.pq_tw_flow_num.argtypes = [p]
+    lib.pq_tw_set_info.argtypes = [p, u32, P(i64), P(i64), P(u32), P(u32), P(u32)]
+    lib.pq_tw_coefficient.argtypes = [p, P(ctypes.c_double)]
+    lib.pq_tw_query_new.restype = p
+    lib.pq_tw_query_new.argtypes = [p]
+    lib.pq_tw_query_free.argtypes = [p]
+    lib.pq_tw_retrieve.restype = i64
+    lib.pq_tw_retrieve.argtypes = [p, i64, i64]
+    lib.pq_tw_result.restype = u32
+    lib.pq_tw_result.argtypes = [p, u32, P(u64), P(i64)]
+    lib.pq_tw_result_sets.restype = u32
+    lib.pq_tw_result_sets.argtypes = [p, u32, P(u32), P(i64), P(i64), P(ctypes.c_int)]
+    lib.pq_qm_open.restype = p
+    lib.pq_qm_open.argtypes = [ctypes.c_char_p, u32, u32]
+    lib.pq_qm_close.argtypes = [p]
+    lib.pq_qm_snapshot_num.restype = u32
+    lib.pq_qm_snapshot_num.argtypes = [p]
+    lib.pq_qm_flow_num.restype = u32
+    lib.pq_qm_flow_num.argtypes = [p]
+    lib.pq_qm_snapshot_info.argtypes = [p, u32, P(u32), P(u32), P(u32), P(i64), P(u32), P(u32)]
+    lib.pq_qm_stack.restype = u32
+    lib.pq_qm_stack.argtypes = [p, u32, u32, P(u32), P(u64), P(i64)]
+    lib.pq_qm_query_new.restype = p
+    lib.pq_qm_query_new.argtypes = [p]
+    lib.pq_qm_query_free.argtypes = [p]
+    lib.pq_qm_occupancy.restype = i64
+    lib.pq_qm_occupancy.argtypes = [p, i64, i64]
+    lib.pq_qm_result.restype = u32
+    lib.pq_qm_result.argtypes = [p, u32, P(u64), P(u32)]
+    _lib = lib
+    return lib
+
+
+def ingest(path, store=None, alpha=1, k=10, T=3, TW0_TB=7, threads=0):
+    """
+    store the snapshots of a port in one indexed file (native/tw_store.h), as pq_ingest
+    :param path: the path to the parent folder of the TW data folder
+    :param store: the path of the store, <path>/tw_store.pqtw by default
+    :param threads: decoding threads, 0 for one per core
+    :return: the path of the store
+    """
+    if store is None:
+        store = os.path.join(path, 'tw_store.pqtw')
+    if load_library().pq_tw_ingest(path.encode(), store.encode(), k, T, alpha, TW0_TB, threads) < 0:
+        raise IOError('Error storing time windows of {0}'.format(path))
+    return store
+
+
+class TimeWindowIndex:
+    def __init__(self, path, alpha=1, k=10, T=3, TW0_TB=7, TW0_z=1, threads=0):
+        """
+        Drop-in replacement of TimeWindowController for queries: the snapshots (.cells or .bin) are loaded through
+        mmap and indexed by libpqnative, retrieve returns the same result as TimeWindowController.retrieve
+        :param path: the path to the parent folder of the TW data folder, or a store written by ingest / pq_ingest
+        :param threads: decoding threads, 0 for one per core
+        the other parameters are those of TimeWindowController
+        """
+        self.lib = load_library()
+        self.alpha = alpha
+        self.k = k
+        self.T = T
+        self.TW0_TB = TW0_TB
+        self.TW0_z = TW0_z
+        self.handle = self.lib.pq_tw_open(path.encode(), k, T, alpha, TW0_TB, TW0_z, threads)
+        if not self.handle:
+            raise IOError('Error loading time windows from {0}'.format(path))
+        self.query = self.lib.pq_tw_query_new(self.handle)
+        coef = (ctypes.c_double * T)()
+        self.lib.pq_tw_coefficient(self.handle, coef)
+        self.cofficient = list(coef)
+        # self.TW_registers = [{'ts': [A, B], 'sts': integer, 'lts': integer, 'cells': integer}], without the cells
+        self.TW_registers = []
+        sts, lts = ctypes.c_int64(), ctypes.c_int64()
+        sec, usec, cells = ctypes.c_uint32(), ctypes.c_uint32(), ctypes.c_uint32()
+        for i in range(self.lib.pq_tw_set_num(self.handle)):
+            self.lib.pq_tw_set_info(self.handle, i, ctypes.byref(sts), ctypes.byref(lts), ctypes.byref(sec),
+                                    ctypes.byref(usec), ctypes.byref(cells))
+            self.TW_registers.append({'ts': [str(sec.value), str(usec.value)], 'sts': sts.value, 'lts': lts.value,
+                                      'cells': cells.value})
+        self.flow_number = self.lib.pq_tw_flow_num(self.handle)
+        print('Native index: {0} sets, {1} flows, Cofficients: {2}'.format(len(self.TW_registers), self.flow_number,
+                                                                           self.cofficient))
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            self.lib.pq_tw_query_free(self.query)
+            self.lib.pq_tw_close(self.handle)
+            self.handle = None
+
+    def retrieve(self, ts, te, K=0):
+        """
+        Given a query interval [ts, te], return the result, as TimeWindowController.retrieve
+        :param K: only the Top-K flows (0: all)
+        :return: {'flow ID hex string': integer}, The list of sets, [[s, e]],  G
+        """
+        n = self.lib.pq_tw_retrieve(self.query, ts, te)
+        if n < 0:
+            print("For query {0} to {1}, no right set of time windows is found!".format(ts, te))
+            return [], [], [], -1
+        n = n if K == 0 else min(n, K)
+        fid = (ctypes.c_uint64 * max(n, 1))()
+        est = (ctypes.c_int64 * max(n, 1))()
+        n = self.lib.pq_tw_result(self.query, n, fid, est)
+        result = {'{0:016x}'.format(fid[i]): est[i] for i in range(n)}
+        window_id = ctypes.c_int()
+        m = self.lib.pq_tw_result_sets(self.query, 0, None, None, None, ctypes.byref(window_id))
+        sets = (ctypes.c_uint32 * m)()
+        start = (ctypes.c_int64 * m)()
+        end = (ctypes.c_int64 * m)()
+        self.lib.pq_tw_result_sets(self.query, m, sets, start, end, ctypes.byref(window_id))
+        TW = [self.TW_registers[sets[i]] for i in range(m)]
+        query_interval = [[start[i], end[i]] for i in range(m)]
+        return result, TW, query_interval, window_id.value
+
+
+class QueueMonitorIndex:
+    def __init__(self, path, max_qdepth=25000, threads=0):
+        """
+        The stacks of QueueMonitor.filter_QM, reconstructed by libpqnative: a stack is derived from the previous one
+        through the valid slots of the snapshot only, and the stacks share their common entries
+        :param path: the path to the QM data folder, as QueueMonitor
+        :param threads: decoding threads, 0 for one per core
+        """
+        self.lib = load_library()
+        self.max_qdepth = max_qdepth
+        self.handle = self.lib.pq_qm_open(path.encode(), max_qdepth, threads)
+        if not self.handle:
+            raise IOError('Error loading queue monitor from {0}'.format(path))
+        self.query = self.lib.pq_qm_query_new(self.handle)
+        # self.QM_snapshots = [{'ts': [A, B, C], 'qdepth': integer, 'depth': integer, 'interval': integer}],
+        # the stacks of filter_QM without their entries (see stack)
+        self.QM_snapshots = []
+        sec, usec, wrap = ctypes.c_uint32(), ctypes.c_uint32(), ctypes.c_uint32()
+        interval, qdepth, depth = ctypes.c_int64(), ctypes.c_uint32(), ctypes.c_uint32()
+        prev_wrap = 0
+        for i in range(self.lib.pq_qm_snapshot_num(self.handle)):
+            self.lib.pq_qm_snapshot_info(self.handle, i, ctypes.byref(sec), ctypes.byref(usec), ctypes.byref(wrap),
+                                         ctypes.byref(interval), ctypes.byref(qdepth), ctypes.byref(depth))
+            self.QM_snapshots.append({'ts': [str(sec.value), str(usec.value), '1' if wrap.value > prev_wrap else '0'],
+                                      'qdepth': qdepth.value, 'depth': depth.value,
+                                      'interval': None if interval.value < 0 else interval.value})
+            prev_wrap = wrap.value
+        self.flow_number = self.lib.pq_qm_flow_num(self.handle)
+        print('Native index: {0} snapshots, {1} flows'.format(len(self.QM_snapshots), self.flow_number))
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            self.lib.pq_qm_query_free(self.query)
+            self.lib.pq_qm_close(self.handle)
+            self.handle = None
+
+    def stack(self, i):
+        """
+        the stack of snapshot i, as an element of QueueMonitor.QM_result
+        :return: {'ts': A_B_C, 'qdepth': integer, 'QM_result': [{'index': integer, 'FID': hex_string, 'seq': integer}],
+        'interval': integer}
+        """
+        s = self.QM_snapshots[i]
+        n = s['depth']
+        index = (ctypes.c_uint32 * max(n, 1))()
+        fid = (ctypes.c_uint64 * max(n, 1))()
+        seq = (ctypes.c_int64 * max(n, 1))()
+        self.lib.pq_qm_stack(self.handle, i, n, index, fid, seq)
+        return {'ts': s['ts'], 'qdepth': s['qdepth'],
+                'QM_result': [{'index': index[j], 'FID': '{0:016x}'.format(fid[j]), 'seq': seq[j]} for j in range(n)],
+                'interval': s['interval']}
+
+    def occupancy(self, t1, t2, K=0):
+        """
+        flows in the queue during [t1, t2] (microseconds, as the names of the snapshots): the entries of the stack in
+        force at t1 and those pushed until t2
+        :param K: only the Top-K flows (0: all)
+        :return: {'flow ID hex string': number of entries}, entries descending
+        """
+        n = self.lib.pq_qm_occupancy(self.query, t1, t2)
+        if n < 0:
+            print("For query {0} to {1}, no snapshot of the queue is found!".format(t1, t2))
+            return {}
+        n = n if K == 0 else min(n, K)
+        fid = (ctypes.c_uint64 * max(n, 1))()
+        count = (ctypes.c_uint32 * max(n, 1))()
+        n = self.lib.pq_qm_result(self.query, n, fid, count)
+        return {'{0:016x}'.format(fid[i]): count[i] for i in range(n)}
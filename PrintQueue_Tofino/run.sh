@@ -39,6 +39,7 @@ if [ "$1" == "--kernel-pkt" ]; then
     KERNEL_PKT_STR="--kernel-pkt"
 fi
 
+# PrintQueue options (e.g. --pq-mode, --rt-mode) are passed by PQ_OPTS
 # gdb -ex run --args 
 ./PrintQueue\
-	--install-dir $SDE_INSTALL --conf-file $TARGET_CONFIG_FILE --status-port 7777 $KERNEL_PKT_STR
\ No newline at end of file
+	--install-dir $SDE_INSTALL --conf-file $TARGET_CONFIG_FILE --status-port 7777 $KERNEL_PKT_STR $PQ_OPTS
\ No newline at end of file
@@ -0,0 +1,971 @@
+/*************************************************************************
+	> File Name: backend_model.c
+  > Description: Software model of the PrintQueue data plane: registers and
+  >              tables of time_windows_data_query.p4 / queue_monitor.p4,
+  >              egress FIFO queues, and signal frames sent to the CPU
+  >              interface
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "backend_model.h"
+
+#define ETHERTYPE_PRINTQUEUE_SIGNAL   0x080e
+#define MODEL_THRESHOLD_SLOTS (2 * THRESHOLD_FLOW_NUMBER)   // hash slots of the threshold table, at most half used
+#define MODEL_SIGNAL_BATCH 64
+#define MODEL_SIGNAL_LEN 66             // Ether + IPv4 + TCP + signal header
+#define MODEL_STEP_US 50                // packets are generated in steps of MODEL_STEP_US
+
+pq_model_config_t pq_model_config = {
+  .pcap_path = NULL,
+  .rate_gbps = 12,
+  .flows = 16,
+  .pkt_size = 1500,
+  .line_rate_gbps = 10,
+  .burst_on_us = 0,
+  .burst_off_us = 0,
+  .port = 0,
+  .signal_ifname = "lo",
+  .default_threshold = 10000,
+  .state_path = NULL,
+};
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                     Registers and Tables                           //
+//                                                                    //
+//--------------------------------------------------------------------//
+// Registers are laid out as in the data plane: index = isolation prefix
+// | second highest bit | highest bit | cell. IPs are stored in host order.
+// All of them are protected by model_lock, shared by the traffic thread
+// (the "pipeline") and the control plane.
+//----------------------------------------------------------------------
+static pthread_mutex_t model_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// get_isolation_id_tb
+typedef struct model_port{
+  uint16_t port;
+  uint16_t iso_id;
+  uint32_t iso_prefix;
+  uint64_t busy_until_ns;   // the last queued byte leaves the port (model clock)
+} model_port_t;
+
+// qdepth_alerting_threshold_2: (src, dst) -> threshold, open addressing
+typedef struct model_threshold{
+  bool used;
+  uint32_t src_ip, dst_ip;   // as populated by the control plane (network byte order)
+  uint32_t threshold;
+} model_threshold_t;
+
+//----------------------------------------------------------------------
+// The whole data plane state (tables, registers, model clock) is a single
+// block. With pq_model_config.state_path the block is a shared mapping of
+// that file, so that it outlives the process as the state of a switch
+// outlives its control plane: a restarted control plane finds its tables
+// and registers as they were (warm restart, checkpoint.c). The model
+// clock pauses while no process runs the model.
+//----------------------------------------------------------------------
+#define MODEL_STATE_MAGIC 0x53445150    // "PQDS"
+#define MODEL_STATE_VERSION 1
+
+typedef struct model_state{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t T, tw_reg_size, qm_reg_size, threshold_slots;   // layout of the block
+  uint64_t clock_ns;                  // model time reached
+  // per-port registers, indexed by isolation id
+  uint32_t highest_bit_r[MAX_PORT_NUM];
+  uint16_t data_query_lock_r[MAX_PORT_NUM];
+  uint32_t pre_pkt_qdepth_r[MAX_PORT_NUM];
+  uint32_t stack_top_r[MAX_PORT_NUM], seq_num_r[MAX_PORT_NUM], port_pkt_cnt_r[MAX_PORT_NUM];
+  // prepare_TW0_tb / prepare_qm_tb: second highest bit of every isolation id
+  bool prepared[MAX_PORT_NUM];
+  pq_mode_t prepare_mode[MAX_PORT_NUM];
+  uint32_t prepare_sh[MAX_PORT_NUM];
+  model_port_t ports[MAX_PORT_NUM];
+  uint16_t port_num;
+  model_threshold_t threshold_tb[MODEL_THRESHOLD_SLOTS];
+  // time windows: tts, src, dst of T windows x tw_reg_size; queue monitor: src, dst, seq x qm_reg_size
+  uint32_t regs[];
+} model_state_t;
+
+static model_state_t *dp = NULL;
+static size_t dp_size = 0;
+static bool dp_mapped = false;
+
+static uint32_t tw_reg_size, qm_reg_size;
+static uint32_t *tw_tts_r, *tw_src_r, *tw_dst_r;   // T windows x tw_reg_size
+static uint32_t *qm_src_r, *qm_dst_r, *qm_seq_r;   // qm_reg_size
+static uint32_t *highest_bit_r, *pre_pkt_qdepth_r, *stack_top_r, *seq_num_r, *port_pkt_cnt_r;
+static uint16_t *data_query_lock_r;
+static bool *prepared;
+static pq_mode_t *prepare_mode;
+static uint32_t *prepare_sh;
+static model_port_t *model_ports;
+static model_threshold_t *threshold_tb;
+// a batch of threshold operations (batch_begin / batch_end) holds model_lock
+// throughout, as the switch applies a batch at once
+static __thread bool model_in_batch = false;
+
+// top bits of a multiplicative hash of the whole key, scaled to the slots:
+// the low bits of the addresses (network byte order) are their first
+// octets, shared by many flows
+static inline uint32_t threshold_slot(uint32_t src_ip, uint32_t dst_ip){
+  uint64_t h = ((uint64_t)src_ip << 32 | dst_ip) * 0x9e3779b97f4a7c15ULL;
+  return ((h >> 32) * MODEL_THRESHOLD_SLOTS) >> 32;
+}
+
+static uint32_t threshold_lookup(uint32_t src_ip, uint32_t dst_ip){
+  uint32_t s = threshold_slot(src_ip, dst_ip);
+  for (uint32_t n = 0; n < MODEL_THRESHOLD_SLOTS && threshold_tb[s].used; n++){
+    if (threshold_tb[s].src_ip == src_ip && threshold_tb[s].dst_ip == dst_ip){
+      return threshold_tb[s].threshold;
+    }
+    s = (s + 1) % MODEL_THRESHOLD_SLOTS;
+  }
+  return pq_model_config.default_threshold;
+}
+
+//----------------------------------------------------------------------
+// Statistics of the model
+//----------------------------------------------------------------------
+static uint64_t stat_pkt_num, stat_drop_num, stat_byte_num, stat_signal_num, stat_signal_fail;
+static uint32_t stat_max_qdepth;
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                          Signal Frames                             //
+//                                                                    //
+//--------------------------------------------------------------------//
+// Signals are built under model_lock and sent after it is released.
+// Frame: Ethernet / IPv4 / TCP of the triggering packet, then the
+// printqueue_signal header at byte 54:
+// [type 16 | isolation id 16 | enqueue ts 32 | dequeue ts 32]
+//----------------------------------------------------------------------
+typedef struct model_pkt{
+  uint64_t arrival_ns;
+  uint32_t src_ip, dst_ip;     // network byte order
+  uint16_t src_port, dst_port; // host byte order
+  uint32_t len;
+  uint16_t port;               // egress port
+} model_pkt_t;
+
+static int signal_fd = -1;
+static struct sockaddr_ll signal_addr;
+static uint8_t signal_frames[MODEL_SIGNAL_BATCH][MODEL_SIGNAL_LEN];
+static uint32_t signal_frame_num = 0;
+
+static void model_signal(const model_pkt_t *pkt, uint16_t type, uint16_t iso_id, uint32_t enq_ts, uint32_t deq_ts){
+  if (signal_frame_num == MODEL_SIGNAL_BATCH){
+    stat_signal_fail += 1;
+    return;
+  }
+  uint8_t *f = signal_frames[signal_frame_num++];
+  uint16_t v16;
+  uint32_t v32;
+  memset(f, 0, MODEL_SIGNAL_LEN);
+  memset(f, 0xff, 6);                      // broadcast destination MAC
+  v16 = htons(ETHERTYPE_PRINTQUEUE_SIGNAL);
+  memcpy(f + 12, &v16, 2);
+  f[14] = 0x45;                            // IPv4, IHL 5
+  v16 = htons(MODEL_SIGNAL_LEN - 14);
+  memcpy(f + 16, &v16, 2);
+  f[22] = 64;                              // TTL
+  f[23] = 6;                               // TCP
+  memcpy(f + 26, &pkt->src_ip, 4);
+  memcpy(f + 30, &pkt->dst_ip, 4);
+  v16 = htons(pkt->src_port);
+  memcpy(f + 34, &v16, 2);
+  v16 = htons(pkt->dst_port);
+  memcpy(f + 36, &v16, 2);
+  f[46] = 0x50;                            // TCP data offset 5
+  v16 = htons(type);
+  memcpy(f + 54, &v16, 2);
+  v16 = htons(iso_id);
+  memcpy(f + 56, &v16, 2);
+  v32 = htonl(enq_ts);
+  memcpy(f + 58, &v32, 4);
+  v32 = htonl(deq_ts);
+  memcpy(f + 62, &v32, 4);
+}
+
+static void model_flush_signals(uint8_t frames[][MODEL_SIGNAL_LEN], uint32_t num){
+  for (uint32_t i = 0; i < num; i++){
+    if (signal_fd < 0 || sendto(signal_fd, frames[i], MODEL_SIGNAL_LEN, 0, (struct sockaddr *)&signal_addr, sizeof(signal_addr)) != MODEL_SIGNAL_LEN){
+      stat_signal_fail += 1;
+      continue;
+    }
+    stat_signal_num += 1;
+  }
+}
+
+static int model_open_signal_socket(void){
+  struct ifreq ifr;
+  if ((signal_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) == -1) {
+    printf("Model: fail to open the raw socket (%s), no signal is sent.\n", strerror(errno));
+    return -1;
+  }
+  memset(&ifr, 0, sizeof(struct ifreq));
+  strncpy(ifr.ifr_name, pq_model_config.signal_ifname, IFNAMSIZ-1);
+  if (ioctl(signal_fd, SIOCGIFINDEX, &ifr) < 0) {
+    printf("Model: SIOCGIFINDEX failed on %s, no signal is sent.\n", ifr.ifr_name);
+    close(signal_fd);
+    signal_fd = -1;
+    return -1;
+  }
+  memset(&signal_addr, 0, sizeof(signal_addr));
+  signal_addr.sll_family = AF_PACKET;
+  signal_addr.sll_ifindex = ifr.ifr_ifindex;
+  signal_addr.sll_protocol = htons(ETHERTYPE_PRINTQUEUE_SIGNAL);
+  signal_addr.sll_halen = 6;
+  memset(signal_addr.sll_addr, 0xff, 6);
+  printf("Model: signals are sent on %s\n", pq_model_config.signal_ifname);
+  return 0;
+}
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                           Pipeline                                 //
+//                                                                    //
+//--------------------------------------------------------------------//
+//----------------------------------------------------------------------
+// Data plane query (both data structures): a packet finding the previous
+// packet's enqueue qdepth above its threshold locks the port. The first
+// locking packet flips the highest bit, so that the half just written is
+// frozen for the control plane, and is mirrored to the CPU as a signal.
+//----------------------------------------------------------------------
+static bool model_exceed(uint16_t iso, const model_pkt_t *pkt, uint32_t enq_qdepth){
+  bool exceed = pre_pkt_qdepth_r[iso] >= threshold_lookup(pkt->src_ip, pkt->dst_ip);
+  pre_pkt_qdepth_r[iso] = enq_qdepth;
+  return exceed;
+}
+
+static void model_lock_and_flip(uint16_t iso, const model_pkt_t *pkt, uint32_t highest_shift, uint16_t type, uint32_t enq_ts, uint32_t deq_ts){
+  uint16_t locked = data_query_lock_r[iso];
+  data_query_lock_r[iso] = 1;
+  if (!locked){
+    highest_bit_r[iso] ^= 1 << highest_shift;
+    model_signal(pkt, type, iso, enq_ts, deq_ts);
+  }
+}
+
+//----------------------------------------------------------------------
+// time_windows_data_query.p4: the packet is stored in TW0 at the cell of
+// its dequeue tts; the evicted cell moves on to the next window when it
+// belongs to the previous cycle of the same cell, with tts >> a.
+//----------------------------------------------------------------------
+static void model_tw_update(const model_port_t *mp, const model_pkt_t *pkt, uint32_t enq_qdepth, uint32_t enq_ts, uint32_t deq_ts){
+  uint16_t iso = mp->iso_id;
+  uint32_t base = mp->iso_prefix | prepare_sh[iso] | highest_bit_r[iso];
+  uint32_t mask = (1 << k) - 1;
+  uint32_t tts = deq_ts >> TB0, src = ntohl(pkt->src_ip), dst = ntohl(pkt->dst_ip);
+  uint32_t idx, old_tts, old_src, old_dst;
+  if (model_exceed(iso, pkt, enq_qdepth)){
+    model_lock_and_flip(iso, pkt, highest_shift_bit, 4, enq_ts, deq_ts);
+  }
+  for (uint32_t t = 0; t < T; t++){
+    idx = t * tw_reg_size + (base | (tts & mask));
+    old_tts = tw_tts_r[idx];
+    old_src = tw_src_r[idx];
+    old_dst = tw_dst_r[idx];
+    tw_tts_r[idx] = tts;
+    tw_src_r[idx] = src;
+    tw_dst_r[idx] = dst;
+    if (old_tts == 0 || old_tts != tts - (1 << k)){
+      break;
+    }
+    tts = old_tts >> a;
+    src = old_src;
+    dst = old_dst;
+  }
+  port_pkt_cnt_r[iso] += 1;
+}
+
+//----------------------------------------------------------------------
+// queue_monitor.p4: the stack slot of the enqueue qdepth is overwritten
+// when the depth changes; every packet increments the seq number, whose
+// overflow also triggers a data plane query.
+//----------------------------------------------------------------------
+static void model_qm_update(const model_port_t *mp, const model_pkt_t *pkt, uint32_t enq_qdepth, uint32_t enq_ts, uint32_t deq_ts){
+  uint16_t iso = mp->iso_id;
+  bool changed = enq_qdepth != stack_top_r[iso];
+  uint32_t seq, idx;
+  stack_top_r[iso] = enq_qdepth;
+  seq = ++seq_num_r[iso];
+  idx = enq_qdepth | prepare_sh[iso] | mp->iso_prefix | highest_bit_r[iso];
+  if (model_exceed(iso, pkt, enq_qdepth) || seq == 0){
+    model_lock_and_flip(iso, pkt, highest_shift_bit_q, seq == 0 ? 2 : 1, enq_ts, deq_ts);
+  }
+  if (changed && idx < qm_reg_size){
+    qm_src_r[idx] = ntohl(pkt->src_ip);
+    qm_dst_r[idx] = ntohl(pkt->dst_ip);
+    qm_seq_r[idx] = seq;
+  }
+}
+
+//----------------------------------------------------------------------
+// Egress FIFO of the port: the packet waits for the bytes queued before
+// it, then leaves at line rate. Timestamps are the lower 32 bits of the
+// model clock in ns, as the 32-bit timestamps of the data plane.
+//----------------------------------------------------------------------
+static void model_process(const model_pkt_t *pkt){
+  model_port_t *mp = NULL;
+  for (uint16_t i = 0; i < dp->port_num; i++){
+    if (model_ports[i].port == pkt->port){
+      mp = &model_ports[i];
+      break;
+    }
+  }
+  if (mp == NULL || !prepared[mp->iso_id]){
+    return;
+  }
+  double bytes_per_ns = pq_model_config.line_rate_gbps / 8;
+  if (mp->busy_until_ns < pkt->arrival_ns){
+    mp->busy_until_ns = pkt->arrival_ns;
+  }
+  uint32_t queued = (mp->busy_until_ns - pkt->arrival_ns) * bytes_per_ns;
+  uint32_t enq_qdepth = (queued + MODEL_CELL_SIZE - 1) / MODEL_CELL_SIZE;
+  if (enq_qdepth + (pkt->len + MODEL_CELL_SIZE - 1) / MODEL_CELL_SIZE >= max_qdepth){
+    stat_drop_num += 1;   // tail drop
+    return;
+  }
+  uint32_t enq_ts = (uint32_t)pkt->arrival_ns;
+  uint32_t deq_ts = (uint32_t)mp->busy_until_ns;
+  mp->busy_until_ns += pkt->len / bytes_per_ns;
+  if (enq_qdepth > stat_max_qdepth){
+    stat_max_qdepth = enq_qdepth;
+  }
+  stat_pkt_num += 1;
+  stat_byte_num += pkt->len;
+  if (prepare_mode[mp->iso_id] == PQ_MODE_QM){
+    model_qm_update(mp, pkt, enq_qdepth, enq_ts, deq_ts);
+  }else{
+    model_tw_update(mp, pkt, enq_qdepth, enq_ts, deq_ts);
+  }
+}
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                          Traffic Sources                           //
+//                                                                    //
+//--------------------------------------------------------------------//
+static FILE *pcap_f = NULL;
+static bool pcap_swap = false, pcap_nsec = false;
+static uint32_t pcap_linktype = 1;
+static uint64_t pcap_first_ns = 0;
+// model time at which the traffic of this process starts (0, or the clock of a kept state)
+static uint64_t model_t0_ns = 0;
+
+static inline uint32_t pcap_u32(uint32_t v){
+  return pcap_swap ? __builtin_bswap32(v) : v;
+}
+
+static int pcap_open(const char *path){
+  uint32_t hdr[6];
+  pcap_f = fopen(path, "rb");
+  if (pcap_f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  if (fread(hdr, 4, 6, pcap_f) != 6){
+    printf("Error: %s is not a pcap file!\n", path);
+    return -1;
+  }
+  switch (hdr[0]){
+    case 0xa1b2c3d4: break;
+    case 0xd4c3b2a1: pcap_swap = true; break;
+    case 0xa1b23c4d: pcap_nsec = true; break;
+    case 0x4d3cb2a1: pcap_swap = true; pcap_nsec = true; break;
+    default:
+      printf("Error: %s is not a classic pcap file (pcapng is not supported)!\n", path);
+      return -1;
+  }
+  pcap_linktype = pcap_u32(hdr[5]);
+  if (pcap_linktype != 1 && pcap_linktype != 101){
+    printf("Error: link type %u of %s is not supported (Ethernet or raw IP)!\n", pcap_linktype, path);
+    return -1;
+  }
+  printf("Model: replay %s\n", path);
+  return 0;
+}
+
+// next IPv4 packet of the pcap file; arrival time is relative to the first packet, from model_t0_ns on
+static bool pcap_next(model_pkt_t *pkt){
+  uint32_t rec[4];
+  uint8_t data[128];
+  while (fread(rec, 4, 4, pcap_f) == 4){
+    uint32_t caplen = pcap_u32(rec[2]);
+    uint32_t n = caplen < sizeof(data) ? caplen : sizeof(data);
+    if (fread(data, 1, n, pcap_f) != n || (caplen > n && fseek(pcap_f, caplen - n, SEEK_CUR) != 0)){
+      return false;
+    }
+    uint64_t ts = (uint64_t)pcap_u32(rec[0]) * 1000000000 + (uint64_t)pcap_u32(rec[1]) * (pcap_nsec ? 1 : 1000);
+    uint32_t off = 0;
+    if (pcap_linktype == 1){
+      if (n < 14 || data[12] != 0x08 || data[13] != 0x00) continue;
+      off = 14;
+    }
+    if (n < off + 20 || (data[off] >> 4) != 4) continue;
+    uint32_t ihl = (data[off] & 0x0f) * 4;
+    if (pcap_first_ns == 0){
+      pcap_first_ns = ts;
+    }
+    pkt->arrival_ns = model_t0_ns + ts - pcap_first_ns;
+    memcpy(&pkt->src_ip, data + off + 12, 4);
+    memcpy(&pkt->dst_ip, data + off + 16, 4);
+    pkt->src_port = pkt->dst_port = 0;
+    if ((data[off + 9] == 6 || data[off + 9] == 17) && n >= off + ihl + 4){
+      pkt->src_port = (data[off + ihl] << 8) | data[off + ihl + 1];
+      pkt->dst_port = (data[off + ihl + 2] << 8) | data[off + ihl + 3];
+    }
+    pkt->len = pcap_u32(rec[3]);
+    pkt->port = pq_model_config.port ? pq_model_config.port : model_ports[0].port;
+    return true;
+  }
+  return false;
+}
+
+// next packet of the synthetic traffic: flows in round robin, constant gap within a burst
+static uint64_t synth_next_ns = 0;
+static uint32_t synth_flow = 0;
+
+static bool synth_next(model_pkt_t *pkt){
+  uint64_t gap = pq_model_config.pkt_size * 8 / pq_model_config.rate_gbps;
+  if (pq_model_config.burst_off_us){
+    uint64_t cycle = (uint64_t)(pq_model_config.burst_on_us + pq_model_config.burst_off_us) * 1000;
+    if (synth_next_ns % cycle >= (uint64_t)pq_model_config.burst_on_us * 1000){
+      synth_next_ns += cycle - synth_next_ns % cycle;
+    }
+  }
+  pkt->arrival_ns = synth_next_ns;
+  pkt->src_ip = htonl(0x0a000001 + synth_flow);     // 10.0.0.1 + flow
+  pkt->dst_ip = htonl(0x0a010001);                  // 10.1.0.1
+  pkt->src_port = 10000 + synth_flow;
+  pkt->dst_port = 5001;
+  pkt->len = pq_model_config.pkt_size;
+  pkt->port = pq_model_config.port ? pq_model_config.port : model_ports[synth_flow % dp->port_num].port;
+  synth_flow = (synth_flow + 1) % pq_model_config.flows;
+  synth_next_ns += gap ? gap : 1;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Traffic thread: the model clock starts (or resumes from model_t0_ns)
+// once every isolated port has its prepare entry (after pq_pollers_init).
+// Every MODEL_STEP_US, the packets arrived until now are pushed through
+// the pipeline, then the signals of the step are sent.
+//----------------------------------------------------------------------
+static pthread_t traffic_thread;
+static volatile bool model_running = false;
+
+static uint64_t mono_ns(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void *model_traffic_thread(void *arg){
+  uint8_t frames[MODEL_SIGNAL_BATCH][MODEL_SIGNAL_LEN];
+  uint32_t frame_num;
+  uint64_t start_ns = 0, now;
+  model_pkt_t pkt;
+  bool has_pkt = false, traffic_end = false;
+  (void)arg;
+  while (model_running){
+    pthread_mutex_lock(&model_lock);
+    if (start_ns == 0){
+      bool ready = dp->port_num > 0;
+      for (uint16_t i = 0; i < dp->port_num; i++){
+        ready = ready && prepared[model_ports[i].iso_id];
+      }
+      if (ready){
+        start_ns = mono_ns() - model_t0_ns;
+        printf("Model: traffic starts on %d port(s)\n", dp->port_num);
+      }
+    }
+    if (start_ns){
+      now = mono_ns() - start_ns;
+      dp->clock_ns = now;
+      while (!traffic_end){
+        if (!has_pkt){
+          has_pkt = pq_model_config.pcap_path ? pcap_next(&pkt) : synth_next(&pkt);
+          if (!has_pkt){
+            traffic_end = true;
+            printf("Model: end of the pcap file\n");
+            break;
+          }
+        }
+        if (pkt.arrival_ns > now) break;
+        model_process(&pkt);
+        has_pkt = false;
+      }
+    }
+    frame_num = signal_frame_num;
+    memcpy(frames, signal_frames, frame_num * MODEL_SIGNAL_LEN);
+    signal_frame_num = 0;
+    pthread_mutex_unlock(&model_lock);
+    model_flush_signals(frames, frame_num);
+    usleep(MODEL_STEP_US);
+  }
+  return NULL;
+}
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                       Backend Interface                            //
+//                                                                    //
+//--------------------------------------------------------------------//
+static void model_table_lock(void){
+  if (!model_in_batch){
+    pthread_mutex_lock(&model_lock);
+  }
+}
+
+static void model_table_unlock(void){
+  if (!model_in_batch){
+    pthread_mutex_unlock(&model_lock);
+  }
+}
+
+static void model_batch_begin(void){
+  pthread_mutex_lock(&model_lock);
+  model_in_batch = true;
+}
+
+static int model_batch_end(void){
+  model_in_batch = false;
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static int model_threshold_add(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold){
+  uint32_t s = threshold_slot(src_ip, dst_ip);
+  model_table_lock();
+  for (uint32_t n = 0; n < MODEL_THRESHOLD_SLOTS; n++){
+    if (!threshold_tb[s].used || (threshold_tb[s].src_ip == src_ip && threshold_tb[s].dst_ip == dst_ip)){
+      threshold_tb[s].used = true;
+      threshold_tb[s].src_ip = src_ip;
+      threshold_tb[s].dst_ip = dst_ip;
+      threshold_tb[s].threshold = threshold;
+      model_table_unlock();
+      return 0;
+    }
+    s = (s + 1) % MODEL_THRESHOLD_SLOTS;
+  }
+  model_table_unlock();
+  return -1;
+}
+
+static model_threshold_t *threshold_find(uint32_t src_ip, uint32_t dst_ip){
+  uint32_t s = threshold_slot(src_ip, dst_ip);
+  for (uint32_t n = 0; n < MODEL_THRESHOLD_SLOTS && threshold_tb[s].used; n++){
+    if (threshold_tb[s].src_ip == src_ip && threshold_tb[s].dst_ip == dst_ip){
+      return &threshold_tb[s];
+    }
+    s = (s + 1) % MODEL_THRESHOLD_SLOTS;
+  }
+  return NULL;
+}
+
+static int model_threshold_modify(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold){
+  model_table_lock();
+  model_threshold_t *t = threshold_find(src_ip, dst_ip);
+  if (t != NULL){
+    t->threshold = threshold;
+  }
+  model_table_unlock();
+  return t != NULL ? 0 : -1;
+}
+
+// the entries after the deleted one move back to the first free slot on their probe path
+static int model_threshold_delete(uint32_t src_ip, uint32_t dst_ip){
+  model_table_lock();
+  model_threshold_t *t = threshold_find(src_ip, dst_ip);
+  if (t == NULL){
+    model_table_unlock();
+    return -1;
+  }
+  uint32_t hole = t - threshold_tb, s = hole;
+  threshold_tb[hole].used = false;
+  for (uint32_t n = 0; n < MODEL_THRESHOLD_SLOTS; n++){
+    s = (s + 1) % MODEL_THRESHOLD_SLOTS;
+    if (!threshold_tb[s].used){
+      break;
+    }
+    uint32_t home = threshold_slot(threshold_tb[s].src_ip, threshold_tb[s].dst_ip);
+    // the entry stays if its home lies cyclically in (hole, s]
+    if ((s > hole && home > hole && home <= s) || (s < hole && (home > hole || home <= s))){
+      continue;
+    }
+    threshold_tb[hole] = threshold_tb[s];
+    threshold_tb[s].used = false;
+    hole = s;
+  }
+  model_table_unlock();
+  return 0;
+}
+
+static int model_isolation_add(uint16_t port, uint16_t iso_id, uint32_t iso_prefix){
+  if (dp->port_num == MAX_PORT_NUM || iso_id >= MAX_PORT_NUM){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  model_ports[dp->port_num].port = port;
+  model_ports[dp->port_num].iso_id = iso_id;
+  model_ports[dp->port_num].iso_prefix = iso_prefix;
+  model_ports[dp->port_num].busy_until_ns = 0;
+  dp->port_num += 1;
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static model_port_t *isolation_find(uint16_t port){
+  for (uint16_t i = 0; i < dp->port_num; i++){
+    if (model_ports[i].port == port){
+      return &model_ports[i];
+    }
+  }
+  return NULL;
+}
+
+static int model_isolation_get(uint16_t port, uint16_t *iso_id, uint32_t *iso_prefix){
+  pthread_mutex_lock(&model_lock);
+  model_port_t *mp = isolation_find(port);
+  if (mp != NULL){
+    *iso_id = mp->iso_id;
+    *iso_prefix = mp->iso_prefix;
+  }
+  pthread_mutex_unlock(&model_lock);
+  return mp != NULL ? 0 : -1;
+}
+
+static int model_isolation_modify(uint16_t port, uint16_t iso_id, uint32_t iso_prefix){
+  if (iso_id >= MAX_PORT_NUM){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  model_port_t *mp = isolation_find(port);
+  if (mp != NULL){
+    mp->iso_id = iso_id;
+    mp->iso_prefix = iso_prefix;
+  }
+  pthread_mutex_unlock(&model_lock);
+  return mp != NULL ? 0 : -1;
+}
+
+static int model_isolation_delete(uint16_t port){
+  pthread_mutex_lock(&model_lock);
+  model_port_t *mp = isolation_find(port);
+  if (mp != NULL){
+    *mp = model_ports[dp->port_num - 1];
+    dp->port_num -= 1;
+  }
+  pthread_mutex_unlock(&model_lock);
+  return mp != NULL ? 0 : -1;
+}
+
+static int model_prepare_add(pq_mode_t mode, uint16_t iso_id, uint32_t sh){
+  if (iso_id >= MAX_PORT_NUM){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  prepared[iso_id] = true;
+  prepare_mode[iso_id] = mode;
+  prepare_sh[iso_id] = sh;
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static int model_prepare_modify(pq_mode_t mode, uint16_t iso_id, uint32_t sh){
+  if (iso_id >= MAX_PORT_NUM || !prepared[iso_id] || prepare_mode[iso_id] != mode){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  prepare_sh[iso_id] = sh;
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static int model_prepare_get(pq_mode_t mode, uint16_t iso_id, uint32_t *sh){
+  if (iso_id >= MAX_PORT_NUM || !prepared[iso_id] || prepare_mode[iso_id] != mode){
+    return -1;
+  }
+  *sh = prepare_sh[iso_id];
+  return 0;
+}
+
+static int model_prepare_delete(pq_mode_t mode, uint16_t iso_id){
+  if (iso_id >= MAX_PORT_NUM || !prepared[iso_id] || prepare_mode[iso_id] != mode){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  prepared[iso_id] = false;
+  prepare_sh[iso_id] = 0;
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static void model_clear_tables(void){
+  pthread_mutex_lock(&model_lock);
+  dp->port_num = 0;
+  memset(prepared, 0, MAX_PORT_NUM * sizeof(bool));
+  memset(prepare_sh, 0, MAX_PORT_NUM * sizeof(uint32_t));
+  memset(threshold_tb, 0, MODEL_THRESHOLD_SLOTS * sizeof(model_threshold_t));
+  pthread_mutex_unlock(&model_lock);
+}
+
+// copy [start, start + count) of the registers, register r at buf + r * stride * 4
+static int model_range_copy(uint8_t *buf, uint32_t **regs, uint32_t reg_num, uint32_t reg_size, uint32_t start, uint32_t count, uint32_t stride){
+  if (start + count > reg_size){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  for (uint32_t r = 0; r < reg_num; r++){
+    memcpy(buf + (size_t)r * stride * 4, regs[r] + start, count * 4);
+  }
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static int model_tw_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  uint32_t *regs[3 * T];
+  for (uint32_t t = 0; t < T; t++){
+    regs[t * 3] = tw_tts_r + t * tw_reg_size;
+    regs[t * 3 + 1] = tw_src_r + t * tw_reg_size;
+    regs[t * 3 + 2] = tw_dst_r + t * tw_reg_size;
+  }
+  return model_range_copy(buf, regs, 3 * T, tw_reg_size, start, count, stride);
+}
+
+static int model_qm_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  uint32_t *regs[3] = {qm_src_r, qm_dst_r, qm_seq_r};
+  return model_range_copy(buf, regs, 3, qm_reg_size, start, count, stride);
+}
+
+static void model_qm_range_reset(uint32_t start, uint32_t count){
+  if (start + count > qm_reg_size){
+    return;
+  }
+  pthread_mutex_lock(&model_lock);
+  memset(qm_src_r + start, 0, count * 4);
+  memset(qm_dst_r + start, 0, count * 4);
+  memset(qm_seq_r + start, 0, count * 4);
+  pthread_mutex_unlock(&model_lock);
+}
+
+static int model_iso_reg_read(pq_reg_t reg, uint16_t iso_id, uint32_t *value){
+  if (iso_id >= MAX_PORT_NUM){
+    return -1;
+  }
+  pthread_mutex_lock(&model_lock);
+  switch (reg){
+    case PQ_REG_STACK_TOP:
+      *value = stack_top_r[iso_id];
+      break;
+    case PQ_REG_SEQ_NUM:
+      *value = seq_num_r[iso_id];
+      break;
+    case PQ_REG_PORT_PKT_CNT:
+      *value = port_pkt_cnt_r[iso_id];
+      break;
+    case PQ_REG_HIGHEST_BIT:
+      *value = highest_bit_r[iso_id];
+      break;
+    case PQ_REG_DATA_QUERY_LOCK:
+      *value = data_query_lock_r[iso_id];
+      break;
+    default:
+      pthread_mutex_unlock(&model_lock);
+      return -1;
+  }
+  pthread_mutex_unlock(&model_lock);
+  return 0;
+}
+
+static void model_data_query_unlock(uint16_t iso_id){
+  if (iso_id >= MAX_PORT_NUM){
+    return;
+  }
+  pthread_mutex_lock(&model_lock);
+  data_query_lock_r[iso_id] = 0;
+  pthread_mutex_unlock(&model_lock);
+}
+
+static void model_reset_query_state(void){
+  pthread_mutex_lock(&model_lock);
+  memset(highest_bit_r, 0, MAX_PORT_NUM * sizeof(uint32_t));
+  memset(data_query_lock_r, 0, MAX_PORT_NUM * sizeof(uint16_t));
+  pthread_mutex_unlock(&model_lock);
+}
+
+pq_backend_t pq_backend_model = {
+  .name = "model",
+  .cpu_ifname = "lo",
+  .modes = 1 << PQ_MODE_TW | 1 << PQ_MODE_QM,
+  .threshold_add = model_threshold_add,
+  .threshold_modify = model_threshold_modify,
+  .threshold_delete = model_threshold_delete,
+  .batch_begin = model_batch_begin,
+  .batch_end = model_batch_end,
+  .isolation_add = model_isolation_add,
+  .isolation_get = model_isolation_get,
+  .isolation_modify = model_isolation_modify,
+  .isolation_delete = model_isolation_delete,
+  .prepare_add = model_prepare_add,
+  .prepare_modify = model_prepare_modify,
+  .prepare_get = model_prepare_get,
+  .prepare_delete = model_prepare_delete,
+  .clear_tables = model_clear_tables,
+  .tw_range_read = model_tw_range_read,
+  .qm_range_read = model_qm_range_read,
+  .qm_range_reset = model_qm_range_reset,
+  .iso_reg_read = model_iso_reg_read,
+  .data_query_unlock = model_data_query_unlock,
+  .reset_query_state = model_reset_query_state,
+};
+
+//----------------------------------------------------------------------
+// The state block, mapped from state_path when it is set. A file of
+// another layout (parameters of control.c changed) is started over, as a
+// data plane reloaded with a new program.
+//----------------------------------------------------------------------
+static int model_state_open(void){
+  size_t regs = ((size_t)T * 3 * tw_reg_size + (size_t)3 * qm_reg_size) * 4;
+  dp_size = sizeof(model_state_t) + regs;
+  if (pq_model_config.state_path == NULL){
+    dp = calloc(1, dp_size);
+    if (dp == NULL){
+      printf("Model: allocating registers failed!\n");
+      return -1;
+    }
+  }else{
+    int fd = open(pq_model_config.state_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0){
+      printf("Model: error opening %s!\n", pq_model_config.state_path);
+      return -1;
+    }
+    // magic, version and layout of the block in the file
+    uint32_t h[6];
+    bool kept = pread(fd, h, sizeof(h), 0) == sizeof(h) && h[0] == MODEL_STATE_MAGIC && h[1] == MODEL_STATE_VERSION &&
+                h[2] == T && h[3] == tw_reg_size && h[4] == qm_reg_size && h[5] == MODEL_THRESHOLD_SLOTS;
+    if ((!kept && ftruncate(fd, 0) != 0) || ftruncate(fd, dp_size) != 0){
+      printf("Model: error sizing %s!\n", pq_model_config.state_path);
+      close(fd);
+      return -1;
+    }
+    dp = mmap(NULL, dp_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (dp == MAP_FAILED){
+      dp = NULL;
+      printf("Model: error mapping %s!\n", pq_model_config.state_path);
+      return -1;
+    }
+    dp_mapped = true;
+    if (kept){
+      printf("Model: data plane state kept in %s, %d port(s), model clock %.3f s\n", pq_model_config.state_path, dp->port_num, dp->clock_ns / 1e9);
+    }else{
+      printf("Model: new data plane state in %s\n", pq_model_config.state_path);
+    }
+  }
+  dp->magic = MODEL_STATE_MAGIC;
+  dp->version = MODEL_STATE_VERSION;
+  dp->T = T;
+  dp->tw_reg_size = tw_reg_size;
+  dp->qm_reg_size = qm_reg_size;
+  dp->threshold_slots = MODEL_THRESHOLD_SLOTS;
+  highest_bit_r = dp->highest_bit_r;
+  data_query_lock_r = dp->data_query_lock_r;
+  pre_pkt_qdepth_r = dp->pre_pkt_qdepth_r;
+  stack_top_r = dp->stack_top_r;
+  seq_num_r = dp->seq_num_r;
+  port_pkt_cnt_r = dp->port_pkt_cnt_r;
+  prepared = dp->prepared;
+  prepare_mode = dp->prepare_mode;
+  prepare_sh = dp->prepare_sh;
+  model_ports = dp->ports;
+  threshold_tb = dp->threshold_tb;
+  tw_tts_r = dp->regs;
+  tw_src_r = tw_tts_r + (size_t)T * tw_reg_size;
+  tw_dst_r = tw_src_r + (size_t)T * tw_reg_size;
+  qm_src_r = tw_dst_r + (size_t)T * tw_reg_size;
+  qm_dst_r = qm_src_r + qm_reg_size;
+  qm_seq_r = qm_dst_r + qm_reg_size;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Allocate the registers from the parameters of control.c: both data
+// structures cover 2^(highest shift bit + 1) entries.
+//----------------------------------------------------------------------
+int pq_model_init(void){
+  tw_reg_size = 1 << (highest_shift_bit + 1);
+  qm_reg_size = 1 << (highest_shift_bit_q + 1);
+  if (model_state_open() != 0){
+    return -1;
+  }
+  if (pq_model_config.pcap_path && pcap_open(pq_model_config.pcap_path) != 0){
+    return -1;
+  }
+  if (!pq_model_config.pcap_path && (pq_model_config.rate_gbps <= 0 || pq_model_config.flows == 0 || pq_model_config.pkt_size == 0)){
+    printf("Model: rate, flows and packet size must be positive!\n");
+    return -1;
+  }
+  if (pq_model_config.line_rate_gbps <= 0){
+    printf("Model: line rate must be positive!\n");
+    return -1;
+  }
+  model_open_signal_socket();
+  printf("Model: %d x %d time windows entries, %d queue monitor entries\n", T, tw_reg_size, qm_reg_size);
+  return 0;
+}
+
+int pq_model_start(void){
+  // a kept state resumes its clock; its queues drained while the model was not running
+  model_t0_ns = dp->clock_ns;
+  synth_next_ns = model_t0_ns;
+  for (uint16_t i = 0; i < dp->port_num; i++){
+    model_ports[i].busy_until_ns = 0;
+  }
+  model_running = true;
+  if (pthread_create(&traffic_thread, NULL, &model_traffic_thread, NULL) != 0){
+    printf("Error: creation of model traffic thread failed!\n");
+    model_running = false;
+    return -1;
+  }
+  return 0;
+}
+
+void pq_model_stop(void){
+  if (model_running){
+    model_running = false;
+    pthread_join(traffic_thread, NULL);
+  }
+  if (signal_fd >= 0){
+    close(signal_fd);
+    signal_fd = -1;
+  }
+  if (pcap_f){
+    fclose(pcap_f);
+    pcap_f = NULL;
+  }
+  if (dp_mapped){
+    msync(dp, dp_size, MS_SYNC);
+  }
+}
+
+void pq_model_print_stats(void){
+  printf("Model: %lu packets (%lu bytes), %lu dropped, max enqueue qdepth %u cells, %lu signals sent, %lu signals lost\n",
+      stat_pkt_num, stat_byte_num, stat_drop_num, stat_max_qdepth, stat_signal_num, stat_signal_fail);
+}
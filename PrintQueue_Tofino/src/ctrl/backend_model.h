@@ -0,0 +1,49 @@
+/*************************************************************************
+	> File Name: backend_model.h
+  > Description: Software model of the PrintQueue data plane, used as the
+  >              register and table backend when no Tofino is available
+*************************************************************************/
+
+#ifndef _BACKEND_MODEL_H_
+#define _BACKEND_MODEL_H_
+
+#include "printqueue.h"
+
+//----------------------------------------------------------------------
+// Traffic driving the model.
+// Synthetic traffic: flows sending pkt_size-byte packets at rate_gbps in
+// total, during burst_on_us out of every burst_on_us + burst_off_us
+// (burst_off_us = 0: constant rate). Flows are spread over the ports of
+// the isolation table unless port is set.
+// pcap_path: replay a classic pcap file (Ethernet or raw IP) at its
+// original pace instead; every packet goes to port (or the first
+// isolated port).
+// Every egress port is a FIFO drained at line_rate_gbps, whose depth is
+// counted in cells of MODEL_CELL_SIZE bytes and bounded by max_qdepth.
+// state_path: keep the tables and registers in this file, so that they
+// survive a restart of the control plane as on a switch (NULL: in memory)
+//----------------------------------------------------------------------
+#define MODEL_CELL_SIZE 80
+
+typedef struct pq_model_config {
+  const char *pcap_path;
+  double rate_gbps;
+  uint32_t flows;
+  uint32_t pkt_size;
+  double line_rate_gbps;
+  uint32_t burst_on_us, burst_off_us;
+  uint16_t port;               // 0: spread flows over the isolated ports
+  const char *signal_ifname;   // interface on which signal frames are sent
+  uint32_t default_threshold;  // DEFAULT_QDEPTH_THRESHOLD of includes.p4
+  const char *state_path;
+} pq_model_config_t;
+
+extern pq_model_config_t pq_model_config;
+extern pq_backend_t pq_backend_model;
+
+int pq_model_init(void);
+int pq_model_start(void);
+void pq_model_stop(void);
+void pq_model_print_stats(void);
+
+#endif
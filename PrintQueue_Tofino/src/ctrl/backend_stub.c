@@ -0,0 +1,207 @@
+/*************************************************************************
+	> File Name: backend_stub.c
+  > Description: In-process stub of the data plane: register reads cost a
+  >              configurable latency, signals are generated at a given
+  >              rate and queued without the CPU interface
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "backend_stub.h"
+
+pq_stub_config_t pq_stub_config = {
+  .read_entry_ns = 20,
+  .read_call_us = 50,
+  .reg_read_us = 10,
+  .signal_rate = 0,
+  .qm_stack_top = 12500,
+};
+
+uint64_t stub_signal_num = 0, stub_signal_suppressed = 0;
+
+static volatile uint16_t stub_lock[MAX_PORT_NUM];
+static uint32_t stub_pkt_cnt[MAX_PORT_NUM], stub_seq_num[MAX_PORT_NUM];
+
+static uint64_t mono_ns(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// busy wait, as the control plane does while the driver reads the registers
+static void stub_spin_ns(uint64_t ns){
+  uint64_t end = mono_ns() + ns;
+  while (mono_ns() < end);
+}
+
+//--------------------------------------------------------------------//
+//                       Backend Interface                            //
+//--------------------------------------------------------------------//
+static int stub_threshold_add(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold){
+  (void)src_ip; (void)dst_ip; (void)threshold;
+  return 0;
+}
+
+static int stub_isolation_add(uint16_t port, uint16_t iso_id, uint32_t iso_prefix){
+  (void)port; (void)iso_prefix;
+  return iso_id < MAX_PORT_NUM ? 0 : -1;
+}
+
+static int stub_prepare(pq_mode_t mode, uint16_t iso_id, uint32_t sh){
+  (void)mode; (void)sh;
+  stub_spin_ns((uint64_t)pq_stub_config.reg_read_us * 1000);
+  return iso_id < MAX_PORT_NUM ? 0 : -1;
+}
+
+static int stub_range_read(uint32_t start, uint32_t count, uint32_t stride, uint32_t reg_num, uint8_t *buf){
+  stub_spin_ns((uint64_t)pq_stub_config.read_call_us * 1000 + (uint64_t)count * reg_num * pq_stub_config.read_entry_ns);
+  // the entries of the range hold their index, written as the driver converts them
+  for (uint32_t r = 0; r < reg_num; r++){
+    uint32_t *col = (uint32_t *)(buf + (size_t)r * stride * 4);
+    for (uint32_t i = 0; i < count; i++){
+      col[i] = start + i;
+    }
+  }
+  return 0;
+}
+
+static int stub_tw_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  return stub_range_read(start, count, stride, T * 3, buf);
+}
+
+static int stub_qm_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  return stub_range_read(start, count, stride, 3, buf);
+}
+
+static void stub_qm_range_reset(uint32_t start, uint32_t count){
+  (void)start;
+  stub_spin_ns((uint64_t)pq_stub_config.read_call_us * 1000 + (uint64_t)count * 3 * pq_stub_config.read_entry_ns / 4);
+}
+
+// ports always look busy: the packet counter and the seq number move between reads
+static int stub_iso_reg_read(pq_reg_t reg, uint16_t iso_id, uint32_t *value){
+  if (iso_id >= MAX_PORT_NUM){
+    return -1;
+  }
+  stub_spin_ns((uint64_t)pq_stub_config.reg_read_us * 1000);
+  switch (reg){
+    case PQ_REG_STACK_TOP:
+      *value = pq_stub_config.qm_stack_top;
+      break;
+    case PQ_REG_SEQ_NUM:
+      stub_seq_num[iso_id] += 1000;
+      *value = stub_seq_num[iso_id];
+      break;
+    case PQ_REG_PORT_PKT_CNT:
+      stub_pkt_cnt[iso_id] += 1000;
+      *value = stub_pkt_cnt[iso_id];
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
+static void stub_data_query_unlock(uint16_t iso_id){
+  if (iso_id < MAX_PORT_NUM){
+    stub_lock[iso_id] = 0;
+  }
+}
+
+static void stub_reset_query_state(void){
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    stub_lock[i] = 0;
+  }
+}
+
+pq_backend_t pq_backend_stub = {
+  .name = "stub",
+  .cpu_ifname = NULL,   // signals are queued in process
+  .modes = 1 << PQ_MODE_TW | 1 << PQ_MODE_QM,
+  .threshold_add = stub_threshold_add,
+  .isolation_add = stub_isolation_add,
+  .prepare_add = stub_prepare,
+  .prepare_modify = stub_prepare,
+  .tw_range_read = stub_tw_range_read,
+  .qm_range_read = stub_qm_range_read,
+  .qm_range_reset = stub_qm_range_reset,
+  .iso_reg_read = stub_iso_reg_read,
+  .data_query_unlock = stub_data_query_unlock,
+  .reset_query_state = stub_reset_query_state,
+};
+
+//--------------------------------------------------------------------//
+//                        Signal Generator                            //
+//--------------------------------------------------------------------//
+// Takes the place of the signal-receiving thread: the only producer of
+// the signal queue. Ports are picked in round robin.
+//--------------------------------------------------------------------
+static pthread_t stub_thread;
+static volatile bool stub_running = false;
+
+static void *stub_signal_thread(void *arg){
+  uint64_t next = mono_ns();
+  uint16_t rr = 0;
+  unsigned int seed = 1;
+  struct in_addr src_ip, dst_ip;
+  (void)arg;
+  pq_trace_thread_name("stub");
+  src_ip.s_addr = htonl(0x0a000001);
+  dst_ip.s_addr = htonl(0x0a010001);
+  while (stub_running){
+    // exponential gap between signals
+    double u = (rand_r(&seed) + 1.0) / ((double)RAND_MAX + 2.0);
+    next += (uint64_t)(-log(u) / pq_stub_config.signal_rate * 1e9);
+    while (stub_running && mono_ns() < next){
+      struct timespec t = {0, 100000};
+      uint64_t left = next - mono_ns();
+      if (left < 100000){
+        t.tv_nsec = left;
+      }
+      nanosleep(&t, NULL);
+    }
+    if (!stub_running || port_entry_num == 0){
+      break;
+    }
+    uint16_t idx = rr++ % port_entry_num;
+    uint16_t iso = port_table[idx].isolation_id;
+    if (stub_lock[iso]){
+      stub_signal_suppressed += 1;
+      continue;
+    }
+    stub_lock[iso] = 1;
+    uint32_t ts = (uint32_t)mono_ns();
+    if (pq_signal_enqueue(port_table[idx].mode == PQ_MODE_QM ? 1 : 4, iso, src_ip, dst_ip, 10000, 5001, ts, ts) != 0){
+      stub_lock[iso] = 0;   // lost signal: the stub does not keep the port locked forever
+      continue;
+    }
+    stub_signal_num += 1;
+  }
+  return NULL;
+}
+
+int pq_stub_start(void){
+  stub_signal_num = 0;
+  stub_signal_suppressed = 0;
+  if (pq_stub_config.signal_rate <= 0){
+    return 0;
+  }
+  stub_running = true;
+  if (pthread_create(&stub_thread, NULL, &stub_signal_thread, NULL) != 0){
+    printf("Error: creation of stub signal thread failed!\n");
+    stub_running = false;
+    return -1;
+  }
+  return 0;
+}
+
+void pq_stub_stop(void){
+  if (stub_running){
+    stub_running = false;
+    pthread_join(stub_thread, NULL);
+  }
+}
@@ -0,0 +1,39 @@
+/*************************************************************************
+	> File Name: backend_stub.h
+  > Description: In-process stub of the data plane with a configurable
+  >              register read latency, used by the control loop benchmark
+*************************************************************************/
+
+#ifndef _BACKEND_STUB_H_
+#define _BACKEND_STUB_H_
+
+#include "printqueue.h"
+
+//----------------------------------------------------------------------
+// A range read of count entries of reg_num registers costs
+// read_call_us + count * reg_num * read_entry_ns, spent busy waiting as
+// the PD calls do. Per-port register reads and table modifications cost
+// reg_read_us.
+// signal_rate: data plane query signals per second over all ports
+// (Poisson arrivals). A locked port sends no signal until its data plane
+// query is unlocked, as in the data plane.
+// qm_stack_top: stack top returned for queue monitor ports
+//----------------------------------------------------------------------
+typedef struct pq_stub_config {
+  uint32_t read_entry_ns;
+  uint32_t read_call_us;
+  uint32_t reg_read_us;
+  double signal_rate;
+  uint32_t qm_stack_top;
+} pq_stub_config_t;
+
+extern pq_stub_config_t pq_stub_config;
+extern pq_backend_t pq_backend_stub;
+
+// signals sent and signals held back by a locked port since pq_stub_start
+extern uint64_t stub_signal_num, stub_signal_suppressed;
+
+int pq_stub_start(void);
+void pq_stub_stop(void);
+
+#endif
@@ -0,0 +1,507 @@
+/*************************************************************************
+	> File Name: backend_tofino.c
+  > Description: Register and table backend of the Tofino data plane
+  >              (PD API and pipe manager)
+*************************************************************************/
+
+#include <string.h>
+
+#include "backend_tofino.h"
+
+#define PIPE_MGR_SUCCESS 0
+// all the links of the testbed go through pipeline 1 of the switch
+#define OUTPUT_PIPE_ID 1
+
+p4_pd_sess_hdl_t pq_sess_hdl = 0;
+p4_pd_sess_hdl_t pq_table_sess_hdl = 0;
+p4_pd_dev_target_t pq_dev_tgt;
+
+#ifndef PQ_QUEUE_MONITOR
+//----------------------------------------------------------------------
+// The following function range read registers of time windows.
+// Based on the C API provided after compilation, the following
+// code gets rid of some unneccessary parts to achieve higher reading
+// speed and less used memory.
+//-----------------------------------------------------------------------
+p4_pd_status_t
+p4_pd_time_windows_register_range_read
+(
+ p4_pd_sess_hdl_t sess_hdl,
+ p4_pd_dev_target_t dev_tgt,
+ int index,
+ int count,
+ int flags,
+ int *num_actually_read,
+ uint8_t *register_values,
+ int stride,
+ int *value_count,
+ int output_pipe_id,
+ int T
+)
+{
+  p4_pd_status_t status;
+  dev_target_t pipe_mgr_dev_tgt;
+  pipe_mgr_dev_tgt.device_id = dev_tgt.device_id;
+  pipe_mgr_dev_tgt.dev_pipe_id = dev_tgt.dev_pipe_id;
+
+  uint32_t pipe_api_flags = flags & REGISTER_READ_HW_SYNC ?
+                            PIPE_FLAG_SYNC_REQ : 0;
+  /* Get the maximum number of elements the query can return. */
+  int pipe_count, num_vals_per_pipe;
+  status = pipe_stful_query_get_sizes(sess_hdl,
+                                      dev_tgt.device_id,
+                                      100663301,
+                                      &pipe_count,
+                                      &num_vals_per_pipe);
+  if(status != PIPE_MGR_SUCCESS) return status;
+  /* Allocate space for the query results. */
+  pipe_stful_mem_query_t *stful_query = bf_sys_calloc(count, sizeof *stful_query);
+  pipe_stful_mem_spec_t **pipe_data = bf_sys_calloc(pipe_count * count, sizeof *pipe_data);
+  pipe_stful_mem_spec_t *stage_data = bf_sys_calloc(pipe_count * num_vals_per_pipe * count, sizeof *stage_data);
+  if (!stful_query || !pipe_data || !stage_data) {
+    status = PIPE_NO_SYS_RESOURCES;
+    goto free_query_data;
+  }
+
+  for (int j=0; j<count; ++j) {
+    stful_query[j].pipe_count = pipe_count;
+    stful_query[j].instance_per_pipe_count = num_vals_per_pipe;
+    stful_query[j].data = pipe_data + (pipe_count * j);
+    for (int o=0; o<pipe_count; ++o) {
+      stful_query[j].data[o] = stage_data + (pipe_count * j * num_vals_per_pipe) + (num_vals_per_pipe * o);
+    }
+  }
+//   printf("pipe count: %d, instance_per_pipe_count: %d, count: %d\n", pipe_count, num_vals_per_pipe, count);
+ 
+    // ------------------------------------------------------------------------------------------------------------------
+    //   Please check and modify the handle_id under your environment. 
+    //   They can be found at your $SDE/pkgsrc/p4-build/tofino/printqueue/src/pd.c after compilation.
+    //   When the number of time windows changes, remember to modify the number of elements in handle_id
+    //-------------------------------------------------------------------------------------------------------------------
+    int handle_id_data_query[] = {100663301, 100663302, 100663303, // TW0: tts, srcIP, dstIP
+                            100663306, 100663307, 100663308,       // TW1: tts, srcIP, dstIP
+                            100663311, 100663312, 100663313,       // TW2: tts, srcIP, dstIP
+                            100663316, 100663317, 100663318        // TW3: tts, srcIP, dstIP
+                          };
+    uint total = 0;
+    for (int rn = 0; rn < T * 3; rn ++){
+        /* Perform the query.*/
+        // ------------------------------------------------------------------------------------
+        // The following function accepts the handle id. Change according to your setting.
+        //------------------------------------------------------------------------------------
+        uint64_t t_ns = pq_stats_now();
+        status = pipe_stful_ent_query_range(sess_hdl, pipe_mgr_dev_tgt,
+                                            handle_id_data_query[rn], index, count,
+                                            stful_query, num_actually_read,
+                                            pipe_api_flags);
+        t_ns = pq_stats_phase(PQ_PHASE_REG_READ, t_ns);
+
+        // if(status != PIPE_MGR_SUCCESS) goto free_query_data;
+        /* Convert the query data to PD format, straight into the column of the register. */
+        uint8_t *reg_values = register_values + (size_t)rn * stride * 4;
+        *value_count = 0;
+        // printf("num_actual_read: %d\n", *num_actually_read);
+        for (int i=0; i<*num_actually_read; ++i) {
+            *value_count += 1 * stful_query->instance_per_pipe_count;
+
+            for(int s = 0; s < stful_query->instance_per_pipe_count; s++) {
+                memcpy(reg_values, &(stful_query + i)->data[output_pipe_id][s].word, 4);
+                reg_values += 4;
+                total++;
+            }
+        }
+        // printf("value count: %d\n", *value_count);
+        pq_stats_phase(PQ_PHASE_REPACK, t_ns);
+    }
+    // printf("total: %d\n", total);
+  
+free_query_data:
+  if (stful_query) bf_sys_free(stful_query);
+  if (pipe_data) bf_sys_free(pipe_data);
+  if (stage_data) bf_sys_free(stage_data);
+  return status;
+}
+#else
+//----------------------------------------------------------------------
+// The following function range read registers of queue monitor.
+// Based on the C API provided after compilation, the following
+// code gets rid of some unneccessary parts to achieve higher reading
+// speed and less used memory.
+//-----------------------------------------------------------------------
+p4_pd_status_t
+p4_pd_queue_monitor_register_range_read
+(
+ p4_pd_sess_hdl_t sess_hdl,
+ p4_pd_dev_target_t dev_tgt,
+ int index,
+ int count,
+ int flags,
+ int *num_actually_read,
+ uint8_t *register_values,
+ int stride,
+ int *value_count,
+ int output_pipe_id
+)
+{
+  p4_pd_status_t status;
+  dev_target_t pipe_mgr_dev_tgt;
+  pipe_mgr_dev_tgt.device_id = dev_tgt.device_id;
+  pipe_mgr_dev_tgt.dev_pipe_id = dev_tgt.dev_pipe_id;
+
+  uint32_t pipe_api_flags = flags & REGISTER_READ_HW_SYNC ?
+                            PIPE_FLAG_SYNC_REQ : 0;
+  /* Get the maximum number of elements the query can return. */
+  int pipe_count, num_vals_per_pipe;
+  status = pipe_stful_query_get_sizes(sess_hdl,
+                                      dev_tgt.device_id,
+                                      100663304,
+                                      &pipe_count,
+                                      &num_vals_per_pipe);
+  if(status != PIPE_MGR_SUCCESS) return status;
+  /* Allocate space for the query results. */
+  pipe_stful_mem_query_t *stful_query = bf_sys_calloc(count, sizeof *stful_query);
+  pipe_stful_mem_spec_t **pipe_data = bf_sys_calloc(pipe_count * count, sizeof *pipe_data);
+  pipe_stful_mem_spec_t *stage_data = bf_sys_calloc(pipe_count * num_vals_per_pipe * count, sizeof *stage_data);
+  if (!stful_query || !pipe_data || !stage_data) {
+    status = PIPE_NO_SYS_RESOURCES;
+    goto free_query_data;
+  }
+
+  for (int j=0; j<count; ++j) {
+    stful_query[j].pipe_count = pipe_count;
+    stful_query[j].instance_per_pipe_count = num_vals_per_pipe;
+    stful_query[j].data = pipe_data + (pipe_count * j);
+    for (int o=0; o<pipe_count; ++o) {
+      stful_query[j].data[o] = stage_data + (pipe_count * j * num_vals_per_pipe) + (num_vals_per_pipe * o);
+    }
+  }
+//   printf("pipe count: %d, instance_per_pipe_count: %d, count: %d\n", pipe_count, num_vals_per_pipe, count);
+
+    // ------------------------------------------------------------------------------------------------------------------
+    //   Please check and modify the handle_id under your environment. They can be found at your pd.c after compilation.
+    //-------------------------------------------------------------------------------------------------------------------
+    int handle_id[] = {100663304, 100663305,100663306}; // src_ip, dst_ip, seq_num
+
+    uint total = 0;
+    for (int rn = 0; rn < 3; rn ++){
+        /* Perform the query. */
+        // ------------------------------------------------------------------------------------
+        // The following function accepts the handle id. Change according to your setting.
+        //------------------------------------------------------------------------------------
+        uint64_t t_ns = pq_stats_now();
+        status = pipe_stful_ent_query_range(sess_hdl, pipe_mgr_dev_tgt,
+                                            handle_id[rn], index, count,
+                                            stful_query, num_actually_read,
+                                            pipe_api_flags);
+        t_ns = pq_stats_phase(PQ_PHASE_REG_READ, t_ns);
+        // if(status != PIPE_MGR_SUCCESS) goto free_query_data;
+        /* Convert the query data to PD format, straight into the column of the register. */
+        uint8_t *reg_values = register_values + (size_t)rn * stride * 4;
+        *value_count = 0;
+        // printf("num_actual_read: %d\n", *num_actually_read);
+        for (int i=0; i<*num_actually_read; ++i) {
+            *value_count += 1 * stful_query->instance_per_pipe_count;
+
+            for(int s = 0; s < stful_query->instance_per_pipe_count; s++) {
+                memcpy(reg_values, &(stful_query + i)->data[output_pipe_id][s].word, 4);
+                reg_values += 4;
+                total++;
+            }
+        }
+        // printf("value count: %d\n", *value_count);
+        pq_stats_phase(PQ_PHASE_REPACK, t_ns);
+    }
+    // printf("total: %d\n", total);
+  
+free_query_data:
+  if (stful_query) bf_sys_free(stful_query);
+  if (pipe_data) bf_sys_free(pipe_data);
+  if (stage_data) bf_sys_free(stage_data);
+  return status;
+}
+#endif
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                        PD API wrappers                             //
+//                                                                    //
+//--------------------------------------------------------------------//
+// The thresholds go through a session of their own: a batch of a reload
+// does not hold back the register reads of the pollers on pq_sess_hdl.
+static void tofino_batch_begin(void){
+  p4_pd_begin_batch(pq_table_sess_hdl);
+}
+
+static int tofino_batch_end(void){
+  return p4_pd_end_batch(pq_table_sess_hdl, true);
+}
+
+static int tofino_threshold_add(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold){
+  p4_pd_entry_hdl_t hdl;
+  p4_pd_printqueue_qdepth_alerting_threshold_2_match_spec_t match;
+  p4_pd_printqueue_set_threshold_action_spec_t action;
+  match.ipv4_src_addr = src_ip;
+  match.ipv4_dst_addr = dst_ip;
+  action.action_flow_threshold = threshold;
+  return p4_pd_printqueue_qdepth_alerting_threshold_2_table_add_with_set_threshold(pq_table_sess_hdl, pq_dev_tgt, &match, &action, &hdl);
+}
+
+static int tofino_threshold_modify(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold){
+  p4_pd_printqueue_qdepth_alerting_threshold_2_match_spec_t match;
+  p4_pd_printqueue_set_threshold_action_spec_t action;
+  match.ipv4_src_addr = src_ip;
+  match.ipv4_dst_addr = dst_ip;
+  action.action_flow_threshold = threshold;
+  return p4_pd_printqueue_qdepth_alerting_threshold_2_table_modify_with_set_threshold_by_match_spec(pq_table_sess_hdl, pq_dev_tgt, &match, &action);
+}
+
+static int tofino_threshold_delete(uint32_t src_ip, uint32_t dst_ip){
+  p4_pd_printqueue_qdepth_alerting_threshold_2_match_spec_t match;
+  match.ipv4_src_addr = src_ip;
+  match.ipv4_dst_addr = dst_ip;
+  return p4_pd_printqueue_qdepth_alerting_threshold_2_table_delete_by_match_spec(pq_table_sess_hdl, pq_dev_tgt, &match);
+}
+
+static int tofino_isolation_add(uint16_t port, uint16_t iso_id, uint32_t iso_prefix){
+  p4_pd_entry_hdl_t hdl;
+  p4_pd_printqueue_get_isolation_id_tb_match_spec_t match;
+  p4_pd_printqueue_get_isolation_id_action_spec_t action;
+  match.ig_intr_md_for_tm_ucast_egress_port = port;
+  action.action_iso_id = iso_id;
+  action.action_iso_prefix = iso_prefix;
+  return p4_pd_printqueue_get_isolation_id_tb_table_add_with_get_isolation_id(pq_sess_hdl, pq_dev_tgt, &match, &action, &hdl);
+}
+
+// the entry as installed in the hardware, for a warm restart
+static int tofino_isolation_get(uint16_t port, uint16_t *iso_id, uint32_t *iso_prefix){
+  p4_pd_entry_hdl_t hdl;
+  p4_pd_printqueue_get_isolation_id_tb_match_spec_t match;
+  p4_pd_printqueue_action_specs_t action;
+  match.ig_intr_md_for_tm_ucast_egress_port = port;
+  p4_pd_status_t status = p4_pd_printqueue_get_isolation_id_tb_match_spec_to_entry_hdl(pq_sess_hdl, pq_dev_tgt, &match, &hdl);
+  if (status != 0){
+    return status;
+  }
+  status = p4_pd_printqueue_get_isolation_id_tb_get_entry(pq_sess_hdl, pq_dev_tgt.device_id, hdl, true, &match, &action);
+  if (status != 0){
+    return status;
+  }
+  *iso_id = action.u.p4_pd_printqueue_get_isolation_id.action_iso_id;
+  *iso_prefix = action.u.p4_pd_printqueue_get_isolation_id.action_iso_prefix;
+  return 0;
+}
+
+static int tofino_isolation_modify(uint16_t port, uint16_t iso_id, uint32_t iso_prefix){
+  p4_pd_printqueue_get_isolation_id_tb_match_spec_t match;
+  p4_pd_printqueue_get_isolation_id_action_spec_t action;
+  match.ig_intr_md_for_tm_ucast_egress_port = port;
+  action.action_iso_id = iso_id;
+  action.action_iso_prefix = iso_prefix;
+  return p4_pd_printqueue_get_isolation_id_tb_table_modify_with_get_isolation_id_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match, &action);
+}
+
+static int tofino_isolation_delete(uint16_t port){
+  p4_pd_printqueue_get_isolation_id_tb_match_spec_t match;
+  match.ig_intr_md_for_tm_ucast_egress_port = port;
+  return p4_pd_printqueue_get_isolation_id_tb_table_delete_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match);
+}
+
+// only the prepare table of the data structure main.p4 includes exists
+static int tofino_prepare_add(pq_mode_t mode, uint16_t iso_id, uint32_t sh){
+  p4_pd_entry_hdl_t hdl;
+  if (mode != PQ_TOFINO_MODE){
+    return -1;
+  }
+#ifdef PQ_QUEUE_MONITOR
+  p4_pd_printqueue_prepare_qm_tb_match_spec_t match;
+  p4_pd_printqueue_prepare_qm_action_spec_t action;
+  match.PQ_md_isolation_id = iso_id;
+  action.action_second_highest = sh;
+  return p4_pd_printqueue_prepare_qm_tb_table_add_with_prepare_qm(pq_sess_hdl, pq_dev_tgt, &match, &action, &hdl);
+#else
+  p4_pd_printqueue_prepare_TW0_tb_match_spec_t match;
+  p4_pd_printqueue_prepare_TW0_action_spec_t action;
+  match.PQ_md_isolation_id = iso_id;
+  action.action_second_highest = sh;
+  return p4_pd_printqueue_prepare_TW0_tb_table_add_with_prepare_TW0(pq_sess_hdl, pq_dev_tgt, &match, &action, &hdl);
+#endif
+}
+
+static int tofino_prepare_modify(pq_mode_t mode, uint16_t iso_id, uint32_t sh){
+  if (mode != PQ_TOFINO_MODE){
+    return -1;
+  }
+#ifdef PQ_QUEUE_MONITOR
+  p4_pd_printqueue_prepare_qm_tb_match_spec_t match;
+  p4_pd_printqueue_prepare_qm_action_spec_t action;
+  match.PQ_md_isolation_id = iso_id;
+  action.action_second_highest = sh;
+  return p4_pd_printqueue_prepare_qm_tb_table_modify_with_prepare_qm_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match, &action);
+#else
+  p4_pd_printqueue_prepare_TW0_tb_match_spec_t match;
+  p4_pd_printqueue_prepare_TW0_action_spec_t action;
+  match.PQ_md_isolation_id = iso_id;
+  action.action_second_highest = sh;
+  return p4_pd_printqueue_prepare_TW0_tb_table_modify_with_prepare_TW0_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match, &action);
+#endif
+}
+
+static int tofino_prepare_get(pq_mode_t mode, uint16_t iso_id, uint32_t *sh){
+  p4_pd_entry_hdl_t hdl;
+  p4_pd_printqueue_action_specs_t action;
+  p4_pd_status_t status;
+  if (mode != PQ_TOFINO_MODE){
+    return -1;
+  }
+#ifdef PQ_QUEUE_MONITOR
+  p4_pd_printqueue_prepare_qm_tb_match_spec_t match;
+  match.PQ_md_isolation_id = iso_id;
+  status = p4_pd_printqueue_prepare_qm_tb_match_spec_to_entry_hdl(pq_sess_hdl, pq_dev_tgt, &match, &hdl);
+  if (status == 0){
+    status = p4_pd_printqueue_prepare_qm_tb_get_entry(pq_sess_hdl, pq_dev_tgt.device_id, hdl, true, &match, &action);
+  }
+  if (status == 0){
+    *sh = action.u.p4_pd_printqueue_prepare_qm.action_second_highest;
+  }
+#else
+  p4_pd_printqueue_prepare_TW0_tb_match_spec_t match;
+  match.PQ_md_isolation_id = iso_id;
+  status = p4_pd_printqueue_prepare_TW0_tb_match_spec_to_entry_hdl(pq_sess_hdl, pq_dev_tgt, &match, &hdl);
+  if (status == 0){
+    status = p4_pd_printqueue_prepare_TW0_tb_get_entry(pq_sess_hdl, pq_dev_tgt.device_id, hdl, true, &match, &action);
+  }
+  if (status == 0){
+    *sh = action.u.p4_pd_printqueue_prepare_TW0.action_second_highest;
+  }
+#endif
+  return status;
+}
+
+static int tofino_prepare_delete(pq_mode_t mode, uint16_t iso_id){
+  if (mode != PQ_TOFINO_MODE){
+    return -1;
+  }
+#ifdef PQ_QUEUE_MONITOR
+  p4_pd_printqueue_prepare_qm_tb_match_spec_t match;
+  match.PQ_md_isolation_id = iso_id;
+  return p4_pd_printqueue_prepare_qm_tb_table_delete_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match);
+#else
+  p4_pd_printqueue_prepare_TW0_tb_match_spec_t match;
+  match.PQ_md_isolation_id = iso_id;
+  return p4_pd_printqueue_prepare_TW0_tb_table_delete_by_match_spec(pq_sess_hdl, pq_dev_tgt, &match);
+#endif
+}
+
+// every entry of the tables this program installs, for a cold start over a running data plane
+#define TOFINO_CLEAR_TABLE(tb) do { \
+    p4_pd_entry_hdl_t hdl; \
+    while (p4_pd_printqueue_##tb##_get_first_entry_handle(pq_sess_hdl, pq_dev_tgt, (int *)&hdl) == 0) { \
+      if (p4_pd_printqueue_##tb##_table_delete(pq_sess_hdl, pq_dev_tgt.device_id, hdl) != 0) { \
+        break; \
+      } \
+    } \
+  } while (0)
+
+static void tofino_clear_tables(void){
+  TOFINO_CLEAR_TABLE(qdepth_alerting_threshold_2);
+  TOFINO_CLEAR_TABLE(get_isolation_id_tb);
+#ifdef PQ_QUEUE_MONITOR
+  TOFINO_CLEAR_TABLE(prepare_qm_tb);
+#else
+  TOFINO_CLEAR_TABLE(prepare_TW0_tb);
+#endif
+  p4_pd_complete_operations(pq_sess_hdl);
+}
+
+// a short read leaves stale words at the end of the columns: reported as a failure
+#ifndef PQ_QUEUE_MONITOR
+static int tofino_tw_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  int actual_read = 0, value_count;
+  p4_pd_status_t status = p4_pd_time_windows_register_range_read(pq_sess_hdl, pq_dev_tgt, start, count, 1, &actual_read, buf, stride, &value_count, OUTPUT_PIPE_ID, T);
+  return status != 0 ? status : (actual_read == (int)count ? 0 : -1);
+}
+#else
+static int tofino_qm_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  int actual_read = 0, value_count;
+  p4_pd_status_t status = p4_pd_queue_monitor_register_range_read(pq_sess_hdl, pq_dev_tgt, start, count, 1, &actual_read, buf, stride, &value_count, OUTPUT_PIPE_ID);
+  return status != 0 ? status : (actual_read == (int)count ? 0 : -1);
+}
+
+static void tofino_qm_range_reset(uint32_t start, uint32_t count){
+  p4_pd_printqueue_register_range_reset_src_ip_r(pq_sess_hdl, pq_dev_tgt, start, count);
+  p4_pd_printqueue_register_range_reset_dst_ip_r(pq_sess_hdl, pq_dev_tgt, start, count);
+  p4_pd_printqueue_register_range_reset_seq_array_r(pq_sess_hdl, pq_dev_tgt, start, count);
+}
+#endif
+
+// per-port registers hold one value per pipeline
+static int tofino_iso_reg_read(pq_reg_t reg, uint16_t iso_id, uint32_t *value){
+  uint32_t values[4] = {0};
+  int value_count;
+  p4_pd_status_t status;
+  switch (reg){
+#ifdef PQ_QUEUE_MONITOR
+    case PQ_REG_STACK_TOP:
+      status = p4_pd_printqueue_register_read_stack_top_r(pq_sess_hdl, pq_dev_tgt, iso_id, REGISTER_READ_HW_SYNC, values, &value_count);
+      break;
+    case PQ_REG_SEQ_NUM:
+      status = p4_pd_printqueue_register_read_seq_num_r(pq_sess_hdl, pq_dev_tgt, iso_id, REGISTER_READ_HW_SYNC, values, &value_count);
+      break;
+#else
+    case PQ_REG_PORT_PKT_CNT:
+      status = p4_pd_printqueue_register_read_port_pkt_cnt_r(pq_sess_hdl, pq_dev_tgt, iso_id, REGISTER_READ_HW_SYNC, values, &value_count);
+      break;
+#endif
+    case PQ_REG_HIGHEST_BIT:
+      status = p4_pd_printqueue_register_read_highest_bit_r(pq_sess_hdl, pq_dev_tgt, iso_id, REGISTER_READ_HW_SYNC, values, &value_count);
+      break;
+    case PQ_REG_DATA_QUERY_LOCK:
+      status = p4_pd_printqueue_register_read_data_query_lock_r(pq_sess_hdl, pq_dev_tgt, iso_id, REGISTER_READ_HW_SYNC, values, &value_count);
+      break;
+    default:
+      return -1;
+  }
+  if (status != 0){
+    return status;
+  }
+  *value = values[OUTPUT_PIPE_ID];
+  return 0;
+}
+
+static void tofino_data_query_unlock(uint16_t iso_id){
+  p4_pd_printqueue_register_range_reset_data_query_lock_r(pq_sess_hdl, pq_dev_tgt, iso_id, 1);
+}
+
+static void tofino_reset_query_state(void){
+  p4_pd_printqueue_register_reset_all_highest_bit_r(pq_sess_hdl, pq_dev_tgt);
+  p4_pd_printqueue_register_reset_all_data_query_lock_r(pq_sess_hdl, pq_dev_tgt);
+}
+
+pq_backend_t pq_backend_tofino = {
+  .name = "tofino",
+  .cpu_ifname = "bf_pci0",
+  .modes = 1 << PQ_TOFINO_MODE,
+  .threshold_add = tofino_threshold_add,
+  .threshold_modify = tofino_threshold_modify,
+  .threshold_delete = tofino_threshold_delete,
+  .batch_begin = tofino_batch_begin,
+  .batch_end = tofino_batch_end,
+  .isolation_add = tofino_isolation_add,
+  .isolation_get = tofino_isolation_get,
+  .isolation_modify = tofino_isolation_modify,
+  .isolation_delete = tofino_isolation_delete,
+  .prepare_add = tofino_prepare_add,
+  .prepare_modify = tofino_prepare_modify,
+  .prepare_get = tofino_prepare_get,
+  .prepare_delete = tofino_prepare_delete,
+  .clear_tables = tofino_clear_tables,
+#ifdef PQ_QUEUE_MONITOR
+  .qm_range_read = tofino_qm_range_read,
+  .qm_range_reset = tofino_qm_range_reset,
+#else
+  .tw_range_read = tofino_tw_range_read,
+#endif
+  .iso_reg_read = tofino_iso_reg_read,
+  .data_query_unlock = tofino_data_query_unlock,
+  .reset_query_state = tofino_reset_query_state,
+};
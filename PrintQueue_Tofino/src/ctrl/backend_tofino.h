@@ -0,0 +1,31 @@
+/*************************************************************************
+	> File Name: backend_tofino.h
+  > Description: Register and table backend of the Tofino data plane
+*************************************************************************/
+
+#ifndef _BACKEND_TOFINO_H_
+#define _BACKEND_TOFINO_H_
+
+#include "pd/pd.h"
+#include "printqueue.h"
+
+// sessions and device of the PD API, opened by main (PrintQueue.c)
+extern p4_pd_sess_hdl_t pq_sess_hdl;
+extern p4_pd_sess_hdl_t pq_table_sess_hdl;   // qdepth_threshold table (batches)
+extern p4_pd_dev_target_t pq_dev_tgt;
+
+//----------------------------------------------------------------------
+// main.p4 includes the program of one data structure, and the PD API and
+// register handles are generated for that one only: the control plane is
+// built for the same (make PQ_DATA_PLANE=qm defines PQ_QUEUE_MONITOR for
+// both, time windows otherwise).
+//----------------------------------------------------------------------
+#ifdef PQ_QUEUE_MONITOR
+#define PQ_TOFINO_MODE PQ_MODE_QM
+#else
+#define PQ_TOFINO_MODE PQ_MODE_TW
+#endif
+
+extern pq_backend_t pq_backend_tofino;
+
+#endif
@@ -0,0 +1,403 @@
+/*************************************************************************
+	> File Name: checkpoint.c
+  > Description: Checkpoint of the control plane state and warm restart:
+  >              tables and sessions reprogrammed by difference, bit parity
+  >              taken back from the data plane
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "printqueue.h"
+
+const char *pq_checkpoint_path = NULL;
+bool pq_warm = false;
+bool pq_warm_port[MAX_PORT_NUM];
+pq_table_diff_t pq_warm_ports, pq_warm_thresholds;
+
+//----------------------------------------------------------------------
+// Checkpoint file: the header, then threshold_num pq_threshold_t (the
+// installed qdepth_threshold entries, sorted by flow). It is written to
+// <path>.tmp and renamed over the previous one.
+// PQ_CKPT_DIRTY is set in place when a start reprograms the data plane
+// from the checkpoint and cleared by the next save: a checkpoint left
+// dirty (crash while programming) no longer tells what is installed.
+// Items are the tables and sessions of the main program (front ports,
+// mirror session), kept as a digest of their configuration.
+// All fields are little endian.
+//----------------------------------------------------------------------
+#define PQ_CHECKPOINT_MAGIC 0x4b435150  // "PQCK"
+#define PQ_CHECKPOINT_VERSION 1
+#define PQ_CKPT_DIRTY 0x1
+#define PQ_CHECKPOINT_ITEMS 32
+#define PQ_CHECKPOINT_PARAMS 10
+// a lock found at the start is the data plane query of a signal sent
+// before the socket listened (lost), or of one still on its way
+#define PQ_WARM_SETTLE_MS 20
+
+typedef struct pq_checkpoint_item_rec {
+  char key[24];
+  uint64_t digest;
+} pq_checkpoint_item_rec_t;
+
+typedef struct pq_checkpoint_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;           // sizeof(pq_checkpoint_header_t)
+  uint32_t flags;
+  uint32_t threshold_num;
+  int64_t saved_us;               // wall clock of the save
+  char boot_id[40];               // host boot: the clock fit holds within a boot
+  uint32_t params[PQ_CHECKPOINT_PARAMS];  // k, T, a, TB0, kq, max_qdepth, shift bits of both modules
+  uint16_t port_entry_num;
+  uint16_t item_num;
+  port_entry_t port_table[MAX_PORT_NUM];
+  uint32_t highest[MAX_PORT_NUM];
+  uint32_t second_highest[MAX_PORT_NUM];
+  uint32_t qm_seq_mark[MAX_PORT_NUM];   // queue monitor: seq number at the last flip (poller.c)
+  uint32_t qm_seq_floor[MAX_PORT_NUM];  // and at the one before
+  uint8_t wrap[MAX_PORT_NUM];
+  pq_clock_t clock;
+  pq_checkpoint_item_rec_t items[PQ_CHECKPOINT_ITEMS];
+} pq_checkpoint_header_t;
+
+static pq_checkpoint_header_t ckpt;           // loaded, valid when pq_warm
+static pq_threshold_t *ckpt_thresholds = NULL;
+static pq_checkpoint_item_rec_t items[PQ_CHECKPOINT_ITEMS];   // items of this run
+static uint16_t item_num = 0;
+static int64_t warm_start_ns = 0;
+// ports locked at the start, and the highest bit set then
+static bool warm_pending[MAX_PORT_NUM];
+static uint32_t warm_highest[MAX_PORT_NUM];
+
+static void checkpoint_params(uint32_t *p){
+  p[0] = k;
+  p[1] = T;
+  p[2] = a;
+  p[3] = TB0;
+  p[4] = kq;
+  p[5] = max_qdepth;
+  p[6] = highest_shift_bit;
+  p[7] = second_highest_shift_bit;
+  p[8] = highest_shift_bit_q;
+  p[9] = second_highest_shift_bit_q;
+}
+
+static void checkpoint_boot_id(char *id, size_t len){
+  memset(id, 0, len);
+  FILE *f = fopen("/proc/sys/kernel/random/boot_id", "r");
+  if (f != NULL){
+    if (fgets(id, len, f) == NULL){
+      id[0] = 0;
+    }
+    fclose(f);
+  }
+}
+
+static uint64_t checkpoint_digest(const void *cfg, size_t len){
+  const uint8_t *p = cfg;
+  uint64_t h = 14695981039346656037ULL;   // FNV-1a
+  for (size_t i = 0; i < len; i++){
+    h = (h ^ p[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+//----------------------------------------------------------------------
+// The checkpoint stands for the data plane when its parameters are those
+// of this run and every port entry it holds reads back unchanged, with
+// its prepare entry.
+//----------------------------------------------------------------------
+static bool checkpoint_verify(void){
+  uint32_t params[PQ_CHECKPOINT_PARAMS], sh, prefix;
+  uint16_t iso;
+  checkpoint_params(params);
+  if (memcmp(params, ckpt.params, sizeof(params))){
+    printf("Checkpoint: parameters changed\n");
+    return false;
+  }
+  if (!pq_backend->isolation_get || !pq_backend->prepare_get || !pq_backend->isolation_modify || !pq_backend->isolation_delete
+      || !pq_backend->prepare_delete || !pq_backend->threshold_modify || !pq_backend->threshold_delete){
+    printf("Checkpoint: the %s backend cannot read back nor modify its tables\n", pq_backend->name);
+    return false;
+  }
+  if (ckpt.port_entry_num == 0 || ckpt.port_entry_num > MAX_PORT_NUM){
+    return false;
+  }
+  for (uint16_t i = 0; i < ckpt.port_entry_num; i++){
+    const port_entry_t *e = &ckpt.port_table[i];
+    if (pq_backend->isolation_get(e->port, &iso, &prefix) != 0 || iso != e->isolation_id || prefix != e->isolation_prefix
+        || pq_backend->prepare_get(e->mode, e->isolation_id, &sh) != 0){
+      printf("Checkpoint: port %d is not installed as checkpointed (data plane reset)\n", e->port);
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Called by the main program once the backend is up, before any table is
+// programmed. Sets pq_warm when the checkpoint can be resumed; otherwise
+// every table is cleared, so that a cold start programs empty tables.
+//----------------------------------------------------------------------
+int pq_checkpoint_load(void){
+  pq_warm = false;
+  memset(pq_warm_port, 0, sizeof(pq_warm_port));
+  memset(&pq_warm_ports, 0, sizeof(pq_warm_ports));
+  memset(&pq_warm_thresholds, 0, sizeof(pq_warm_thresholds));
+  item_num = 0;
+  if (pq_checkpoint_path == NULL){
+    return 0;
+  }
+  warm_start_ns = pq_clock_host_ns();
+  FILE *f = fopen(pq_checkpoint_path, "r+b");
+  if (f == NULL){
+    printf("Checkpoint: no %s, cold start\n", pq_checkpoint_path);
+  }else if (fread(&ckpt, sizeof(ckpt), 1, f) != 1 || ckpt.magic != PQ_CHECKPOINT_MAGIC || ckpt.version != PQ_CHECKPOINT_VERSION
+            || ckpt.header_size != sizeof(ckpt)){
+    printf("Checkpoint: %s is not a checkpoint of this version, cold start\n", pq_checkpoint_path);
+  }else if (ckpt.flags & PQ_CKPT_DIRTY){
+    printf("Checkpoint: %s was left while programming the data plane, cold start\n", pq_checkpoint_path);
+  }else{
+    free(ckpt_thresholds);
+    ckpt_thresholds = malloc((ckpt.threshold_num ? ckpt.threshold_num : 1) * sizeof(pq_threshold_t));
+    if (ckpt_thresholds == NULL || fread(ckpt_thresholds, sizeof(pq_threshold_t), ckpt.threshold_num, f) != ckpt.threshold_num){
+      printf("Checkpoint: %s is truncated, cold start\n", pq_checkpoint_path);
+    }else if (checkpoint_verify()){
+      // from now on the data plane differs from the checkpoint until the next save
+      uint32_t flags = ckpt.flags | PQ_CKPT_DIRTY;
+      if (fseek(f, offsetof(pq_checkpoint_header_t, flags), SEEK_SET) != 0 || fwrite(&flags, sizeof(flags), 1, f) != 1 || fflush(f) != 0){
+        printf("Checkpoint: error writing %s!\n", pq_checkpoint_path);
+        fclose(f);
+        return -1;
+      }
+      pq_warm = true;
+      printf("Checkpoint: warm start from %s (saved %ld.%06ld), %d port(s), %u thresholds\n", pq_checkpoint_path,
+             ckpt.saved_us / 1000000, ckpt.saved_us % 1000000, ckpt.port_entry_num, ckpt.threshold_num);
+    }
+  }
+  if (f != NULL){
+    fclose(f);
+  }
+  if (!pq_warm && pq_backend->clear_tables){
+    pq_backend->clear_tables();
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// A table or session of the main program, key: its name, cfg: its whole
+// configuration. PQ_CKPT_SAME: installed as is by the previous run (warm
+// start only), nothing to do; PQ_CKPT_CHANGED: installed with another
+// configuration; PQ_CKPT_NEW: not installed.
+//----------------------------------------------------------------------
+int pq_checkpoint_item(const char *key, const void *cfg, size_t len){
+  uint64_t digest = checkpoint_digest(cfg, len);
+  int state = PQ_CKPT_NEW;
+  if (pq_warm){
+    for (uint16_t i = 0; i < ckpt.item_num && i < PQ_CHECKPOINT_ITEMS; i++){
+      if (!strncmp(ckpt.items[i].key, key, sizeof(ckpt.items[i].key))){
+        state = ckpt.items[i].digest == digest ? PQ_CKPT_SAME : PQ_CKPT_CHANGED;
+        break;
+      }
+    }
+  }
+  if (item_num < PQ_CHECKPOINT_ITEMS){
+    memset(&items[item_num], 0, sizeof(items[item_num]));
+    strncpy(items[item_num].key, key, sizeof(items[item_num].key) - 1);
+    items[item_num].digest = digest;
+    item_num++;
+  }else{
+    printf("Checkpoint: more than %d items, %s is not checkpointed\n", PQ_CHECKPOINT_ITEMS, key);
+  }
+  return state;
+}
+
+//----------------------------------------------------------------------
+// Mark the saved checkpoint dirty before the data plane is programmed
+// again while running (reload of the thresholds); the next save clears it.
+//----------------------------------------------------------------------
+int pq_checkpoint_dirty(void){
+  if (pq_checkpoint_path == NULL){
+    return 0;
+  }
+  uint32_t flags;
+  FILE *f = fopen(pq_checkpoint_path, "r+b");
+  if (f == NULL){
+    return 0;
+  }
+  if (fseek(f, offsetof(pq_checkpoint_header_t, flags), SEEK_SET) != 0 || fread(&flags, sizeof(flags), 1, f) != 1){
+    fclose(f);
+    return 0;
+  }
+  flags |= PQ_CKPT_DIRTY;
+  if (fseek(f, offsetof(pq_checkpoint_header_t, flags), SEEK_SET) != 0 || fwrite(&flags, sizeof(flags), 1, f) != 1
+      || fflush(f) != 0 || fsync(fileno(f)) != 0){
+    printf("Checkpoint: error writing %s!\n", pq_checkpoint_path);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+
+// installed entries of the previous run, sorted by flow (warm start only)
+const pq_threshold_t *pq_checkpoint_thresholds(uint32_t *num){
+  *num = pq_warm ? ckpt.threshold_num : 0;
+  return pq_warm ? ckpt_thresholds : NULL;
+}
+
+// port entries of the previous run (warm start only)
+uint16_t pq_checkpoint_ports(const port_entry_t **table){
+  *table = ckpt.port_table;
+  return pq_warm ? ckpt.port_entry_num : 0;
+}
+
+//----------------------------------------------------------------------
+// Save the state of this run. Called once the data plane is programmed,
+// after a reload of the thresholds and when the control plane stops.
+//----------------------------------------------------------------------
+int pq_checkpoint_save(void){
+  if (pq_checkpoint_path == NULL){
+    return 0;
+  }
+  pq_checkpoint_header_t h;
+  struct timeval now;
+  char tmp[512];
+  memset(&h, 0, sizeof(h));
+  h.magic = PQ_CHECKPOINT_MAGIC;
+  h.version = PQ_CHECKPOINT_VERSION;
+  h.header_size = sizeof(h);
+  h.threshold_num = pq_threshold_num;
+  gettimeofday(&now, NULL);
+  h.saved_us = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+  checkpoint_boot_id(h.boot_id, sizeof(h.boot_id));
+  checkpoint_params(h.params);
+  h.port_entry_num = port_entry_num;
+  h.item_num = item_num;
+  memcpy(h.port_table, port_table, sizeof(h.port_table));
+  memcpy(h.highest, highest, sizeof(h.highest));
+  memcpy(h.second_highest, second_highest, sizeof(h.second_highest));
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    h.wrap[i] = wrap[i];
+    // moved by the poll thread (qm_flip, poller.c)
+    h.qm_seq_mark[i] = __atomic_load_n(&qm_seq_mark[i], __ATOMIC_RELAXED);
+    h.qm_seq_floor[i] = __atomic_load_n(&qm_seq_floor[i], __ATOMIC_RELAXED);
+  }
+  pq_clock_get(&h.clock);
+  memcpy(h.items, items, sizeof(h.items));
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", pq_checkpoint_path);
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL){
+    printf("Error opening %s!\n", tmp);
+    return -1;
+  }
+  if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(pq_thresholds, sizeof(pq_threshold_t), pq_threshold_num, f) != pq_threshold_num
+      || fflush(f) != 0 || fsync(fileno(f)) != 0){
+    printf("Error writing %s!\n", tmp);
+    fclose(f);
+    unlink(tmp);
+    return -1;
+  }
+  fclose(f);
+  if (rename(tmp, pq_checkpoint_path) != 0){
+    printf("Error renaming %s: %s\n", tmp, strerror(errno));
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Warm start, before the signal-receiving thread: the switch clock fit
+// (same host boot only), the overflow marks not stored yet and the seq
+// marks of the queue monitor ports whose prepare entry is kept.
+//----------------------------------------------------------------------
+void pq_warm_restore(void){
+  char boot_id[40];
+  checkpoint_boot_id(boot_id, sizeof(boot_id));
+  if (ckpt.clock.samples && !memcmp(boot_id, ckpt.boot_id, sizeof(boot_id))){
+    pq_clock_restore(&ckpt.clock);
+  }
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    for (uint16_t j = 0; j < ckpt.port_entry_num; j++){
+      if (ckpt.port_table[j].port == port_table[i].port && ckpt.port_table[j].mode == port_table[i].mode){
+        wrap[i] = ckpt.wrap[j];
+        if (pq_warm_port[i]){
+          qm_seq_mark[i] = ckpt.qm_seq_mark[j];
+          qm_seq_floor[i] = ckpt.qm_seq_floor[j];
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// Warm start, by the signal-receiving thread once its socket is bound and
+// before it receives: the bits of every port are read back from the data
+// plane. The highest bit is the one of the current half, flipped once
+// more by the signal of a locked port; every signal sent from now on is
+// received and flips it back. The second highest bit is the one of the
+// NEXT period, the prepare entry holds the current one.
+// A queue monitor port without a checkpointed seq mark, or with one
+// ahead of the seq number of the data plane, takes the seq number read
+// now as both marks: every slot written so far counts as stale.
+//----------------------------------------------------------------------
+void pq_warm_resume(void){
+  uint32_t h, lock, sh, seq;
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    uint16_t iso = port_table[i].isolation_id;
+    h = lock = 0;
+    if (pq_backend->iso_reg_read(PQ_REG_HIGHEST_BIT, iso, &h) != 0 || pq_backend->iso_reg_read(PQ_REG_DATA_QUERY_LOCK, iso, &lock) != 0){
+      printf("Warning: port %d, reading the query state failed, assumed unlocked in the first half\n", port_table[i].port);
+    }
+    warm_highest[i] = h != 0;
+    warm_pending[i] = lock != 0;
+    highest[i] = warm_highest[i] ^ warm_pending[i];
+    if (pq_warm_port[i] && pq_backend->prepare_get(port_table[i].mode, iso, &sh) == 0){
+      second_highest[i] = (sh != 0) ^ 1;
+    }
+    if (port_table[i].mode == PQ_MODE_QM && pq_backend->iso_reg_read(PQ_REG_SEQ_NUM, iso, &seq) == 0
+        && (!pq_warm_port[i] || (int32_t)(seq - qm_seq_mark[i]) < 0)){
+      qm_seq_mark[i] = qm_seq_floor[i] = seq;
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// Warm start, before polling: a port still locked PQ_WARM_SETTLE_MS after
+// the socket listens lost its signal. Its data plane query is given up:
+// the host takes the bit flipped by the data plane and unlocks the port.
+//----------------------------------------------------------------------
+void pq_warm_settle(void){
+  uint32_t lost = 0, kept = 0;
+  bool pending = true;
+  for (int t = 0; t < PQ_WARM_SETTLE_MS && pending; t++){
+    pending = false;
+    for (uint16_t i = 0; i < port_entry_num; i++){
+      pending = pending || (warm_pending[i] && highest[i] != warm_highest[i]);
+    }
+    if (pending){
+      usleep(1000);
+    }
+  }
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    uint32_t lost_port = warm_pending[i] && highest[i] != warm_highest[i];
+    if (lost_port){
+      highest[i] = warm_highest[i];
+      pq_backend->data_query_unlock(port_table[i].isolation_id);
+      lost++;
+    }
+    kept += pq_warm_port[i];
+    PQ_TRACE(WARM_RESUME, port_table[i].port, highest[i], second_highest[i], pq_warm_port[i], lost_port);
+  }
+  printf("Warm restart: %u of %d port(s) resumed, %u data plane queries lost\n", kept, port_entry_num, lost);
+  printf("Warm restart: port isolation %u added, %u modified, %u deleted, %u kept; qdepth_threshold %u added, %u modified, %u deleted, %u kept (%.3f ms)\n",
+         pq_warm_ports.added, pq_warm_ports.modified, pq_warm_ports.deleted, pq_warm_ports.kept,
+         pq_warm_thresholds.added, pq_warm_thresholds.modified, pq_warm_thresholds.deleted, pq_warm_thresholds.kept, pq_warm_thresholds.ms);
+  printf("Warm restart: polling resumes %.3f ms after the checkpoint was loaded\n", (pq_clock_host_ns() - warm_start_ns) / 1e6);
+}
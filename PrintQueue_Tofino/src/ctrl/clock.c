@@ -0,0 +1,140 @@
+/*************************************************************************
+	> File Name: clock.c
+  > Description: Running linear mapping of the host monotonic clock to the
+  >              unwrapped switch timestamp, fitted from the signal packets
+  >              and the time windows snapshots
+*************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "printqueue.h"
+
+// the rate is kept within 1 +- PQ_CLOCK_MAX_DRIFT: samples close in time
+// carry more jitter than drift
+#define PQ_CLOCK_MAX_DRIFT 1e-3
+
+// samples come from the signal-receiving thread and the writer thread
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t sample_host[PQ_CLOCK_SAMPLES], sample_switch[PQ_CLOCK_SAMPLES];
+static uint32_t sample_next = 0, sample_num = 0, drop_num = 0;
+static pq_clock_t fit = {0, 0, 1, 0, 0};
+
+int64_t pq_clock_host_ns(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void pq_clock_reset(void){
+  pthread_mutex_lock(&clock_lock);
+  sample_next = sample_num = drop_num = 0;
+  fit.host_ns = fit.switch_ns = 0;
+  fit.rate = 1;
+  fit.samples = 0;
+  fit.pad = 0;
+  pthread_mutex_unlock(&clock_lock);
+}
+
+void pq_clock_restore(const pq_clock_t *c){
+  pthread_mutex_lock(&clock_lock);
+  sample_host[0] = c->host_ns;
+  sample_switch[0] = c->switch_ns;
+  sample_next = sample_num = 1;
+  drop_num = 0;
+  fit = *c;
+  fit.samples = 1;
+  pthread_mutex_unlock(&clock_lock);
+}
+
+static inline int64_t clock_predict(const pq_clock_t *c, int64_t host_ns){
+  return c->switch_ns + llround(c->rate * (double)(host_ns - c->host_ns));
+}
+
+//----------------------------------------------------------------------
+// Least squares over the samples, relative to the latest one so that the
+// differences stay small in doubles
+//----------------------------------------------------------------------
+static void clock_refit(void){
+  uint32_t last = (sample_next + PQ_CLOCK_SAMPLES - 1) % PQ_CLOCK_SAMPLES;
+  int64_t h0 = sample_host[last], s0 = sample_switch[last];
+  double mh = 0, ms = 0, shh = 0, shs = 0, dh, ds;
+  for (uint32_t i = 0; i < sample_num; i++){
+    mh += sample_host[i] - h0;
+    ms += sample_switch[i] - s0;
+  }
+  mh /= sample_num;
+  ms /= sample_num;
+  for (uint32_t i = 0; i < sample_num; i++){
+    dh = sample_host[i] - h0 - mh;
+    ds = sample_switch[i] - s0 - ms;
+    shh += dh * dh;
+    shs += dh * ds;
+  }
+  fit.rate = shh > 0 ? shs / shh : 1;
+  if (fit.rate > 1 + PQ_CLOCK_MAX_DRIFT){
+    fit.rate = 1 + PQ_CLOCK_MAX_DRIFT;
+  }else if (fit.rate < 1 - PQ_CLOCK_MAX_DRIFT){
+    fit.rate = 1 - PQ_CLOCK_MAX_DRIFT;
+  }
+  fit.host_ns = h0;
+  fit.switch_ns = s0 + llround(ms - fit.rate * mh);
+  fit.samples = sample_num;
+}
+
+void pq_clock_add(int64_t host_ns, int64_t switch_ns){
+  pthread_mutex_lock(&clock_lock);
+  if (sample_num >= PQ_CLOCK_MIN_SAMPLES && llabs(switch_ns - clock_predict(&fit, host_ns)) > PQ_CLOCK_MAX_RESIDUAL_NS){
+    drop_num += 1;
+    if (drop_num < PQ_CLOCK_RESEED){
+      pthread_mutex_unlock(&clock_lock);
+      return;
+    }
+    sample_next = sample_num = 0;
+  }
+  drop_num = 0;
+  sample_host[sample_next] = host_ns;
+  sample_switch[sample_next] = switch_ns;
+  sample_next = (sample_next + 1) % PQ_CLOCK_SAMPLES;
+  if (sample_num < PQ_CLOCK_SAMPLES){
+    sample_num += 1;
+  }
+  clock_refit();
+  pthread_mutex_unlock(&clock_lock);
+}
+
+//----------------------------------------------------------------------
+// The overflows of ts are those putting it nearest to the fit at host_ns
+//----------------------------------------------------------------------
+bool pq_clock_unwrap(int64_t host_ns, uint32_t ts, int64_t *out){
+  pq_clock_t c;
+  pq_clock_get(&c);
+  if (c.samples == 0){
+    return false;
+  }
+  int64_t wraps = (clock_predict(&c, host_ns) - (int64_t)ts + (1LL << 31)) >> 32;
+  *out = (int64_t)ts + (wraps << 32);
+  return true;
+}
+
+void pq_clock_get(pq_clock_t *c){
+  pthread_mutex_lock(&clock_lock);
+  *c = fit;
+  pthread_mutex_unlock(&clock_lock);
+}
+
+//----------------------------------------------------------------------
+// The queuing delay is below 2^32 ns, so the enqueue ts is taken back
+// from the unwrapped dequeue ts
+//----------------------------------------------------------------------
+void pq_clock_signal(pq_clock_signal_t *s, uint32_t enqueue_ts, uint32_t dequeue_ts){
+  s->host_ns = pq_clock_host_ns();
+  if (!pq_clock_unwrap(s->host_ns, dequeue_ts, &s->dequeue_ns)){
+    s->dequeue_ns = dequeue_ts;
+  }
+  s->enqueue_ns = s->dequeue_ns - (uint32_t)(dequeue_ts - enqueue_ts);
+  pq_clock_add(s->host_ns, s->dequeue_ns);
+  pq_clock_get(&s->clock);
+}
@@ -0,0 +1,65 @@
+/*************************************************************************
+	> File Name: clock.h
+  > Description: Running linear mapping of the host monotonic clock to the
+  >              unwrapped switch timestamp (clock.c), stored with the
+  >              signals and the filtered time windows snapshots
+*************************************************************************/
+
+#ifndef _PQ_CLOCK_H_
+#define _PQ_CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------
+// The switch clock is the 32-bit dequeue timestamp (ns) of the data plane,
+// overflows added. It is fitted on the host CLOCK_MONOTONIC (ns) by least
+// squares over the last PQ_CLOCK_SAMPLES samples:
+//   switch_ns(h) = switch_ns + rate * (h - host_ns)
+// Samples are the dequeue ts of the signal packets and the latest cell of
+// the periodical time windows snapshots, at the time they are received /
+// read. A sample more than PQ_CLOCK_MAX_RESIDUAL_NS away from the fit is
+// dropped; after PQ_CLOCK_RESEED drops in a row, the fit restarts from it
+// (the switch clock was reset).
+// Wraps of a 32-bit ts are those putting it nearest to the fit: right as
+// long as the fit is off by less than 2^31 ns.
+//----------------------------------------------------------------------
+#define PQ_CLOCK_SAMPLES 32
+#define PQ_CLOCK_MIN_SAMPLES 4           // samples before any is dropped
+#define PQ_CLOCK_MAX_RESIDUAL_NS 1000000
+#define PQ_CLOCK_RESEED 8
+
+typedef struct pq_clock {
+  int64_t host_ns;                // host monotonic time of the latest sample
+  int64_t switch_ns;              // fitted switch time at host_ns
+  double rate;                    // switch ns per host ns, 1 with less than 2 samples
+  uint32_t samples;               // samples in the fit, 0: no mapping yet
+  uint32_t pad;
+} pq_clock_t;
+
+//----------------------------------------------------------------------
+// Appended to every signal file after [type | enqueue_ts | dequeue_ts]:
+// the timestamps of the packet unwrapped with the fit at its reception
+// (no overflow for the first sample), and the fit after the packet was
+// added as a sample.
+// All fields are little endian.
+//----------------------------------------------------------------------
+typedef struct pq_clock_signal {
+  int64_t host_ns;                // host monotonic time of the reception
+  int64_t enqueue_ns;             // enqueue_ts, overflows added
+  int64_t dequeue_ns;             // dequeue_ts, overflows added
+  pq_clock_t clock;
+} pq_clock_signal_t;
+
+int64_t pq_clock_host_ns(void);
+void pq_clock_reset(void);
+// ts (32-bit switch ns) read at host_ns with its overflows, false if no mapping yet
+bool pq_clock_unwrap(int64_t host_ns, uint32_t ts, int64_t *out);
+void pq_clock_add(int64_t host_ns, int64_t switch_ns);
+void pq_clock_get(pq_clock_t *c);
+// fit of a previous run on the same host boot (warm restart), taken as its latest sample
+void pq_clock_restore(const pq_clock_t *c);
+// unwrap the timestamps of a signal packet received now and add it as a sample
+void pq_clock_signal(pq_clock_signal_t *s, uint32_t enqueue_ts, uint32_t dequeue_ts);
+
+#endif
@@ -0,0 +1,905 @@
+/*************************************************************************
+	> File Name: control.c
+  > Description: PrintQueue control plane shared by the Tofino and the
+  >              software model backends: parameters, configuration files,
+  >              signal-receiving thread
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <net/ethernet.h>
+
+#include "printqueue.h"
+
+#define RCV_BUF_SIZE 256
+#define ETHERTYPE_PRINTQUEUE_SIGNAL   0x080e
+
+// backend of the running program, set by main before pq_start
+pq_backend_t *pq_backend = NULL;
+bool pq_oneshot = false;
+const char *pq_trace_path = "./pq_trace.bin";
+
+//----------------------------------------------------------------------
+// Real-time mode (--rt-mode): the poll and signal-receiving threads are
+// pinned to isolated cores (-1: not pinned) and scheduled by SCHED_FIFO,
+// and the memory is locked.
+// rt_spin_us: the poller sleeps until rt_spin_us before the next deadline
+// rt_deadline_slack_us: a poll starting later than this is a deadline miss
+//----------------------------------------------------------------------
+bool rt_mode = false;
+int rt_poll_core = -1, rt_signal_core = -1, rt_priority = 80;
+uint32_t rt_spin_us = 200, rt_deadline_slack_us = 100;
+
+// used in transforming address string to uint32
+typedef struct ipv4_address{
+  union
+  {
+    struct{
+      uint8_t b1, b2, b3, b4;
+    } bytes_addr;
+    uint32_t uint32_addr;
+  } addr;
+} ipv4_address_t;
+
+// -------------------------------------------------------------------//
+//    The following is the configurable parameters of TIME WINDOWS    //
+//                Tune them according to your setting                 //
+//--------------------------------------------------------------------//
+// for a single port
+// k: the cell number of a single time window: 2^k
+// T: the number of time windows
+// a: compression factor
+// duration: the number of seconds for which the periodical register reading lasts
+uint32_t k = 12, T = 4, a = 1, duration = 2, TB0 = 10;
+uint32_t highest_shift_bit = 13, second_highest_shift_bit = 12;  // total registers 2^14
+// tw_store_cells: store the valid cells of every snapshot (tw_cells.h) instead of the raw registers
+bool tw_store_cells = true;
+//-----------------------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------//
+//    The following is the configurable parameters of QUEUE MONITOR   //
+//                Tune them according to your setting                 //
+//--------------------------------------------------------------------//
+// for a single port
+// kq: the cell number of a single queue monitor: 2^kq
+// max_qdepth: the maximum qdepth number, must be smaller than 2^kq
+// read_interval: the number of microseconds which is the reading interval
+// duration_q: the number of seconds for which the periodical register reading lasts
+// qm_read_margin: slots read above the stack top, covering the slots of the read half freed
+//   between the flip and the reading of the stack top (stale slots above it are filtered by
+//   seq number). Slots are 80-byte cells: a 10 Gbps port drains 1024 of them in about 65 us,
+//   more than the prepare entry update and the single register read in between. Raise it for
+//   faster ports.
+uint32_t kq = 15, max_qdepth = 25000, read_interval = 100000, duration_q = 5;
+uint32_t highest_shift_bit_q = 16, second_highest_shift_bit_q = 15; // total registers 2^17
+uint32_t qm_read_margin = 1024;
+//----------------------------------------------------------------------
+// Adaptive reading interval of queue monitor (per port)
+// qm_interval_min: floor of the interval (us) when the queue is busy; the poll latency
+//   plus twice the slack of a data plane query (query_guard_us, poller.c) if longer
+// qm_interval_max: ceiling of the interval (us) when the port is idle
+// qm_busy_depth: stack top from which the port is considered busy
+// qm_read_budget: slots per second read over all queue monitor ports
+// read_interval is the initial interval, and the fixed one if qm_adaptive = false
+//----------------------------------------------------------------------
+bool qm_adaptive = true;
+uint32_t qm_interval_min = 10000, qm_interval_max = 800000, qm_busy_depth = 1000, qm_read_budget = 1000000;
+//-----------------------------------------------------------------------------------------------------------------------------------
+uint32_t highest[MAX_PORT_NUM], second_highest[MAX_PORT_NUM], cell_number = 0;  // highest i-th item <-> i-th port entry
+bool wrap[MAX_PORT_NUM];
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                      Signal Receiving Thread                             //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// port entries and the signal queue are declared in printqueue.h
+port_entry_t port_table[MAX_PORT_NUM];
+uint16_t port_entry_num = 0;
+data_signal_t data_signal[SIGNAL_QUEUE_SIZE]; // 0 - 16
+uint16_t data_signal_head = 0, data_signal_tail = 0;
+bool new_signal;
+bool poll_ready;
+bool finish_last;
+// the raw socket is bound: signals sent from now on are received
+static volatile bool signal_ready = false;
+
+//----------------------------------------------------------------------
+// Handler when receiving USR1 signal.
+// The main program starts to periodically poll registers when loop_flag = true, stops when loop_flag = false.
+// The signal-receiving thread starts monitoring CPU-switch interface when signal_flag = true, stops when signal_flag = false;
+//----------------------------------------------------------------------
+bool loop_flag = false;
+bool signal_flag = false;
+static void sigusr1_handler(int signum) {
+  printf("printqueue: received signal %d, flip loop_flag and signal_flag\n", signum);
+  if(loop_flag) {
+    loop_flag = false;
+    signal_flag = false;
+  }
+  else {
+    loop_flag = true;
+    signal_flag = true;
+  }
+}
+
+//----------------------------------------------------------------------
+// Handler when receiving USR2 signal.
+// The main program ends when running_flag = false.
+//----------------------------------------------------------------------
+bool running_flag = true;
+static void sigusr2_handler(int signum) {
+  printf("printqueue: received signal %d, flip running_flag\n", signum);
+  if(running_flag) {
+    running_flag = false;
+  }
+  else {
+    running_flag = true;
+  }
+}
+
+//----------------------------------------------------------------------
+// Handler when receiving HUP signal.
+// Operator trigger of the flight recorder: the snapshots around now are stored for every port.
+//----------------------------------------------------------------------
+static void sighup_handler(int signum) {
+  pq_recorder_trigger();
+}
+
+void pq_register_signal_handlers(void){
+  struct sigaction sa_usr1;
+  memset(&sa_usr1, 0, sizeof(sa_usr1));
+  sa_usr1.sa_handler=&sigusr1_handler;
+  sa_usr1.sa_flags=0;
+  if(sigaction(SIGUSR1, &sa_usr1, NULL)!=0) {
+    fprintf(stderr, "SIGUSR1 handler registration failed for %ld\n", (long)getpid());
+    exit(1);
+  }
+
+  struct sigaction sa_usr2;
+  memset(&sa_usr2, 0, sizeof(sa_usr2));
+  sa_usr2.sa_handler=&sigusr2_handler;
+  sa_usr2.sa_flags=0;
+  if(sigaction(SIGUSR2, &sa_usr2, NULL)!=0) {
+    fprintf(stderr, "SIGUSR2 handler registration failed for %ld\n", (long)getpid());
+    exit(1);
+  }
+
+  struct sigaction sa_hup;
+  memset(&sa_hup, 0, sizeof(sa_hup));
+  sa_hup.sa_handler=&sighup_handler;
+  sa_hup.sa_flags=0;
+  if(sigaction(SIGHUP, &sa_hup, NULL)!=0) {
+    fprintf(stderr, "SIGHUP handler registration failed for %ld\n", (long)getpid());
+    exit(1);
+  }
+}
+
+//----------------------------------------------------------------------
+// Add a data plane query signal to the signal queue and flip the highest
+// bit of its port ASAP. Called for every signal frame received on the
+// CPU interface, or directly by in-process backends (backend_stub.c).
+// The signal-receiving thread is the only producer of the queue.
+//----------------------------------------------------------------------
+uint64_t signal_overflow_num = 0;
+
+int pq_signal_enqueue(uint16_t rcv_signal, uint16_t iso_id, struct in_addr src_ip, struct in_addr dst_ip, uint16_t src_port, uint16_t dst_port, uint32_t enqueue_ts, uint32_t dequeue_ts){
+  uint16_t data_port = 0;
+  if ((data_signal_tail + 1) % SIGNAL_QUEUE_SIZE == data_signal_head){
+    PQ_TRACE(SIGNAL_OVERFLOW, iso_id);
+    signal_overflow_num += 1;
+    __atomic_fetch_add(&pq_stats->signal_overflows, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  data_signal[data_signal_tail].table_idx = 0;
+  for (int i = 0; i < port_entry_num; i++){
+    if (port_table[i].isolation_id == iso_id){
+      data_signal[data_signal_tail].table_idx = i;
+      data_port = port_table[i].port;
+      break;
+    }
+  }
+  PQ_TRACE(SIGNAL_RECV, data_port, rcv_signal, iso_id, ntohl(src_ip.s_addr), ntohl(dst_ip.s_addr));
+  __atomic_fetch_add(&pq_stats->signals, 1, __ATOMIC_RELAXED);
+
+  // receiving a data plane signal - add to the queue
+  gettimeofday(&data_signal[data_signal_tail].ts, NULL);
+  pq_clock_signal(&data_signal[data_signal_tail].clock, enqueue_ts, dequeue_ts);
+  data_signal[data_signal_tail].type = rcv_signal;
+  data_signal[data_signal_tail].src_ip = src_ip;
+  data_signal[data_signal_tail].dst_ip = dst_ip;
+  data_signal[data_signal_tail].src_port = src_port;
+  data_signal[data_signal_tail].dst_port = dst_port;
+  data_signal[data_signal_tail].data_port = data_port;
+  data_signal[data_signal_tail].iso_id = iso_id;
+  data_signal[data_signal_tail].enqueue_ts = enqueue_ts;
+  data_signal[data_signal_tail].dequeue_ts = dequeue_ts;
+  data_signal[data_signal_tail].isolation_prefix = port_table[data_signal[data_signal_tail].table_idx].isolation_prefix;
+  if (rcv_signal == 2){
+    wrap[data_signal[data_signal_tail].table_idx] = true;   //seq num overflow
+  }
+  //flip highest bit ASAP
+  data_signal[data_signal_tail].previous_highest = highest[data_signal[data_signal_tail].table_idx];
+  highest[data_signal[data_signal_tail].table_idx] ^= 1;
+  data_signal[data_signal_tail].previous_second_highest = second_highest[data_signal[data_signal_tail].table_idx] ^ 1;
+  data_signal[data_signal_tail].seq_floor = __atomic_load_n(&qm_seq_mark[data_signal[data_signal_tail].table_idx], __ATOMIC_RELAXED);
+  data_signal_tail = (data_signal_tail + 1) % SIGNAL_QUEUE_SIZE;
+  new_signal = true;
+  return 0;
+}
+
+void* listen_on_interface_thread(){
+  printf("*********************************************************\nSignal-receiving Thread Initiated\n*********************************************************\n");
+  pq_trace_thread_name("signal");
+  if (rt_mode){
+    pq_rt_setup_thread("signal", rt_signal_core, rt_priority);
+  }
+  //----------------------------------------------------------------------//
+  //                      Create raw socket                               //
+  //----------------------------------------------------------------------//
+  printf ("Configuring a raw socket...\n");
+  int sockfd_rcv;
+  if ((sockfd_rcv = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) == -1) {
+    printf("Fail to open the raw socket.\n");
+    return false;
+  }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(struct ifreq));
+  strncpy(ifr.ifr_name, pq_backend->cpu_ifname, IFNAMSIZ-1);
+  if (ioctl(sockfd_rcv, SIOCGIFINDEX, &ifr) < 0) {
+    printf("SIOCGIFINDEX failed on %s.\n", ifr.ifr_name);
+    return false;
+  }
+  // Promisc, so that even if Ethernet interface filters frames (MAC addr unmatch, broadcast...)
+  struct packet_mreq mreq = {0};
+  mreq.mr_ifindex = ifr.ifr_ifindex;
+  mreq.mr_type = PACKET_MR_PROMISC;
+  if (setsockopt(sockfd_rcv, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+    printf("setsockopt failed.\n");
+    return false;
+  }
+  struct sockaddr_ll addr = {0};
+  addr.sll_family = AF_PACKET;
+  addr.sll_ifindex = ifr.ifr_ifindex;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  if (bind(sockfd_rcv, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    printf("Bind failed.\n");
+    return false;
+  }
+  // wake up regularly so that the thread sees running_flag / signal_flag change
+  struct timeval rcv_timeout = {0, 100000};
+  if (setsockopt(sockfd_rcv, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout)) == -1) {
+    printf("setsockopt SO_RCVTIMEO failed.\n");
+    return false;
+  }
+  char rcv_buf[RCV_BUF_SIZE];
+  struct sockaddr_ll from;
+  socklen_t from_len;
+  ssize_t n;
+  uint32_t enqueue_ts, dequeue_ts;
+  uint16_t rcv_signal, iso_id;
+  uint16_t ether_type, src_port, dst_port;
+  struct in_addr src_ip, dst_ip;  //network byte order
+  printf ("Raw socket configuration succeeds.\n");
+  if (pq_warm){
+    // every signal sent from now on is received: take the bits back from the data plane
+    pq_warm_resume();
+  }
+  signal_ready = true;
+  while(running_flag){
+    while(signal_flag){
+      from_len = sizeof(from);
+      n = recvfrom(sockfd_rcv, &rcv_buf, RCV_BUF_SIZE-1, 0, (struct sockaddr*)&from, &from_len);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        continue;
+      }
+      if (n >= 0 && from.sll_pkttype == PACKET_OUTGOING){
+        continue;   // frames sent on the interface (software model on lo)
+      }
+      if (n < 14){
+        printf("Signal-receiving thread error: reading packet fails!\n");
+        signal_flag = false;
+        break;
+      }
+      // parse packet
+      memcpy(&ether_type, rcv_buf + 12, 2);
+      ether_type = ntohs(ether_type);
+      if (ether_type == ETHERTYPE_PRINTQUEUE_SIGNAL){
+        if (n < 66) {
+          printf("Received an invalid signal packet, length: %zd.\n", n);
+          continue;
+        }
+        memcpy(&src_ip.s_addr, rcv_buf + 26, 4);
+        memcpy(&dst_ip.s_addr, rcv_buf + 30, 4);
+        memcpy(&src_port, rcv_buf + 34, 2);
+        memcpy(&dst_port, rcv_buf + 36, 2);
+        memcpy(&rcv_signal, rcv_buf + 54, 2);
+        memcpy(&iso_id, rcv_buf + 56, 2);
+        memcpy(&enqueue_ts, rcv_buf + 58, 4);
+        memcpy(&dequeue_ts, rcv_buf + 62, 4);
+        pq_signal_enqueue(ntohs(rcv_signal), ntohs(iso_id), src_ip, dst_ip, ntohs(src_port), ntohs(dst_port), ntohl(enqueue_ts), ntohl(dequeue_ts));
+      }
+    }
+  }
+  printf("Signal-receiving Thread is killed.\n");
+  return NULL;
+}
+
+//--------------------------------------------------------------------//
+//                       Set Threshold Table                          //
+//--------------------------------------------------------------------//
+//Read data plane query thresholds from the csv file
+//when qdepth is larger than the threshold, trigger data plane query
+//CSV line format: srcIP dstIP threshold
+//---------------------------------------------------------------------
+pq_threshold_t *pq_thresholds = NULL;
+uint32_t pq_threshold_num = 0;
+uint32_t pq_threshold_reload_ms = 1000;
+// table operations per batch: the traffic of the software model waits for a batch at most
+#define PQ_THRESHOLD_BATCH 4096
+
+static int threshold_cmp(const void *x, const void *y){
+  const pq_threshold_t *a = x, *b = y;
+  if (a->src_ip != b->src_ip){
+    return a->src_ip < b->src_ip ? -1 : 1;
+  }
+  return a->dst_ip != b->dst_ip ? (a->dst_ip < b->dst_ip ? -1 : 1) : 0;
+}
+
+// after every operation: the batch is sent once full, and the next one begins
+static int threshold_batch_next(uint32_t *ops){
+  if (pq_backend->batch_end == NULL || ++*ops % PQ_THRESHOLD_BATCH != 0){
+    return 0;
+  }
+  if (pq_backend->batch_end() != 0){
+    printf("Error sending a batch of table entries - qdepth_alerting_threshold_2!\n");
+    return -1;
+  }
+  pq_backend->batch_begin();
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Program the table from the installed entries old to the entries new,
+// both sorted by flow: deletes first, so that the table never holds more
+// than the larger of the two, then modifications and additions, sent in
+// batches of PQ_THRESHOLD_BATCH operations.
+//----------------------------------------------------------------------
+static int threshold_apply(const pq_threshold_t *old, uint32_t old_num, const pq_threshold_t *new, uint32_t new_num, pq_table_diff_t *diff){
+  uint32_t i = 0, j = 0, ops = 0;
+  int ret = -1;
+  int64_t t_ns = pq_clock_host_ns();
+  memset(diff, 0, sizeof(*diff));
+  if (old_num > 0 && (pq_backend->threshold_modify == NULL || pq_backend->threshold_delete == NULL)){
+    printf("Error: the %s backend cannot modify the qdepth_threshold table!\n", pq_backend->name);
+    return -1;
+  }
+  if (pq_backend->batch_begin){
+    pq_backend->batch_begin();
+  }
+  for (i = 0, j = 0; i < old_num; i++){
+    while (j < new_num && threshold_cmp(&new[j], &old[i]) < 0){
+      j++;
+    }
+    if (j == new_num || threshold_cmp(&new[j], &old[i]) != 0){
+      if (pq_backend->threshold_delete(old[i].src_ip, old[i].dst_ip) != 0){
+        printf("Error deleting table entries - qdepth_alerting_threshold_2!\n");
+        goto done;
+      }
+      diff->deleted++;
+      if (threshold_batch_next(&ops) != 0){
+        goto done;
+      }
+    }
+  }
+  for (i = 0, j = 0; j < new_num; j++){
+    while (i < old_num && threshold_cmp(&old[i], &new[j]) < 0){
+      i++;
+    }
+    if (i < old_num && threshold_cmp(&old[i], &new[j]) == 0){
+      if (old[i].threshold == new[j].threshold){
+        diff->kept++;
+        continue;
+      }
+      if (pq_backend->threshold_modify(new[j].src_ip, new[j].dst_ip, new[j].threshold) != 0){
+        printf("Error modifying table entries - qdepth_alerting_threshold_2!\n");
+        goto done;
+      }
+      diff->modified++;
+    }else{
+      if (pq_backend->threshold_add(new[j].src_ip, new[j].dst_ip, new[j].threshold) != 0){
+        printf("Error adding table entries - qdepth_alerting_threshold_2!\n");
+        goto done;
+      }
+      diff->added++;
+    }
+    if (threshold_batch_next(&ops) != 0){
+      goto done;
+    }
+  }
+  ret = 0;
+done:
+  if (pq_backend->batch_end && pq_backend->batch_end() != 0 && ret == 0){
+    printf("Error sending a batch of table entries - qdepth_alerting_threshold_2!\n");
+    ret = -1;
+  }
+  diff->ms = (pq_clock_host_ns() - t_ns) / 1e6;
+  return ret;
+}
+
+// a parsed entry and its line, so that the last line of a flow listed twice wins
+typedef struct threshold_line {
+  pq_threshold_t e;
+  uint32_t line;
+} threshold_line_t;
+
+static int threshold_line_cmp(const void *x, const void *y){
+  const threshold_line_t *a = x, *b = y;
+  int c = threshold_cmp(&a->e, &b->e);
+  return c ? c : (a->line < b->line ? -1 : a->line > b->line);
+}
+
+static const char *parse_blank(const char *p, const char *end){
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')){
+    p++;
+  }
+  return p;
+}
+
+// decimal number up to max, NULL if there is none
+static const char *parse_uint(const char *p, const char *end, uint32_t max, uint32_t *v){
+  uint64_t n = 0;
+  const char *s = p;
+  while (p < end && *p >= '0' && *p <= '9' && n <= max){
+    n = n * 10 + (*p++ - '0');
+  }
+  if (p == s || n > max){
+    return NULL;
+  }
+  *v = n;
+  return p;
+}
+
+// dotted IPv4 address, stored as ipv4_address_t (network byte order)
+static const char *parse_ipv4(const char *p, const char *end, uint32_t *ip){
+  ipv4_address_t addr;
+  uint8_t *b = &addr.addr.bytes_addr.b1;
+  uint32_t v;
+  for (int i = 0; i < 4; i++){
+    if (i > 0 && (p >= end || *p++ != '.')){
+      return NULL;
+    }
+    if ((p = parse_uint(p, end, 255, &v)) == NULL){
+      return NULL;
+    }
+    b[i] = v;
+  }
+  *ip = addr.addr.uint32_addr;
+  return p;
+}
+
+//----------------------------------------------------------------------
+// The threshold file, read at once and scanned in place, to its entries
+// sorted by flow (the last line of a flow listed twice wins). Lines that
+// are not "srcIP dstIP threshold" are skipped and counted.
+//----------------------------------------------------------------------
+static int threshold_read(const char *path, pq_threshold_t **out, uint32_t *out_num){
+  int64_t t_ns = pq_clock_host_ns();
+  FILE * f = fopen(path, "rb");
+  if (f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  char *buf = NULL;
+  long size = -1;
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0){
+    buf = malloc(size + 1);
+  }
+  if (buf == NULL || fread(buf, 1, size, f) != (size_t)size){
+    printf("Error reading %s!\n", path);
+    free(buf);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  const char *p = buf, *end = buf + size, *eol;
+  uint32_t i = 0, j = 0, cap = 0, bad = 0, dup = 0, first_bad = 0, line_no = 1;
+  threshold_line_t *lines = NULL, *grown;
+  pq_threshold_t *entries, e;
+  // skip first line
+  p = memchr(p, '\n', end - p);
+  p = p ? p + 1 : end;
+  for (; p < end; p = eol + 1){
+    line_no++;
+    if ((eol = memchr(p, '\n', end - p)) == NULL){
+      eol = end;
+    }
+    const char *q = parse_blank(p, eol);
+    if (q == eol){
+      continue;
+    }
+    if ((q = parse_ipv4(q, eol, &e.src_ip)) == NULL || parse_blank(q, eol) == q
+        || (q = parse_ipv4(parse_blank(q, eol), eol, &e.dst_ip)) == NULL || parse_blank(q, eol) == q
+        || (q = parse_uint(parse_blank(q, eol), eol, UINT32_MAX, &e.threshold)) == NULL || parse_blank(q, eol) != eol){
+      first_bad = bad++ ? first_bad : line_no;
+      continue;
+    }
+    if (j == cap){
+      cap = cap ? cap * 2 : 1024;
+      grown = realloc(lines, cap * sizeof(threshold_line_t));
+      if (grown == NULL){
+        printf("Error allocating %u thresholds!\n", cap);
+        free(lines);
+        free(buf);
+        return -1;
+      }
+      lines = grown;
+    }
+    lines[j].e = e;
+    lines[j].line = j;
+    j++;
+  }
+  free(buf);
+  qsort(lines, j, sizeof(threshold_line_t), threshold_line_cmp);
+  entries = malloc((j ? j : 1) * sizeof(pq_threshold_t));
+  if (entries == NULL){
+    printf("Error allocating %u thresholds!\n", j);
+    free(lines);
+    return -1;
+  }
+  for (i = 0, cap = 0; i < j; i++){
+    if (cap > 0 && threshold_cmp(&entries[cap - 1], &lines[i].e) == 0){
+      entries[cap - 1] = lines[i].e;
+      dup++;
+      continue;
+    }
+    entries[cap++] = lines[i].e;
+  }
+  free(lines);
+  if (bad){
+    printf("Warning: %u lines of %s are not \"srcIP dstIP threshold\" (first: line %u), skipped\n", bad, path, first_bad);
+  }
+  if (dup){
+    printf("Warning: %u flows listed more than once in %s\n", dup, path);
+  }
+  if (cap > THRESHOLD_FLOW_NUMBER){
+    printf("Error: %u flows in %s, the qdepth_threshold table holds %d!\n", cap, path, THRESHOLD_FLOW_NUMBER);
+    free(entries);
+    return -1;
+  }
+  printf("Read %u thresholds from %s in %.3f ms\n", cap, path, (pq_clock_host_ns() - t_ns) / 1e6);
+  *out = entries;
+  *out_num = cap;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// On a warm start only the difference with the checkpointed entries is
+// programmed, otherwise the difference with the entries loaded before
+// (none on a cold start).
+//----------------------------------------------------------------------
+static const char *threshold_path = NULL;
+static struct stat threshold_stat;    // of the file loaded last
+
+int pq_load_thresholds(const char *path){
+  pq_threshold_t *entries;
+  uint32_t num;
+  if (stat(path, &threshold_stat) != 0){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  if (threshold_read(path, &entries, &num) != 0){
+    return -1;
+  }
+  uint32_t old_num = pq_threshold_num;
+  const pq_threshold_t *installed = pq_thresholds;
+  if (pq_warm && pq_thresholds == NULL){
+    installed = pq_checkpoint_thresholds(&old_num);
+  }
+  if (threshold_apply(installed, old_num, entries, num, &pq_warm_thresholds) != 0){
+    free(entries);
+    return -1;
+  }
+  free(pq_thresholds);
+  pq_thresholds = entries;
+  pq_threshold_num = num;
+  threshold_path = path;
+  if (old_num > 0){
+    printf("qdepth_threshold table: %u added, %u modified, %u deleted, %u kept in %.3f ms\n",
+           pq_warm_thresholds.added, pq_warm_thresholds.modified, pq_warm_thresholds.deleted, pq_warm_thresholds.kept, pq_warm_thresholds.ms);
+  }else{
+    printf("Adding %d entries to the qdepth_threshold table in %.3f ms\n", num, pq_warm_thresholds.ms);
+  }
+  printf("Successfully set the qdepth_threshold table\n");
+  return 0;
+}
+
+static bool threshold_stat_same(const struct stat *a, const struct stat *b){
+  return a->st_ino == b->st_ino && a->st_size == b->st_size
+         && a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+//----------------------------------------------------------------------
+// Hot reload: the threshold file is checked every pq_threshold_reload_ms
+// and loaded again once it changed and then stayed as is for a check, so
+// that a file still being written is not read. Only the difference with
+// the installed entries is programmed, while the pollers run.
+// A file that cannot be read leaves the installed entries. The checkpoint
+// is dirty while the table is programmed: a reload that fails half way
+// leaves it dirty, and the next start is cold.
+//----------------------------------------------------------------------
+static void *threshold_reload_thread(void *arg){
+  struct stat now, seen = threshold_stat;
+  bool changed = false;
+  pq_threshold_t *entries;
+  pq_table_diff_t diff;
+  uint32_t num;
+  pq_trace_thread_name("reload");
+  while (running_flag){
+    for (uint32_t t = 0; t < pq_threshold_reload_ms && running_flag; t += 10){
+      usleep(10000);
+    }
+    if (!running_flag || stat(threshold_path, &now) != 0 || threshold_stat_same(&now, &threshold_stat)){
+      changed = false;
+      continue;
+    }
+    if (!changed || !threshold_stat_same(&now, &seen)){
+      seen = now;
+      changed = true;
+      continue;
+    }
+    changed = false;
+    // retried once the file changes again
+    threshold_stat = now;
+    if (threshold_read(threshold_path, &entries, &num) != 0){
+      printf("qdepth_threshold table: %s not reloaded, %u entries kept\n", threshold_path, pq_threshold_num);
+      continue;
+    }
+    pq_checkpoint_dirty();
+    if (threshold_apply(pq_thresholds, pq_threshold_num, entries, num, &diff) != 0){
+      printf("Error reloading %s, the qdepth_threshold table is partially programmed!\n", threshold_path);
+      free(entries);
+      continue;
+    }
+    free(pq_thresholds);
+    pq_thresholds = entries;
+    pq_threshold_num = num;
+    PQ_TRACE(THRESHOLD_RELOAD, diff.added, diff.modified, diff.deleted, diff.kept, (uint32_t)(diff.ms * 1000));
+    printf("qdepth_threshold table reloaded: %u added, %u modified, %u deleted, %u kept in %.3f ms\n",
+           diff.added, diff.modified, diff.deleted, diff.kept, diff.ms);
+    pq_checkpoint_save();
+  }
+  return NULL;
+}
+
+//--------------------------------------------------------------------//
+//                  Set Port Isolation Table                          //
+//--------------------------------------------------------------------//
+// CSV line format: Port IsolationID [Mode]
+// Mode (tw / qm) is optional, default_mode (--pq-mode) is used when it is absent
+// On a warm start, the entries of the checkpoint are modified or deleted
+// only where they differ, and a port keeps the prepare entry installed
+// for its isolation id and mode (pq_warm_port).
+//---------------------------------------------------------------------
+static int port_install(uint16_t j){
+  const port_entry_t *old = NULL, *e = &port_table[j];
+  uint32_t sh;
+  if (pq_warm){
+    const port_entry_t *table;
+    uint16_t num = pq_checkpoint_ports(&table);
+    for (uint16_t i = 0; i < num; i++){
+      if (table[i].port == e->port){
+        old = &table[i];
+      }
+    }
+    pq_warm_port[j] = pq_backend->prepare_get(e->mode, e->isolation_id, &sh) == 0;
+  }
+  if (old != NULL && old->isolation_id == e->isolation_id && old->isolation_prefix == e->isolation_prefix){
+    pq_warm_ports.kept++;
+    return 0;
+  }
+  if (old != NULL){
+    pq_warm_ports.modified++;
+    return pq_backend->isolation_modify(e->port, e->isolation_id, e->isolation_prefix);
+  }
+  pq_warm_ports.added++;
+  return pq_backend->isolation_add(e->port, e->isolation_id, e->isolation_prefix);
+}
+
+// warm start: entries of the checkpoint no port uses any more
+static int port_uninstall_stale(void){
+  const port_entry_t *table;
+  uint16_t num = pq_checkpoint_ports(&table);
+  for (uint16_t i = 0; i < num; i++){
+    bool port_used = false, prepare_used = false;
+    for (uint16_t j = 0; j < port_entry_num; j++){
+      port_used = port_used || port_table[j].port == table[i].port;
+      prepare_used = prepare_used || (port_table[j].isolation_id == table[i].isolation_id && port_table[j].mode == table[i].mode);
+    }
+    if (!port_used){
+      if (pq_backend->isolation_delete(table[i].port) != 0){
+        printf("Error deleting table entries - port isolation!\n");
+        return -1;
+      }
+      pq_warm_ports.deleted++;
+    }
+    if (!prepare_used && pq_backend->prepare_delete(table[i].mode, table[i].isolation_id) != 0){
+      printf("Warning: iso_id %d, deleting the prepare entry failed\n", table[i].isolation_id);
+    }
+  }
+  return 0;
+}
+
+int pq_load_port_isolation(const char *path, pq_mode_t default_mode){
+  FILE * f = fopen(path, "r");
+  if (f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  char *line = NULL, * ptr;
+  char *fields[3];
+  size_t len = 0;
+  uint32_t first = 0, i = 0, j = 0, port, iso_id;
+  int64_t t_ns = pq_clock_host_ns();
+  while (getline(&line, &len, f) != -1 && j < MAX_PORT_NUM) {
+    if (first == 0){ // skip first line
+      first = 1;
+      continue;
+    }
+    ptr = strtok (line," \n");
+    i = 0;
+    while (ptr != NULL && i < 3){
+      fields[i] = ptr;
+      ptr = strtok(NULL, " \n");
+      i++;
+    }
+    if (i < 2) continue;
+    sscanf(fields[0], "%u", &port);
+    sscanf(fields[1], "%u", &iso_id);
+    port_table[j].mode = (i > 2) ? pq_parse_mode(fields[2]) : default_mode;
+    if (!(pq_backend->modes & 1 << port_table[j].mode)){
+      printf("Error! Port %u: the data plane of the %s backend runs no %s!\n", port, pq_backend->name, pq_pollers[port_table[j].mode]->name);
+      free(line);
+      fclose(f);
+      return -1;
+    }
+    port_table[j].port = port;
+    port_table[j].isolation_id = iso_id;
+    port_table[j].isolation_prefix = iso_id << (port_table[j].mode == PQ_MODE_QM ? kq : k);
+    printf("idx:%d, port: %d, iso_id: %d, iso_pre: %d, mode: %s\n", j, port_table[j].port, port_table[j].isolation_id, port_table[j].isolation_prefix, pq_pollers[port_table[j].mode]->name);
+    if (port_install(j) != 0){
+      printf("Error adding table entries - port isolation!\n");
+      free(line);
+      fclose(f);
+      return -1;
+    }
+    j++;
+  }
+  port_entry_num = j;
+  free(line);
+  fclose(f);
+  if (pq_warm && port_uninstall_stale() != 0){
+    return -1;
+  }
+  pq_warm_ports.ms = (pq_clock_host_ns() - t_ns) / 1e6;
+  if (pq_warm){
+    printf("Port isolation table: %u added, %u modified, %u deleted, %u kept in %.3f ms\n",
+           pq_warm_ports.added, pq_warm_ports.modified, pq_warm_ports.deleted, pq_warm_ports.kept, pq_warm_ports.ms);
+  }else{
+    printf("Adding %d entries to the port isolation table\n", port_entry_num);
+  }
+  printf("Successfully isolate ports\n");
+  return 0;
+}
+
+//---------------------------------------------------------------------//
+//                                                                     //
+//         Local CPU listens on interface of data plane                //
+//         and polls the registers until running_flag = false          //
+//                                                                     //
+//---------------------------------------------------------------------//
+// On a warm start (checkpoint.c) the data plane keeps its query state
+// and already sends signals: the port table is loaded before the socket
+// listens, so that every signal received finds its port.
+//---------------------------------------------------------------------
+int pq_start(const char *port_isolation_path, pq_mode_t default_mode){
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    highest[i] = 0;
+    second_highest[i] = 0;
+    wrap[i] = false;
+  }
+  cell_number = 1 << k;
+
+  pthread_t signal_thread;
+  poll_ready = false;
+  new_signal = false;
+  finish_last = true;
+  if (!pq_warm){
+    pq_backend->reset_query_state();
+  }
+  pq_clock_reset();
+  if (pq_trace_path != NULL && pq_trace_start(pq_trace_path) != 0){
+    return -1;
+  }
+  pq_stats_init(pq_stats_name);
+  if (pq_warm){
+    if (pq_load_port_isolation(port_isolation_path, default_mode) != 0){
+      pq_stats_close();
+      pq_trace_stop();
+      return -1;
+    }
+    pq_warm_restore();
+  }
+  if( pthread_create(&signal_thread, NULL, &listen_on_interface_thread, NULL) != 0){
+    printf("Error: creation of signal-receiving thread failed!\n");
+    pq_stats_close();
+    pq_trace_stop();
+    return -1;
+  }
+  printf("Signal-receiving thread is successfully created with ID %lu.\n", (unsigned long)signal_thread);
+  // no port is isolated (so no signal is sent) before the socket listens, up to 1 s
+  for (int i = 0; i < 1000 && !signal_ready; i++){
+    usleep(1000);
+  }
+  if (!signal_ready){
+    printf("Warning: signal-receiving thread is not listening, data plane queries may be lost!\n");
+  }
+
+  if (!pq_warm && pq_load_port_isolation(port_isolation_path, default_mode) != 0){
+    running_flag = false;
+    signal_flag = false;
+    pthread_join(signal_thread, NULL);
+    pq_stats_close();
+    pq_trace_stop();
+    return -1;
+  }
+  pq_stats_set_ports();
+
+  /*--------------------------------------------------------------------*/
+  /*             Time Windows  and  Queue Monitor  Pollers              */
+  /*--------------------------------------------------------------------*/
+  // Every port runs the data structure given in port_isolation.csv.
+  // The pollers are implemented in poller.c
+  printf("\n\n-----------------------------------------------------\nPrintQueue Pollers are Activating (%s backend)\n-----------------------------------------------------\n\n", pq_backend->name);
+  if (pq_pollers_init() != 0){
+    running_flag = false;
+    signal_flag = false;
+    pthread_join(signal_thread, NULL);
+    pq_stats_close();
+    pq_trace_stop();
+    return -1;
+  }
+  if (pq_warm){
+    pq_warm_settle();
+  }
+  // the data plane is programmed: the checkpoint tells it again
+  pq_checkpoint_save();
+  pthread_t reload_thread;
+  bool reload = pq_threshold_reload_ms > 0 && threshold_path != NULL && pq_backend->threshold_modify && pq_backend->threshold_delete;
+  if (reload && pthread_create(&reload_thread, NULL, &threshold_reload_thread, NULL) != 0){
+    printf("Warning: creation of threshold reload thread failed, %s is not reloaded!\n", threshold_path);
+    reload = false;
+  }
+  pq_poll_loop();
+  pq_pool_free();
+  running_flag = false;
+  signal_flag = false;
+  pthread_join(signal_thread, NULL);
+  if (reload){
+    pthread_join(reload_thread, NULL);
+  }
+  pq_checkpoint_save();
+  pq_stats_close();
+  pq_trace_stop();
+  return 0;
+}
@@ -0,0 +1,765 @@
+/*************************************************************************
+	> File Name: poller.c
+  > Description: Time windows and queue monitor pollers, and the scheduler
+  >              sharing the register read budget between them
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "printqueue.h"
+
+static inline int64_t tv_us(const struct timeval *t){
+  return (int64_t)t->tv_sec * 1000000 + t->tv_usec;
+}
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                      Time          Windows                         //
+//                                                                    //
+//--------------------------------------------------------------------//
+static int tw_prepare(uint16_t idx){
+  if (pq_backend->prepare_add(PQ_MODE_TW, port_table[idx].isolation_id, second_highest[idx]) != 0){
+    printf("Error adding table entries - prepare TW0!\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int tw_flip(uint16_t idx){
+  if (pq_backend->prepare_modify(PQ_MODE_TW, port_table[idx].isolation_id, second_highest[idx] << second_highest_shift_bit) != 0){
+    printf("Error port %d setting second highest bit!\n", port_table[idx].port);
+    return -1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// port_pkt_cnt_r counts the packets of every port in the data plane.
+// A port whose counter does not move since the last reading has no new
+// cells in its time windows, so the reading is skipped.
+//----------------------------------------------------------------------
+static uint32_t tw_pkt_cnt[MAX_PORT_NUM];
+static bool tw_pkt_cnt_valid[MAX_PORT_NUM];
+
+static bool tw_active(uint16_t idx){
+  uint32_t cnt;
+  if (pq_backend->iso_reg_read(PQ_REG_PORT_PKT_CNT, port_table[idx].isolation_id, &cnt) != 0){
+    return true;
+  }
+  if (tw_pkt_cnt_valid[idx] && cnt == tw_pkt_cnt[idx]){
+    return false;
+  }
+  tw_pkt_cnt[idx] = cnt;
+  tw_pkt_cnt_valid[idx] = true;
+  return true;
+}
+
+static int tw_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  return pq_backend->tw_range_read(start, count, stride, buf);
+}
+
+static int tw_persist(uint16_t idx, const struct timeval *ts, int64_t host_ns, const uint8_t *buf, uint32_t count, bool data_query){
+  char data_dir[100];
+  sprintf(data_dir, "./tw_data/%d/tw_data/%ld_%ld.%s", idx, ts->tv_sec, ts->tv_usec, tw_store_cells ? "cells" : "bin");
+  if (data_query){
+    PQ_TRACE(SNAPSHOT, port_table[idx].port, PQ_MODE_TW, count, ts->tv_sec, ts->tv_usec);
+  }
+  if (tw_store_cells){
+    return pq_tw_cells_persist(idx, data_dir, ts, host_ns, buf, count, data_query);
+  }
+  return pq_store_snapshot(idx, data_dir, ts, host_ns, PQ_SEG_RAW, data_query ? PQ_SEG_QUERY : 0, count, NULL, 0, buf, (size_t)count * 12 * T);
+}
+
+// store signal pkt information in the file : [type | enqueue_ts | dequeue_ts | clock (clock.h)]
+static int tw_persist_signal(const data_signal_t *sig){
+  char sig_data_dir[100];
+  uint32_t head[3] = {sig->type, sig->enqueue_ts, sig->dequeue_ts};
+  sprintf(sig_data_dir, "./tw_data/%d/signal_data/%ld_%ld.bin", sig->table_idx, sig->ts.tv_sec, sig->ts.tv_usec);
+  PQ_TRACE(SIGNAL_STORE, sig->data_port, sig->type, sig->iso_id, sig->previous_highest, sig->previous_second_highest);
+  return pq_store_snapshot(sig->table_idx, sig_data_dir, &sig->ts, sig->clock.host_ns, PQ_SEG_SIGNAL, PQ_SEG_QUERY, 0, head, sizeof(head), &sig->clock, sizeof(sig->clock));
+}
+
+static void tw_discard(uint16_t idx, int64_t host_ns, const uint8_t *buf, uint32_t count){
+  if (tw_store_cells){
+    pq_tw_cells_track(idx, host_ns, buf, count);
+  }
+}
+
+static pq_poller_t tw_poller = {
+  .name = "tw",
+  .mode = PQ_MODE_TW,
+  .query_guard_us = 5000,
+  .prepare = tw_prepare,
+  .active = tw_active,
+  .flip = tw_flip,
+  .live_entries = NULL,
+  .range_read = tw_range_read,
+  .filter = NULL,
+  .reset = NULL,
+  .persist = tw_persist,
+  .persist_signal = tw_persist_signal,
+  .discard = tw_discard,
+  .next_period = NULL,
+  .persist_meta = NULL,
+};
+
+//--------------------------------------------------------------------//
+//                                                                    //
+//                    Queue            Monitor                        //
+//                                                                    //
+//--------------------------------------------------------------------//
+//----------------------------------------------------------------------
+// Slots above the stack top are not reset when only the live prefix is
+// read, so an old entry may show up in a later snapshot of the same half.
+// Entries written in the current period carry a seq number larger than
+// seq_num_r read before the previous flip of the port (qm_seq_floor).
+// The half frozen by a data plane query was written since the last flip:
+// its floor is qm_seq_mark at the reception of the signal (control.c).
+// Both are written by the poll thread and read by the signal and reload
+// threads (checkpoint.c): they are stored and loaded atomically.
+//----------------------------------------------------------------------
+uint32_t qm_seq_mark[MAX_PORT_NUM], qm_seq_floor[MAX_PORT_NUM];   // checkpointed (checkpoint.c)
+// stack top and slots read at the last poll, interval chosen for the next poll
+static uint32_t qm_top[MAX_PORT_NUM], qm_last_top[MAX_PORT_NUM], qm_count[MAX_PORT_NUM], qm_period[MAX_PORT_NUM];
+
+static int qm_prepare(uint16_t idx){
+  if (pq_backend->prepare_add(PQ_MODE_QM, port_table[idx].isolation_id, second_highest[idx]) != 0){
+    printf("Error adding table entries - prepare QM!\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int qm_flip(uint16_t idx){
+  uint32_t seq;
+  __atomic_store_n(&qm_seq_floor[idx], qm_seq_mark[idx], __ATOMIC_RELAXED);
+  if (pq_backend->iso_reg_read(PQ_REG_SEQ_NUM, port_table[idx].isolation_id, &seq) == 0){
+    __atomic_store_n(&qm_seq_mark[idx], seq, __ATOMIC_RELAXED);
+  }
+  if (pq_backend->prepare_modify(PQ_MODE_QM, port_table[idx].isolation_id, second_highest[idx] << second_highest_shift_bit_q) != 0){
+    printf("Error port %d setting second highest bit!\n", port_table[idx].port);
+    return -1;
+  }
+  return 0;
+}
+
+// read the stack top of the port: only [0, top + margin) is worth reading.
+// The top is read after the flip, so the margin covers the slots of the
+// read half freed since the flip; slots above its top at the flip are
+// left from older periods and dropped by qm_filter.
+static uint32_t qm_live_entries(uint16_t idx){
+  if (pq_backend->iso_reg_read(PQ_REG_STACK_TOP, port_table[idx].isolation_id, &qm_top[idx]) != 0){
+    printf("Error port %d reading stack top, read the whole stack!\n", port_table[idx].port);
+    return max_qdepth;
+  }
+  if (qm_top[idx] + 1 + qm_read_margin >= max_qdepth){
+    return max_qdepth;
+  }
+  return qm_top[idx] + 1 + qm_read_margin;
+}
+
+static int qm_range_read(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  return pq_backend->qm_range_read(start, count, stride, buf);
+}
+
+// clear slots whose seq number is not larger than the floor of the port
+// (of the signal for a data plane query)
+// layout: [src_ip x count][dst_ip x count][seq x count]
+static void qm_filter(uint16_t idx, const data_signal_t *sig, uint8_t *buf, uint32_t count){
+  uint32_t seq, stale = 0, floor = sig ? sig->seq_floor : qm_seq_floor[idx];
+  for (uint32_t i = 0; i < count; i++){
+    memcpy(&seq, buf + (2 * count + i) * 4, 4);
+    if (seq != 0 && (int32_t)(seq - floor) <= 0){
+      memset(buf + i * 4, 0, 4);
+      memset(buf + (count + i) * 4, 0, 4);
+      memset(buf + (2 * count + i) * 4, 0, 4);
+      stale++;
+    }
+  }
+  if (stale){
+    PQ_TRACE(QM_STALE, port_table[idx].port, stale);
+  }
+}
+
+// reset registers after read: only store delta data
+static void qm_reset(uint32_t start, uint32_t count){
+  pq_backend->qm_range_reset(start, count);
+}
+
+static int qm_persist(uint16_t idx, const struct timeval *ts, int64_t host_ns, const uint8_t *buf, uint32_t count, bool data_query){
+  char data_dir[100];
+  uint8_t flags = data_query ? PQ_SEG_QUERY : 0;
+  // e_us is the time after the operation of bit flip, also the start of the reading
+  // the last number marks the overflow of the seq number
+  if (!data_query && wrap[idx]){
+    sprintf(data_dir, "./qm_data/%d/qm_data/%ld_%ld_1.bin", idx, ts->tv_sec, ts->tv_usec);
+    wrap[idx] = false;
+    flags |= PQ_SEG_WRAP;
+  }else{
+    sprintf(data_dir, "./qm_data/%d/qm_data/%ld_%ld_0.bin", idx, ts->tv_sec, ts->tv_usec);
+  }
+  if (data_query){
+    PQ_TRACE(SNAPSHOT, port_table[idx].port, PQ_MODE_QM, count, ts->tv_sec, ts->tv_usec);
+  }
+  // periodical snapshots only hold the live prefix of the stack: count = file size / 12
+  return pq_store_snapshot(idx, data_dir, ts, host_ns, PQ_SEG_RAW, flags, count, NULL, 0, buf, (size_t)count * 12);
+}
+
+// store signal pkt information in the file : [type]
+static int qm_persist_signal(const data_signal_t *sig){
+  char sig_data_dir[100];
+  sprintf(sig_data_dir, "./qm_data/%d/signal_data/%ld_%ld.bin", sig->table_idx, sig->ts.tv_sec, sig->ts.tv_usec);
+  PQ_TRACE(SIGNAL_STORE, sig->data_port, sig->type, sig->iso_id, sig->previous_highest, sig->previous_second_highest);
+  return pq_store_snapshot(sig->table_idx, sig_data_dir, &sig->ts, sig->clock.host_ns, PQ_SEG_SIGNAL, PQ_SEG_QUERY, 0, NULL, 0, &sig->type, 4);
+}
+
+//----------------------------------------------------------------------
+// Adaptive reading interval of a queue monitor port:
+//   * busy (stack top >= qm_busy_depth, or the stack grows): halve the
+//     interval, down to qm_interval_min, or to the latency of the poll
+//     plus twice query_guard_us if longer
+//   * idle (empty stack, nothing read): double it, up to qm_interval_max
+//   * otherwise keep it
+// Then stretch the interval if the slots read per second by all queue
+// monitor ports exceed qm_read_budget.
+// Every chosen interval is appended to qm_data/<port idx>/qm_meta.csv (a
+// META record with retention) by the writer thread:
+// ts_sec ts_usec interval_us entries stack_top
+// (ts is the name of the snapshot file)
+//----------------------------------------------------------------------
+static pq_poller_t qm_poller;
+
+static uint32_t qm_next_period(uint16_t idx, const struct timeval *ts, uint32_t count){
+  uint32_t period = qm_period[idx];
+  // data plane query chunks are read after the poll while query_guard_us of
+  // slack is left: the interval covers the poll just measured, that slack
+  // and as long again for the chunks, so a busy port still gets queried
+  uint32_t period_min = qm_poller.poll_us_last + 2 * qm_poller.query_guard_us;
+  double rate = 0;
+  bool busy = qm_top[idx] >= qm_busy_depth || qm_top[idx] > qm_last_top[idx] + qm_read_margin;
+  bool idle = qm_top[idx] == 0 && qm_last_top[idx] == 0;
+  if (period_min < qm_interval_min){
+    period_min = qm_interval_min;
+  }
+  if (busy){
+    period = period / 2 > period_min ? period / 2 : period_min;
+  }else if (idle){
+    period = period * 2 < qm_interval_max ? period * 2 : qm_interval_max;
+  }
+  qm_count[idx] = count;
+  qm_last_top[idx] = qm_top[idx];
+  // slots per second of all queue monitor ports with the new interval
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    if (port_table[i].mode != PQ_MODE_QM) continue;
+    rate += (double)qm_count[i] * 1000000 / (i == idx ? period : qm_period[i]);
+  }
+  if (rate > qm_read_budget){
+    period = ceil(period * rate / qm_read_budget);
+    if (period > qm_interval_max){
+      period = qm_interval_max;
+    }
+  }
+  if (period < period_min){
+    period = period_min;
+  }
+  qm_period[idx] = period;
+
+  uint32_t meta[PQ_META_WORDS] = {period, count, qm_top[idx]};
+  pq_writer_meta(&qm_poller, idx, ts, meta);
+  return period;
+}
+
+// append [interval_us, entries, stack_top] of a poll to qm_meta.csv, or
+// to the segment of the port with retention (writer thread)
+static int qm_persist_meta(uint16_t idx, const struct timeval *ts, const uint32_t *meta){
+  char meta_dir[100];
+  if (pq_retain){
+    return pq_store_snapshot(idx, NULL, ts, 0, PQ_SEG_META, 0, 0, NULL, 0, meta, PQ_META_WORDS * 4);
+  }
+  sprintf(meta_dir, "./qm_data/%d/qm_meta.csv", idx);
+  FILE * f = fopen(meta_dir, "a");
+  if (f == NULL){
+    printf("Error opening %s!\n", meta_dir);
+    return -1;
+  }
+  fprintf(f, "%ld %ld %u %u %u\n", ts->tv_sec, ts->tv_usec, meta[0], meta[1], meta[2]);
+  fclose(f);
+  return 0;
+}
+
+static pq_poller_t qm_poller = {
+  .name = "qm",
+  .mode = PQ_MODE_QM,
+  .query_guard_us = 15000,
+  .prepare = qm_prepare,
+  .active = NULL,
+  .flip = qm_flip,
+  .live_entries = qm_live_entries,
+  .range_read = qm_range_read,
+  .filter = qm_filter,
+  .reset = qm_reset,
+  .persist = qm_persist,
+  .persist_signal = qm_persist_signal,
+  .discard = NULL,
+  .next_period = NULL,    // qm_next_period when qm_adaptive
+  .persist_meta = qm_persist_meta,
+};
+
+pq_poller_t *pq_pollers[PQ_MODE_NUM] = {&tw_poller, &qm_poller};
+
+pq_mode_t pq_parse_mode(const char *str){
+  if (!strncmp(str, "qm", 2)){
+    return PQ_MODE_QM;
+  }
+  if (strncmp(str, "tw", 2)){
+    printf("Unknown PrintQueue mode %s, expected one of: \"tw\", \"qm\"\nDefaulting to \"tw\"\n", str);
+  }
+  return PQ_MODE_TW;
+}
+
+//----------------------------------------------------------------------
+// Derive the period and the snapshot size of every module from the
+// parameters, then install the prepare table entries of all ports (but
+// those kept by a warm start, whose bits are read back from them).
+//----------------------------------------------------------------------
+int pq_pollers_init(void){
+  tw_poller.period_us = ((1 << (a * T)) - 1) * (1 << (k + TB0)) / ((1<<a)-1) / 1000 - 100; // us, give a little time ahead to trigger reading
+  tw_poller.duration = duration;
+  tw_poller.entry_num = cell_number;
+  tw_poller.register_num = T * 3;
+  tw_poller.highest_shift = highest_shift_bit;
+  tw_poller.second_highest_shift = second_highest_shift_bit;
+
+  qm_poller.period_us = read_interval;
+  if (qm_adaptive){
+    qm_poller.next_period = qm_next_period;
+    for (uint16_t i = 0; i < port_entry_num; i++){
+      if (port_table[i].mode != PQ_MODE_QM) continue;
+      qm_period[i] = read_interval;
+      if (pq_retain) continue;    // intervals go to the segments (segment.h)
+      char meta_dir[100];
+      sprintf(meta_dir, "./qm_data/%d/qm_meta.csv", i);
+      FILE * f = fopen(meta_dir, "w");
+      if (f == NULL){
+        printf("Error opening %s!\n", meta_dir);
+        return -1;
+      }
+      fprintf(f, "ts_sec ts_usec interval_us entries stack_top\n");
+      fclose(f);
+    }
+    if (qm_interval_max < qm_interval_min){
+      qm_interval_max = qm_interval_min;
+    }
+    printf("qm: adaptive interval in [%d, %d] us (at least the poll latency + 2 x %d us), read budget %d slots/s\n", qm_interval_min, qm_interval_max, qm_poller.query_guard_us, qm_read_budget);
+  }
+  qm_poller.duration = duration_q;
+  qm_poller.entry_num = max_qdepth;
+  qm_poller.register_num = 3;
+  qm_poller.highest_shift = highest_shift_bit_q;
+  qm_poller.second_highest_shift = second_highest_shift_bit_q;
+
+  pq_pool_reserved = 0;
+  if (pq_recorder && pq_recorder_init() != 0){
+    return -1;
+  }
+  if (pq_retain && pq_retain_init() != 0){
+    return -1;
+  }
+  // every buffer of the pool holds the largest snapshot of the modes in use
+  size_t snapshot_size = 0;
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    pq_poller_t *p = pq_pollers[port_table[i].mode];
+    if ((size_t)p->entry_num * p->register_num * 4 > snapshot_size){
+      snapshot_size = (size_t)p->entry_num * p->register_num * 4;
+    }
+  }
+  if (pq_pool_init(snapshot_size) != 0){
+    return -1;
+  }
+  if (tw_store_cells && pq_tw_cells_init() != 0){
+    return -1;
+  }
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    if (!pq_warm_port[i] && pq_pollers[port_table[i].mode]->prepare(i) != 0){
+      return -1;
+    }
+  }
+  //--------------------------------------------------------------
+  // The value of the second highest bit is the NEXT period's
+  // But the value of the highest bit is the CURRENT period's
+  //--------------------------------------------------------------
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    if (!pq_warm_port[i]){
+      second_highest[i] = 1;
+    }
+  }
+  printf("Successfully set the second highest bit\n");
+  for (int m = 0; m < PQ_MODE_NUM; m++){
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < port_entry_num; i++){
+      if (port_table[i].mode == m) n++;
+    }
+    if (n){
+      printf("%s: %d port(s), retrieve interval: %d us, %d entries x %d registers\n", pq_pollers[m]->name, n, pq_pollers[m]->period_us, pq_pollers[m]->entry_num, pq_pollers[m]->register_num);
+    }
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                              Scheduler                                   //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Every port is polled by the module of its mode once its period expires.
+// Periodical polls own the read budget; the slack until the earliest next
+// periodical poll of any port is spent on data plane queries, chunk by
+// chunk, with the chunk size derived from the latency measured for the
+// module of the queried port.
+//--------------------------------------------------------------------------
+static void pq_print_latency(void){
+  for (int m = 0; m < PQ_MODE_NUM; m++){
+    pq_poller_t *p = pq_pollers[m];
+    if (p->poll_num == 0 && p->skip_num == 0) continue;
+    printf("%s poller: %lu polls, %lu skipped on idle ports, average %lu us, max %u us, period %u us\n", p->name, p->poll_num, p->skip_num, p->poll_num ? p->poll_us_total / p->poll_num : 0, p->poll_us_max, p->period_us);
+    printf("%s poller: wakeup latency average %lu us, max %u us, %lu deadline misses (> %u us late)\n", p->name, p->wakeup_us_total / (p->poll_num + p->skip_num), p->wakeup_us_max, p->deadline_miss, rt_deadline_slack_us);
+    printf("%s poller: poll latency p99 %u us, %lu polls longer than the period, %lu data plane queries (p99 %u us)\n", p->name, pq_latency_percentile(&p->poll_lat, 99), p->overrun, p->query_lat.num, pq_latency_percentile(&p->query_lat, 99));
+  }
+  if (signal_overflow_num){
+    printf("Warning: %lu data plane query signals lost on a full signal queue!\n", signal_overflow_num);
+  }
+  if (pq_pool_wait_num){
+    printf("Warning: the poller waited %lu times for a free snapshot buffer, try a larger --pq-pool-buffers!\n", pq_pool_wait_num);
+  }
+}
+
+void pq_latency_add(pq_latency_t *l, uint32_t us){
+  l->us[l->num % PQ_LATENCY_SAMPLES] = us;
+  l->num += 1;
+  l->total += us;
+  if (us > l->max){
+    l->max = us;
+  }
+}
+
+static int cmp_u32(const void *x, const void *y){
+  uint32_t a = *(const uint32_t *)x, b = *(const uint32_t *)y;
+  return a < b ? -1 : a > b;
+}
+
+// p-th percentile (0 - 100) of the kept samples, 0 without samples
+uint32_t pq_latency_percentile(const pq_latency_t *l, double p){
+  uint32_t n = l->num < PQ_LATENCY_SAMPLES ? l->num : PQ_LATENCY_SAMPLES;
+  if (n == 0){
+    return 0;
+  }
+  uint32_t *sorted = malloc(n * sizeof(uint32_t));
+  if (sorted == NULL){
+    return l->max;
+  }
+  memcpy(sorted, l->us, n * sizeof(uint32_t));
+  qsort(sorted, n, sizeof(uint32_t), cmp_u32);
+  uint32_t rank = ceil(p / 100 * n);
+  uint32_t v = sorted[rank ? rank - 1 : 0];
+  free(sorted);
+  return v;
+}
+
+void pq_pollers_reset_stats(void){
+  for (int m = 0; m < PQ_MODE_NUM; m++){
+    pq_poller_t *p = pq_pollers[m];
+    p->poll_num = p->skip_num = p->poll_us_total = 0;
+    p->poll_us_max = p->poll_us_last = p->poll_entries_last = 0;
+    p->wakeup_us_total = p->deadline_miss = p->overrun = p->read_entries = 0;
+    p->wakeup_us_max = 0;
+    memset(&p->poll_lat, 0, sizeof(pq_latency_t));
+    memset(&p->query_lat, 0, sizeof(pq_latency_t));
+  }
+}
+
+//----------------------------------------------------------------------
+// Read [start, start + count) of every register of the module straight
+// into its column of the snapshot (register r at buf + r * stride * 4).
+// Buffers of the pool are not cleared between snapshots: only the count
+// entries just written are persisted. A failed read clears its range instead, so that
+// no stale words of an older snapshot are stored.
+//----------------------------------------------------------------------
+static void pq_read_columns(pq_poller_t *p, uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf){
+  if (p->range_read(start, count, stride, buf) != 0){
+    printf("Error reading registers of %s [%u, %u)!\n", p->name, start, start + count);
+    for (uint32_t r = 0; r < p->register_num; r++){
+      memset(buf + (size_t)r * stride * 4, 0, count * 4);
+    }
+  }
+}
+
+void pq_poll_loop(void){
+  struct timeval s_us, e_us[MAX_PORT_NUM], initial_us;
+  int64_t e_ns[MAX_PORT_NUM];      // e_us on the host monotonic clock (clock.h)
+  uint32_t period[MAX_PORT_NUM];   // period of the next poll of every port
+  uint32_t estimated_retrieve_interval = 0, data_query_start = 0, data_query_num = 0, data_query_end = 0, storage_start = 0, index = 0, count = 0;
+  int64_t available_interval = 0, next_poll = 0;
+  uint32_t delta_time, run_duration = 0;
+  uint64_t t_ns = 0, poll_ns = 0;   // start of the phase and of the poll (stats.h)
+  bool idle = false;
+  double reading_ratio = 0.05;
+  pq_poller_t *p, *q = NULL;   // q: module of the running data plane query
+  // snapshot buffers of the pool (pool.c): the one of a periodical poll is
+  // handed over to the writer right away, the one of a data plane query
+  // once all of its chunks are read
+  pq_buf_t buf, query_buf = PQ_BUF_NONE;
+  pq_pool_wait_num = 0;
+  pq_trace_thread_name("poll");
+  if (rt_mode){
+    pq_rt_setup_thread("poll", rt_poll_core, rt_priority);
+  }
+  if (pq_writer_start() != 0){
+    loop_flag = false;
+    running_flag = false;
+    signal_flag = false;
+    return;
+  }
+
+  // a duration of 0: continuous operation, until USR1 / USR2
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    if (pq_pollers[port_table[i].mode]->duration == 0){
+      run_duration = UINT32_MAX;
+      break;
+    }
+    if (pq_pollers[port_table[i].mode]->duration > run_duration){
+      run_duration = pq_pollers[port_table[i].mode]->duration;
+    }
+  }
+  while(running_flag){
+    gettimeofday(&initial_us, NULL);
+    for (uint16_t i = 0; i < port_entry_num; i ++){
+      gettimeofday(&e_us[i], NULL);
+      period[i] = pq_pollers[port_table[i].mode]->period_us;
+    }
+    while(loop_flag){
+      next_poll = INT64_MAX;
+      for (uint16_t i = 0; i < port_entry_num; i++){
+        p = pq_pollers[port_table[i].mode];
+        gettimeofday(&s_us, NULL);
+        delta_time = tv_us(&s_us) - tv_us(&e_us[i]);
+        if(delta_time >= period[i]){
+          pq_stats_begin(i, PQ_KIND_POLL);
+          poll_ns = t_ns = pq_stats_now();
+          p->wakeup_us_total += delta_time - period[i];
+          if (delta_time - period[i] > p->wakeup_us_max){
+            p->wakeup_us_max = delta_time - period[i];
+          }
+          if (delta_time - period[i] > rt_deadline_slack_us){
+            p->deadline_miss += 1;
+            pq_stats_count(PQ_CNT_DEADLINE_MISSES, 1);
+            PQ_TRACE(DEADLINE_MISS, port_table[i].port, delta_time - period[i]);
+          }
+          idle = p->active && !p->active(i);
+          if (p->active){
+            t_ns = pq_stats_phase(PQ_PHASE_ACTIVE, t_ns);
+          }
+        }
+        if(delta_time >= period[i] && idle){
+          // idle port: no flip, no reading, only an empty snapshot marking the period
+          gettimeofday(&e_us[i], NULL);
+          pq_writer_submit(p, i, &e_us[i], pq_clock_host_ns(), PQ_BUF_NONE, 0, false);
+          p->skip_num += 1;
+          pq_stats_count(PQ_CNT_SKIPS, 1);
+          pq_stats_end();
+          PQ_TRACE(POLL_SKIP, port_table[i].port);
+        }
+        else if(delta_time >= period[i]){
+          if (p->flip(i) != 0){
+            loop_flag = false;
+            running_flag = false;
+            signal_flag = false;
+            pq_buf_put(query_buf);
+            pq_writer_stop();
+            return;
+          }
+          t_ns = pq_stats_phase(PQ_PHASE_FLIP, t_ns);
+          gettimeofday(&e_us[i], NULL);
+          e_ns[i] = pq_clock_host_ns();
+          second_highest[i] ^= 1;
+          // read just recorded registers
+          PQ_TRACE(POLL_BEGIN, port_table[i].port, port_table[i].mode, highest[i], second_highest[i]);
+          index = port_table[i].isolation_prefix + (second_highest[i] << p->second_highest_shift) + (highest[i] << p->highest_shift);
+          if (p->live_entries){
+            count = p->live_entries(i);
+            t_ns = pq_stats_phase(PQ_PHASE_LIVE, t_ns);
+          }else{
+            count = p->entry_num;
+          }
+          PQ_TRACE(POLL_READ, port_table[i].port, count);
+          buf = pq_buf_get();
+          pq_read_columns(p, index, count, count, pq_buf_ptr(buf));
+          t_ns = pq_stats_phase(PQ_PHASE_READ, t_ns);
+          if (p->filter){
+            p->filter(i, NULL, pq_buf_ptr(buf), count);
+            t_ns = pq_stats_phase(PQ_PHASE_FILTER, t_ns);
+          }
+          if (p->reset){
+            p->reset(index, count);
+            t_ns = pq_stats_phase(PQ_PHASE_RESET, t_ns);
+          }
+          // store the register values
+          pq_writer_submit(p, i, &e_us[i], e_ns[i], buf, count, false);   // e_us is the time after the operation of bit flip, also the start of the reading
+          t_ns = pq_stats_phase(PQ_PHASE_PERSIST, t_ns);
+          gettimeofday(&s_us, NULL);
+          estimated_retrieve_interval = tv_us(&s_us) - tv_us(&e_us[i]);
+          p->poll_us_last = estimated_retrieve_interval;
+          p->poll_entries_last = count;
+          p->poll_us_total += estimated_retrieve_interval;
+          p->poll_num += 1;
+          if (estimated_retrieve_interval > p->poll_us_max){
+            p->poll_us_max = estimated_retrieve_interval;
+          }
+          if (estimated_retrieve_interval > period[i]){
+            p->overrun += 1;
+            pq_stats_count(PQ_CNT_OVERRUNS, 1);
+          }
+          pq_latency_add(&p->poll_lat, estimated_retrieve_interval);
+          p->read_entries += count;
+          if (p->next_period){
+            period[i] = p->next_period(i, &e_us[i], count);
+          }
+          pq_stats_phase(PQ_PHASE_TOTAL, poll_ns);
+          pq_stats_count(PQ_CNT_POLLS, 1);
+          pq_stats_count(PQ_CNT_ENTRIES_READ, count);
+          pq_stats_count(PQ_CNT_BYTES_WRITTEN, (uint64_t)count * p->register_num * 4);
+          pq_stats_end();
+          PQ_TRACE(POLL_END, port_table[i].port, estimated_retrieve_interval, period[i]);
+        }
+        if (tv_us(&e_us[i]) + period[i] < next_poll){
+          next_poll = tv_us(&e_us[i]) + period[i];
+        }
+      }
+      gettimeofday(&s_us, NULL);
+      if (s_us.tv_sec - initial_us.tv_sec > run_duration){
+        printf("\nPeriodical retrieve Ends!\n");
+        pq_print_latency();
+        loop_flag = false;
+        signal_flag = false;
+        break;
+      }
+      available_interval = next_poll - tv_us(&s_us);
+      if (rt_mode && finish_last && !new_signal && available_interval > rt_spin_us){
+        // nothing to query: sleep in short steps (new signals are picked up after a step),
+        // spin for the last rt_spin_us before the deadline
+        pq_rt_sleep_us(available_interval - rt_spin_us < 1000 ? available_interval - rt_spin_us : 1000);
+        continue;
+      }
+      if (available_interval < 2000){
+        // printf("*");
+        continue;
+      }
+      //-----------------------------------------------------------------------------------//
+      //                               Data Plane Query                                    //
+      //-----------------------------------------------------------------------------------//
+      if (!poll_ready && finish_last){
+        if (new_signal){
+          q = pq_pollers[port_table[data_signal[data_signal_head].table_idx].mode];
+          if (q->poll_us_last){
+            poll_ready = true;
+            finish_last = false;
+          }
+        }
+      }
+      if (poll_ready && !finish_last){
+        data_signal_t *sig = &data_signal[data_signal_head];
+        pq_writer_signal(q, sig);
+        PQ_TRACE(QUERY_BEGIN, sig->iso_id, sig->data_port, sig->previous_highest, sig->previous_second_highest);
+        data_query_start = sig->isolation_prefix + (sig->previous_highest << q->highest_shift) + (sig->previous_second_highest << q->second_highest_shift);
+        data_query_end = data_query_start + q->entry_num;
+        storage_start = 0;
+        query_buf = pq_buf_get();
+        poll_ready = false;
+      }
+      if (!poll_ready && !finish_last){
+        gettimeofday(&s_us, NULL);
+        available_interval = next_poll - tv_us(&s_us);
+        if (available_interval < q->query_guard_us){
+          // printf("x:%d",available_interval);
+          continue;
+        }
+        pq_stats_begin(data_signal[data_signal_head].table_idx, PQ_KIND_QUERY);
+        t_ns = pq_stats_now();
+        // a periodical poll may read only a prefix (queue monitor): the latency per entry it measured
+        // sizes the chunk, a query reads all entry_num entries
+        data_query_num = floor((double)available_interval * reading_ratio * (double)q->poll_entries_last / (double)q->poll_us_last);
+        if (data_query_start + data_query_num >= data_query_end){
+          data_query_num = data_query_end - data_query_start;
+        }
+        if(data_query_num != 0){
+          PQ_TRACE(QUERY_CHUNK, data_signal[data_signal_head].data_port, data_query_num, available_interval);
+          // every register's chunk goes to its column of the snapshot
+          pq_read_columns(q, data_query_start, data_query_num, q->entry_num, pq_buf_ptr(query_buf) + storage_start * 4);
+          t_ns = pq_stats_phase(PQ_PHASE_READ, t_ns);
+          q->read_entries += data_query_num;
+          pq_stats_count(PQ_CNT_QUERY_CHUNKS, 1);
+          pq_stats_count(PQ_CNT_ENTRIES_READ, data_query_num);
+          if (q->reset){
+            q->reset(data_query_start, data_query_num);
+            t_ns = pq_stats_phase(PQ_PHASE_RESET, t_ns);
+          }
+          data_query_start += data_query_num;
+          storage_start += data_query_num;
+        }
+        if (data_query_start == data_query_end){
+          gettimeofday(&s_us, NULL);
+          available_interval = next_poll - tv_us(&s_us);
+          if (available_interval < 2500){
+            PQ_TRACE(QUERY_WAIT, data_signal[data_signal_head].data_port, available_interval);
+            pq_stats_end();
+            continue;
+          }
+          // the whole half is read: slots above the stack top may be left from older periods
+          if (q->filter){
+            q->filter(data_signal[data_signal_head].table_idx, &data_signal[data_signal_head], pq_buf_ptr(query_buf), q->entry_num);
+            t_ns = pq_stats_phase(PQ_PHASE_FILTER, t_ns);
+          }
+          // all registers are read
+          pq_writer_submit(q, data_signal[data_signal_head].table_idx, &data_signal[data_signal_head].ts, data_signal[data_signal_head].clock.host_ns, query_buf, q->entry_num, true);  // start of reading
+          query_buf = PQ_BUF_NONE;
+          t_ns = pq_stats_phase(PQ_PHASE_PERSIST, t_ns);
+          // unlock data plane
+          pq_backend->data_query_unlock(data_signal[data_signal_head].iso_id);
+          pq_stats_phase(PQ_PHASE_UNLOCK, t_ns);
+          gettimeofday(&s_us, NULL);
+          pq_latency_add(&q->query_lat, tv_us(&s_us) - tv_us(&data_signal[data_signal_head].ts));
+          pq_stats_add(PQ_PHASE_TOTAL, (tv_us(&s_us) - tv_us(&data_signal[data_signal_head].ts)) * 1000);
+          pq_stats_count(PQ_CNT_QUERIES, 1);
+          pq_stats_count(PQ_CNT_BYTES_WRITTEN, (uint64_t)q->entry_num * q->register_num * 4);
+          PQ_TRACE(QUERY_END, data_signal[data_signal_head].iso_id, data_signal[data_signal_head].data_port, tv_us(&s_us) - tv_us(&data_signal[data_signal_head].ts));
+          data_signal_head = (data_signal_head + 1) % SIGNAL_QUEUE_SIZE;
+          if (data_signal_head == data_signal_tail){
+            PQ_TRACE(SIGNAL_QUEUE_EMPTY, data_signal[(data_signal_head + SIGNAL_QUEUE_SIZE - 1) % SIGNAL_QUEUE_SIZE].iso_id);
+            new_signal = false;
+          }
+          finish_last = true;
+        }
+        gettimeofday(&s_us, NULL);
+        available_interval = next_poll - tv_us(&s_us);
+        PQ_TRACE(QUERY_SLACK, available_interval);
+        pq_stats_end();
+      }
+      gettimeofday(&s_us, NULL);
+      if (s_us.tv_sec - initial_us.tv_sec > run_duration){
+        printf("\nPeriodical retrieve Ends!\n");
+        pq_print_latency();
+        loop_flag = false;
+        signal_flag = false;
+      }
+    }
+    if (pq_oneshot){
+      // single run (software model): no USR1 / USR2 control
+      running_flag = false;
+    }
+  }
+  pq_buf_put(query_buf);
+  pq_writer_stop();
+  pq_recorder_print_stats();
+  pq_retain_print_stats();
+}
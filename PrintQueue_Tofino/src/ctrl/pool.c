@@ -0,0 +1,283 @@
+/*************************************************************************
+	> File Name: pool.c
+  > Description: Pool of snapshot buffers on 2 MB hugepages, and the writer
+  >              thread storing the snapshots handed over by the pollers
+*************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "printqueue.h"
+
+#define PQ_HUGEPAGE_SIZE (2UL << 20)
+#define PQ_WRITER_QUEUE_SIZE 64
+
+uint32_t pq_pool_buffers = 8;
+uint32_t pq_pool_reserved = 0;
+uint64_t pq_pool_wait_num = 0;
+
+static uint8_t *pool_base = NULL;
+static size_t pool_len = 0, pool_slot = 0, pool_buf_size = 0;
+static bool pool_huge = false;
+static uint32_t pool_num = 0;
+
+// free buffers, a stack of handles
+static pq_buf_t *pool_free = NULL;
+static uint32_t pool_free_num = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+//----------------------------------------------------------------------
+// Map len bytes on 2 MB hugepages (hugetlbfs pool, vm.nr_hugepages).
+// Without reserved hugepages, fall back to normal pages and ask for
+// transparent hugepages instead.
+//----------------------------------------------------------------------
+static void *pool_map(size_t len, bool *huge){
+  void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (m != MAP_FAILED){
+    *huge = true;
+    return m;
+  }
+  *huge = false;
+  m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED){
+    return NULL;
+  }
+  madvise(m, len, MADV_HUGEPAGE);
+  return m;
+}
+
+void pq_pool_free(void){
+  if (pool_base != NULL){
+    munmap(pool_base, pool_len);
+  }
+  free(pool_free);
+  pool_base = NULL;
+  pool_free = NULL;
+  pool_len = pool_slot = pool_buf_size = 0;
+  pool_num = pool_free_num = 0;
+}
+
+//----------------------------------------------------------------------
+// Slab of pq_pool_buffers + pq_pool_reserved buffers of buf_size bytes
+// each, rounded up to whole pages, in one mapping rounded up to whole
+// hugepages. Every page is touched here, so that no page fault hits a
+// poll. Called again with the same size, the pool is kept.
+//----------------------------------------------------------------------
+int pq_pool_init(size_t buf_size){
+  uint32_t num = pq_pool_buffers + pq_pool_reserved;
+  if (pool_base != NULL && buf_size == pool_buf_size && pool_num == num && pool_free_num == pool_num){
+    return 0;
+  }
+  pq_pool_free();
+  if (pq_pool_buffers < 2){
+    printf("Error: the snapshot pool needs at least 2 buffers (periodical poll and data plane query)!\n");
+    return -1;
+  }
+  pool_slot = (buf_size + 4095) & ~(size_t)4095;
+  pool_len = (pool_slot * num + PQ_HUGEPAGE_SIZE - 1) & ~(PQ_HUGEPAGE_SIZE - 1);
+  pool_base = pool_map(pool_len, &pool_huge);
+  pool_free = malloc(num * sizeof(pq_buf_t));
+  if (pool_base == NULL || pool_free == NULL){
+    printf("Error allocating the snapshot pool (%u x %zu bytes): %s\n", num, buf_size, strerror(errno));
+    pq_pool_free();
+    return -1;
+  }
+  memset(pool_base, 0, pool_len);
+  pool_buf_size = buf_size;
+  pool_num = num;
+  for (uint32_t i = 0; i < pool_num; i++){
+    pool_free[i] = pool_num - 1 - i;
+  }
+  pool_free_num = pool_num;
+  printf("Snapshot pool: %u buffers x %zu bytes on %s pages (%zu KB)\n", pool_num, buf_size, pool_huge ? "2 MB huge" : "normal", pool_len >> 10);
+  return 0;
+}
+
+uint8_t *pq_buf_ptr(pq_buf_t h){
+  return pool_base + (size_t)h * pool_slot;
+}
+
+// take a free buffer, waiting for the writer when all of them are queued
+pq_buf_t pq_buf_get(void){
+  pthread_mutex_lock(&pool_lock);
+  if (pool_free_num == 0){
+    struct timeval s, e;
+    gettimeofday(&s, NULL);
+    while (pool_free_num == 0){
+      pthread_cond_wait(&pool_cond, &pool_lock);
+    }
+    gettimeofday(&e, NULL);
+    pq_pool_wait_num += 1;
+    pq_stats_count(PQ_CNT_POOL_WAITS, 1);
+    PQ_TRACE(POOL_WAIT, (e.tv_sec - s.tv_sec) * 1000000 + e.tv_usec - s.tv_usec);
+  }
+  pq_buf_t h = pool_free[--pool_free_num];
+  pthread_mutex_unlock(&pool_lock);
+  return h;
+}
+
+void pq_buf_put(pq_buf_t h){
+  if (h == PQ_BUF_NONE){
+    return;
+  }
+  pthread_mutex_lock(&pool_lock);
+  pool_free[pool_free_num++] = h;
+  pthread_cond_signal(&pool_cond);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                               Writer                                     //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Snapshots are stored in the order they are handed over. The buffer of
+// a snapshot goes back to the pool once its file is written. With the
+// flight recorder (recorder.c), it decides which snapshots are stored.
+//--------------------------------------------------------------------------
+
+static pq_write_job_t write_queue[PQ_WRITER_QUEUE_SIZE];
+static uint32_t write_head = 0, write_tail = 0;
+static bool writer_running = false;
+static pthread_t writer_thread;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;    // job queued, or stop
+static pthread_cond_t write_space = PTHREAD_COND_INITIALIZER;   // job taken
+
+static void *pq_writer(void *arg){
+  pq_trace_thread_name("writer");
+  pthread_mutex_lock(&write_lock);
+  while (1){
+    while (write_head == write_tail && writer_running){
+      pthread_cond_wait(&write_cond, &write_lock);
+    }
+    if (write_head == write_tail){
+      break;
+    }
+    pq_write_job_t job = write_queue[write_head];
+    write_head = (write_head + 1) % PQ_WRITER_QUEUE_SIZE;
+    pthread_cond_signal(&write_space);
+    pthread_mutex_unlock(&write_lock);
+    if (job.type == PQ_WRITE_SIGNAL){
+      job.p->persist_signal(&job.sig);
+    }else if (job.type == PQ_WRITE_META){
+      job.p->persist_meta(job.idx, &job.ts, job.meta);
+    }else if (pq_recorder){
+      pq_recorder_write(&job);
+    }else{
+      pq_writer_store(&job);
+    }
+    pthread_mutex_lock(&write_lock);
+  }
+  pthread_mutex_unlock(&write_lock);
+  if (pq_recorder){
+    pq_recorder_release();
+  }
+  return NULL;
+}
+
+// persist the snapshot of a job and give its buffer back to the pool
+void pq_writer_store(const pq_write_job_t *job){
+  job->p->persist(job->idx, &job->ts, job->host_ns, job->buf == PQ_BUF_NONE ? (const uint8_t *)"" : pq_buf_ptr(job->buf), job->count, job->data_query);
+  pq_buf_put(job->buf);
+}
+
+//----------------------------------------------------------------------
+// Hand count entries of buf over to the writer, which stores them with
+// p->persist and releases buf. buf may be PQ_BUF_NONE for an empty
+// snapshot (count = 0).
+//----------------------------------------------------------------------
+static pq_write_job_t *writer_slot(void){
+  pthread_mutex_lock(&write_lock);
+  while ((write_tail + 1) % PQ_WRITER_QUEUE_SIZE == write_head){
+    pthread_cond_wait(&write_space, &write_lock);
+  }
+  return &write_queue[write_tail];
+}
+
+static void writer_queue(void){
+  write_tail = (write_tail + 1) % PQ_WRITER_QUEUE_SIZE;
+  pthread_cond_signal(&write_cond);
+  pthread_mutex_unlock(&write_lock);
+}
+
+void pq_writer_submit(pq_poller_t *p, uint16_t idx, const struct timeval *ts, int64_t host_ns, pq_buf_t buf, uint32_t count, bool data_query){
+  pq_write_job_t *job = writer_slot();
+  job->p = p;
+  job->idx = idx;
+  job->data_query = data_query;
+  job->type = PQ_WRITE_SNAPSHOT;
+  job->ts = *ts;
+  job->host_ns = host_ns;
+  job->buf = buf;
+  job->count = count;
+  writer_queue();
+}
+
+// hand PQ_META_WORDS words of metadata of a poll over to the writer, which stores them with p->persist_meta
+void pq_writer_meta(pq_poller_t *p, uint16_t idx, const struct timeval *ts, const uint32_t *meta){
+  pq_write_job_t *job = writer_slot();
+  job->p = p;
+  job->idx = idx;
+  job->data_query = false;
+  job->type = PQ_WRITE_META;
+  memcpy(job->meta, meta, sizeof(job->meta));
+  job->ts = *ts;
+  job->host_ns = 0;
+  job->buf = PQ_BUF_NONE;
+  job->count = 0;
+  writer_queue();
+}
+
+// hand the signal of a data plane query over to the writer, which stores it with p->persist_signal
+void pq_writer_signal(pq_poller_t *p, const data_signal_t *sig){
+  pq_write_job_t *job = writer_slot();
+  job->p = p;
+  job->idx = sig->table_idx;
+  job->data_query = true;
+  job->type = PQ_WRITE_SIGNAL;
+  job->sig = *sig;
+  job->ts = sig->ts;
+  job->host_ns = sig->clock.host_ns;
+  job->buf = PQ_BUF_NONE;
+  job->count = 0;
+  writer_queue();
+}
+
+int pq_writer_start(void){
+  if (pq_retain && pq_retain_start() != 0){
+    return -1;
+  }
+  write_head = write_tail = 0;
+  writer_running = true;
+  if (pthread_create(&writer_thread, NULL, pq_writer, NULL) != 0){
+    printf("Error creating the writer thread!\n");
+    writer_running = false;
+    if (pq_retain){
+      pq_retain_stop();
+    }
+    return -1;
+  }
+  return 0;
+}
+
+// store every queued snapshot, then stop the writer (and close the segments)
+void pq_writer_stop(void){
+  pthread_mutex_lock(&write_lock);
+  if (!writer_running){
+    pthread_mutex_unlock(&write_lock);
+    return;
+  }
+  writer_running = false;
+  pthread_cond_signal(&write_cond);
+  pthread_mutex_unlock(&write_lock);
+  pthread_join(writer_thread, NULL);
+  if (pq_retain){
+    pq_retain_stop();
+  }
+}
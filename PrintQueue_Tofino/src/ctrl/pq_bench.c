@@ -0,0 +1,380 @@
+/*************************************************************************
+	> File Name: pq_bench.c
+  > Description: Benchmark of the PrintQueue control loop on the stub
+  >              backend, sweeping k, T, port number and signal rate
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "backend_stub.h"
+
+#define BENCH_LIST_SIZE 16
+
+typedef struct bench_list{
+  double v[BENCH_LIST_SIZE];
+  int num;
+} bench_list_t;
+
+// comma separated values, e.g. 10,11,12
+static int parse_list(const char *str, bench_list_t *l){
+  char *buf = strdup(str), *ptr;
+  l->num = 0;
+  for (ptr = strtok(buf, ","); ptr != NULL && l->num < BENCH_LIST_SIZE; ptr = strtok(NULL, ",")){
+    l->v[l->num++] = atof(ptr);
+  }
+  free(buf);
+  return l->num > 0 ? 0 : -1;
+}
+
+//----------------------------------------------------------------------
+// Snapshots are stored as in a real run, under the work directory; they
+// are removed after every point of the sweep.
+//----------------------------------------------------------------------
+static const char *data_dirs[] = {"tw_data/%d/tw_data", "tw_data/%d/signal_data", "qm_data/%d/qm_data", "qm_data/%d/signal_data"};
+
+static int prepare_work_dir(const char *work_dir){
+  char path[256];
+  mkdir(work_dir, 0755);
+  if (chdir(work_dir) != 0){
+    fprintf(stderr, "Error: cannot enter %s\n", work_dir);
+    return -1;
+  }
+  mkdir("tw_data", 0755);
+  mkdir("qm_data", 0755);
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    sprintf(path, "tw_data/%d", i);
+    mkdir(path, 0755);
+    sprintf(path, "qm_data/%d", i);
+    mkdir(path, 0755);
+    for (int d = 0; d < 4; d++){
+      sprintf(path, data_dirs[d], i);
+      mkdir(path, 0755);
+    }
+  }
+  return 0;
+}
+
+static void clean_work_dir(void){
+  char dir[256], path[512];
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    for (int d = 0; d < 4; d++){
+      sprintf(dir, data_dirs[d], i);
+      DIR *dp = opendir(dir);
+      if (dp == NULL) continue;
+      struct dirent *e;
+      while ((e = readdir(dp)) != NULL){
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+      }
+      closedir(dp);
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// One point of the sweep: every port runs mode with 2^k cells and T
+// windows, signals arrive at signal_rate per second.
+//----------------------------------------------------------------------
+typedef struct bench_result{
+  pq_mode_t mode;
+  uint32_t k, T, ports;
+  double signal_rate;
+  double wall_s;
+  pq_poller_t *p;
+  uint64_t queries_pending;
+} bench_result_t;
+
+static int run_point(pq_mode_t mode, uint32_t k_, uint32_t T_, uint32_t ports, double signal_rate, uint32_t run_s, bench_result_t *r){
+  struct timeval start, end;
+  k = k_;
+  T = T_;
+  cell_number = 1 << k;
+  second_highest_shift_bit = k;
+  highest_shift_bit = k + 1;
+  duration = duration_q = run_s;
+  for (uint16_t i = 0; i < ports; i++){
+    port_table[i].port = i;
+    port_table[i].isolation_id = i;
+    port_table[i].isolation_prefix = i << (mode == PQ_MODE_QM ? highest_shift_bit_q + 1 : highest_shift_bit + 1);
+    port_table[i].mode = mode;
+  }
+  port_entry_num = ports;
+  for (int i = 0; i < MAX_PORT_NUM; i++){
+    highest[i] = 0;
+    second_highest[i] = 0;
+    wrap[i] = false;
+  }
+  data_signal_head = data_signal_tail = 0;
+  signal_overflow_num = 0;
+  new_signal = false;
+  poll_ready = false;
+  finish_last = true;
+  pq_backend->reset_query_state();
+  pq_pollers_reset_stats();
+  if (pq_pollers_init() != 0){
+    return -1;
+  }
+  pq_stub_config.signal_rate = signal_rate;
+  loop_flag = true;
+  signal_flag = true;
+  running_flag = true;
+  if (pq_stub_start() != 0){
+    return -1;
+  }
+  gettimeofday(&start, NULL);
+  pq_poll_loop();
+  gettimeofday(&end, NULL);
+  pq_stub_stop();
+  clean_work_dir();
+
+  r->mode = mode;
+  r->k = k;
+  r->T = T;
+  r->ports = ports;
+  r->signal_rate = signal_rate;
+  r->wall_s = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  r->p = pq_pollers[mode];
+  r->queries_pending = (data_signal_tail + SIGNAL_QUEUE_SIZE - data_signal_head) % SIGNAL_QUEUE_SIZE;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Output: one CSV row or one JSON object per line for every point
+//----------------------------------------------------------------------
+#define BENCH_FIELDS(X) \
+  X("mode", "%s", r->p->name) \
+  X("k", "%u", r->k) \
+  X("T", "%u", r->T) \
+  X("ports", "%u", r->ports) \
+  X("signal_rate", "%g", r->signal_rate) \
+  X("wall_s", "%.3f", r->wall_s) \
+  X("period_us", "%u", r->p->period_us) \
+  X("entries", "%u", r->p->entry_num) \
+  X("registers", "%u", r->p->register_num) \
+  X("polls", "%lu", r->p->poll_num) \
+  X("read_entries_per_s", "%.0f", r->p->read_entries / r->wall_s) \
+  X("poll_avg_us", "%lu", r->p->poll_num ? r->p->poll_us_total / r->p->poll_num : 0) \
+  X("poll_p50_us", "%u", pq_latency_percentile(&r->p->poll_lat, 50)) \
+  X("poll_p99_us", "%u", pq_latency_percentile(&r->p->poll_lat, 99)) \
+  X("poll_max_us", "%u", r->p->poll_us_max) \
+  X("overruns", "%lu", r->p->overrun) \
+  X("deadline_misses", "%lu", r->p->deadline_miss) \
+  X("wakeup_max_us", "%u", r->p->wakeup_us_max) \
+  X("signals", "%lu", stub_signal_num) \
+  X("signals_suppressed", "%lu", stub_signal_suppressed) \
+  X("signal_overflows", "%lu", signal_overflow_num) \
+  X("queries", "%lu", r->p->query_lat.num) \
+  X("queries_pending", "%lu", r->queries_pending) \
+  X("query_p50_us", "%u", pq_latency_percentile(&r->p->query_lat, 50)) \
+  X("query_p99_us", "%u", pq_latency_percentile(&r->p->query_lat, 99)) \
+  X("query_max_us", "%u", r->p->query_lat.max)
+
+static void print_header(FILE *out){
+  const char *sep = "";
+#define X_NAME(name, fmt, val) fprintf(out, "%s%s", sep, name); sep = ",";
+  BENCH_FIELDS(X_NAME)
+#undef X_NAME
+  fprintf(out, "\n");
+}
+
+static void print_csv(FILE *out, const bench_result_t *r){
+  const char *sep = "";
+#define X_CSV(name, fmt, val) fprintf(out, "%s" fmt, sep, val); sep = ",";
+  BENCH_FIELDS(X_CSV)
+#undef X_CSV
+  fprintf(out, "\n");
+}
+
+static void print_json(FILE *out, const bench_result_t *r){
+  const char *sep = "{";
+  fprintf(out, "%s\"mode\": \"%s\"", sep, r->p->name);
+  sep = ", ";
+#define X_JSON(name, fmt, val) if (strcmp(name, "mode")) fprintf(out, "%s\"%s\": " fmt, sep, name, val);
+  BENCH_FIELDS(X_JSON)
+#undef X_JSON
+  fprintf(out, "}\n");
+}
+
+static void pq_bench_usage(void){
+  printf("Usage: PrintQueue_bench [OPTIONS]...\n");
+  printf("\n");
+  printf(" --k=list Cell number exponents of time windows (default 12)\n");
+  printf(" --T=list Numbers of time windows (default 4)\n");
+  printf(" --ports=list Numbers of ports (default 1)\n");
+  printf(" --signal-rate=list Data plane query signals per second (default 0)\n");
+  printf(" --pq-mode Data structure of the ports, tw (default) or qm\n");
+  printf(" --duration=s Seconds of every point (default 2)\n");
+  printf(" --read-entry-ns=ns Read latency of an entry of a register (default 20)\n");
+  printf(" --read-call-us=us Fixed latency of a range read (default 50)\n");
+  printf(" --reg-read-us=us Latency of a register read or a table modification (default 10)\n");
+  printf(" --format=csv|json Output format (default csv)\n");
+  printf(" --out=file Output file (default stdout)\n");
+  printf(" --work-dir=dir Directory of the snapshots (default /tmp/pq_bench)\n");
+  printf(" --verbose Keep the output of the control loop\n");
+  printf(" --rt-mode Run the poll thread with SCHED_FIFO and locked memory\n");
+  printf(" --pq-trace=file Binary event log of the whole sweep (default off)\n");
+  printf(" -h,--help Display this help message and exit\n");
+  printf("Lists are comma separated, every combination is run.\n");
+}
+
+int main(int argc, char *argv[]) {
+  bench_list_t k_list = {{12}, 1}, T_list = {{4}, 1}, port_list = {{1}, 1}, rate_list = {{0}, 1};
+  pq_mode_t mode = PQ_MODE_TW;
+  uint32_t run_s = 2;
+  bool json = false, verbose = false;
+  const char *out_path = NULL, *work_dir = "/tmp/pq_bench", *trace_path = NULL;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_K,
+    OPT_T,
+    OPT_PORTS,
+    OPT_SIGNAL_RATE,
+    OPT_PQ_MODE,
+    OPT_DURATION,
+    OPT_READ_ENTRY_NS,
+    OPT_READ_CALL_US,
+    OPT_REG_READ_US,
+    OPT_FORMAT,
+    OPT_OUT,
+    OPT_WORK_DIR,
+    OPT_VERBOSE,
+    OPT_RT_MODE,
+    OPT_PQ_TRACE,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"k", required_argument, 0, OPT_K},
+      {"T", required_argument, 0, OPT_T},
+      {"ports", required_argument, 0, OPT_PORTS},
+      {"signal-rate", required_argument, 0, OPT_SIGNAL_RATE},
+      {"pq-mode", required_argument, 0, OPT_PQ_MODE},
+      {"duration", required_argument, 0, OPT_DURATION},
+      {"read-entry-ns", required_argument, 0, OPT_READ_ENTRY_NS},
+      {"read-call-us", required_argument, 0, OPT_READ_CALL_US},
+      {"reg-read-us", required_argument, 0, OPT_REG_READ_US},
+      {"format", required_argument, 0, OPT_FORMAT},
+      {"out", required_argument, 0, OPT_OUT},
+      {"work-dir", required_argument, 0, OPT_WORK_DIR},
+      {"verbose", no_argument, 0, OPT_VERBOSE},
+      {"rt-mode", no_argument, 0, OPT_RT_MODE},
+      {"pq-trace", required_argument, 0, OPT_PQ_TRACE},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_K:
+        if (parse_list(optarg, &k_list) != 0) exit(1);
+        break;
+      case OPT_T:
+        if (parse_list(optarg, &T_list) != 0) exit(1);
+        break;
+      case OPT_PORTS:
+        if (parse_list(optarg, &port_list) != 0) exit(1);
+        break;
+      case OPT_SIGNAL_RATE:
+        if (parse_list(optarg, &rate_list) != 0) exit(1);
+        break;
+      case OPT_PQ_MODE:
+        mode = pq_parse_mode(optarg);
+        break;
+      case OPT_DURATION:
+        run_s = atoi(optarg);
+        break;
+      case OPT_READ_ENTRY_NS:
+        pq_stub_config.read_entry_ns = atoi(optarg);
+        break;
+      case OPT_READ_CALL_US:
+        pq_stub_config.read_call_us = atoi(optarg);
+        break;
+      case OPT_REG_READ_US:
+        pq_stub_config.reg_read_us = atoi(optarg);
+        break;
+      case OPT_FORMAT:
+        json = !strcmp(optarg, "json");
+        break;
+      case OPT_OUT:
+        out_path = optarg;
+        break;
+      case OPT_WORK_DIR:
+        work_dir = optarg;
+        break;
+      case OPT_VERBOSE:
+        verbose = true;
+        break;
+      case OPT_RT_MODE:
+        rt_mode = true;
+        break;
+      case OPT_PQ_TRACE:
+        trace_path = optarg;
+        break;
+      case 'h':
+      case '?':
+        pq_bench_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+
+  // results go to --out or to the original stdout; the printf lines of the control loop go to /dev/null
+  FILE *out = out_path ? fopen(out_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+  if (out == NULL){
+    fprintf(stderr, "Error opening %s!\n", out_path);
+    return 1;
+  }
+  // opened before the work directory is entered: a relative path is kept
+  if (trace_path != NULL && pq_trace_start(trace_path) != 0){
+    return 1;
+  }
+  if (prepare_work_dir(work_dir) != 0){
+    return 1;
+  }
+  if (!verbose && freopen("/dev/null", "w", stdout) == NULL){
+    fprintf(stderr, "Error redirecting stdout!\n");
+  }
+  if (rt_mode){
+    pq_rt_lock_memory();
+  }
+  pq_backend = &pq_backend_stub;
+  pq_oneshot = true;
+  if (!json){
+    print_header(out);
+  }
+  for (int ki = 0; ki < k_list.num; ki++)
+  for (int ti = 0; ti < T_list.num; ti++)
+  for (int pi = 0; pi < port_list.num; pi++)
+  for (int ri = 0; ri < rate_list.num; ri++){
+    bench_result_t r;
+    uint32_t ports = port_list.v[pi];
+    if (ports == 0 || ports > MAX_PORT_NUM){
+      fprintf(stderr, "Skip %u ports: 1 to %d ports are supported\n", ports, MAX_PORT_NUM);
+      continue;
+    }
+    fprintf(stderr, "Running %s k=%g T=%g ports=%u signal_rate=%g ...\n", pq_pollers[mode]->name, k_list.v[ki], T_list.v[ti], ports, rate_list.v[ri]);
+    if (run_point(mode, k_list.v[ki], T_list.v[ti], ports, rate_list.v[ri], run_s, &r) != 0){
+      fprintf(stderr, "Skip k=%g T=%g: invalid parameters (see --verbose)\n", k_list.v[ki], T_list.v[ti]);
+      continue;
+    }
+    if (json){
+      print_json(out, &r);
+    }else{
+      print_csv(out, &r);
+    }
+    fflush(out);
+  }
+  pq_pool_free();
+  pq_trace_stop();
+  fclose(out);
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*************************************************************************
+	> File Name: pq_model.c
+  > Description: PrintQueue control plane running on the software model of
+  >              the data plane (no Tofino, no SDE)
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "backend_model.h"
+
+static void pq_model_usage(void){
+  printf("Usage: PrintQueue_model [OPTIONS]...\n");
+  printf("\n");
+  printf(" --pcap=file Replay a pcap file instead of synthetic traffic\n");
+  printf(" --rate=Gbps Offered load of the synthetic traffic (default 12)\n");
+  printf(" --flows=N Number of synthetic flows (default 16)\n");
+  printf(" --pkt-size=bytes Size of synthetic packets (default 1500)\n");
+  printf(" --burst=on_us,off_us On/off bursts of the synthetic traffic (default constant)\n");
+  printf(" --line-rate=Gbps Drain rate of every egress port (default 10)\n");
+  printf(" --port=P Egress port of all packets (default: flows spread over port_isolation.csv)\n");
+  printf(" --duration=s Seconds of the run, 0 until USR1 / USR2 (default: duration / duration_q of control.c, 0 with --retain)\n");
+  printf(" --threshold-file=file Data plane query thresholds (default ./src/ctrl/qdepth_threshold.csv)\n");
+  printf(" --port-file=file Port isolation (default ./src/ctrl/port_isolation.csv)\n");
+  printf(" --cpu-if=ifname Interface the control plane listens on (default lo)\n");
+  printf(" --signal-if=ifname Interface the model sends signals on (default: --cpu-if)\n");
+  printf(" --pq-mode Data structure of the ports without a mode in port_isolation.csv\n");
+  printf(" tw:time windows (default), qm:queue monitor\n");
+  printf(" --rt-mode Run the poll and signal-receiving threads with SCHED_FIFO and locked memory\n");
+  printf(" --pq-trace=file Binary event log of the pollers (default ./pq_trace.bin, none: off)\n");
+  printf(" --pq-stats=name Shared memory page of the poll statistics (default /printqueue_stats, none: not shared)\n");
+  printf(" --pq-pool-buffers=n Snapshot buffers shared by the poller and the writer thread (default 8, at least 2)\n");
+  printf(" --tw-format=cells|raw Time windows snapshots: valid cells with 64-bit timestamps (default) or raw registers\n");
+  printf(" --recorder=pre_ms,post_ms Flight recorder: store only the snapshots around data plane queries and SIGHUP (default: store all)\n");
+  printf(" --retain=budget_mb[,segment_s,full_s,compact_s,summary_ms] Snapshots in segment files within budget_mb (default 1,60,600,1000)\n");
+  printf(" --checkpoint=file Save the control plane state to file and restart warm from it (default: cold start)\n");
+  printf(" --model-state=file Keep the tables and registers of the model in file across restarts (default: in memory)\n");
+  printf(" --threshold-reload=ms Check the threshold file every ms and reprogram the changes (default 1000, 0: off)\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *threshold_path = "./src/ctrl/qdepth_threshold.csv";
+  const char *port_path = "./src/ctrl/port_isolation.csv";
+  const char *signal_ifname = NULL;
+  pq_mode_t default_mode = PQ_MODE_TW;
+  bool duration_set = false;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_PCAP,
+    OPT_RATE,
+    OPT_FLOWS,
+    OPT_PKT_SIZE,
+    OPT_BURST,
+    OPT_LINE_RATE,
+    OPT_PORT,
+    OPT_DURATION,
+    OPT_THRESHOLD_FILE,
+    OPT_PORT_FILE,
+    OPT_CPU_IF,
+    OPT_SIGNAL_IF,
+    OPT_PQ_MODE,
+    OPT_TW_FORMAT,
+    OPT_RT_MODE,
+    OPT_PQ_TRACE,
+    OPT_PQ_STATS,
+    OPT_PQ_POOL_BUFFERS,
+    OPT_RECORDER,
+    OPT_RETAIN,
+    OPT_CHECKPOINT,
+    OPT_MODEL_STATE,
+    OPT_THRESHOLD_RELOAD,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"pcap", required_argument, 0, OPT_PCAP},
+      {"rate", required_argument, 0, OPT_RATE},
+      {"flows", required_argument, 0, OPT_FLOWS},
+      {"pkt-size", required_argument, 0, OPT_PKT_SIZE},
+      {"burst", required_argument, 0, OPT_BURST},
+      {"line-rate", required_argument, 0, OPT_LINE_RATE},
+      {"port", required_argument, 0, OPT_PORT},
+      {"duration", required_argument, 0, OPT_DURATION},
+      {"threshold-file", required_argument, 0, OPT_THRESHOLD_FILE},
+      {"port-file", required_argument, 0, OPT_PORT_FILE},
+      {"cpu-if", required_argument, 0, OPT_CPU_IF},
+      {"signal-if", required_argument, 0, OPT_SIGNAL_IF},
+      {"pq-mode", required_argument, 0, OPT_PQ_MODE},
+      {"tw-format", required_argument, 0, OPT_TW_FORMAT},
+      {"rt-mode", no_argument, 0, OPT_RT_MODE},
+      {"pq-trace", required_argument, 0, OPT_PQ_TRACE},
+      {"pq-stats", required_argument, 0, OPT_PQ_STATS},
+      {"pq-pool-buffers", required_argument, 0, OPT_PQ_POOL_BUFFERS},
+      {"recorder", required_argument, 0, OPT_RECORDER},
+      {"retain", required_argument, 0, OPT_RETAIN},
+      {"checkpoint", required_argument, 0, OPT_CHECKPOINT},
+      {"model-state", required_argument, 0, OPT_MODEL_STATE},
+      {"threshold-reload", required_argument, 0, OPT_THRESHOLD_RELOAD},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_PCAP:
+        pq_model_config.pcap_path = optarg;
+        break;
+      case OPT_RATE:
+        pq_model_config.rate_gbps = atof(optarg);
+        break;
+      case OPT_FLOWS:
+        pq_model_config.flows = atoi(optarg);
+        break;
+      case OPT_PKT_SIZE:
+        pq_model_config.pkt_size = atoi(optarg);
+        break;
+      case OPT_BURST:
+        if (sscanf(optarg, "%u,%u", &pq_model_config.burst_on_us, &pq_model_config.burst_off_us) != 2){
+          printf("--burst expects on_us,off_us\n");
+          exit(1);
+        }
+        break;
+      case OPT_LINE_RATE:
+        pq_model_config.line_rate_gbps = atof(optarg);
+        break;
+      case OPT_PORT:
+        pq_model_config.port = atoi(optarg);
+        break;
+      case OPT_DURATION:
+        duration = duration_q = atoi(optarg);
+        duration_set = true;
+        break;
+      case OPT_THRESHOLD_FILE:
+        threshold_path = optarg;
+        break;
+      case OPT_PORT_FILE:
+        port_path = optarg;
+        break;
+      case OPT_CPU_IF:
+        pq_backend_model.cpu_ifname = optarg;
+        break;
+      case OPT_SIGNAL_IF:
+        signal_ifname = optarg;
+        break;
+      case OPT_PQ_MODE:
+        default_mode = pq_parse_mode(optarg);
+        break;
+      case OPT_RT_MODE:
+        rt_mode = true;
+        break;
+      case OPT_PQ_TRACE:
+        pq_trace_path = strcmp(optarg, "none") ? optarg : NULL;
+        break;
+      case OPT_PQ_STATS:
+        pq_stats_name = strcmp(optarg, "none") ? optarg : NULL;
+        break;
+      case OPT_PQ_POOL_BUFFERS:
+        pq_pool_buffers = atoi(optarg);
+        break;
+      case OPT_TW_FORMAT:
+        tw_store_cells = strcmp(optarg, "raw") != 0;
+        break;
+      case OPT_RECORDER:
+        if (pq_recorder_parse(optarg) != 0){
+          exit(1);
+        }
+        break;
+      case OPT_RETAIN:
+        if (pq_retain_parse(optarg) != 0){
+          exit(1);
+        }
+        break;
+      case OPT_CHECKPOINT:
+        pq_checkpoint_path = optarg;
+        break;
+      case OPT_MODEL_STATE:
+        pq_model_config.state_path = optarg;
+        break;
+      case OPT_THRESHOLD_RELOAD:
+        pq_threshold_reload_ms = atoi(optarg);
+        break;
+      case 'h':
+      case '?':
+        pq_model_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+  pq_model_config.signal_ifname = signal_ifname ? signal_ifname : pq_backend_model.cpu_ifname;
+  if (pq_retain && !duration_set){
+    // continuous operation: run until USR1 / USR2
+    duration = duration_q = 0;
+  }
+
+  printf("-----------------------------------------------------\nPrintQueue Control Plane is Activating (software model)\n-----------------------------------------------------\n");
+  printf("Program ID: %d\n", getpid());
+  pq_register_signal_handlers();
+  if (rt_mode){
+    pq_rt_lock_memory();
+  }
+  pq_backend = &pq_backend_model;
+  if (pq_model_init() != 0){
+    return 1;
+  }
+  if (pq_checkpoint_load() != 0){
+    return 1;
+  }
+  if (pq_load_thresholds(threshold_path) != 0){
+    printf("No data plane query threshold is set, default %d cells\n", pq_model_config.default_threshold);
+  }
+  // a single run starting right away, USR1 / USR2 stop it early
+  pq_oneshot = true;
+  loop_flag = true;
+  signal_flag = true;
+  if (pq_model_start() != 0){
+    return 1;
+  }
+  int ret = pq_start(port_path, default_mode);
+  pq_model_stop();
+  pq_model_print_stats();
+  return ret == 0 ? 0 : 1;
+}
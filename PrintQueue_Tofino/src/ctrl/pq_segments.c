@@ -0,0 +1,321 @@
+/*************************************************************************
+	> File Name: pq_segments.c
+  > Description: Reader of the segment files of continuous operation
+  >              (segment.h): list them, extract their snapshots and
+  >              signals back to data files, print their flow summaries
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <dirent.h>
+
+#include "segment.h"
+
+static const char *level_name[PQ_SEG_LEVEL_NUM] = {"full", "compact", "summary"};
+
+static int64_t from_us = INT64_MIN, to_us = INT64_MAX;
+static uint32_t K = 10;
+
+static int cmp_name(const void *x, const void *y){
+  long long a, b;
+  unsigned int au, bu;
+  sscanf(*(char *const *)x, "%lld_%u", &a, &au);
+  sscanf(*(char *const *)y, "%lld_%u", &b, &bu);
+  return a != b ? (a < b ? -1 : 1) : (au < bu ? -1 : au > bu);
+}
+
+static int cmp_flow(const void *x, const void *y){
+  const pq_segment_flow_t *a = x, *b = y;
+  return a->count != b->count ? (a->count > b->count ? -1 : 1) : 0;
+}
+
+// next record and its payload, 0 at the end of the file, -1 on a truncated record
+static int read_record(FILE *f, pq_segment_record_t *r, uint8_t **buf, size_t *cap){
+  size_t n = fread(r, 1, sizeof(*r), f);
+  if (n == 0){
+    return 0;
+  }
+  if (n != sizeof(*r)){
+    return -1;
+  }
+  if (r->size > *cap){
+    uint8_t *b = realloc(*buf, r->size);
+    if (b == NULL){
+      return -1;
+    }
+    *buf = b;
+    *cap = r->size;
+  }
+  return fread(*buf, 1, r->size, f) == r->size ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// A snapshot record back to the file the writer stores without
+// retention, in <port folder>/<tw_data|qm_data>, a SIGNAL record in
+// <port folder>/signal_data. SPARSE records are expanded with 0 for the
+// entries left out.
+//----------------------------------------------------------------------
+static int extract(const char *dir, const pq_segment_header_t *h, const pq_segment_record_t *r, const uint8_t *p, uint8_t **raw, size_t *raw_cap){
+  char path[512];
+  long sec = r->ts_us / 1000000, usec = r->ts_us % 1000000;
+  const uint8_t *out = p;
+  size_t len = r->size;
+  if (r->kind == PQ_SEG_SIGNAL){
+    snprintf(path, sizeof(path), "%s/signal_data/%ld_%ld.bin", dir, sec, usec);
+  }else if (h->mode == 1){
+    snprintf(path, sizeof(path), "%s/qm_data/%ld_%ld_%d.bin", dir, sec, usec, (r->flags & PQ_SEG_WRAP) ? 1 : 0);
+  }else{
+    snprintf(path, sizeof(path), "%s/tw_data/%ld_%ld.%s", dir, sec, usec, r->kind == PQ_SEG_CELLS ? "cells" : "bin");
+  }
+  if (r->kind == PQ_SEG_SPARSE){
+    uint32_t R = r->registers, n = r->count, m = r->size / 4 / (R + 1);
+    const uint32_t *v = (const uint32_t *)p;
+    len = (size_t)n * R * 4;
+    if (len > *raw_cap){
+      uint8_t *b = realloc(*raw, len);
+      if (b == NULL){
+        printf("Error allocating %zu bytes!\n", len);
+        return -1;
+      }
+      *raw = b;
+      *raw_cap = len;
+    }
+    uint32_t *o = (uint32_t *)*raw;
+    memset(o, 0, len);
+    for (uint32_t s = 0; s < R; s++){
+      for (uint32_t j = 0; j < m; j++){
+        o[(size_t)s * n + v[j]] = v[m + s * m + j];
+      }
+    }
+    out = *raw;
+  }
+  FILE *f = fopen(path, "wb");
+  if (f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  fwrite(out, 1, len, f);
+  fclose(f);
+  return 0;
+}
+
+// a META record back to its line of <port folder>/qm_meta.csv
+static int extract_meta(const char *dir, FILE **meta, const pq_segment_record_t *r, const uint8_t *p){
+  char path[512];
+  uint32_t v[3];
+  if (r->size < sizeof(v)){
+    return 0;
+  }
+  if (*meta == NULL){
+    snprintf(path, sizeof(path), "%s/qm_meta.csv", dir);
+    *meta = fopen(path, "a");
+    if (*meta == NULL){
+      printf("Error opening %s!\n", path);
+      return -1;
+    }
+    if (ftell(*meta) == 0){
+      fprintf(*meta, "ts_sec ts_usec interval_us entries stack_top\n");
+    }
+  }
+  memcpy(v, p, sizeof(v));
+  fprintf(*meta, "%ld %ld %u %u %u\n", r->ts_us / 1000000, r->ts_us % 1000000, v[0], v[1], v[2]);
+  return 0;
+}
+
+static void print_summary(const pq_segment_record_t *r, uint8_t *p){
+  pq_segment_flow_t *f = (pq_segment_flow_t *)p;
+  qsort(f, r->count, sizeof(pq_segment_flow_t), cmp_flow);
+  printf("%ld_%ld +%u us: %u flows\n", r->ts_us / 1000000, r->ts_us % 1000000, r->span_us, r->count);
+  for (uint32_t i = 0; i < r->count && (K == 0 || i < K); i++){
+    printf("  %016lx %u\n", (uint64_t)f[i].src_ip << 32 | f[i].dst_ip, f[i].count);
+  }
+}
+
+//----------------------------------------------------------------------
+// Segments of a port folder (./tw_data/<idx>, ./qm_data/<idx>), oldest
+// first, overlapping [from_us, to_us]
+//----------------------------------------------------------------------
+static int pq_segments_dir(const char *dir, bool do_extract, bool do_summaries){
+  char seg_dir[512], path[1024];
+  char **names = NULL;
+  uint32_t num = 0, cap = 0;
+  uint8_t *buf = NULL, *raw = NULL;
+  size_t buf_cap = 0, raw_cap = 0;
+  uint64_t extracted = 0, signals = 0, intervals = 0;
+  FILE *meta = NULL;
+  snprintf(seg_dir, sizeof(seg_dir), "%s/segments", dir);
+  DIR *dp = opendir(seg_dir);
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", seg_dir);
+    return -1;
+  }
+  struct dirent *e;
+  while ((e = readdir(dp)) != NULL){
+    size_t len = strlen(e->d_name);
+    if (len <= 6 || strcmp(e->d_name + len - 6, ".pqseg")){
+      continue;
+    }
+    if (num == cap){
+      cap = cap ? cap * 2 : 256;
+      names = realloc(names, cap * sizeof(char *));
+    }
+    names[num++] = strdup(e->d_name);
+  }
+  closedir(dp);
+  qsort(names, num, sizeof(char *), cmp_name);
+
+  for (uint32_t i = 0; i < num; i++){
+    pq_segment_header_t h;
+    pq_segment_record_t r;
+    uint32_t kinds[PQ_SEG_KIND_NUM] = {0}, records = 0, queries = 0;
+    int64_t last = 0;
+    int ret;
+    snprintf(path, sizeof(path), "%s/%s", seg_dir, names[i]);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL || fread(&h, sizeof(h), 1, f) != 1 || h.magic != PQ_SEGMENT_MAGIC){
+      printf("%s: not a segment\n", path);
+      if (f != NULL){
+        fclose(f);
+      }
+      continue;
+    }
+    if ((h.last_us && h.last_us < from_us) || h.first_us > to_us){
+      fclose(f);
+      continue;
+    }
+    fseek(f, h.header_size, SEEK_SET);
+    while ((ret = read_record(f, &r, &buf, &buf_cap)) > 0){
+      records++;
+      kinds[r.kind < PQ_SEG_KIND_NUM ? r.kind : PQ_SEG_RAW]++;
+      queries += (r.flags & PQ_SEG_QUERY) != 0;
+      if (r.ts_us > last){
+        last = r.ts_us;
+      }
+      if (r.ts_us + r.span_us <= from_us || r.ts_us > to_us){
+        continue;
+      }
+      if (do_extract && r.kind == PQ_SEG_META){
+        if (extract_meta(dir, &meta, &r, buf) != 0){
+          fclose(f);
+          return -1;
+        }
+        intervals++;
+      }else if (do_extract && r.kind != PQ_SEG_SUMMARY){
+        if (extract(dir, &h, &r, buf, &raw, &raw_cap) != 0){
+          fclose(f);
+          if (meta != NULL){
+            fclose(meta);
+          }
+          return -1;
+        }
+        if (r.kind == PQ_SEG_SIGNAL){
+          signals++;
+        }else{
+          extracted++;
+        }
+      }
+      if (do_summaries && r.kind == PQ_SEG_SUMMARY){
+        print_summary(&r, buf);
+      }
+    }
+    long size = ftell(f);
+    fclose(f);
+    if (!do_extract && !do_summaries){
+      printf("%s: %s, %s, %u records (raw %u, cells %u, sparse %u, summaries %u, signals %u, intervals %u; %u data plane queries), %ld KB, %ld to %ld%s\n",
+             path, h.mode == 1 ? "qm" : "tw", h.level < PQ_SEG_LEVEL_NUM ? level_name[h.level] : "?", records,
+             kinds[PQ_SEG_RAW], kinds[PQ_SEG_CELLS], kinds[PQ_SEG_SPARSE], kinds[PQ_SEG_SUMMARY], kinds[PQ_SEG_SIGNAL], kinds[PQ_SEG_META], queries - kinds[PQ_SEG_SIGNAL],
+             size >> 10, h.first_us, last, h.last_us ? "" : " (open)");
+    }
+    if (ret < 0){
+      printf("%s: truncated record\n", path);
+    }
+  }
+  if (meta != NULL){
+    fclose(meta);
+  }
+  if (do_extract){
+    printf("%s: %lu snapshots, %lu signals, %lu intervals extracted\n", dir, extracted, signals, intervals);
+  }
+  for (uint32_t i = 0; i < num; i++){
+    free(names[i]);
+  }
+  free(names);
+  free(buf);
+  free(raw);
+  return 0;
+}
+
+static void pq_segments_usage(void){
+  printf("Usage: pq_segments [OPTIONS] <port folder>...\n");
+  printf("\n");
+  printf(" --from=us Only the snapshots named from this wall clock time (sec * 1000000 + usec)\n");
+  printf(" --to=us Only the snapshots named until this wall clock time\n");
+  printf(" --extract Write the snapshots, signals and intervals back to the files of the port folder, for the analysis programs\n");
+  printf(" --summaries Print the flow summaries of the summarized segments\n");
+  printf(" --top=K Flows printed per summary, 0 for all (default 10)\n");
+  printf(" -h,--help Display this help message and exit\n");
+  printf("Port folders are the data folders of the ports, e.g. ./tw_data/0. Without --extract or --summaries, the segments are listed.\n");
+}
+
+int main(int argc, char *argv[]) {
+  bool do_extract = false, do_summaries = false;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_FROM,
+    OPT_TO,
+    OPT_EXTRACT,
+    OPT_SUMMARIES,
+    OPT_TOP,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"from", required_argument, 0, OPT_FROM},
+      {"to", required_argument, 0, OPT_TO},
+      {"extract", no_argument, 0, OPT_EXTRACT},
+      {"summaries", no_argument, 0, OPT_SUMMARIES},
+      {"top", required_argument, 0, OPT_TOP},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_FROM:
+        from_us = atoll(optarg);
+        break;
+      case OPT_TO:
+        to_us = atoll(optarg);
+        break;
+      case OPT_EXTRACT:
+        do_extract = true;
+        break;
+      case OPT_SUMMARIES:
+        do_summaries = true;
+        break;
+      case OPT_TOP:
+        K = atoi(optarg);
+        break;
+      case 'h':
+      case '?':
+        pq_segments_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+  if (optind >= argc){
+    pq_segments_usage();
+    return 1;
+  }
+  for (int i = optind; i < argc; i++){
+    if (pq_segments_dir(argv[i], do_extract, do_summaries) != 0){
+      return 1;
+    }
+  }
+  return 0;
+}
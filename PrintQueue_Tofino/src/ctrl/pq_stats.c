@@ -0,0 +1,226 @@
+/*************************************************************************
+	> File Name: pq_stats.c
+  > Description: Scraper of the shared statistics page of a running control
+  >              plane (stats.h): text table or Prometheus exposition
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+#include "stats.h"
+
+#define PQ_STATS_PHASE_NAME(ph, name, desc) name,
+static const char *phase_name[PQ_PHASE_NUM] = {
+  PQ_STATS_PHASES(PQ_STATS_PHASE_NAME)
+};
+#undef PQ_STATS_PHASE_NAME
+
+#define PQ_STATS_PHASE_DESC(ph, name, desc) desc,
+static const char *phase_desc[PQ_PHASE_NUM] = {
+  PQ_STATS_PHASES(PQ_STATS_PHASE_DESC)
+};
+#undef PQ_STATS_PHASE_DESC
+
+#define PQ_STATS_COUNTER_NAME(c, name) name,
+static const char *counter_name[PQ_CNT_NUM] = {
+  PQ_STATS_COUNTERS(PQ_STATS_COUNTER_NAME)
+};
+#undef PQ_STATS_COUNTER_NAME
+
+static const char *kind_name[PQ_KIND_NUM] = {"poll", "query"};
+
+static const char *mode_name(uint32_t mode){
+  return mode == 0 ? "tw" : mode == 1 ? "qm" : "?";
+}
+
+//----------------------------------------------------------------------
+// Copy of a port block under its seqlock: retried while the poll thread
+// updates the block. Only the reader spins, the poll thread never waits.
+//----------------------------------------------------------------------
+static void read_block(const pq_port_stats_t *b, pq_port_stats_t *copy){
+  uint32_t s1, s2;
+  do {
+    s1 = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+    if (s1 & 1){
+      continue;
+    }
+    memcpy(copy, (const void *)b, sizeof(pq_port_stats_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    s2 = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+    if (s1 == s2){
+      return;
+    }
+  } while (1);
+}
+
+// upper bound of the bucket holding the p-th percentile, capped by the max
+static uint64_t hist_percentile(const pq_phase_stats_t *ps, double p){
+  uint64_t rank = ps->count * p / 100, cum = 0;
+  for (int b = 0; b < PQ_HIST_BUCKETS; b++){
+    cum += ps->hist[b];
+    if (cum > rank){
+      uint64_t ub = b == PQ_HIST_BUCKETS - 1 ? ps->max_ns : (2ULL << b) - 1;
+      return ub < ps->max_ns ? ub : ps->max_ns;
+    }
+  }
+  return ps->max_ns;
+}
+
+static void print_text(FILE *out, const pq_stats_page_t *s){
+  fprintf(out, "pid %u, signals %lu, signal queue overflows %lu\n", s->pid, __atomic_load_n(&s->signals, __ATOMIC_RELAXED), __atomic_load_n(&s->signal_overflows, __ATOMIC_RELAXED));
+  for (uint32_t i = 0; i < s->port_num; i++){
+    pq_port_stats_t b;
+    read_block(&s->port[i], &b);
+    fprintf(out, "port %u (%s, iso %u):", b.port, mode_name(b.mode), b.iso_id);
+    for (int c = 0; c < PQ_CNT_NUM; c++){
+      fprintf(out, " %s %lu", counter_name[c], b.counter[c]);
+    }
+    fprintf(out, "\n  %-6s %-9s %10s %10s %10s %10s %10s\n", "kind", "phase", "count", "avg_us", "p50_us", "p99_us", "max_us");
+    for (int k = 0; k < PQ_KIND_NUM; k++){
+      for (int ph = 0; ph < PQ_PHASE_NUM; ph++){
+        const pq_phase_stats_t *ps = &b.phase[k][ph];
+        if (ps->count == 0){
+          continue;
+        }
+        fprintf(out, "  %-6s %-9s %10lu %10.1f %10.1f %10.1f %10.1f\n", kind_name[k], phase_name[ph], ps->count,
+                ps->total_ns / 1e3 / ps->count, hist_percentile(ps, 50) / 1e3, hist_percentile(ps, 99) / 1e3, ps->max_ns / 1e3);
+      }
+    }
+  }
+}
+
+static void print_prometheus(FILE *out, const pq_stats_page_t *s){
+  fprintf(out, "# TYPE printqueue_signals_total counter\nprintqueue_signals_total %lu\n", __atomic_load_n(&s->signals, __ATOMIC_RELAXED));
+  fprintf(out, "# TYPE printqueue_signal_overflows_total counter\nprintqueue_signal_overflows_total %lu\n", __atomic_load_n(&s->signal_overflows, __ATOMIC_RELAXED));
+  pq_port_stats_t *blocks = malloc(s->port_num * sizeof(pq_port_stats_t));
+  if (blocks == NULL){
+    return;
+  }
+  for (uint32_t i = 0; i < s->port_num; i++){
+    read_block(&s->port[i], &blocks[i]);
+  }
+  for (int c = 0; c < PQ_CNT_NUM; c++){
+    fprintf(out, "# TYPE printqueue_%s_total counter\n", counter_name[c]);
+    for (uint32_t i = 0; i < s->port_num; i++){
+      fprintf(out, "printqueue_%s_total{port=\"%u\",mode=\"%s\"} %lu\n", counter_name[c], blocks[i].port, mode_name(blocks[i].mode), blocks[i].counter[c]);
+    }
+  }
+  fprintf(out, "# TYPE printqueue_phase_seconds histogram\n");
+  for (uint32_t i = 0; i < s->port_num; i++){
+    for (int k = 0; k < PQ_KIND_NUM; k++){
+      for (int ph = 0; ph < PQ_PHASE_NUM; ph++){
+        const pq_phase_stats_t *ps = &blocks[i].phase[k][ph];
+        uint64_t cum = 0;
+        if (ps->count == 0){
+          continue;
+        }
+        char labels[128];
+        snprintf(labels, sizeof(labels), "port=\"%u\",mode=\"%s\",kind=\"%s\",phase=\"%s\"", blocks[i].port, mode_name(blocks[i].mode), kind_name[k], phase_name[ph]);
+        for (int b = 0; b < PQ_HIST_BUCKETS - 1; b++){
+          cum += ps->hist[b];
+          if (ps->hist[b] == 0 && cum != ps->count){
+            continue;
+          }
+          fprintf(out, "printqueue_phase_seconds_bucket{%s,le=\"%g\"} %lu\n", labels, (double)(2ULL << b) / 1e9, cum);
+        }
+        fprintf(out, "printqueue_phase_seconds_bucket{%s,le=\"+Inf\"} %lu\n", labels, ps->count);
+        fprintf(out, "printqueue_phase_seconds_sum{%s} %g\n", labels, ps->total_ns / 1e9);
+        fprintf(out, "printqueue_phase_seconds_count{%s} %lu\n", labels, ps->count);
+      }
+    }
+  }
+  free(blocks);
+}
+
+static void pq_stats_usage(void){
+  printf("Usage: pq_stats [OPTIONS]\n");
+  printf("\n");
+  printf(" --name=name Shared memory page of the control plane (default /printqueue_stats)\n");
+  printf(" --format=text|prom Text table (default) or Prometheus exposition format\n");
+  printf(" --interval=ms Print every ms milliseconds (default: once)\n");
+  printf(" --phases List the phases and exit\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = "/printqueue_stats";
+  bool prom = false;
+  uint32_t interval_ms = 0;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_NAME,
+    OPT_FORMAT,
+    OPT_INTERVAL,
+    OPT_PHASES,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"name", required_argument, 0, OPT_NAME},
+      {"format", required_argument, 0, OPT_FORMAT},
+      {"interval", required_argument, 0, OPT_INTERVAL},
+      {"phases", no_argument, 0, OPT_PHASES},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_NAME:
+        name = optarg;
+        break;
+      case OPT_FORMAT:
+        prom = strcmp(optarg, "prom") == 0;
+        break;
+      case OPT_INTERVAL:
+        interval_ms = atoi(optarg);
+        break;
+      case OPT_PHASES:
+        for (int ph = 0; ph < PQ_PHASE_NUM; ph++){
+          printf("%-9s %s\n", phase_name[ph], phase_desc[ph]);
+        }
+        exit(0);
+        break;
+      case 'h':
+      case '?':
+        pq_stats_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0){
+    fprintf(stderr, "Error opening /dev/shm%s, is the control plane running?\n", name);
+    return 1;
+  }
+  const pq_stats_page_t *s = mmap(NULL, sizeof(pq_stats_page_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (s == MAP_FAILED){
+    fprintf(stderr, "Error mapping /dev/shm%s!\n", name);
+    return 1;
+  }
+  if (s->magic != PQ_STATS_MAGIC || s->version != PQ_STATS_VERSION || s->size != sizeof(pq_stats_page_t)){
+    fprintf(stderr, "/dev/shm%s is not a statistics page of this version!\n", name);
+    return 1;
+  }
+  while (1){
+    if (prom){
+      print_prometheus(stdout, s);
+    }else{
+      print_text(stdout, s);
+    }
+    fflush(stdout);
+    if (interval_ms == 0){
+      break;
+    }
+    usleep(interval_ms * 1000);
+  }
+  return 0;
+}
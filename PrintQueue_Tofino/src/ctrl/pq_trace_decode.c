@@ -0,0 +1,228 @@
+/*************************************************************************
+	> File Name: pq_trace_decode.c
+  > Description: Decoder of the binary event log (trace.h): text lines or
+  >              Chrome trace JSON (chrome://tracing, Perfetto)
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "trace.h"
+
+typedef struct pq_trace_event_info {
+  const char *ev;
+  char phase;
+  const char *name;
+  const char *args;
+  const char *fmt;
+} pq_trace_event_info_t;
+
+#define PQ_TRACE_INFO(ev, level, phase, name, args, fmt) {#ev, phase, name, args, fmt},
+static const pq_trace_event_info_t event_info[PQ_EV_NUM] = {
+  PQ_TRACE_EVENTS(PQ_TRACE_INFO)
+};
+#undef PQ_TRACE_INFO
+
+static const char *mode_name(uint32_t mode){
+  return mode == 0 ? "tw" : mode == 1 ? "qm" : "?";
+}
+
+// render one argument of a %-conversion of the event formats
+static void print_arg(FILE *out, char conv, const pq_trace_rec_t *rec, int a){
+  uint32_t v = rec->arg[a];
+  switch (conv){
+    case 'u':
+      fprintf(out, "%u", v);
+      break;
+    case 'd':
+      fprintf(out, "%d", (int32_t)v);
+      break;
+    case 'I':
+      fprintf(out, "%u.%u.%u.%u", v >> 24, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff);
+      break;
+    case 'M':
+      fprintf(out, "%s", mode_name(v));
+      break;
+    case 's':
+      fprintf(out, "%.*s", (int)sizeof(rec->arg), (const char *)rec->arg);
+      break;
+    default:
+      fprintf(out, "%%%c", conv);
+  }
+}
+
+static void print_text(FILE *out, const pq_trace_rec_t *rec){
+  const char *f = event_info[rec->id].fmt;
+  int a = 0;
+  for (; *f; f++){
+    if (*f == '%' && f[1] && a < PQ_TRACE_ARG_NUM){
+      f++;
+      print_arg(out, *f, rec, a++);
+    }else{
+      fputc(*f, out);
+    }
+  }
+}
+
+// "args" of a Chrome trace event, named after the event table
+static void print_json_args(FILE *out, const pq_trace_rec_t *rec){
+  const char *names = event_info[rec->id].args, *f = event_info[rec->id].fmt;
+  int a = 0;
+  fprintf(out, "\"args\":{");
+  while (*names && a < PQ_TRACE_ARG_NUM){
+    int len = strcspn(names, " ");
+    f = strchr(f, '%');
+    char conv = f ? f[1] : 'u';
+    fprintf(out, "%s\"%.*s\":", a ? "," : "", len, names);
+    if (conv == 'u' || conv == 'd'){
+      print_arg(out, conv, rec, a);
+    }else{
+      fputc('"', out);
+      print_arg(out, conv, rec, a);
+      fputc('"', out);
+    }
+    names += len;
+    names += strspn(names, " ");
+    f = f ? f + 2 : NULL;
+    a++;
+  }
+  fprintf(out, "}");
+}
+
+// records of a thread are in order, threads are interleaved by drained chunks
+static int cmp_rec(const void *x, const void *y){
+  const pq_trace_rec_t *a = x, *b = y;
+  if (a->tsc != b->tsc){
+    return a->tsc < b->tsc ? -1 : 1;
+  }
+  return a->tid < b->tid ? -1 : a->tid > b->tid;
+}
+
+static void pq_trace_decode_usage(void){
+  printf("Usage: pq_trace_decode [OPTIONS] trace_file\n");
+  printf("\n");
+  printf(" --format=text|chrome Text lines (default) or Chrome trace JSON\n");
+  printf(" --out=file Output file (default stdout)\n");
+  printf(" -h,--help Display this help message and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+  bool chrome = false;
+  const char *out_path = NULL;
+  enum long_opts {
+    OPT_START = 256,
+    OPT_FORMAT,
+    OPT_OUT,
+  };
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"format", required_argument, 0, OPT_FORMAT},
+      {"out", required_argument, 0, OPT_OUT},
+      {0, 0, 0, 0}};
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "h", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_FORMAT:
+        chrome = strcmp(optarg, "chrome") == 0;
+        break;
+      case OPT_OUT:
+        out_path = optarg;
+        break;
+      case 'h':
+      case '?':
+        pq_trace_decode_usage();
+        exit(c == 'h' ? 0 : 1);
+        break;
+    }
+  }
+  if (optind != argc - 1){
+    pq_trace_decode_usage();
+    return 1;
+  }
+
+  FILE *f = fopen(argv[optind], "rb");
+  if (f == NULL){
+    fprintf(stderr, "Error opening %s!\n", argv[optind]);
+    return 1;
+  }
+  pq_trace_file_header_t hdr;
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, PQ_TRACE_MAGIC, 8) != 0 || hdr.rec_size != sizeof(pq_trace_rec_t)){
+    fprintf(stderr, "%s is not a PrintQueue trace!\n", argv[optind]);
+    fclose(f);
+    return 1;
+  }
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (out == NULL){
+    fprintf(stderr, "Error opening %s!\n", out_path);
+    fclose(f);
+    return 1;
+  }
+
+  pq_trace_rec_t *recs = NULL;
+  size_t rec_num = 0, rec_cap = 0;
+  while (1){
+    if (rec_num == rec_cap){
+      rec_cap = rec_cap ? rec_cap * 2 : 65536;
+      recs = realloc(recs, rec_cap * sizeof(pq_trace_rec_t));
+      if (recs == NULL){
+        fprintf(stderr, "Error: out of memory!\n");
+        return 1;
+      }
+    }
+    if (fread(&recs[rec_num], sizeof(pq_trace_rec_t), 1, f) != 1){
+      break;
+    }
+    rec_num++;
+  }
+  fclose(f);
+  qsort(recs, rec_num, sizeof(pq_trace_rec_t), cmp_rec);
+
+  uint64_t num = 0, unknown = 0;
+  if (chrome){
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  }else{
+    fprintf(out, "# start %lu.%09lu, %.3f MHz clock, events up to level %u\n", hdr.realtime_ns0 / 1000000000, hdr.realtime_ns0 % 1000000000, hdr.tsc_hz / 1e6, hdr.level);
+  }
+  for (size_t i = 0; i < rec_num; i++){
+    const pq_trace_rec_t rec = recs[i];
+    if (rec.id >= PQ_EV_NUM){
+      unknown++;
+      continue;
+    }
+    const pq_trace_event_info_t *info = &event_info[rec.id];
+    // ticks before tsc0 only come from a clock going backwards between cores
+    double us = rec.tsc >= hdr.tsc0 ? (double)(rec.tsc - hdr.tsc0) * 1e6 / hdr.tsc_hz : 0;
+    if (chrome){
+      fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,", num ? ",\n" : "", info->name, info->phase, us, rec.tid);
+      if (info->phase == 'b' || info->phase == 'e'){
+        fprintf(out, "\"cat\":\"%s\",\"id\":%u,", info->name, rec.arg[0]);
+      }else if (info->phase == 'i'){
+        fprintf(out, "\"s\":\"t\",");
+      }
+      print_json_args(out, &rec);
+      fprintf(out, "}");
+    }else{
+      fprintf(out, "%14.3f us [%2u] %-18s ", us, rec.tid, info->ev);
+      print_text(out, &rec);
+      fputc('\n', out);
+    }
+    num++;
+  }
+  if (chrome){
+    fprintf(out, "\n]}\n");
+  }
+  if (unknown){
+    fprintf(stderr, "Warning: %lu records of unknown events skipped\n", unknown);
+  }
+  free(recs);
+  if (out != stdout){
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,431 @@
+/*************************************************************************
+	> File Name: printqueue.h
+  > Description: Shared state of the PrintQueue control plane and the
+  >              common interface of the time windows / queue monitor pollers
+*************************************************************************/
+
+#ifndef _PRINTQUEUE_H_
+#define _PRINTQUEUE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "trace.h"
+#include "stats.h"
+#include "tw_cells.h"
+#include "clock.h"
+#include "segment.h"
+
+#define MAX_PORT_NUM 16
+#ifndef THRESHOLD_FLOW_NUMBER
+#define THRESHOLD_FLOW_NUMBER 1024      // entries of the qdepth_threshold table (includes.p4); PQ_THRESHOLD_FLOWS of the Makefile
+#endif
+#define SIGNAL_QUEUE_SIZE (MAX_PORT_NUM + 2)
+
+//----------------------------------------------------------------------
+// Data structure running on a port.
+// The mode of every port is given by the third column of
+// port_isolation.csv, or by --pq-mode when the column is absent.
+//----------------------------------------------------------------------
+typedef enum pq_mode {
+  PQ_MODE_TW = 0,   // time windows
+  PQ_MODE_QM = 1,   // queue monitor
+  PQ_MODE_NUM
+} pq_mode_t;
+
+//------------------------------------------------------//
+//                  Port Isolation                      //
+//------------------------------------------------------//
+typedef struct port_entry{
+  uint16_t port;
+  uint16_t isolation_id;
+  uint32_t isolation_prefix;
+  pq_mode_t mode;
+} port_entry_t;
+
+typedef struct data_signal{
+  struct timeval ts;
+  uint32_t type;  // Bitmap: bit 0 = QM data plane query; bit 1 = QM seq overflow; bit 2 = TW data plane query
+  uint16_t table_idx;
+  uint16_t iso_id;
+  uint16_t data_port;
+  struct in_addr src_ip;
+  struct in_addr dst_ip;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t enqueue_ts;
+  uint32_t dequeue_ts;
+  uint32_t isolation_prefix;
+  uint32_t previous_highest;
+  uint32_t previous_second_highest;
+  uint32_t seq_floor;       // QM: seq number before the frozen half was written
+  pq_clock_signal_t clock;  // timestamps unwrapped at the reception (clock.h)
+} data_signal_t;
+
+//----------------------------------------------------------------------
+// Parameters of time windows and queue monitor (see control.c)
+//----------------------------------------------------------------------
+extern uint32_t k, T, a, duration, TB0;
+extern uint32_t highest_shift_bit, second_highest_shift_bit;
+extern uint32_t kq, max_qdepth, read_interval, duration_q;
+extern uint32_t highest_shift_bit_q, second_highest_shift_bit_q;
+extern uint32_t qm_read_margin;
+extern bool qm_adaptive;
+extern uint32_t qm_interval_min, qm_interval_max, qm_busy_depth, qm_read_budget;
+extern bool tw_store_cells;
+extern uint32_t highest[MAX_PORT_NUM], second_highest[MAX_PORT_NUM], cell_number;
+extern bool wrap[MAX_PORT_NUM];
+extern uint32_t qm_seq_mark[MAX_PORT_NUM], qm_seq_floor[MAX_PORT_NUM];
+
+extern port_entry_t port_table[MAX_PORT_NUM];
+extern uint16_t port_entry_num;
+
+extern data_signal_t data_signal[SIGNAL_QUEUE_SIZE];
+extern uint16_t data_signal_head, data_signal_tail;
+extern bool new_signal;
+extern bool poll_ready;
+extern bool finish_last;
+
+extern bool loop_flag;
+extern bool signal_flag;
+extern bool running_flag;
+
+//----------------------------------------------------------------------
+// Real-time mode (rt.c), enabled by --rt-mode
+//----------------------------------------------------------------------
+extern bool rt_mode;
+extern int rt_poll_core, rt_signal_core, rt_priority;
+extern uint32_t rt_spin_us, rt_deadline_slack_us;
+
+int pq_rt_lock_memory(void);
+int pq_rt_setup_thread(const char *name, int core, int priority);
+void pq_rt_sleep_us(uint32_t us);
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                    Register and table backend                            //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Every access of the control plane to the data plane goes through the
+// backend, so that the control plane runs on the Tofino (backend_tofino.c)
+// or on the software model of the data plane (backend_model.c).
+//   threshold_add / _modify / _delete: entry of the qdepth alerting
+//                   threshold table (IPs in network byte order, as ipv4_address_t)
+//   batch_begin / batch_end: the threshold operations in between are sent
+//                   to the data plane at once, batch_end returns when they
+//                   are applied (NULL: every operation is sent by itself)
+//   isolation_add / _modify / _delete: entry of the port isolation table
+//   isolation_get:  the entry of a port installed in the data plane
+//   prepare_add / prepare_modify / prepare_delete: entry of
+//                   prepare_TW0_tb / prepare_qm_tb
+//   prepare_get:    the second highest bit installed for an isolation id
+//   clear_tables:   delete every entry of the tables above
+//   tw_range_read / qm_range_read: [start, start + count) of every register,
+//                   register r stored at buf + r * stride * 4, so that a
+//                   chunk lands in its column of a larger snapshot:
+//                   [count values of register 0]...[count values of register 1]...
+//   qm_range_reset: clear [start, start + count) of the queue monitor registers
+//   iso_reg_read:   read the entry of a per-port register
+//   data_query_unlock: reset data_query_lock_r of a port
+//   reset_query_state: reset highest_bit_r and data_query_lock_r of all ports
+// The range reads and the registers of a data structure the data plane
+// does not run (modes) are NULL or fail.
+// Functions return 0 on success. The get, modify, delete and clear
+// functions are only needed by a warm restart (checkpoint.c) and a reload
+// of the thresholds, NULL if the backend has none.
+//--------------------------------------------------------------------------
+typedef enum pq_reg {
+  PQ_REG_STACK_TOP = 0,     // stack_top_r
+  PQ_REG_SEQ_NUM,           // seq_num_r
+  PQ_REG_PORT_PKT_CNT,      // port_pkt_cnt_r
+  PQ_REG_HIGHEST_BIT,       // highest_bit_r
+  PQ_REG_DATA_QUERY_LOCK,   // data_query_lock_r
+} pq_reg_t;
+
+typedef struct pq_backend {
+  const char *name;
+  const char *cpu_ifname;   // interface on which the signals of the data plane arrive
+  uint32_t modes;           // data structures the data plane runs, bits 1 << pq_mode_t
+  int (*threshold_add)(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold);
+  int (*threshold_modify)(uint32_t src_ip, uint32_t dst_ip, uint32_t threshold);
+  int (*threshold_delete)(uint32_t src_ip, uint32_t dst_ip);
+  void (*batch_begin)(void);
+  int (*batch_end)(void);
+  int (*isolation_add)(uint16_t port, uint16_t iso_id, uint32_t iso_prefix);
+  int (*isolation_get)(uint16_t port, uint16_t *iso_id, uint32_t *iso_prefix);
+  int (*isolation_modify)(uint16_t port, uint16_t iso_id, uint32_t iso_prefix);
+  int (*isolation_delete)(uint16_t port);
+  int (*prepare_add)(pq_mode_t mode, uint16_t iso_id, uint32_t second_highest);
+  int (*prepare_modify)(pq_mode_t mode, uint16_t iso_id, uint32_t second_highest);
+  int (*prepare_get)(pq_mode_t mode, uint16_t iso_id, uint32_t *second_highest);
+  int (*prepare_delete)(pq_mode_t mode, uint16_t iso_id);
+  void (*clear_tables)(void);
+  int (*tw_range_read)(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf);
+  int (*qm_range_read)(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf);
+  void (*qm_range_reset)(uint32_t start, uint32_t count);
+  int (*iso_reg_read)(pq_reg_t reg, uint16_t iso_id, uint32_t *value);
+  void (*data_query_unlock)(uint16_t iso_id);
+  void (*reset_query_state)(void);
+} pq_backend_t;
+
+extern pq_backend_t *pq_backend;
+
+//----------------------------------------------------------------------
+// Control plane shared by both backends (control.c)
+//----------------------------------------------------------------------
+extern bool pq_oneshot;   // stop after one periodical run instead of waiting for USR1 / USR2
+extern const char *pq_trace_path;   // binary event log of pq_start (trace.h), NULL: off
+
+void pq_register_signal_handlers(void);
+int pq_load_thresholds(const char *path);
+// period of the check of the threshold file for a hot reload, 0: off
+extern uint32_t pq_threshold_reload_ms;
+// qdepth_threshold entries installed in the data plane, sorted by flow
+typedef struct pq_threshold {
+  uint32_t src_ip;
+  uint32_t dst_ip;
+  uint32_t threshold;
+} pq_threshold_t;
+extern pq_threshold_t *pq_thresholds;
+extern uint32_t pq_threshold_num;
+int pq_load_port_isolation(const char *path, pq_mode_t default_mode);
+int pq_start(const char *port_isolation_path, pq_mode_t default_mode);
+int pq_signal_enqueue(uint16_t type, uint16_t iso_id, struct in_addr src_ip, struct in_addr dst_ip, uint16_t src_port, uint16_t dst_port, uint32_t enqueue_ts, uint32_t dequeue_ts);
+extern uint64_t signal_overflow_num;   // signals dropped on a full signal queue
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                    Poller of a data structure                            //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Time windows and queue monitor are polled through the same steps:
+//   prepare:    install the prepare table entry of a port
+//   active:     cheap probe before the flip; an idle port is not flipped nor
+//               read, and an empty snapshot marks the period (NULL: always read)
+//   flip:       flip the second highest bit so that the data plane writes
+//               the other half of the registers
+//   live_entries: entries worth reading in a periodical poll, read right
+//               after the flip (NULL: all entry_num entries)
+//   range_read: read [start, start + count) of every register of the module,
+//               register r at buf + r * stride * 4 (stride = count: packed)
+//   filter:     drop stale entries of a snapshot; sig: the data plane query
+//               of the snapshot, NULL for a periodical poll (NULL if not needed)
+//   reset:      clear registers after reading (NULL if not needed)
+//   persist:    store count entries of a snapshot, or a signal, to the data folder
+//               (snapshots and signals are persisted by the writer thread, see pool.c);
+//               host_ns: host monotonic time of the reading (clock.h)
+//   discard:    a periodical snapshot dropped by the flight recorder, so that
+//               state carried from snapshot to snapshot moves on (NULL if none)
+//   next_period: period of the next periodical poll of a port, given the
+//               entries just read (NULL: period_us for every poll)
+//   persist_meta: store PQ_META_WORDS words of metadata of a poll, handed
+//               over to the writer thread with pq_writer_meta (NULL if none)
+// The scheduler (poller.c) runs the module of every port in its own
+// period and fills the rest of the read budget with data plane queries.
+//--------------------------------------------------------------------------
+//----------------------------------------------------------------------
+// Latency samples of a poller: the latest PQ_LATENCY_SAMPLES samples are
+// kept for percentiles, the total and the maximum cover all of them.
+//----------------------------------------------------------------------
+#define PQ_LATENCY_SAMPLES 8192
+typedef struct pq_latency {
+  uint32_t us[PQ_LATENCY_SAMPLES];
+  uint64_t num;
+  uint64_t total;
+  uint32_t max;
+} pq_latency_t;
+
+void pq_latency_add(pq_latency_t *l, uint32_t us);
+uint32_t pq_latency_percentile(const pq_latency_t *l, double p);
+
+typedef struct pq_poller pq_poller_t;
+struct pq_poller {
+  const char *name;
+  pq_mode_t mode;
+  uint32_t period_us;          // retrieve_interval (TW) or read_interval (QM)
+  uint32_t duration;           // seconds the periodical reading lasts
+  uint32_t entry_num;          // entries of a snapshot in every register
+  uint32_t register_num;       // registers read per entry
+  uint32_t query_guard_us;     // least slack to read a chunk of a data plane query
+  uint32_t highest_shift;
+  uint32_t second_highest_shift;
+
+  int (*prepare)(uint16_t idx);
+  bool (*active)(uint16_t idx);
+  int (*flip)(uint16_t idx);
+  uint32_t (*live_entries)(uint16_t idx);
+  int (*range_read)(uint32_t start, uint32_t count, uint32_t stride, uint8_t *buf);
+  void (*filter)(uint16_t idx, const data_signal_t *sig, uint8_t *buf, uint32_t count);
+  void (*reset)(uint32_t start, uint32_t count);
+  int (*persist)(uint16_t idx, const struct timeval *ts, int64_t host_ns, const uint8_t *buf, uint32_t count, bool data_query);
+  int (*persist_signal)(const data_signal_t *sig);
+  void (*discard)(uint16_t idx, int64_t host_ns, const uint8_t *buf, uint32_t count);
+  uint32_t (*next_period)(uint16_t idx, const struct timeval *ts, uint32_t count);
+  int (*persist_meta)(uint16_t idx, const struct timeval *ts, const uint32_t *meta);
+
+  // measured latency of periodical polls
+  uint64_t poll_num;
+  uint64_t skip_num;           // polls skipped on idle ports
+  uint64_t poll_us_total;
+  uint32_t poll_us_max;
+  uint32_t poll_us_last;
+  uint32_t poll_entries_last;  // entries read by the last poll: chunks of data plane queries are sized per entry
+  // wakeup latency: delay between the deadline of a poll and its start
+  uint64_t wakeup_us_total;
+  uint32_t wakeup_us_max;
+  uint64_t deadline_miss;      // polls starting more than rt_deadline_slack_us late
+  uint64_t overrun;            // polls lasting longer than the period of the port
+  uint64_t read_entries;       // entries read by periodical polls and data plane queries
+  pq_latency_t poll_lat;       // latency of periodical polls
+  pq_latency_t query_lat;      // signal arrival to the end of its data plane query
+};
+
+extern pq_poller_t *pq_pollers[PQ_MODE_NUM];
+
+pq_mode_t pq_parse_mode(const char *str);
+int pq_pollers_init(void);
+void pq_pollers_reset_stats(void);
+void pq_poll_loop(void);
+
+//----------------------------------------------------------------------
+// Snapshot buffers (pool.c): a slab of pq_pool_buffers buffers, each as
+// large as the largest snapshot of the active modes (TW: cell_number *
+// 12 * T, QM: max_qdepth * 12), on 2 MB hugepages when reserved.
+// The poller reads a snapshot into a buffer taken from the pool and hands
+// the buffer over to the writer thread, which persists it and gives it
+// back to the pool. Buffers are passed by handle, never copied.
+//----------------------------------------------------------------------
+typedef int32_t pq_buf_t;
+#define PQ_BUF_NONE (-1)
+
+extern uint32_t pq_pool_buffers;    // buffers of the pool, at least 2
+extern uint32_t pq_pool_reserved;   // buffers held by the flight recorder, on top of them
+extern uint64_t pq_pool_wait_num;   // waits of the poller for a free buffer
+
+int pq_pool_init(size_t buf_size);
+void pq_pool_free(void);
+pq_buf_t pq_buf_get(void);
+uint8_t *pq_buf_ptr(pq_buf_t h);
+void pq_buf_put(pq_buf_t h);
+
+int pq_writer_start(void);
+void pq_writer_stop(void);
+
+// a snapshot, the signal of a data plane query or metadata of a poll,
+// handed over to the writer
+#define PQ_META_WORDS 3
+enum pq_write_type { PQ_WRITE_SNAPSHOT = 0, PQ_WRITE_SIGNAL, PQ_WRITE_META };
+typedef struct pq_write_job {
+  pq_poller_t *p;
+  uint16_t idx;
+  bool data_query;
+  uint8_t type;                          // pq_write_type
+  uint32_t meta[PQ_META_WORDS];          // PQ_WRITE_META
+  data_signal_t sig;                     // PQ_WRITE_SIGNAL
+  struct timeval ts;
+  int64_t host_ns;
+  pq_buf_t buf;
+  uint32_t count;
+} pq_write_job_t;
+
+void pq_writer_submit(pq_poller_t *p, uint16_t idx, const struct timeval *ts, int64_t host_ns, pq_buf_t buf, uint32_t count, bool data_query);
+void pq_writer_meta(pq_poller_t *p, uint16_t idx, const struct timeval *ts, const uint32_t *meta);
+void pq_writer_signal(pq_poller_t *p, const data_signal_t *sig);
+void pq_writer_store(const pq_write_job_t *job);
+
+//----------------------------------------------------------------------
+// Flight recorder (recorder.c): with pq_recorder, the writer keeps the
+// latest snapshots of every port in memory and stores them only around
+// an event: a data plane query of the port, or an operator trigger
+// (SIGHUP) for all ports. Snapshots read up to pq_recorder_pre_ms before
+// the event and pq_recorder_post_ms after it are stored, the others are
+// dropped.
+//----------------------------------------------------------------------
+extern bool pq_recorder;
+extern uint32_t pq_recorder_pre_ms, pq_recorder_post_ms;
+
+int pq_recorder_parse(const char *str);
+int pq_recorder_init(void);
+void pq_recorder_trigger(void);
+void pq_recorder_write(const pq_write_job_t *job);
+void pq_recorder_release(void);
+void pq_recorder_print_stats(void);
+
+//----------------------------------------------------------------------
+// Filtered time windows snapshots (tw_cells.c): with tw_store_cells, the
+// writer stores the valid cells of every set with their 64-bit timestamps
+// (tw_cells.h) instead of the raw registers; pq_tw_valid_flows walks the
+// flow IDs of the valid cells of a raw set (retention summaries)
+//----------------------------------------------------------------------
+int pq_tw_cells_init(void);
+int pq_tw_cells_persist(uint16_t idx, const char *path, const struct timeval *ts, int64_t host_ns, const uint8_t *buf, uint32_t count, bool data_query);
+void pq_tw_cells_track(uint16_t idx, int64_t host_ns, const uint8_t *buf, uint32_t count);
+int pq_tw_valid_flows(const uint8_t *buf, uint32_t n, uint32_t windows, void (*flow)(uint32_t src_ip, uint32_t dst_ip));
+
+//----------------------------------------------------------------------
+// Continuous operation (retention.c): with pq_retain, the writer appends
+// the snapshots, signals and queue monitor intervals of every port to
+// segment files of pq_retain_segment_s seconds (segment.h) instead of a
+// file each (or a line of qm_meta.csv), and a retention thread
+// keeps all segments within pq_retain_budget_mb: segments older than
+// pq_retain_full_s only keep their non-empty entries, those older than
+// pq_retain_compact_s only per pq_retain_summary_ms flow summaries, and
+// over the budget the oldest segment is compacted, then deleted.
+// The pollers run until stopped when their duration is 0.
+//----------------------------------------------------------------------
+extern bool pq_retain;
+extern uint32_t pq_retain_budget_mb, pq_retain_segment_s, pq_retain_full_s, pq_retain_compact_s, pq_retain_summary_ms;
+
+int pq_retain_parse(const char *str);
+int pq_retain_init(void);
+int pq_retain_start(void);
+void pq_retain_stop(void);
+void pq_retain_print_stats(void);
+int pq_store_snapshot(uint16_t idx, const char *path, const struct timeval *ts, int64_t host_ns, uint8_t kind, uint8_t flags, uint32_t count,
+                      const void *head, size_t head_len, const void *body, size_t body_len);
+
+//----------------------------------------------------------------------
+// Warm restart (checkpoint.c): with pq_checkpoint_path, the control plane
+// state (parameters, port table, installed thresholds, bits, overflow
+// and seq marks, switch clock fit, items of the main program) is saved
+// once the data plane is programmed and when the control plane stops.
+// pq_checkpoint_load sets pq_warm when the data plane still holds the
+// checkpointed tables: they are then reprogrammed by difference, the
+// query state of the data plane is kept and the bits are read back from
+// it; pq_warm_port tells the ports whose prepare entry is kept. Without a
+// usable checkpoint the tables are cleared and programmed from scratch.
+//----------------------------------------------------------------------
+typedef struct pq_table_diff {
+  uint32_t added;
+  uint32_t modified;
+  uint32_t deleted;
+  uint32_t kept;
+  double ms;
+} pq_table_diff_t;
+
+enum pq_checkpoint_item_state {
+  PQ_CKPT_NEW = 0,          // not installed
+  PQ_CKPT_SAME,             // installed as is by the previous run
+  PQ_CKPT_CHANGED,          // installed with another configuration
+};
+
+extern const char *pq_checkpoint_path;
+extern bool pq_warm;
+extern bool pq_warm_port[MAX_PORT_NUM];
+extern pq_table_diff_t pq_warm_ports, pq_warm_thresholds;
+
+int pq_checkpoint_load(void);
+int pq_checkpoint_item(const char *key, const void *cfg, size_t len);
+const pq_threshold_t *pq_checkpoint_thresholds(uint32_t *num);
+uint16_t pq_checkpoint_ports(const port_entry_t **table);
+int pq_checkpoint_save(void);
+int pq_checkpoint_dirty(void);
+void pq_warm_restore(void);
+void pq_warm_resume(void);
+void pq_warm_settle(void);
+
+#endif
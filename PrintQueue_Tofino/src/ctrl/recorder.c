@@ -0,0 +1,157 @@
+/*************************************************************************
+	> File Name: recorder.c
+  > Description: Flight recorder of the writer thread: the latest snapshots
+  >              of every port are kept in memory and stored only around
+  >              data plane queries and operator triggers
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "printqueue.h"
+
+bool pq_recorder = false;
+uint32_t pq_recorder_pre_ms = 500, pq_recorder_post_ms = 500;
+
+//----------------------------------------------------------------------
+// Every port has a ring of the snapshots read in the last pre_ms (plus
+// one), sized on the shortest period of its module. The buffers of the
+// rings are reserved in the pool on top of pq_pool_buffers, so that the
+// poller never waits for a snapshot held by a ring.
+// Rings and the post-event deadlines are only touched by the writer
+// thread; the operator trigger is the host time of the last SIGHUP.
+//----------------------------------------------------------------------
+static pq_write_job_t *ring = NULL;
+static uint32_t ring_start[MAX_PORT_NUM], ring_size[MAX_PORT_NUM], ring_head[MAX_PORT_NUM], ring_num[MAX_PORT_NUM];
+static int64_t post_until[MAX_PORT_NUM];
+static int64_t operator_trigger_ns = 0;
+static uint64_t event_num = 0, stored_num = 0, dropped_num = 0;
+
+// --recorder=pre_ms,post_ms
+int pq_recorder_parse(const char *str){
+  if (sscanf(str, "%u,%u", &pq_recorder_pre_ms, &pq_recorder_post_ms) != 2){
+    printf("--recorder expects pre_ms,post_ms\n");
+    return -1;
+  }
+  pq_recorder = true;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Size the ring of every port; called by pq_pollers_init once the
+// periods are known, before the pool is allocated.
+//----------------------------------------------------------------------
+int pq_recorder_init(void){
+  uint32_t total = 0;
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    uint32_t period = pq_pollers[port_table[i].mode]->period_us;
+    if (port_table[i].mode == PQ_MODE_QM && qm_adaptive && qm_interval_min < period){
+      period = qm_interval_min;
+    }
+    ring_start[i] = total;
+    ring_size[i] = (uint64_t)pq_recorder_pre_ms * 1000 / (period ? period : 1) + 2;
+    ring_head[i] = ring_num[i] = 0;
+    post_until[i] = 0;
+    total += ring_size[i];
+  }
+  free(ring);
+  ring = malloc((total ? total : 1) * sizeof(pq_write_job_t));
+  if (ring == NULL){
+    printf("Error allocating the flight recorder (%u snapshots)!\n", total);
+    return -1;
+  }
+  pq_pool_reserved = total;
+  operator_trigger_ns = 0;
+  event_num = stored_num = dropped_num = 0;
+  printf("Flight recorder: %u ms before and %u ms after every event, %u snapshots kept in memory\n", pq_recorder_pre_ms, pq_recorder_post_ms, total);
+  return 0;
+}
+
+// SIGHUP: every port is an event (async-signal-safe)
+void pq_recorder_trigger(void){
+  __atomic_store_n(&operator_trigger_ns, pq_clock_host_ns(), __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------
+// A snapshot not stored: the poller moves its state on (wrap tracking of
+// time windows) before the buffer goes back to the pool. The overflow
+// mark of queue monitor stays pending until a periodical snapshot of the
+// port is stored.
+//----------------------------------------------------------------------
+static void recorder_drop(const pq_write_job_t *job){
+  if (job->p->discard && job->buf != PQ_BUF_NONE){
+    job->p->discard(job->idx, job->host_ns, pq_buf_ptr(job->buf), job->count);
+  }
+  pq_buf_put(job->buf);
+  dropped_num += 1;
+}
+
+//----------------------------------------------------------------------
+// Event of port idx at host time t: the ring is stored from the oldest
+// snapshot read at t - pre_ms on (snapshots read after t included), and
+// every snapshot read until t + post_ms is stored as it comes
+//----------------------------------------------------------------------
+static void recorder_event(uint16_t idx, int64_t t){
+  int64_t from = t - (int64_t)pq_recorder_pre_ms * 1000000;
+  uint32_t stored = 0, dropped = 0;
+  for (; ring_num[idx] > 0; ring_num[idx]--){
+    pq_write_job_t *job = &ring[ring_start[idx] + (ring_head[idx] + ring_size[idx] - ring_num[idx]) % ring_size[idx]];
+    if (job->host_ns < from){
+      recorder_drop(job);
+      dropped++;
+    }else{
+      pq_writer_store(job);
+      stored++;
+    }
+  }
+  stored_num += stored;
+  if (t + (int64_t)pq_recorder_post_ms * 1000000 > post_until[idx]){
+    post_until[idx] = t + (int64_t)pq_recorder_post_ms * 1000000;
+  }
+  event_num += 1;
+  PQ_TRACE(RECORDER_EVENT, port_table[idx].port, stored, dropped);
+}
+
+//----------------------------------------------------------------------
+// Called by the writer for every snapshot handed over, in order
+//----------------------------------------------------------------------
+void pq_recorder_write(const pq_write_job_t *job){
+  int64_t t = __atomic_exchange_n(&operator_trigger_ns, 0, __ATOMIC_ACQ_REL);
+  uint16_t idx = job->idx;
+  if (t){
+    for (uint16_t i = 0; i < port_entry_num; i++){
+      recorder_event(i, t);
+    }
+  }
+  if (job->data_query){
+    // read at the signal: the event of its port
+    recorder_event(idx, job->host_ns);
+  }
+  if (job->data_query || job->host_ns <= post_until[idx]){
+    pq_writer_store(job);
+    stored_num += 1;
+    return;
+  }
+  if (ring_num[idx] == ring_size[idx]){
+    recorder_drop(&ring[ring_start[idx] + (ring_head[idx] + ring_size[idx] - ring_num[idx]) % ring_size[idx]]);
+    ring_num[idx]--;
+  }
+  ring[ring_start[idx] + ring_head[idx]] = *job;
+  ring_head[idx] = (ring_head[idx] + 1) % ring_size[idx];
+  ring_num[idx]++;
+}
+
+// writer stopping: the snapshots of the rings go back to the pool
+void pq_recorder_release(void){
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    for (; ring_num[i] > 0; ring_num[i]--){
+      recorder_drop(&ring[ring_start[i] + (ring_head[i] + ring_size[i] - ring_num[i]) % ring_size[i]]);
+    }
+  }
+}
+
+void pq_recorder_print_stats(void){
+  if (pq_recorder){
+    printf("Flight recorder: %lu events, %lu snapshots stored, %lu dropped\n", event_num, stored_num, dropped_num);
+  }
+}
@@ -0,0 +1,738 @@
+/*************************************************************************
+	> File Name: retention.c
+  > Description: Continuous operation within a disk budget: snapshots are
+  >              appended to segment files, which a retention thread
+  >              compacts as they age and deletes oldest first
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "printqueue.h"
+
+bool pq_retain = false;
+uint32_t pq_retain_budget_mb = 0, pq_retain_segment_s = 1, pq_retain_full_s = 60, pq_retain_compact_s = 600, pq_retain_summary_ms = 1000;
+
+static const char *data_folder[PQ_MODE_NUM] = {"tw_data", "qm_data"};
+
+static inline int64_t tv_us(const struct timeval *t){
+  return (int64_t)t->tv_sec * 1000000 + t->tv_usec;
+}
+
+static void segment_path(char *path, size_t len, uint8_t mode, uint16_t idx, int64_t first_us, const char *ext){
+  snprintf(path, len, "./%s/%d/segments/%ld_%ld.%s", data_folder[mode], idx, first_us / 1000000, first_us % 1000000, ext);
+}
+
+//----------------------------------------------------------------------
+// Closed segments of all ports, oldest first. The writer thread appends
+// the segments it closes; only the retention thread rewrites or removes
+// them, so an index stays valid while it works on a copy unlocked.
+// The open segment of every port belongs to the writer thread, its size
+// is shared for the budget.
+//----------------------------------------------------------------------
+typedef struct retain_segment {
+  int64_t first_us;
+  int64_t last_us;
+  uint64_t bytes;
+  uint16_t idx;
+  uint8_t mode;
+  uint8_t level;
+} retain_segment_t;
+
+static retain_segment_t *segs = NULL;
+static uint32_t seg_num = 0, seg_cap = 0;
+static uint64_t closed_bytes = 0, open_bytes[MAX_PORT_NUM];
+static FILE *open_file[MAX_PORT_NUM];
+static pq_segment_header_t open_header[MAX_PORT_NUM];
+static uint64_t compact_num = 0, delete_num = 0;
+
+static pthread_t retain_thread;
+static bool retain_running = false;
+static pthread_mutex_t retain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t retain_cond = PTHREAD_COND_INITIALIZER;   // segment closed, or stop
+
+// --retain=budget_mb[,segment_s,full_s,compact_s,summary_ms]
+int pq_retain_parse(const char *str){
+  if (sscanf(str, "%u,%u,%u,%u,%u", &pq_retain_budget_mb, &pq_retain_segment_s, &pq_retain_full_s, &pq_retain_compact_s, &pq_retain_summary_ms) < 1
+      || pq_retain_budget_mb == 0 || pq_retain_segment_s == 0 || pq_retain_summary_ms == 0 || pq_retain_full_s > pq_retain_compact_s){
+    printf("--retain expects budget_mb[,segment_s,full_s,compact_s,summary_ms], full_s <= compact_s\n");
+    return -1;
+  }
+  pq_retain = true;
+  return 0;
+}
+
+// walked under retain_lock
+static int segment_add(const retain_segment_t *s){
+  if (seg_num == seg_cap){
+    uint32_t cap = seg_cap ? seg_cap * 2 : 256;
+    retain_segment_t *n = realloc(segs, cap * sizeof(retain_segment_t));
+    if (n == NULL){
+      printf("Error allocating the segment list (%u segments)!\n", cap);
+      return -1;
+    }
+    segs = n;
+    seg_cap = cap;
+  }
+  segs[seg_num++] = *s;
+  closed_bytes += s->bytes;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Next record of a segment and its payload, in *buf grown as needed.
+// Returns 1, 0 at the end of the file, -1 on a truncated record.
+//----------------------------------------------------------------------
+static int segment_read(FILE *f, pq_segment_record_t *r, uint8_t **buf, size_t *cap){
+  size_t n = fread(r, 1, sizeof(*r), f);
+  if (n == 0){
+    return 0;
+  }
+  if (n != sizeof(*r)){
+    return -1;
+  }
+  if (r->size > *cap){
+    uint8_t *b = realloc(*buf, r->size);
+    if (b == NULL){
+      return -1;
+    }
+    *buf = b;
+    *cap = r->size;
+  }
+  return fread(*buf, 1, r->size, f) == r->size ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// A segment left open by a crash: count its records, cut a truncated
+// one, and close it
+//----------------------------------------------------------------------
+static int segment_recover(const char *path, pq_segment_header_t *h){
+  FILE *f = fopen(path, "r+b");
+  pq_segment_record_t r;
+  uint8_t *buf = NULL;
+  size_t cap = 0;
+  long end = h->header_size;
+  int ret;
+  if (f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  fseek(f, h->header_size, SEEK_SET);
+  h->record_num = 0;
+  h->last_us = h->first_us;
+  while ((ret = segment_read(f, &r, &buf, &cap)) > 0){
+    h->record_num += 1;
+    if (r.ts_us > h->last_us){
+      h->last_us = r.ts_us;
+    }
+    end = ftell(f);
+  }
+  free(buf);
+  fseek(f, 0, SEEK_SET);
+  fwrite(h, sizeof(*h), 1, f);
+  fclose(f);
+  if (ret < 0 && truncate(path, end) != 0){
+    printf("Error truncating %s: %s\n", path, strerror(errno));
+  }
+  printf("Retention: recovered %s, %u records\n", path, h->record_num);
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Segments of earlier runs count in the budget: scan the segment folder
+// of a port, drop interrupted compactions and close crashed segments
+//----------------------------------------------------------------------
+static int retain_scan(uint16_t idx, uint8_t mode, const char *dir){
+  DIR *dp = opendir(dir);
+  struct dirent *e;
+  char path[512];
+  if (dp == NULL){
+    printf("Error! Path %s does not exist!\n", dir);
+    return -1;
+  }
+  while ((e = readdir(dp)) != NULL){
+    size_t len = strlen(e->d_name);
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    if (len > 4 && !strcmp(e->d_name + len - 4, ".tmp")){
+      unlink(path);
+      continue;
+    }
+    if (len <= 6 || strcmp(e->d_name + len - 6, ".pqseg")){
+      continue;
+    }
+    pq_segment_header_t h;
+    struct stat st;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL || fread(&h, sizeof(h), 1, f) != 1 || h.magic != PQ_SEGMENT_MAGIC || h.mode != mode){
+      printf("Warning: %s is not a segment of this port, left out of the budget\n", path);
+      if (f != NULL){
+        fclose(f);
+      }
+      continue;
+    }
+    fclose(f);
+    if (h.last_us == 0 && segment_recover(path, &h) != 0){
+      closedir(dp);
+      return -1;
+    }
+    if (stat(path, &st) != 0){
+      continue;
+    }
+    retain_segment_t s = {h.first_us, h.last_us, (uint64_t)st.st_size, idx, mode, h.level};
+    if (segment_add(&s) != 0){
+      closedir(dp);
+      return -1;
+    }
+  }
+  closedir(dp);
+  return 0;
+}
+
+static int cmp_segment(const void *x, const void *y){
+  const retain_segment_t *a = x, *b = y;
+  return a->first_us < b->first_us ? -1 : a->first_us > b->first_us;
+}
+
+//----------------------------------------------------------------------
+// Create the segment folder of every port and take over the segments
+// already there; called by pq_pollers_init before the writer starts
+//----------------------------------------------------------------------
+int pq_retain_init(void){
+  char dir[128];
+  free(segs);
+  segs = NULL;
+  seg_num = seg_cap = 0;
+  closed_bytes = 0;
+  compact_num = delete_num = 0;
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    uint8_t mode = port_table[i].mode;
+    open_file[i] = NULL;
+    open_bytes[i] = 0;
+    snprintf(dir, sizeof(dir), "./%s/%d/segments", data_folder[mode], i);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST){
+      printf("Error creating %s: %s\n", dir, strerror(errno));
+      return -1;
+    }
+    if (retain_scan(i, mode, dir) != 0){
+      return -1;
+    }
+  }
+  qsort(segs, seg_num, sizeof(retain_segment_t), cmp_segment);
+  printf("Retention: %u MB on disk, %u s segments, compacted after %u s, summaries of %u ms after %u s; %u segments (%lu KB) of earlier runs\n",
+         pq_retain_budget_mb, pq_retain_segment_s, pq_retain_full_s, pq_retain_summary_ms, pq_retain_compact_s, seg_num, closed_bytes >> 10);
+  return 0;
+}
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                            Writer side                                   //
+//                                                                          //
+//--------------------------------------------------------------------------//
+static int segment_open(uint16_t idx, int64_t ts_us){
+  char path[128];
+  pq_segment_header_t *h = &open_header[idx];
+  memset(h, 0, sizeof(*h));
+  h->magic = PQ_SEGMENT_MAGIC;
+  h->version = PQ_SEGMENT_VERSION;
+  h->header_size = sizeof(*h);
+  h->mode = port_table[idx].mode;
+  h->level = PQ_SEG_LEVEL_FULL;
+  h->idx = idx;
+  h->first_us = ts_us;
+  segment_path(path, sizeof(path), h->mode, idx, ts_us, "pqseg");
+  open_file[idx] = fopen(path, "wb");
+  if (open_file[idx] == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  // record_num and last_us are written when the segment is closed
+  fwrite(h, sizeof(*h), 1, open_file[idx]);
+  pthread_mutex_lock(&retain_lock);
+  open_bytes[idx] = sizeof(*h);
+  pthread_mutex_unlock(&retain_lock);
+  return 0;
+}
+
+static void segment_close(uint16_t idx){
+  pq_segment_header_t *h = &open_header[idx];
+  retain_segment_t s = {h->first_us, h->last_us, 0, idx, h->mode, PQ_SEG_LEVEL_FULL};
+  fseek(open_file[idx], 0, SEEK_SET);
+  fwrite(h, sizeof(*h), 1, open_file[idx]);
+  fclose(open_file[idx]);
+  open_file[idx] = NULL;
+  pthread_mutex_lock(&retain_lock);
+  s.bytes = open_bytes[idx];
+  open_bytes[idx] = 0;
+  segment_add(&s);
+  pthread_cond_signal(&retain_cond);
+  pthread_mutex_unlock(&retain_lock);
+  PQ_TRACE(SEGMENT_CLOSE, port_table[idx].port, h->record_num, s.bytes >> 10);
+}
+
+//----------------------------------------------------------------------
+// Append a snapshot to the open segment of its port, closing it once
+// the snapshot is pq_retain_segment_s after its first one
+//----------------------------------------------------------------------
+static int retain_append(uint16_t idx, const struct timeval *ts, int64_t host_ns, uint8_t kind, uint8_t flags, uint32_t count,
+                         const void *head, size_t head_len, const void *body, size_t body_len){
+  int64_t t = tv_us(ts);
+  if (open_file[idx] != NULL && t - open_header[idx].first_us >= (int64_t)pq_retain_segment_s * 1000000){
+    segment_close(idx);
+  }
+  if (open_file[idx] == NULL && segment_open(idx, t) != 0){
+    return -1;
+  }
+  pq_segment_record_t r;
+  memset(&r, 0, sizeof(r));
+  r.size = head_len + body_len;
+  r.kind = kind;
+  r.flags = flags;
+  r.registers = pq_pollers[port_table[idx].mode]->register_num;
+  r.count = count;
+  r.ts_us = t;
+  r.host_ns = host_ns;
+  fwrite(&r, sizeof(r), 1, open_file[idx]);
+  if (head_len){
+    fwrite(head, 1, head_len, open_file[idx]);
+  }
+  if (body_len){
+    fwrite(body, 1, body_len, open_file[idx]);
+  }
+  open_header[idx].record_num += 1;
+  if (t > open_header[idx].last_us){
+    open_header[idx].last_us = t;
+  }
+  pthread_mutex_lock(&retain_lock);
+  open_bytes[idx] += sizeof(r) + r.size;
+  pthread_mutex_unlock(&retain_lock);
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Store a snapshot (or a signal, an interval) of port idx, head (may be
+// NULL) then body: in its own file path, or as a record of kind / flags
+// (segment.h) with retention. Runs on the writer thread.
+//----------------------------------------------------------------------
+int pq_store_snapshot(uint16_t idx, const char *path, const struct timeval *ts, int64_t host_ns, uint8_t kind, uint8_t flags, uint32_t count,
+                      const void *head, size_t head_len, const void *body, size_t body_len){
+  if (pq_retain){
+    return retain_append(idx, ts, host_ns, kind, flags, count, head, head_len, body, body_len);
+  }
+  FILE * f = fopen(path, "wb");
+  if (f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  if (head_len){
+    fwrite(head, 1, head_len, f);
+  }
+  if (body_len){
+    fwrite(body, 1, body_len, f);
+  }
+  fclose(f);
+  return 0;
+}
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                            Compaction                                    //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Entries of every flow in the interval being summarized: open addressing
+// on the flow ID (src_ip << 32 | dst_ip, never 0)
+static uint64_t *flow_key = NULL;
+static uint32_t *flow_count = NULL;
+static uint32_t flow_cap = 0, flow_num = 0;
+
+static int flow_grow(void){
+  uint32_t cap = flow_cap ? flow_cap * 2 : 4096;
+  uint64_t *key = calloc(cap, sizeof(uint64_t));
+  uint32_t *count = malloc(cap * sizeof(uint32_t));
+  if (key == NULL || count == NULL){
+    free(key);
+    free(count);
+    return -1;
+  }
+  for (uint32_t i = 0; i < flow_cap; i++){
+    if (flow_key[i] == 0) continue;
+    uint32_t j = (flow_key[i] * 0x9E3779B97F4A7C15ULL) >> 32 & (cap - 1);
+    while (key[j]){
+      j = (j + 1) & (cap - 1);
+    }
+    key[j] = flow_key[i];
+    count[j] = flow_count[i];
+  }
+  free(flow_key);
+  free(flow_count);
+  flow_key = key;
+  flow_count = count;
+  flow_cap = cap;
+  return 0;
+}
+
+static void flow_add(uint32_t src, uint32_t dst){
+  uint64_t fid = (uint64_t)src << 32 | dst;
+  if (fid == 0 || ((flow_num + 1) * 2 > flow_cap && flow_grow() != 0)){
+    return;
+  }
+  uint32_t j = (fid * 0x9E3779B97F4A7C15ULL) >> 32 & (flow_cap - 1);
+  while (flow_key[j] && flow_key[j] != fid){
+    j = (j + 1) & (flow_cap - 1);
+  }
+  if (flow_key[j] == 0){
+    flow_key[j] = fid;
+    flow_count[j] = 0;
+    flow_num++;
+  }
+  flow_count[j]++;
+}
+
+//----------------------------------------------------------------------
+// Flows of a snapshot record. Registers of a flow ID: src of time
+// windows window w at 3w + 1, dst at 3w + 2; src of queue monitor at 0,
+// dst at 1. A SPARSE record holds m entries of every register.
+// Raw time windows registers also hold stale cells of older cycles: only
+// the valid cells of the set are counted (pq_tw_valid_flows, tw_cells.c),
+// a SPARSE one is laid out dense again first. Queue monitor slots are
+// filtered before they are stored.
+//----------------------------------------------------------------------
+static uint32_t *dense = NULL;
+static size_t dense_cap = 0;
+
+static void record_flows(uint8_t mode, const pq_segment_record_t *r, const uint8_t *p){
+  const uint32_t *v = (const uint32_t *)p;
+  uint32_t n = r->count;
+  if (r->kind == PQ_SEG_CELLS){
+    const pq_tw_cells_header_t *h = (const pq_tw_cells_header_t *)p;
+    if (r->size < PQ_TW_CELLS_HEADER_V1_SIZE || h->magic != PQ_TW_CELLS_MAGIC){
+      return;
+    }
+    const pq_tw_cell_t *c = (const pq_tw_cell_t *)(p + h->header_size);
+    for (uint32_t i = 0; i < h->cell_num; i++){
+      flow_add(c[i].src_ip, c[i].dst_ip);
+    }
+    return;
+  }
+  if (r->kind == PQ_SEG_SPARSE){
+    n = r->size / 4 / (r->registers + 1);
+    v += n;
+  }else if (r->kind != PQ_SEG_RAW || (uint64_t)n * r->registers * 4 > r->size){
+    return;
+  }
+  if (mode == PQ_MODE_TW){
+    if (r->registers % 3 != 0){
+      return;
+    }
+    if (r->kind == PQ_SEG_SPARSE){
+      size_t need = (size_t)r->count * r->registers * 4;
+      const uint32_t *idx = (const uint32_t *)p;
+      if (need > dense_cap){
+        uint32_t *b = realloc(dense, need);
+        if (b == NULL){
+          return;
+        }
+        dense = b;
+        dense_cap = need;
+      }
+      memset(dense, 0, need);
+      for (uint32_t s = 0; s < r->registers; s++){
+        for (uint32_t j = 0; j < n; j++){
+          if (idx[j] < r->count){
+            dense[s * r->count + idx[j]] = v[s * n + j];
+          }
+        }
+      }
+      v = dense;
+    }
+    pq_tw_valid_flows((const uint8_t *)v, r->count, r->registers / 3, flow_add);
+    return;
+  }
+  for (uint32_t s = 0; s + 1 < r->registers; s += 3){
+    for (uint32_t j = 0; j < n; j++){
+      flow_add(v[s * n + j], v[(s + 1) * n + j]);
+    }
+  }
+}
+
+// entries of a RAW record holding any non-zero value, as a SPARSE payload in out
+static uint32_t record_sparse(const pq_segment_record_t *r, const uint8_t *p, uint32_t *out){
+  const uint32_t *v = (const uint32_t *)p;
+  uint32_t n = r->count, R = r->registers, m = 0;
+  for (uint32_t j = 0; j < n; j++){
+    uint32_t any = 0;
+    for (uint32_t s = 0; s < R; s++){
+      any |= v[s * n + j];
+    }
+    if (any){
+      out[m++] = j;
+    }
+  }
+  for (uint32_t s = 0; s < R; s++){
+    for (uint32_t j = 0; j < m; j++){
+      out[m + s * m + j] = v[s * n + out[j]];
+    }
+  }
+  return m * (R + 1) * 4;
+}
+
+static void summary_flush(FILE *out, int64_t start, int64_t host_ns, uint32_t *record_num){
+  pq_segment_record_t r;
+  pq_segment_flow_t f;
+  memset(&r, 0, sizeof(r));
+  r.size = flow_num * sizeof(f);
+  r.kind = PQ_SEG_SUMMARY;
+  r.count = flow_num;
+  r.span_us = pq_retain_summary_ms * 1000;
+  r.ts_us = start;
+  r.host_ns = host_ns;
+  fwrite(&r, sizeof(r), 1, out);
+  for (uint32_t i = 0; i < flow_cap; i++){
+    if (flow_key[i] == 0) continue;
+    f.src_ip = flow_key[i] >> 32;
+    f.dst_ip = flow_key[i];
+    f.count = flow_count[i];
+    fwrite(&f, sizeof(f), 1, out);
+    flow_key[i] = 0;
+  }
+  flow_num = 0;
+  *record_num += 1;
+}
+
+//----------------------------------------------------------------------
+// Rewrite a closed segment at level (segment.h) into <name>.tmp, then
+// rename it over the segment. Returns the new size in bytes, -1 on error.
+//----------------------------------------------------------------------
+static int64_t segment_compact(const retain_segment_t *s, uint8_t level){
+  char path[128], tmp[136];
+  pq_segment_header_t h;
+  pq_segment_record_t r;
+  uint8_t *buf = NULL;
+  uint32_t *sparse = NULL;
+  size_t cap = 0, sparse_cap = 0;
+  int64_t span = (int64_t)pq_retain_summary_ms * 1000, start = -1, start_host = 0;
+  uint32_t record_num = 0;
+  struct stat st;
+  int ret;
+  segment_path(path, sizeof(path), s->mode, s->idx, s->first_us, "pqseg");
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *in = fopen(path, "rb"), *out = NULL;
+  if (in == NULL || fread(&h, sizeof(h), 1, in) != 1 || h.magic != PQ_SEGMENT_MAGIC || (out = fopen(tmp, "wb")) == NULL){
+    printf("Error opening %s!\n", in == NULL || out != NULL ? path : tmp);
+    if (in != NULL){
+      fclose(in);
+    }
+    return -1;
+  }
+  fseek(in, h.header_size, SEEK_SET);
+  h.header_size = sizeof(h);
+  h.level = level;
+  fwrite(&h, sizeof(h), 1, out);
+  flow_num = 0;
+  while ((ret = segment_read(in, &r, &buf, &cap)) > 0){
+    bool snapshot = r.kind == PQ_SEG_RAW || r.kind == PQ_SEG_CELLS || r.kind == PQ_SEG_SPARSE;
+    if (level >= PQ_SEG_LEVEL_SUMMARY && !(r.flags & PQ_SEG_QUERY) && snapshot){
+      // periodical snapshot: into the summary of its interval
+      int64_t t = r.ts_us - r.ts_us % span;
+      if (t != start){
+        if (start >= 0){
+          summary_flush(out, start, start_host, &record_num);
+        }
+        start = t;
+        start_host = r.host_ns;
+      }
+      if (flow_cap == 0 && flow_grow() != 0){
+        ret = -1;
+        break;
+      }
+      record_flows(h.mode, &r, buf);
+      continue;
+    }
+    if (r.kind == PQ_SEG_RAW && r.size && (uint64_t)r.count * r.registers * 4 <= r.size){
+      // at most count entries of registers + 1 values
+      size_t need = r.size + (size_t)r.count * 4;
+      if (need > sparse_cap){
+        uint32_t *b = realloc(sparse, need);
+        if (b == NULL){
+          ret = -1;
+          break;
+        }
+        sparse = b;
+        sparse_cap = need;
+      }
+      uint32_t size = record_sparse(&r, buf, sparse);
+      if (size < r.size){
+        r.size = size;
+        r.kind = PQ_SEG_SPARSE;
+        fwrite(&r, sizeof(r), 1, out);
+        fwrite(sparse, 1, r.size, out);
+      }else{
+        // dense snapshot (loaded time windows): kept RAW
+        fwrite(&r, sizeof(r), 1, out);
+        fwrite(buf, 1, r.size, out);
+      }
+    }else{
+      fwrite(&r, sizeof(r), 1, out);
+      fwrite(buf, 1, r.size, out);
+    }
+    record_num++;
+  }
+  if (start >= 0){
+    summary_flush(out, start, start_host, &record_num);
+  }
+  free(buf);
+  free(sparse);
+  fclose(in);
+  h.record_num = record_num;
+  fseek(out, 0, SEEK_SET);
+  fwrite(&h, sizeof(h), 1, out);
+  if (fclose(out) != 0 || ret < 0){
+    printf("Error writing %s!\n", tmp);
+    unlink(tmp);
+    return -1;
+  }
+  if (rename(tmp, path) != 0 || stat(path, &st) != 0){
+    printf("Error renaming %s: %s\n", tmp, strerror(errno));
+    unlink(tmp);
+    return -1;
+  }
+  return st.st_size;
+}
+
+//--------------------------------------------------------------------------//
+//                                                                          //
+//                          Retention thread                                //
+//                                                                          //
+//--------------------------------------------------------------------------//
+// Work on the segments, one at a time:
+//   * over the budget: the oldest segment goes one level down, or is
+//     deleted at the SUMMARY level
+//   * otherwise, the oldest segment older than its level allows: COMPACT
+//     after pq_retain_full_s, SUMMARY after pq_retain_compact_s
+// The open segments count in the budget, so the budget should hold more
+// than a segment of every port.
+//--------------------------------------------------------------------------
+enum retain_work { RETAIN_NONE, RETAIN_COMPACT, RETAIN_DELETE };
+
+static int retain_pick(int64_t now_us, uint32_t *i, uint8_t *level){
+  uint64_t total = closed_bytes;
+  for (uint16_t p = 0; p < port_entry_num; p++){
+    total += open_bytes[p];
+  }
+  if (total > ((uint64_t)pq_retain_budget_mb << 20) && seg_num > 0){
+    *i = 0;
+    *level = segs[0].level + 1;
+    return segs[0].level >= PQ_SEG_LEVEL_SUMMARY ? RETAIN_DELETE : RETAIN_COMPACT;
+  }
+  for (uint32_t j = 0; j < seg_num; j++){
+    int64_t age = now_us - segs[j].last_us;
+    uint8_t target = age > (int64_t)pq_retain_compact_s * 1000000 ? PQ_SEG_LEVEL_SUMMARY : age > (int64_t)pq_retain_full_s * 1000000 ? PQ_SEG_LEVEL_COMPACT : PQ_SEG_LEVEL_FULL;
+    if (target > segs[j].level){
+      *i = j;
+      *level = target;
+      return RETAIN_COMPACT;
+    }
+  }
+  return RETAIN_NONE;
+}
+
+static void *pq_retainer(void *arg){
+  char path[128];
+  struct timeval now;
+  struct timespec deadline;
+  uint32_t i;
+  uint8_t level;
+  pq_trace_thread_name("retain");
+  pthread_mutex_lock(&retain_lock);
+  while (1){
+    gettimeofday(&now, NULL);
+    int work = retain_pick(tv_us(&now), &i, &level);
+    if (work == RETAIN_NONE){
+      if (!retain_running){
+        break;
+      }
+      // segments age without any new one closed
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += 1;
+      pthread_cond_timedwait(&retain_cond, &retain_lock, &deadline);
+      continue;
+    }
+    retain_segment_t s = segs[i];
+    pthread_mutex_unlock(&retain_lock);
+    int64_t bytes = -1;
+    if (work == RETAIN_DELETE){
+      segment_path(path, sizeof(path), s.mode, s.idx, s.first_us, "pqseg");
+      if (unlink(path) != 0){
+        printf("Error deleting %s: %s\n", path, strerror(errno));
+      }
+      PQ_TRACE(SEGMENT_DELETE, port_table[s.idx].port, s.level, s.bytes >> 10);
+    }else{
+      bytes = segment_compact(&s, level);
+      PQ_TRACE(SEGMENT_COMPACT, port_table[s.idx].port, level, s.bytes >> 10, bytes < 0 ? 0 : bytes >> 10);
+    }
+    pthread_mutex_lock(&retain_lock);
+    if (work == RETAIN_DELETE){
+      closed_bytes -= s.bytes;
+      memmove(&segs[i], &segs[i + 1], (seg_num - i - 1) * sizeof(retain_segment_t));
+      seg_num--;
+      delete_num += 1;
+    }else if (bytes >= 0){
+      closed_bytes = closed_bytes - s.bytes + bytes;
+      segs[i].bytes = bytes;
+      segs[i].level = level;
+      compact_num += 1;
+    }else{
+      // left as is, deleted first when over the budget
+      segs[i].level = PQ_SEG_LEVEL_SUMMARY;
+    }
+  }
+  pthread_mutex_unlock(&retain_lock);
+  return NULL;
+}
+
+int pq_retain_start(void){
+  retain_running = true;
+  if (pthread_create(&retain_thread, NULL, pq_retainer, NULL) != 0){
+    printf("Error creating the retention thread!\n");
+    retain_running = false;
+    return -1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Close the open segments once the writer is stopped, bring the
+// segments within the budget and stop the retention thread
+//----------------------------------------------------------------------
+void pq_retain_stop(void){
+  for (uint16_t i = 0; i < port_entry_num; i++){
+    if (open_file[i] != NULL){
+      segment_close(i);
+    }
+  }
+  pthread_mutex_lock(&retain_lock);
+  if (!retain_running){
+    pthread_mutex_unlock(&retain_lock);
+    return;
+  }
+  retain_running = false;
+  pthread_cond_signal(&retain_cond);
+  pthread_mutex_unlock(&retain_lock);
+  pthread_join(retain_thread, NULL);
+}
+
+void pq_retain_print_stats(void){
+  if (pq_retain){
+    uint32_t level_num[PQ_SEG_LEVEL_NUM] = {0};
+    for (uint32_t i = 0; i < seg_num; i++){
+      level_num[segs[i].level < PQ_SEG_LEVEL_NUM ? segs[i].level : PQ_SEG_LEVEL_SUMMARY]++;
+    }
+    printf("Retention: %u segments (%u full, %u compact, %u summary), %lu KB of %u MB, %lu compactions, %lu segments deleted\n",
+           seg_num, level_num[PQ_SEG_LEVEL_FULL], level_num[PQ_SEG_LEVEL_COMPACT], level_num[PQ_SEG_LEVEL_SUMMARY], closed_bytes >> 10, pq_retain_budget_mb, compact_num, delete_num);
+  }
+}
@@ -0,0 +1,75 @@
+/*************************************************************************
+	> File Name: rt.c
+  > Description: Real-time execution of the poller and the signal-receiving
+  >              thread: core pinning, SCHED_FIFO, locked memory
+*************************************************************************/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "printqueue.h"
+
+//----------------------------------------------------------------------
+// Lock all current and future pages of the process, so that no page
+// fault hits in the middle of a poll. The snapshot pool (pool.c) touches
+// its buffers once, so that they are backed by memory before the first poll.
+//----------------------------------------------------------------------
+int pq_rt_lock_memory(void){
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+    printf("RT: mlockall failed: %s\n", strerror(errno));
+    return -1;
+  }
+  printf("RT: memory locked\n");
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Pin the calling thread to core (core < 0: no pinning) and switch it to
+// SCHED_FIFO with the given priority.
+//----------------------------------------------------------------------
+int pq_rt_setup_thread(const char *name, int core, int priority){
+  int ret = 0;
+  if (core >= 0){
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0){
+      printf("RT: pinning %s thread to core %d failed\n", name, core);
+      ret = -1;
+    }
+  }
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0){
+    printf("RT: SCHED_FIFO (priority %d) for %s thread failed\n", priority, name);
+    ret = -1;
+  }
+  if (ret == 0){
+    printf("RT: %s thread runs on core %d with SCHED_FIFO priority %d\n", name, core, priority);
+  }
+  return ret;
+}
+
+//----------------------------------------------------------------------
+// Sleep for us microseconds on the monotonic clock, resuming after
+// interruptions by signals (USR1/USR2).
+//----------------------------------------------------------------------
+void pq_rt_sleep_us(uint32_t us){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  t.tv_sec += us / 1000000;
+  t.tv_nsec += (us % 1000000) * 1000;
+  if (t.tv_nsec >= 1000000000){
+    t.tv_sec += 1;
+    t.tv_nsec -= 1000000000;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR){
+    if (!loop_flag) break;
+  }
+}
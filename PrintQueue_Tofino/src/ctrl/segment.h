@@ -0,0 +1,96 @@
+/*************************************************************************
+	> File Name: segment.h
+  > Description: Layout of the segment files of continuous operation: the
+  >              snapshots of a port over a few seconds, compacted as they
+  >              age (retention.c)
+*************************************************************************/
+
+#ifndef _PQ_SEGMENT_H_
+#define _PQ_SEGMENT_H_
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// A segment (<tw|qm>_data/<port idx>/segments/<sec>_<usec>.pqseg, named
+// after its first snapshot) is a header followed by records, each a
+// pq_segment_record_t and size bytes of payload. The payload of a record
+// depends on its kind:
+//   * RAW: the snapshot file the writer stores without retention, count
+//     entries of every register (an empty payload marks an idle period)
+//   * CELLS: a filtered time windows snapshot (tw_cells.h)
+//   * SPARSE: the entries of a RAW snapshot holding any non-zero value:
+//     their index in the snapshot (uint32 x m), then the values of every
+//     register (uint32 x m, register 0 first), m = size / 4 / (registers
+//     + 1); the other entries are 0
+//   * SUMMARY: count pq_segment_flow_t, the entries (cells, slots) of
+//     every flow in the periodical snapshots named in
+//     [ts_us, ts_us + span_us)
+//   * SIGNAL: the signal file of a data plane query (signal_data/), named
+//     ts_us; flagged QUERY
+//   * META: interval_us, entries, stack_top (uint32 each) of a line of
+//     qm_meta.csv, named ts_us
+// A segment is rewritten as it ages, from level FULL (snapshots as read)
+// to COMPACT (RAW records made SPARSE where smaller) to SUMMARY
+// (periodical snapshots merged into summaries, data plane query
+// snapshots kept COMPACT). SIGNAL and META records are kept at every
+// level.
+// The header is written again when the segment is closed; readers walk
+// the records up to the end of the file, so an unclosed segment (crash)
+// stays readable.
+// All fields are little endian.
+//----------------------------------------------------------------------
+#define PQ_SEGMENT_MAGIC 0x47535150     // "PQSG"
+#define PQ_SEGMENT_VERSION 1
+
+enum pq_segment_level {
+  PQ_SEG_LEVEL_FULL = 0,
+  PQ_SEG_LEVEL_COMPACT,
+  PQ_SEG_LEVEL_SUMMARY,
+  PQ_SEG_LEVEL_NUM
+};
+
+enum pq_segment_kind {
+  PQ_SEG_RAW = 0,
+  PQ_SEG_CELLS,
+  PQ_SEG_SPARSE,
+  PQ_SEG_SUMMARY,
+  PQ_SEG_SIGNAL,
+  PQ_SEG_META,
+  PQ_SEG_KIND_NUM
+};
+
+// flags of a record
+#define PQ_SEG_QUERY 0x1                // data plane query snapshot, or its signal
+#define PQ_SEG_WRAP 0x2                 // queue monitor: seq number overflow (<sec>_<usec>_1.bin)
+
+typedef struct pq_segment_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;           // sizeof(pq_segment_header_t)
+  uint8_t mode;                   // pq_mode_t of the port
+  uint8_t level;                  // pq_segment_level
+  uint16_t idx;                   // port index (data folder)
+  uint32_t record_num;            // 0 until the segment is closed
+  uint32_t pad;
+  int64_t first_us;               // name of the first snapshot, sec * 10^6 + usec
+  int64_t last_us;                // name of the latest snapshot, 0 until closed
+} pq_segment_header_t;
+
+typedef struct pq_segment_record {
+  uint32_t size;                  // bytes of the payload
+  uint8_t kind;                   // pq_segment_kind
+  uint8_t flags;
+  uint16_t registers;             // RAW, SPARSE: registers of the snapshot
+  uint32_t count;                 // RAW, SPARSE: entries per register; CELLS: cells; SUMMARY: flows
+  uint32_t span_us;               // SUMMARY: length of the interval
+  int64_t ts_us;                  // name of the snapshot, start of the interval of a SUMMARY
+  int64_t host_ns;                // host monotonic time of the reading (clock.h), of the first one of a SUMMARY
+} pq_segment_record_t;
+
+typedef struct pq_segment_flow {
+  uint32_t src_ip;                // flow ID, as stored in the registers
+  uint32_t dst_ip;
+  uint32_t count;
+} pq_segment_flow_t;
+
+#endif
@@ -0,0 +1,124 @@
+/*************************************************************************
+	> File Name: stats.c
+  > Description: Shared memory page of the per-phase latency histograms
+  >              and counters of the pollers
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "printqueue.h"
+
+// the page layout (stats.h) is shared with the scraper, which does not
+// include printqueue.h: it keeps its own bound of the ports
+_Static_assert(PQ_STATS_MAX_PORTS >= MAX_PORT_NUM, "PQ_STATS_MAX_PORTS of stats.h is smaller than MAX_PORT_NUM");
+
+// counted in a private page until pq_stats_init maps the shared one
+static pq_stats_page_t pq_stats_private;
+pq_stats_page_t *pq_stats = &pq_stats_private;
+const char *pq_stats_name = "/printqueue_stats";
+
+pq_stats_pending_t pq_stats_pending;
+
+static pq_port_stats_t *cur_block = NULL;
+static pq_stats_kind_t cur_kind;
+static const char *shm_name = NULL;
+
+static void pq_stats_header(pq_stats_page_t *s){
+  struct timespec rt;
+  clock_gettime(CLOCK_REALTIME, &rt);
+  s->magic = PQ_STATS_MAGIC;
+  s->version = PQ_STATS_VERSION;
+  s->size = sizeof(pq_stats_page_t);
+  s->pid = getpid();
+  s->kind_num = PQ_KIND_NUM;
+  s->phase_num = PQ_PHASE_NUM;
+  s->counter_num = PQ_CNT_NUM;
+  s->bucket_num = PQ_HIST_BUCKETS;
+  s->start_realtime_ns = (uint64_t)rt.tv_sec * 1000000000 + rt.tv_nsec;
+}
+
+// ports of the page, once port_isolation.csv is loaded
+void pq_stats_set_ports(void){
+  for (uint16_t i = 0; i < port_entry_num && i < PQ_STATS_MAX_PORTS; i++){
+    pq_stats->port[i].port = port_table[i].port;
+    pq_stats->port[i].iso_id = port_table[i].isolation_id;
+    pq_stats->port[i].mode = port_table[i].mode;
+  }
+  __atomic_store_n(&pq_stats->port_num, port_entry_num < PQ_STATS_MAX_PORTS ? port_entry_num : PQ_STATS_MAX_PORTS, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------
+// Map the shared page /dev/shm<name> for scrapers. Without a name (or
+// when the mapping fails), the statistics stay in the private page.
+//----------------------------------------------------------------------
+int pq_stats_init(const char *name){
+  memset(&pq_stats_private, 0, sizeof(pq_stats_private));
+  pq_stats = &pq_stats_private;
+  if (name != NULL){
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0){
+      printf("Warning: shm_open %s failed, statistics are not shared!\n", name);
+    }else if (ftruncate(fd, sizeof(pq_stats_page_t)) != 0){
+      printf("Warning: ftruncate %s failed, statistics are not shared!\n", name);
+      close(fd);
+      shm_unlink(name);
+    }else{
+      void *m = mmap(NULL, sizeof(pq_stats_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (m == MAP_FAILED){
+        printf("Warning: mmap %s failed, statistics are not shared!\n", name);
+        shm_unlink(name);
+      }else{
+        pq_stats = m;
+        shm_name = name;
+        printf("Statistics are shared in /dev/shm%s\n", name);
+      }
+    }
+  }
+  pq_stats_header(pq_stats);
+  return 0;
+}
+
+void pq_stats_close(void){
+  if (shm_name != NULL){
+    munmap(pq_stats, sizeof(pq_stats_page_t));
+    shm_unlink(shm_name);
+    shm_name = NULL;
+  }
+  pq_stats = &pq_stats_private;
+}
+
+void pq_stats_begin(uint16_t idx, pq_stats_kind_t kind){
+  cur_block = idx < PQ_STATS_MAX_PORTS ? &pq_stats->port[idx] : NULL;
+  cur_kind = kind;
+  memset(&pq_stats_pending, 0, sizeof(pq_stats_pending));
+}
+
+// add the samples of the finished poll to the block of its port
+void pq_stats_end(void){
+  pq_port_stats_t *b = cur_block;
+  if (b == NULL){
+    return;
+  }
+  __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (uint32_t i = 0; i < pq_stats_pending.num; i++){
+    pq_phase_stats_t *ps = &b->phase[cur_kind][pq_stats_pending.phase[i]];
+    uint64_t ns = pq_stats_pending.ns[i];
+    ps->count += 1;
+    ps->total_ns += ns;
+    if (ns > ps->max_ns){
+      ps->max_ns = ns;
+    }
+    ps->hist[pq_stats_bucket(ns)] += 1;
+  }
+  for (int c = 0; c < PQ_CNT_NUM; c++){
+    b->counter[c] += pq_stats_pending.counter[c];
+  }
+  __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELEASE);
+  cur_block = NULL;
+}
@@ -0,0 +1,166 @@
+/*************************************************************************
+	> File Name: stats.h
+  > Description: Per-phase latency histograms and counters of the pollers,
+  >              kept in a shared memory page (stats.c) that pq_stats
+  >              scrapes while the control plane runs
+*************************************************************************/
+
+#ifndef _PQ_STATS_H_
+#define _PQ_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+//----------------------------------------------------------------------
+// Phases of a periodical poll or of a data plane query, in ns.
+// REG_READ and REPACK are measured per register by the backend.
+//----------------------------------------------------------------------
+#define PQ_STATS_PHASES(X) \
+  X(ACTIVE,   "active",   "idle check of the port (packet counter register)") \
+  X(FLIP,     "flip",     "table modify of the second highest bit") \
+  X(LIVE,     "live",     "stack top read (queue monitor)") \
+  X(READ,     "read",     "range read of all registers") \
+  X(REG_READ, "reg_read", "range query of one register, HW sync included") \
+  X(REPACK,   "repack",   "copy of one register to the snapshot layout") \
+  X(FILTER,   "filter",   "stale slot filter (queue monitor)") \
+  X(RESET,    "reset",    "register reset after read (queue monitor)") \
+  X(PERSIST,  "persist",  "hand-off of the snapshot to the writer thread") \
+  X(UNLOCK,   "unlock",   "data plane query unlock") \
+  X(TOTAL,    "total",    "whole poll, or signal to the end of the query")
+
+#define PQ_STATS_COUNTERS(X) \
+  X(POLLS,           "polls") \
+  X(SKIPS,           "skips") \
+  X(DEADLINE_MISSES, "deadline_misses") \
+  X(OVERRUNS,        "overruns") \
+  X(QUERIES,         "queries") \
+  X(QUERY_CHUNKS,    "query_chunks") \
+  X(ENTRIES_READ,    "entries_read") \
+  X(BYTES_WRITTEN,   "bytes_written") \
+  X(POOL_WAITS,      "pool_waits")
+
+#define PQ_STATS_PHASE_ID(ph, name, desc) PQ_PHASE_##ph,
+typedef enum pq_phase {
+  PQ_STATS_PHASES(PQ_STATS_PHASE_ID)
+  PQ_PHASE_NUM
+} pq_phase_t;
+#undef PQ_STATS_PHASE_ID
+
+#define PQ_STATS_COUNTER_ID(c, name) PQ_CNT_##c,
+typedef enum pq_counter {
+  PQ_STATS_COUNTERS(PQ_STATS_COUNTER_ID)
+  PQ_CNT_NUM
+} pq_counter_t;
+#undef PQ_STATS_COUNTER_ID
+
+// periodical polls run in the mode of the port, data plane queries apart
+typedef enum pq_stats_kind {
+  PQ_KIND_POLL = 0,
+  PQ_KIND_QUERY = 1,
+  PQ_KIND_NUM
+} pq_stats_kind_t;
+
+//----------------------------------------------------------------------
+// Histogram bucket b holds latencies in [2^b, 2^(b+1)) ns, bucket 0 also
+// holds 0 ns, the last bucket everything above 2^31 ns.
+//----------------------------------------------------------------------
+#define PQ_HIST_BUCKETS 32
+typedef struct pq_phase_stats {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t hist[PQ_HIST_BUCKETS];
+} pq_phase_stats_t;
+
+//----------------------------------------------------------------------
+// Block of a port, written by the poll thread only. seq is a seqlock:
+// odd while the block is updated. A reader copies the block and retries
+// when seq was odd or changed during the copy.
+//----------------------------------------------------------------------
+typedef struct pq_port_stats {
+  uint32_t seq;
+  uint16_t port;
+  uint16_t iso_id;
+  uint32_t mode;
+  uint32_t pad;
+  uint64_t counter[PQ_CNT_NUM];
+  pq_phase_stats_t phase[PQ_KIND_NUM][PQ_PHASE_NUM];
+} pq_port_stats_t;
+
+#define PQ_STATS_MAGIC 0x54535150   // "PQST"
+#define PQ_STATS_VERSION 2
+#define PQ_STATS_MAX_PORTS 16       // at least MAX_PORT_NUM of printqueue.h (checked in stats.c)
+typedef struct pq_stats_page {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;                    // bytes of the page
+  uint32_t pid;
+  uint32_t port_num;
+  uint32_t kind_num;
+  uint32_t phase_num;
+  uint32_t counter_num;
+  uint32_t bucket_num;
+  uint32_t pad;
+  uint64_t start_realtime_ns;
+  // written by the signal-receiving thread, atomic 64-bit counters
+  uint64_t signals;
+  uint64_t signal_overflows;
+  pq_port_stats_t port[PQ_STATS_MAX_PORTS];
+} pq_stats_page_t;
+
+extern pq_stats_page_t *pq_stats;
+extern const char *pq_stats_name;   // shared memory object of pq_start (shm_open), NULL: private
+
+int pq_stats_init(const char *name);
+void pq_stats_set_ports(void);
+void pq_stats_close(void);
+void pq_stats_begin(uint16_t idx, pq_stats_kind_t kind);
+void pq_stats_end(void);
+
+//----------------------------------------------------------------------
+// Samples of the running poll are kept aside and added to the block of
+// its port at pq_stats_end, so that a block is only locked for a short
+// copy instead of the whole poll.
+//----------------------------------------------------------------------
+#define PQ_STATS_PENDING 64
+typedef struct pq_stats_pending {
+  uint32_t num;
+  uint8_t phase[PQ_STATS_PENDING];
+  uint64_t ns[PQ_STATS_PENDING];
+  uint64_t counter[PQ_CNT_NUM];
+} pq_stats_pending_t;
+
+extern pq_stats_pending_t pq_stats_pending;
+
+static inline uint64_t pq_stats_now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static inline void pq_stats_add(pq_phase_t phase, uint64_t ns){
+  if (pq_stats_pending.num < PQ_STATS_PENDING){
+    pq_stats_pending.phase[pq_stats_pending.num] = phase;
+    pq_stats_pending.ns[pq_stats_pending.num] = ns;
+    pq_stats_pending.num += 1;
+  }
+}
+
+// close the phase started at start_ns, returns the end, start of the next phase
+static inline uint64_t pq_stats_phase(pq_phase_t phase, uint64_t start_ns){
+  uint64_t now = pq_stats_now();
+  pq_stats_add(phase, now - start_ns);
+  return now;
+}
+
+static inline void pq_stats_count(pq_counter_t c, uint64_t n){
+  pq_stats_pending.counter[c] += n;
+}
+
+static inline uint32_t pq_stats_bucket(uint64_t ns){
+  uint32_t b = ns ? 63 - __builtin_clzll(ns) : 0;
+  return b < PQ_HIST_BUCKETS ? b : PQ_HIST_BUCKETS - 1;
+}
+
+#endif
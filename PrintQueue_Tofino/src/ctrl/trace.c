@@ -0,0 +1,163 @@
+/*************************************************************************
+	> File Name: trace.c
+  > Description: Registration of the per-thread trace rings and the
+  >              background thread draining them to the trace file
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define PQ_TRACE_MAX_THREADS 16
+#define PQ_TRACE_DRAIN_US 1000
+
+_Atomic bool pq_trace_on = false;
+__thread pq_trace_ring_t *pq_trace_ring = NULL;
+static __thread const char *pq_trace_name = NULL;
+
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pq_trace_ring_t *rings[PQ_TRACE_MAX_THREADS];
+static uint32_t ring_num = 0;
+
+static FILE *trace_f = NULL;
+static pthread_t drain_thread;
+static volatile bool drain_running = false;
+static uint64_t drained_num = 0;
+
+//----------------------------------------------------------------------
+// Ring of the calling thread, allocated when the thread is named at its
+// start (pq_trace_thread_name), or else at its first event. Its pages are
+// touched here, not in the first timed poll. The first record of a ring
+// is the name of the thread.
+//----------------------------------------------------------------------
+pq_trace_ring_t *pq_trace_ring_init(void){
+  pthread_mutex_lock(&ring_lock);
+  if (ring_num == PQ_TRACE_MAX_THREADS){
+    pthread_mutex_unlock(&ring_lock);
+    return NULL;
+  }
+  pq_trace_ring_t *r = malloc(sizeof(pq_trace_ring_t));
+  if (r == NULL){
+    pthread_mutex_unlock(&ring_lock);
+    return NULL;
+  }
+  memset(r, 0, sizeof(pq_trace_ring_t));
+  r->tid = ring_num;
+  rings[ring_num] = r;
+  __atomic_store_n(&ring_num, ring_num + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&ring_lock);
+  pq_trace_ring = r;
+
+  uint32_t name[PQ_TRACE_ARG_NUM] = {0};
+  char tmp[16];
+  if (pq_trace_name == NULL){
+    sprintf(tmp, "thread-%d", r->tid);
+  }
+  strncpy((char *)name, pq_trace_name ? pq_trace_name : tmp, sizeof(name) - 1);
+  pq_trace_emit(PQ_EV_THREAD, name[0], name[1], name[2], name[3], name[4]);
+  return r;
+}
+
+// name the calling thread in the trace and allocate its ring, at the
+// start of the thread
+void pq_trace_thread_name(const char *name){
+  pq_trace_name = name;
+  if (__atomic_load_n(&pq_trace_on, __ATOMIC_RELAXED) && pq_trace_ring == NULL){
+    pq_trace_ring_init();
+  }
+}
+
+//----------------------------------------------------------------------
+// Drainer: copies the records of every ring to the file, then releases
+// them to the producer.
+//----------------------------------------------------------------------
+static void pq_trace_drain(void){
+  uint32_t n = __atomic_load_n(&ring_num, __ATOMIC_ACQUIRE);
+  for (uint32_t i = 0; i < n; i++){
+    pq_trace_ring_t *r = rings[i];
+    uint32_t tail = r->tail;
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    while (tail != head){
+      uint32_t start = tail & (PQ_TRACE_RING_SIZE - 1);
+      uint32_t num = head - tail;
+      if (start + num > PQ_TRACE_RING_SIZE){
+        num = PQ_TRACE_RING_SIZE - start;
+      }
+      fwrite(&r->rec[start], sizeof(pq_trace_rec_t), num, trace_f);
+      tail += num;
+      drained_num += num;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+static void *pq_trace_drain_thread(void *arg){
+  (void)arg;
+  while (drain_running){
+    pq_trace_drain();
+    usleep(PQ_TRACE_DRAIN_US);
+  }
+  pq_trace_drain();
+  return NULL;
+}
+
+// ticks of pq_trace_clock per second, measured over 20 ms
+static uint64_t pq_trace_calibrate(uint64_t *tsc0, uint64_t *realtime_ns0){
+  struct timespec m0, m1, rt;
+  clock_gettime(CLOCK_REALTIME, &rt);
+  clock_gettime(CLOCK_MONOTONIC, &m0);
+  *tsc0 = pq_trace_clock();
+  *realtime_ns0 = (uint64_t)rt.tv_sec * 1000000000 + rt.tv_nsec;
+  usleep(20000);
+  clock_gettime(CLOCK_MONOTONIC, &m1);
+  uint64_t tsc1 = pq_trace_clock();
+  uint64_t ns = (uint64_t)(m1.tv_sec - m0.tv_sec) * 1000000000 + m1.tv_nsec - m0.tv_nsec;
+  return (double)(tsc1 - *tsc0) * 1e9 / ns;
+}
+
+int pq_trace_start(const char *path){
+  pq_trace_file_header_t hdr;
+  trace_f = fopen(path, "wb");
+  if (trace_f == NULL){
+    printf("Error opening %s!\n", path);
+    return -1;
+  }
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, PQ_TRACE_MAGIC, 8);
+  hdr.rec_size = sizeof(pq_trace_rec_t);
+  hdr.level = PQ_TRACE_LEVEL;
+  hdr.tsc_hz = pq_trace_calibrate(&hdr.tsc0, &hdr.realtime_ns0);
+  fwrite(&hdr, sizeof(hdr), 1, trace_f);
+  drained_num = 0;
+  drain_running = true;
+  if (pthread_create(&drain_thread, NULL, &pq_trace_drain_thread, NULL) != 0){
+    printf("Error: creation of trace thread failed!\n");
+    drain_running = false;
+    fclose(trace_f);
+    trace_f = NULL;
+    return -1;
+  }
+  __atomic_store_n(&pq_trace_on, true, __ATOMIC_RELEASE);
+  printf("Trace: events up to level %d are logged to %s\n", PQ_TRACE_LEVEL, path);
+  return 0;
+}
+
+void pq_trace_stop(void){
+  uint64_t dropped = 0;
+  if (!drain_running){
+    return;
+  }
+  __atomic_store_n(&pq_trace_on, false, __ATOMIC_RELEASE);
+  drain_running = false;
+  pthread_join(drain_thread, NULL);
+  fclose(trace_f);
+  trace_f = NULL;
+  for (uint32_t i = 0; i < ring_num; i++){
+    dropped += rings[i]->dropped;
+  }
+  printf("Trace: %lu events logged, %lu dropped on full rings\n", drained_num, dropped);
+}
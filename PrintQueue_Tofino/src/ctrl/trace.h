@@ -0,0 +1,154 @@
+/*************************************************************************
+	> File Name: trace.h
+  > Description: Binary event log of the control plane: per-thread
+  >              lock-free rings of fixed-size records, drained to a file
+  >              by a background thread (trace.c), decoded by
+  >              pq_trace_decode.c
+*************************************************************************/
+
+#ifndef _PQ_TRACE_H_
+#define _PQ_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+//----------------------------------------------------------------------
+// Events of the control plane.
+//   level:  events above PQ_TRACE_LEVEL are removed at compile time
+//   phase:  Chrome trace phase: B/E begin/end on the thread, b/e async
+//           begin/end (id = first argument), i instant, M metadata
+//   args:   names of the arguments, separated by spaces
+//   format: text of the decoder: %u unsigned, %d signed, %I IPv4 (host order),
+//           %M mode (tw / qm), %s thread name
+//----------------------------------------------------------------------
+#define PQ_TRACE_EVENTS(X) \
+  /*  event              level phase  name                args                         format */ \
+  X(THREAD,               0,  'M', "thread_name",       "name",                      "thread %s") \
+  X(POLL_BEGIN,           1,  'B', "poll",              "port mode h sh",            "periodical reading - port %u (%M), h: %u, sh: %u") \
+  X(POLL_READ,            2,  'i', "poll_read",         "port entries",              "port %u reads %u entries") \
+  X(POLL_END,             1,  'E', "poll",              "port latency_us next_us",   "port %u periodical poll finishes in %u us, next poll in %u us") \
+  X(POLL_SKIP,            1,  'i', "poll_skip",         "port",                      "port %u is idle, skip the periodical poll") \
+  X(DEADLINE_MISS,        1,  'i', "deadline_miss",     "port late_us",              "port %u poll starts %u us late") \
+  X(QM_STALE,             2,  'i', "qm_stale",          "port slots",                "port %u clears %u stale slots") \
+  X(POOL_WAIT,            1,  'i', "pool_wait",         "wait_us",                   "no free snapshot buffer, waits %u us for the writer") \
+  X(SNAPSHOT,             2,  'i', "snapshot",          "port mode entries sec usec","port %u (%M) stores %u entries in %u_%u") \
+  X(SIGNAL_RECV,          1,  'i', "signal",            "port type iso src_ip dst_ip","port %u data plane query signal - type: %u, iso_id: %u, src_ip: %I, dst_ip: %I") \
+  X(SIGNAL_OVERFLOW,      0,  'i', "signal_overflow",   "iso",                       "iso_id %u: data signal queue overflows") \
+  X(SIGNAL_STORE,         2,  'i', "signal_store",      "port type iso h sh",        "port %u stores signal type %u, iso_id: %u, h: %u, sh: %u") \
+  X(SIGNAL_QUEUE_EMPTY,   3,  'i', "signal_queue_empty","iso",                       "iso_id %u: last query done, data signal queue is empty") \
+  X(QUERY_BEGIN,          1,  'b', "query",             "iso port h sh",             "iso_id %u: data plane query of port %u begins, h: %u, sh: %u") \
+  X(QUERY_CHUNK,          2,  'i', "query_chunk",       "port entries available_us", "port %u reads %u entries, %d us available") \
+  X(QUERY_WAIT,           3,  'i', "query_wait",        "port available_us",         "port %u waits to store the query, %d us available") \
+  X(QUERY_SLACK,          3,  'i', "query_slack",       "available_us",              "%d us left till next periodical poll") \
+  X(QUERY_END,            1,  'e', "query",             "iso port latency_us",       "iso_id %u: data plane query of port %u finishes, %u us after the signal") \
+  X(RECORDER_EVENT,       1,  'i', "recorder_event",    "port stored dropped",       "port %u: flight recorder event, stores %u snapshots, drops %u older ones") \
+  X(SEGMENT_CLOSE,        1,  'i', "segment_close",     "port records kb",           "port %u closes a segment of %u snapshots, %u KB") \
+  X(SEGMENT_COMPACT,      1,  'i', "segment_compact",   "port level kb new_kb",      "port %u: segment compacted to level %u, %u KB to %u KB") \
+  X(SEGMENT_DELETE,       1,  'i', "segment_delete",    "port level kb",             "port %u: segment of level %u deleted, %u KB freed") \
+  X(WARM_RESUME,          1,  'i', "warm_resume",       "port h sh kept lost",       "port %u resumes, h: %u, sh: %u, prepare entry kept: %u, query lost: %u") \
+  X(THRESHOLD_RELOAD,     1,  'i', "threshold_reload",  "added modified deleted kept us", "qdepth_threshold table reloaded: %u added, %u modified, %u deleted, %u kept in %u us")
+
+#ifndef PQ_TRACE_LEVEL
+#define PQ_TRACE_LEVEL 2
+#endif
+
+#define PQ_TRACE_ID(ev, level, phase, name, args, fmt) PQ_EV_##ev,
+typedef enum pq_trace_id {
+  PQ_TRACE_EVENTS(PQ_TRACE_ID)
+  PQ_EV_NUM
+} pq_trace_id_t;
+#undef PQ_TRACE_ID
+
+#define PQ_TRACE_LEVELS(ev, level, phase, name, args, fmt) pq_trace_level_##ev = level,
+enum {
+  PQ_TRACE_EVENTS(PQ_TRACE_LEVELS)
+};
+#undef PQ_TRACE_LEVELS
+
+//----------------------------------------------------------------------
+// Record of an event: 32 bytes, timestamp in ticks of pq_trace_clock.
+// Trace file: pq_trace_file_header_t, then records in the order they are
+// drained (per thread in order, threads interleaved by chunks).
+//----------------------------------------------------------------------
+#define PQ_TRACE_ARG_NUM 5
+typedef struct pq_trace_rec {
+  uint64_t tsc;
+  uint16_t id;
+  uint16_t tid;
+  uint32_t arg[PQ_TRACE_ARG_NUM];
+} pq_trace_rec_t;
+
+#define PQ_TRACE_MAGIC "PQTRACE1"
+typedef struct pq_trace_file_header {
+  char magic[8];
+  uint32_t rec_size;
+  uint32_t level;
+  uint64_t tsc_hz;          // ticks per second
+  uint64_t tsc0;            // ticks at the start of the trace
+  uint64_t realtime_ns0;    // wall clock at tsc0
+} pq_trace_file_header_t;
+
+#define PQ_TRACE_RING_SIZE 16384   // records per thread, power of 2
+typedef struct pq_trace_ring {
+  uint32_t head;            // written by the thread
+  uint32_t tail;            // written by the drainer
+  uint16_t tid;
+  uint64_t dropped;
+  pq_trace_rec_t rec[PQ_TRACE_RING_SIZE];
+} pq_trace_ring_t;
+
+extern _Atomic bool pq_trace_on;
+extern __thread pq_trace_ring_t *pq_trace_ring;
+
+pq_trace_ring_t *pq_trace_ring_init(void);
+void pq_trace_thread_name(const char *name);
+int pq_trace_start(const char *path);
+void pq_trace_stop(void);
+
+static inline uint64_t pq_trace_clock(void){
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+static inline void pq_trace_emit(uint16_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4){
+  if (!__atomic_load_n(&pq_trace_on, __ATOMIC_RELAXED)){
+    return;
+  }
+  pq_trace_ring_t *r = pq_trace_ring ? pq_trace_ring : pq_trace_ring_init();
+  if (r == NULL){
+    return;
+  }
+  uint32_t head = r->head;
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == PQ_TRACE_RING_SIZE){
+    r->dropped += 1;
+    return;
+  }
+  pq_trace_rec_t *rec = &r->rec[head & (PQ_TRACE_RING_SIZE - 1)];
+  rec->tsc = pq_trace_clock();
+  rec->id = id;
+  rec->tid = r->tid;
+  rec->arg[0] = a0;
+  rec->arg[1] = a1;
+  rec->arg[2] = a2;
+  rec->arg[3] = a3;
+  rec->arg[4] = a4;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------
+// PQ_TRACE(EVENT, args...): up to 5 uint32 arguments. The level test is
+// a constant, so events above PQ_TRACE_LEVEL compile to nothing.
+//----------------------------------------------------------------------
+#define PQ_TRACE_ARGS(a0, a1, a2, a3, a4, ...) (a0), (a1), (a2), (a3), (a4)
+#define PQ_TRACE(ev, ...) do { \
+    if (pq_trace_level_##ev <= PQ_TRACE_LEVEL) \
+      pq_trace_emit(PQ_EV_##ev, PQ_TRACE_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0)); \
+  } while (0)
+
+#endif
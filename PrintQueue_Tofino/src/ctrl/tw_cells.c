@@ -0,0 +1,252 @@
+/*************************************************************************
+	> File Name: tw_cells.c
+  > Description: Stale cell filter and timestamp unwrapping of time windows
+  >              snapshots at capture time (filter_TW of TimeWindows.py)
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "printqueue.h"
+
+// per port: latest tts of TW0 seen so far, overflows included, and the
+// host monotonic time of its set
+static int64_t tw_latest[MAX_PORT_NUM], tw_latest_host[MAX_PORT_NUM];
+static bool tw_latest_valid[MAX_PORT_NUM];
+
+static int64_t *cell_ts = NULL;
+static pq_tw_cell_t *cells = NULL;
+static uint32_t cells_size = 0;
+static uint64_t dropped_num = 0;
+
+// parameters of the sets of this run (pq_tw_cells_init)
+static pq_tw_params_t tw_params;
+
+static inline int64_t tw_cell_ts(int64_t tts, uint32_t twid, int32_t wrap){
+  return pq_tw_cell_ts(&tw_params, tts, twid, wrap);
+}
+
+//----------------------------------------------------------------------
+// Reset the wrap tracking of every port and size the cell array for
+// 2^k cells x T windows. Called before the writer starts.
+//----------------------------------------------------------------------
+int pq_tw_cells_init(void){
+  if (T > PQ_TW_MAX_WINDOWS){
+    printf("Error: at most %d time windows are supported by the filtered snapshots!\n", PQ_TW_MAX_WINDOWS);
+    return -1;
+  }
+  memset(tw_latest_valid, 0, sizeof(tw_latest_valid));
+  tw_params.k = k;
+  tw_params.T = T;
+  tw_params.alpha = a;
+  tw_params.tb0 = TB0;
+  dropped_num = 0;
+  if (cells_size < cell_number * T){
+    free(cell_ts);
+    free(cells);
+    cells_size = cell_number * T;
+    cell_ts = malloc(cells_size * sizeof(int64_t));
+    cells = malloc(cells_size * sizeof(pq_tw_cell_t));
+    if (cell_ts == NULL || cells == NULL){
+      printf("Error allocating the filtered time windows cells!\n");
+      free(cell_ts);
+      free(cells);
+      cell_ts = NULL;
+      cells = NULL;
+      cells_size = 0;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Latest cell of a set (largest tts of TW0, its index and overflows), the
+// wrap tracking of the port moved up to it. False for a set without any
+// flow ID, which leaves the tracking as is.
+//----------------------------------------------------------------------
+static bool tw_latest_cell(uint16_t idx, int64_t host_ns, const uint32_t *reg, uint32_t n, int64_t *largest_tts, uint32_t *largest_index, int32_t *wrap_num){
+  int64_t tts_bit = 32 - TB0;
+  int64_t largest, unwrapped;
+  int32_t wrapping = 0;
+  bool fresh;
+
+  if (!pq_tw_largest(&tw_params, reg, &largest, largest_index)){
+    return false;
+  }
+  // 2^31 ns after the latest set of the port, the switch clock tells the
+  // overflows instead (idle port, snapshots not stored by the recorder)
+  fresh = tw_latest_valid[idx] && host_ns - tw_latest_host[idx] < (1LL << 31);
+  if (!fresh && pq_clock_unwrap(host_ns, (uint32_t)(largest << TB0), &unwrapped)){
+    wrapping = unwrapped >> 32;
+  }else if (tw_latest_valid[idx]){
+    wrapping = pq_tw_nearest_wrap(&tw_params, tw_latest[idx], largest);
+  }
+  if (!tw_latest_valid[idx] || ((int64_t)wrapping << tts_bit) + largest > tw_latest[idx]){
+    tw_latest[idx] = ((int64_t)wrapping << tts_bit) + largest;
+    tw_latest_host[idx] = host_ns;
+    tw_latest_valid[idx] = true;
+  }
+  *largest_tts = largest;
+  *wrap_num = wrapping;
+  return true;
+}
+
+// a valid cell into the cell array; the oldest cell of the set is the
+// first one of the last half walked
+typedef struct tw_filter_ctx {
+  pq_tw_cells_header_t *h;
+  uint32_t num;
+  int64_t smallest;
+  uint32_t smallest_twid;
+  int32_t smallest_wrap;
+} tw_filter_ctx_t;
+
+static void tw_filter_cell(void *ctx, uint32_t twid, int64_t tts, int64_t wrap, uint32_t src, uint32_t dst, bool first){
+  tw_filter_ctx_t *c = ctx;
+  cell_ts[c->num] = tw_cell_ts(tts, twid, wrap);
+  cells[c->num].src_ip = src;
+  cells[c->num].dst_ip = dst;
+  c->num++;
+  c->h->window_cells[twid]++;
+  if (first){
+    c->smallest = tts;
+    c->smallest_twid = twid;
+    c->smallest_wrap = wrap;
+  }
+}
+
+//----------------------------------------------------------------------
+// Filter a set of n = 2^k cells x T windows (pq_tw_valid_cells, tw_cells.h):
+//   * the largest tts of TW0 is the latest cell of the set
+//   * the overflows of the latest cell are the ones putting it nearest to
+//     the latest cell of the port so far. Counting an overflow whenever
+//     the largest tts drops across sets (filter_TW) counts one per
+//     data plane query snapshot around an overflow, as those are older
+//     than the periodical snapshot read before them
+// Sets without any flow ID are skipped and leave the wrap tracking as is.
+// The first set of a port takes its overflows from the switch clock
+// (clock.h), so that all ports and signals agree; without any mapping yet,
+// it has no overflow. So does a set read long after the previous one.
+// Returns the number of valid cells, stored in the cell array.
+//----------------------------------------------------------------------
+static uint32_t pq_tw_filter(uint16_t idx, int64_t host_ns, const uint8_t *buf, uint32_t n, pq_tw_cells_header_t *h){
+  const uint32_t *reg = (const uint32_t *)buf;
+  tw_filter_ctx_t c = {.h = h};
+  int64_t largest;
+  uint32_t largest_idx;
+  int32_t wrapping;
+
+  if (!tw_latest_cell(idx, host_ns, reg, n, &largest, &largest_idx, &wrapping)){
+    return 0;
+  }
+  h->lts = tw_cell_ts(largest, 0, wrapping);
+  h->wrap = wrapping;
+  memset(h->window_cells, 0, sizeof(h->window_cells));
+  pq_tw_valid_cells(&tw_params, reg, largest, largest_idx, wrapping, tw_filter_cell, &c);
+  if (c.num == 0){
+    return 0;
+  }
+  h->sts = tw_cell_ts(c.smallest, c.smallest_twid, c.smallest_wrap);
+  h->smallest_twid = c.smallest_twid;
+  h->base = cell_ts[0];
+  for (uint32_t j = 1; j < c.num; j++){
+    if (cell_ts[j] < h->base){
+      h->base = cell_ts[j];
+    }
+  }
+  return c.num;
+}
+
+//----------------------------------------------------------------------
+// Flow IDs of the valid cells of a raw set of n = 2^k cells x windows,
+// without timestamps nor wrap tracking (retention summaries, retention.c)
+//----------------------------------------------------------------------
+typedef struct tw_flow_ctx {
+  void (*flow)(uint32_t src_ip, uint32_t dst_ip);
+} tw_flow_ctx_t;
+
+static void tw_flow_cell(void *ctx, uint32_t twid, int64_t tts, int64_t wrap, uint32_t src, uint32_t dst, bool first){
+  ((tw_flow_ctx_t *)ctx)->flow(src, dst);
+}
+
+int pq_tw_valid_flows(const uint8_t *buf, uint32_t n, uint32_t windows, void (*flow)(uint32_t src_ip, uint32_t dst_ip)){
+  const uint32_t *reg = (const uint32_t *)buf;
+  tw_flow_ctx_t c = {.flow = flow};
+  pq_tw_params_t p = {n ? __builtin_ctz(n) : 0, windows, a, TB0};
+  int64_t largest;
+  uint32_t largest_idx;
+  if (n == 0 || (n & (n - 1)) || windows == 0 || windows > PQ_TW_MAX_WINDOWS){
+    return -1;
+  }
+  if (pq_tw_largest(&p, reg, &largest, &largest_idx)){
+    pq_tw_valid_cells(&p, reg, largest, largest_idx, 0, tw_flow_cell, &c);
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// Store the valid cells of a snapshot, instead of its raw registers, in
+// <sec>_<usec>.cells (tw_cells.h), or a record of the segment of the port
+// with retention (retention.c). Runs on the writer thread, in the
+// order of the readings, which the wrap tracking relies on. The latest
+// cell of a periodical set is a sample of the switch clock at host_ns;
+// a data plane query set is older than its reading, its signal is the
+// sample instead.
+//----------------------------------------------------------------------
+int pq_tw_cells_persist(uint16_t idx, const char *path, const struct timeval *ts, int64_t host_ns, const uint8_t *buf, uint32_t count, bool data_query){
+  pq_tw_cells_header_t h;
+  uint32_t num = 0, kept = 0;
+  memset(&h, 0, sizeof(h));
+  if (count == cell_number && cells != NULL){
+    num = pq_tw_filter(idx, host_ns, buf, count, &h);
+    if (num && !data_query){
+      pq_clock_add(host_ns, h.lts);
+    }
+  }
+  if (num){
+    // a set spans less than 2^32 ns, cells further away are dropped
+    uint32_t c = 0;
+    for (uint32_t w = 0; w < T; w++){
+      uint32_t wn = h.window_cells[w];
+      h.window_cells[w] = 0;
+      for (uint32_t i = 0; i < wn; i++, c++){
+        if (cell_ts[c] - h.base > UINT32_MAX){
+          dropped_num += 1;
+          continue;
+        }
+        cells[kept] = cells[c];
+        cells[kept].ts_offset = cell_ts[c] - h.base;
+        kept++;
+        h.window_cells[w]++;
+      }
+    }
+    h.magic = PQ_TW_CELLS_MAGIC;
+    h.version = PQ_TW_CELLS_VERSION;
+    h.header_size = sizeof(h);
+    h.k = k;
+    h.T = T;
+    h.alpha = a;
+    h.tb0 = TB0;
+    h.cell_num = kept;
+    h.host_ns = host_ns;
+    pq_clock_get(&h.clock);
+  }
+  if (num != kept){
+    printf("Warning: port %d drops %u cells more than 2^32 ns away from the set (%lu so far)!\n", port_table[idx].port, num - kept, dropped_num);
+  }
+  return pq_store_snapshot(idx, path, ts, host_ns, PQ_SEG_CELLS, data_query ? PQ_SEG_QUERY : 0, kept, &h, num ? sizeof(h) : 0, cells, num ? kept * sizeof(pq_tw_cell_t) : 0);
+}
+
+//----------------------------------------------------------------------
+// A periodical set not stored (flight recorder, recorder.c) still moves
+// the wrap tracking of its port and feeds the switch clock
+//----------------------------------------------------------------------
+void pq_tw_cells_track(uint16_t idx, int64_t host_ns, const uint8_t *buf, uint32_t count){
+  int64_t largest;
+  uint32_t largest_idx;
+  int32_t wrapping;
+  if (count == cell_number && cells != NULL && tw_latest_cell(idx, host_ns, (const uint32_t *)buf, count, &largest, &largest_idx, &wrapping)){
+    pq_clock_add(host_ns, tw_cell_ts(largest, 0, wrapping));
+  }
+}
@@ -0,0 +1,170 @@
+/*************************************************************************
+	> File Name: tw_cells.h
+  > Description: Layout of the filtered time windows snapshots: the valid
+  >              cells of a set with their reconstructed timestamps
+*************************************************************************/
+
+#ifndef _PQ_TW_CELLS_H_
+#define _PQ_TW_CELLS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "clock.h"
+
+//----------------------------------------------------------------------
+// A filtered snapshot (tw_data/<port idx>/tw_data/<sec>_<usec>.cells) is
+// a header followed by cell_num cells, window 0 first: window_cells[w]
+// cells of window w, in the order of filter_TW (TimeWindows.py).
+// Timestamps are ns with the overflows of the 32-bit dequeue timestamp
+// added, the timestamp of a cell is the middle of its span:
+//   ts = (tts << TB) + 2^(TB - 1) + wrap * 2^32, TB = tb0 + twid * alpha
+// so tts = (ts mod 2^32) >> TB and wrap = floor(ts / 2^32).
+// Cells store ts - base, base being the smallest ts of the set.
+// An empty file marks an idle period or a set without any valid cell.
+// Version 2 adds the host monotonic time of the reading and the fit of
+// the switch clock after the set (clock.h); readers skip header_size
+// bytes, so version 1 headers end at host_ns.
+// All fields are little endian.
+//----------------------------------------------------------------------
+#define PQ_TW_CELLS_MAGIC 0x43545150    // "PQTC"
+#define PQ_TW_CELLS_VERSION 2
+#define PQ_TW_MAX_WINDOWS 16
+
+typedef struct pq_tw_cells_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;           // sizeof(pq_tw_cells_header_t)
+  uint8_t k;
+  uint8_t T;
+  uint8_t alpha;
+  uint8_t tb0;                    // trimmed bits of the first window
+  uint32_t cell_num;
+  int64_t base;
+  int64_t sts;                    // ts of the oldest cell of the set (smallest_cell)
+  int64_t lts;                    // ts of the latest cell of the set (largest_cell, window 0)
+  int32_t wrap;                   // overflows of the latest cell since the first set
+  uint8_t smallest_twid;          // window of the oldest cell
+  uint8_t pad[3];
+  uint32_t window_cells[PQ_TW_MAX_WINDOWS];
+  int64_t host_ns;                // host monotonic time of the reading (after the flip)
+  pq_clock_t clock;               // fit of the switch clock after the set
+} pq_tw_cells_header_t;
+
+#define PQ_TW_CELLS_HEADER_V1_SIZE offsetof(pq_tw_cells_header_t, host_ns)
+
+typedef struct pq_tw_cell {
+  uint32_t ts_offset;             // ts - base
+  uint32_t src_ip;                // flow ID, as stored in the registers
+  uint32_t dst_ip;
+} pq_tw_cell_t;
+
+//----------------------------------------------------------------------
+// Valid cell filter of a raw set, shared by the control plane (tw_cells.c)
+// and the analysis programs (AnalysisProgram/native/tw_ingest.cpp), so
+// that there is a single copy next to filter_TW of TimeWindows.py.
+// A set is 2^k cells x T windows, registers laid out as read:
+// [2^k tts of TW0][2^k src of TW0][2^k dst of TW0][2^k tts of TW1]...
+//----------------------------------------------------------------------
+typedef struct pq_tw_params {
+  uint32_t k;
+  uint32_t T;
+  uint32_t alpha;
+  uint32_t tb0;                   // TW0_TB
+} pq_tw_params_t;
+
+// middle of the span of a cell of window twid, cell_duration()[2]
+static inline int64_t pq_tw_cell_ts(const pq_tw_params_t *p, int64_t tts, uint32_t twid, int64_t wrap){
+  uint32_t tb = p->tb0 + twid * p->alpha;
+  return (tts << tb) + (1LL << (tb - 1)) + (wrap << 32);
+}
+
+// Largest tts of TW0 and its index: a tts close to 0 after one close to
+// the overflow is later than it. False for a set without any flow ID.
+static inline bool pq_tw_largest(const pq_tw_params_t *p, const uint32_t *reg, int64_t *largest_tts, uint32_t *largest_index){
+  uint32_t n = 1U << p->k, largest_idx = 0, j;
+  int64_t tts_bit = 32 - p->tb0, threshold_bit = (tts_bit + p->k) / 2;
+  int64_t largest, t;
+  bool any = false;
+
+  for (uint32_t i = 0; i < p->T && !any; i++){
+    for (j = 0; j < n && !any; j++){
+      any = reg[(3 * i + 1) * n + j] || reg[(3 * i + 2) * n + j];
+    }
+  }
+  if (!any){
+    return false;
+  }
+  largest = reg[0];
+  for (j = 0; j < n; j++){
+    t = reg[j];
+    if (t > largest){
+      if ((1LL << tts_bit) + largest - t > (1LL << threshold_bit)){
+        largest = t;
+        largest_idx = j;
+      }
+    }else if ((1LL << tts_bit) + t - largest < (1LL << threshold_bit)){
+      // the tts grows past the overflow: smaller value, later time
+      largest = t;
+      largest_idx = j;
+    }
+  }
+  *largest_tts = largest;
+  *largest_index = largest_idx;
+  return true;
+}
+
+// Overflows of the latest cell tts of a set putting it nearest to the
+// latest cell of the port so far (tts with its overflows << (32 - tb0))
+static inline int64_t pq_tw_nearest_wrap(const pq_tw_params_t *p, int64_t latest, int64_t largest){
+  int64_t tts_bit = 32 - p->tb0;
+  return (latest - largest + (1LL << (tts_bit - 1))) >> tts_bit;
+}
+
+// Walk the valid cells of a set whose latest cell is (largest,
+// largest_idx) with wrapping overflows:
+//   * in every window, cells up to the index of the latest cell belong to
+//     its cycle, cells after it to the previous cycle; others are stale
+//   * the latest cell of the next window is the cell evicted by the
+//     latest one: (tts - 2^k) >> alpha
+// cell() gets the window, tts and overflows of every valid cell, window 0
+// first; first is set on the first cell of each half of a window.
+typedef void (*pq_tw_cell_fn)(void *ctx, uint32_t twid, int64_t tts, int64_t wrap, uint32_t src, uint32_t dst, bool first);
+
+static inline void pq_tw_valid_cells(const pq_tw_params_t *p, const uint32_t *reg, int64_t largest, uint32_t largest_idx, int64_t wrapping, pq_tw_cell_fn cell, void *ctx){
+  uint32_t n = 1U << p->k, j;
+  int64_t cid_bit = 32 - p->tb0 - p->k;
+  int64_t latest_cid = largest >> p->k, t, t_cid;
+  bool first;
+
+  for (uint32_t i = 0; i < p->T; i++){
+    const uint32_t *tts_r = reg + 3 * i * n, *src_r = tts_r + n, *dst_r = tts_r + 2 * n;
+    int64_t cid_mask = cid_bit > 0 ? (1LL << cid_bit) - 1 : 0;
+    // from index 0 to the latest cell: the cycle of the latest cell
+    first = true;
+    for (j = 0; j <= largest_idx && j < n; j++){
+      if (src_r[j] == 0 && dst_r[j] == 0) continue;
+      t = tts_r[j];
+      if ((t >> p->k) != latest_cid) continue;
+      cell(ctx, i, t, wrapping, src_r[j], dst_r[j], first);
+      first = false;
+    }
+    // from the latest cell to index 2^k - 1: the previous cycle
+    first = true;
+    for (j = largest_idx + 1; j < n; j++){
+      if (src_r[j] == 0 && dst_r[j] == 0) continue;
+      t = tts_r[j];
+      t_cid = t >> p->k;
+      if (((t_cid + 1) & cid_mask) != (latest_cid & cid_mask)) continue;
+      cell(ctx, i, t, t_cid > latest_cid ? wrapping - 1 : wrapping, src_r[j], dst_r[j], first);
+      first = false;
+    }
+    cid_bit -= p->alpha;
+    largest = (largest - (1LL << p->k)) >> p->alpha;
+    largest_idx = largest & ((1LL << p->k) - 1);
+    latest_cid = largest >> p->k;
+  }
+}
+
+#endif